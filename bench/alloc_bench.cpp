@@ -0,0 +1,81 @@
+#include "alloc_counter.h"
+#include "bench_util.h"
+#include "user.pb.h"
+#include "user.sugar.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+// Read-side proxy operations on User, timed and with the heap allocations
+// each one makes once warm: reads through the const accessors, string
+// views and in-place element comparisons should allocate nothing, and
+// reading an unset submessage should not create it.
+
+namespace {
+
+template <typename Fn> void run(string_view name, size_t iters, Fn &&fn) {
+  bench::run(name, iters, fn);
+  const uint64_t allocs = sugar::testing::allocations_in([&] {
+    for (size_t i = 0; i < iters; ++i)
+      fn();
+  });
+  std::printf("%-48s %12.2f allocs/op\n", "  heap allocations",
+              static_cast<double>(allocs) / static_cast<double>(iters));
+}
+
+} // namespace
+
+int main() {
+  constexpr size_t kIters = 1000000;
+
+  User u;
+  u.set_id(42);
+  u.set_name("a name past the short string buffer");
+  for (int i = 0; i < 16; ++i)
+    u.add_tags("a tag past the short string buffer " + to_string(i));
+  for (int i = 0; i < 64; ++i)
+    u.add_numbers(i);
+  u.set_email("ada@example.com");
+  UserWrapped w(u);
+  int64_t sink = 0;
+
+  run("scalar read", kIters, [&] {
+    sink += w.id;
+    bench::do_not_optimize(sink);
+  });
+  run("string read as string_view", kIters, [&] {
+    sink += static_cast<string_view>(w.name).size();
+    bench::do_not_optimize(sink);
+  });
+  run("string read by get()", kIters, [&] {
+    sink += w.name.get().size();
+    bench::do_not_optimize(sink);
+  });
+  run("unset submessage field read", kIters, [&] {
+    sink += static_cast<string_view>(w.profile.city).size();
+    bench::do_not_optimize(sink);
+  });
+  run("repeated int32 sum (64)", kIters / 10, [&] {
+    for (int32_t v : w.numbers)
+      sink += v;
+    bench::do_not_optimize(sink);
+  });
+  run("repeated string compare (16)", kIters / 10, [&] {
+    for (const auto &t : w.tags)
+      sink += t == "a tag past the short string buffer 7";
+    bench::do_not_optimize(sink);
+  });
+  run("oneof active_field", kIters, [&] {
+    sink += w.contact.active_field() != nullptr;
+    bench::do_not_optimize(sink);
+  });
+  if (u.has_profile()) {
+    std::printf("reading profile.city created the submessage\n");
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,142 @@
+#include "bench_util.h"
+#include "sugar_async.h"
+#include "user.pb.h"
+#include "user.sugar.h"
+
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/util/delimited_message_util.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// End-to-end record pipeline over local files: read framed Users, bump the
+// score, write them to a second file. Compares protobuf's delimited stream
+// utilities (blocking FileInputStream / FileOutputStream) with
+// async_records + AsyncRecordWriter on each available backend, with the
+// input in the page cache and after dropping it. Files live in $TMPDIR (or
+// /tmp) and are removed afterwards.
+
+namespace {
+
+constexpr int kRecords = 200000;
+
+void fill(User &u, int i) {
+  u.set_id(i);
+  u.set_name("user-" + to_string(i));
+  u.set_active(i % 2 == 0);
+  u.set_score(i * 0.5);
+  for (int t = 0; t < 8; ++t) {
+    u.add_tags("tag-" + to_string(t));
+    u.add_numbers(i + t);
+  }
+  (*u.mutable_meta())["lang"] = "c++";
+  u.mutable_profile()->set_city("Berlin");
+}
+
+int temp_file(string &path) {
+  const char *dir = getenv("TMPDIR");
+  path = string(dir ? dir : "/tmp") + "/sugar_async_bench_XXXXXX";
+  return ::mkstemp(path.data());
+}
+
+// cold: drop the input from the page cache so reads wait on the device.
+void rewind_both(int in, int out, bool cold) {
+  if (cold)
+    ::posix_fadvise(in, 0, 0, POSIX_FADV_DONTNEED);
+  ::lseek(in, 0, SEEK_SET);
+  ::lseek(out, 0, SEEK_SET);
+  if (::ftruncate(out, 0) != 0)
+    std::abort();
+}
+
+void run_sync(int in, int out) {
+  google::protobuf::io::FileInputStream is(in);
+  google::protobuf::io::FileOutputStream os(out);
+  User u;
+  bool clean_eof = false;
+  for (;;) {
+    u.Clear(); // the delimited parser merges
+    if (!google::protobuf::util::ParseDelimitedFromZeroCopyStream(&u, &is,
+                                                                  &clean_eof))
+      break;
+    u.set_score(u.score() * 2);
+    google::protobuf::util::SerializeDelimitedToZeroCopyStream(u, &os);
+  }
+  os.Flush();
+}
+
+sugar::Task<void> run_async(int in, int out, sugar::AsyncIoOptions opts) {
+  sugar::AsyncRecordWriter writer(out, opts);
+  for (UserWrapped u : sugar::async_records<UserWrapped>(in, opts)) {
+    u.score = u.score * 2;
+    co_await writer.write(u);
+  }
+  co_await writer.flush();
+}
+
+} // namespace
+
+int main() {
+  string in_path, out_path;
+  const int in = temp_file(in_path);
+  const int out = temp_file(out_path);
+  if (in < 0 || out < 0) {
+    std::perror("mkstemp");
+    return 1;
+  }
+
+  {
+    google::protobuf::io::FileOutputStream os(in);
+    for (int i = 0; i < kRecords; ++i) {
+      User u;
+      fill(u, i);
+      google::protobuf::util::SerializeDelimitedToZeroCopyStream(u, &os);
+    }
+  }
+  const double mb = static_cast<double>(::lseek(in, 0, SEEK_END)) / (1 << 20);
+  std::printf("%d records, %.1f MB\n", kRecords, mb);
+
+  ::fsync(in);
+
+  vector<unique_ptr<sugar::IoBackend>> backends;
+  backends.push_back(make_unique<sugar::ThreadIoBackend>());
+#if SUGAR_HAS_IO_URING
+  if (auto uring = sugar::IoUringBackend::create())
+    backends.push_back(std::move(uring));
+#endif
+
+  constexpr size_t kPasses = 5;
+  for (const bool cold : {false, true}) {
+    const string cache = cold ? "cold cache" : "warm cache";
+    const double sync_ns =
+        bench::run(cache + ": delimited streams", kPasses, [&] {
+          rewind_both(in, out, cold);
+          run_sync(in, out);
+        });
+    std::printf("%-48s %12.1f MB/s\n", "", mb / (sync_ns / 1e9));
+    for (auto &io : backends) {
+      const sugar::AsyncIoOptions opts{size_t{1} << 20, io.get()};
+      const string name = cache + ": async_records (" + string(io->name()) + ")";
+      const double ns = bench::run(name, kPasses, [&] {
+        rewind_both(in, out, cold);
+        sugar::sync_wait(run_async(in, out, opts));
+      });
+      std::printf("%-48s %12.1f MB/s\n", "", mb / (ns / 1e9));
+      bench::ratio("  speedup", sync_ns, ns);
+    }
+  }
+
+  ::close(in);
+  ::close(out);
+  ::unlink(in_path.c_str());
+  ::unlink(out_path.c_str());
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <string_view>
+
+namespace bench {
+
+template <typename T> inline void do_not_optimize(const T &v) {
+#if defined(__GNUC__)
+  asm volatile("" : : "g"(&v) : "memory");
+#else
+  static volatile const void *sink;
+  sink = &v;
+#endif
+}
+
+// Times `iters` calls of fn after a warm-up pass and prints ns/op.
+template <typename Fn>
+double run(std::string_view name, std::size_t iters, Fn &&fn) {
+  for (std::size_t i = 0; i < iters / 10 + 1; ++i)
+    fn();
+  const auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < iters; ++i)
+    fn();
+  const auto stop = std::chrono::steady_clock::now();
+  const double ns =
+      std::chrono::duration<double, std::nano>(stop - start).count() /
+      static_cast<double>(iters);
+  std::printf("%-48.*s %12.1f ns/op\n", static_cast<int>(name.size()),
+              name.data(), ns);
+  return ns;
+}
+
+inline void ratio(std::string_view what, double baseline, double candidate) {
+  std::printf("%-48.*s %12.2fx\n", static_cast<int>(what.size()), what.data(),
+              baseline / candidate);
+}
+
+} // namespace bench
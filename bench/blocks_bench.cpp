@@ -0,0 +1,133 @@
+#include "bench_util.h"
+#include "sugar_blocks.h"
+#include "user.pb.h"
+#include "user.sugar.h"
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/util/delimited_message_util.h>
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Archive throughput over 200k User records held in memory: protobuf's
+// delimited format through coded streams against BlockWriter / BlockReader with and
+// without the per-block dictionary, sequentially and on every hardware
+// thread. Also times CRC32C itself.
+
+namespace {
+
+constexpr int kRecords = 200000;
+
+const char *const kCities[] = {"Berlin", "Istanbul", "Lisbon", "Osaka",
+                               "Toronto", "Nairobi", "Lima", "Oslo"};
+
+void fill(User &u, int i) {
+  u.set_id(i);
+  u.set_name("user-" + to_string(i));
+  u.set_active(i % 2 == 0);
+  u.set_score(i * 0.5);
+  for (int t = 0; t < 4; ++t)
+    u.add_tags("tag-" + to_string((i + t) % 16));
+  u.add_numbers(i);
+  (*u.mutable_meta())["lang"] = "c++";
+  (*u.mutable_meta())["team"] = "storage-" + to_string(i % 3);
+  u.mutable_profile()->set_city(kCities[i % 8]);
+  u.mutable_profile()->set_country("somewhere far away");
+}
+
+void report(double ns, size_t bytes) {
+  std::printf("%-48s %12.1f MB/s\n", "",
+              static_cast<double>(bytes) / (1 << 20) / (ns / 1e9));
+}
+
+} // namespace
+
+int main() {
+  vector<User> users(kRecords);
+  for (int i = 0; i < kRecords; ++i)
+    fill(users[static_cast<size_t>(i)], i);
+
+  constexpr size_t kPasses = 5;
+
+  string delimited;
+  const double delim_write = bench::run("write: delimited stream", kPasses, [&] {
+    delimited.clear();
+    google::protobuf::io::StringOutputStream os(&delimited);
+    google::protobuf::io::CodedOutputStream out(&os);
+    for (const User &u : users) {
+      out.WriteVarint32(static_cast<uint32_t>(u.ByteSizeLong()));
+      u.SerializeWithCachedSizes(&out);
+    }
+  });
+  report(delim_write, delimited.size());
+
+  vector<byte> archives[2];
+  for (const bool dictionary : {false, true}) {
+    auto &out = archives[dictionary];
+    sugar::BlockWriterOptions opts;
+    opts.dictionary = dictionary;
+    const double ns = bench::run(
+        dictionary ? "write: BlockWriter (dictionary)" : "write: BlockWriter",
+        kPasses, [&] {
+          out.clear();
+          sugar::BlockWriter writer(
+              [&](span<const byte> b) { out.insert(out.end(), b.begin(), b.end()); },
+              opts);
+          for (User &u : users)
+            writer.write(UserWrapped(u));
+          writer.flush();
+        });
+    report(ns, delimited.size());
+    std::printf("%-48s %12.1f%% of delimited\n", "",
+                100.0 * static_cast<double>(out.size()) /
+                    static_cast<double>(delimited.size()));
+  }
+
+  User u;
+  const double delim_read = bench::run("read: delimited stream", kPasses, [&] {
+    google::protobuf::io::ArrayInputStream is(delimited.data(),
+                                              static_cast<int>(delimited.size()));
+    for (int i = 0; i < kRecords; ++i) {
+      u.Clear();
+      google::protobuf::util::ParseDelimitedFromZeroCopyStream(&u, &is, nullptr);
+    }
+    bench::do_not_optimize(u);
+  });
+  report(delim_read, delimited.size());
+
+  const unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  for (const bool dictionary : {false, true}) {
+    const sugar::BlockReader reader(archives[dictionary]);
+    const string suffix = dictionary ? " (dictionary)" : "";
+    const double seq = bench::run("read: BlockReader::for_each" + suffix, kPasses, [&] {
+      bench::do_not_optimize(
+          reader.for_each<UserWrapped>([](UserWrapped w) { bench::do_not_optimize(w); }));
+    });
+    report(seq, delimited.size());
+    bench::ratio("  vs delimited", delim_read, seq);
+    const double par = bench::run(
+        "read: parallel_for_each x" + to_string(threads) + suffix, kPasses, [&] {
+          bench::do_not_optimize(reader.parallel_for_each<UserWrapped>(
+              [](UserWrapped w) { bench::do_not_optimize(w); }, threads));
+        });
+    report(par, delimited.size());
+    bench::ratio("  vs delimited", delim_read, par);
+  }
+
+  const auto &data = archives[0];
+  const double hw = bench::run("crc32c", kPasses * 10, [&] {
+    bench::do_not_optimize(sugar::crc32c(data));
+  });
+  report(hw, data.size());
+  const double sw = bench::run("crc32c (portable)", kPasses * 10, [&] {
+    bench::do_not_optimize(
+        sugar::detail::crc32c_portable(0, data.data(), data.size()));
+  });
+  report(sw, data.size());
+}
@@ -0,0 +1,161 @@
+#include "bench_util.h"
+#include "sugar_columns.h"
+#include "user.pb.h"
+#include "user.sugar.h"
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Analytical scans over 200k User records held in memory: summing ids and
+// counting users per city, and finding the users in an id range. Rows are
+// protobuf's delimited format, parsed record by record; the column file
+// reads the "id" and "profile.city" chunks only, and the range query skips
+// row groups by their id statistics.
+
+namespace {
+
+constexpr int kRecords = 200000;
+
+const char *const kCities[] = {"Berlin", "Istanbul", "Lisbon", "Osaka",
+                               "Toronto", "Nairobi", "Lima", "Oslo"};
+
+void fill(User &u, int i) {
+  u.set_id(i);
+  u.set_name("user-" + to_string(i));
+  u.set_active(i % 2 == 0);
+  u.set_score(i * 0.5);
+  for (int t = 0; t < 4; ++t)
+    u.add_tags("tag-" + to_string((i + t) % 16));
+  u.add_numbers(i);
+  (*u.mutable_meta())["lang"] = "c++";
+  (*u.mutable_meta())["team"] = "storage-" + to_string(i % 3);
+  u.mutable_profile()->set_city(kCities[i % 8]);
+  u.mutable_profile()->set_country("somewhere far away");
+}
+
+struct Result {
+  int64_t id_sum = 0;
+  int64_t berlin = 0;
+  bool operator==(const Result &) const = default;
+};
+
+// Calls fn(user) for each record of a delimited stream.
+template <typename Fn> void for_each_row(const string &rows, Fn &&fn) {
+  google::protobuf::io::CodedInputStream in(
+      reinterpret_cast<const uint8_t *>(rows.data()),
+      static_cast<int>(rows.size()));
+  User u;
+  uint32_t size;
+  while (in.ReadVarint32(&size)) {
+    const auto limit = in.PushLimit(static_cast<int>(size));
+    u.Clear();
+    u.MergeFromCodedStream(&in);
+    in.PopLimit(limit);
+    fn(u);
+  }
+}
+
+Result scan_rows(const string &rows) {
+  Result r;
+  for_each_row(rows, [&](const User &u) {
+    r.id_sum += u.id();
+    r.berlin += u.profile().city() == "Berlin";
+  });
+  return r;
+}
+
+Result scan_columns(const sugar::ColumnReader &file) {
+  Result r;
+  file.scan<int32_t>("id", [&](const sugar::ColumnEntry<int32_t> &e) {
+    r.id_sum += e.value;
+  });
+  file.scan<string_view>(
+      "profile.city", [&](const sugar::ColumnEntry<string_view> &e) {
+        r.berlin += e.value == "Berlin";
+      });
+  return r;
+}
+
+constexpr int32_t kLow = 150000, kHigh = 150999;
+
+} // namespace
+
+int main() {
+  string rows;
+  {
+    google::protobuf::io::StringOutputStream os(&rows);
+    google::protobuf::io::CodedOutputStream out(&os);
+    User u;
+    for (int i = 0; i < kRecords; ++i) {
+      u.Clear();
+      fill(u, i);
+      out.WriteVarint32(static_cast<uint32_t>(u.ByteSizeLong()));
+      u.SerializeWithCachedSizes(&out);
+    }
+  }
+  vector<byte> columns;
+  {
+    sugar::ColumnWriter w(User::descriptor(), [&](span<const byte> b) {
+      columns.insert(columns.end(), b.begin(), b.end());
+    });
+    User u;
+    for (int i = 0; i < kRecords; ++i) {
+      u.Clear();
+      fill(u, i);
+      w.write(UserWrapped(u));
+    }
+    w.finish();
+  }
+  const sugar::ColumnReader file(columns);
+  std::printf("delimited rows: %zu bytes, column file: %zu bytes (%zu row "
+              "groups)\n",
+              rows.size(), columns.size(), file.row_groups());
+
+  const Result expected = scan_rows(rows);
+  if (scan_columns(file) != expected) {
+    std::printf("column scan differs from the row scan\n");
+    return EXIT_FAILURE;
+  }
+
+  constexpr size_t kPasses = 10;
+  const double row_scan = bench::run("sum(id), count(city): delimited rows",
+                                     kPasses, [&] {
+                                       bench::do_not_optimize(scan_rows(rows));
+                                     });
+  const double column_scan =
+      bench::run("sum(id), count(city): ColumnReader::scan", kPasses, [&] {
+        bench::do_not_optimize(scan_columns(file));
+      });
+  bench::ratio("  speedup", row_scan, column_scan);
+
+  const double row_range =
+      bench::run("ids in [150000, 150999]: delimited rows", kPasses, [&] {
+        size_t n = 0;
+        for_each_row(rows, [&](const User &u) {
+          n += u.id() >= kLow && u.id() <= kHigh;
+        });
+        bench::do_not_optimize(n);
+      });
+  const double column_range = bench::run(
+      "ids in [150000, 150999]: scan with ValueRange", kPasses, [&] {
+        size_t n = 0;
+        file.scan<int32_t>(
+            "id",
+            [&](const sugar::ColumnEntry<int32_t> &e) {
+              n += e.value >= kLow && e.value <= kHigh;
+            },
+            {kLow, kHigh});
+        bench::do_not_optimize(n);
+      });
+  bench::ratio("  speedup", row_range, column_range);
+}
@@ -0,0 +1,116 @@
+#!/usr/bin/env bash
+# Compile-time benchmark: single .sugar.h vs the split_headers layout.
+#
+# Generates a synthetic schema, runs protoc with both layouts and times
+#   - one consumer TU that touches a single message,
+#   - a batch of consumer TUs touching different messages (plus, for the
+#     split layout, the one-off .sugar.cc they link against).
+#
+# usage: compile_time.sh <protoc-gen-sugar> [messages] [consumers]
+# env:   PROTOC, CXX, CXXFLAGS, SUGAR_INCLUDE_DIR, WORK_DIR
+set -euo pipefail
+
+PLUGIN="$(realpath "$1")"
+MESSAGES="${2:-1200}"
+CONSUMERS="${3:-8}"
+PROTOC="${PROTOC:-protoc}"
+CXX="${CXX:-c++}"
+CXXFLAGS="${CXXFLAGS:--std=c++20 -O2}"
+SUGAR_INCLUDE_DIR="${SUGAR_INCLUDE_DIR:-$(dirname "$0")/../src}"
+SUGAR_INCLUDE_DIR="$(realpath "$SUGAR_INCLUDE_DIR")"
+WORK_DIR="${WORK_DIR:-$(mktemp -d)}"
+
+mkdir -p "$WORK_DIR"/{single,split}
+cd "$WORK_DIR"
+
+echo "[1/4] Generating synthetic schema ($MESSAGES messages)..."
+{
+    echo 'syntax = "proto3";'
+    echo 'package bench;'
+    echo 'message Leaf { int32 id = 1; string label = 2; }'
+    for ((i = 0; i < MESSAGES; ++i)); do
+        cat <<EOF
+message M$i {
+  int32 id = 1;
+  string name = 2;
+  repeated int64 values = 3;
+  map<string, int32> counts = 4;
+  Leaf leaf = 5;
+  repeated Leaf leaves = 6;
+  double score = 7;
+  bool flag = 8;
+}
+EOF
+    done
+} > synth.proto
+
+echo "[2/4] Running protoc for both layouts..."
+"$PROTOC" --plugin=protoc-gen-sugar="$PLUGIN" -I . \
+    --cpp_out=single --sugar_out=single synth.proto
+"$PROTOC" --plugin=protoc-gen-sugar="$PLUGIN" -I . \
+    --cpp_out=split --sugar_out=split_headers:split synth.proto
+
+consumer() { # <dir> <header> <message index>
+    cat > "$1/consumer_$3.cpp" <<EOF
+#include "$2"
+#include <string>
+
+std::string touch_$3(bench::M$3& m) {
+    bench::M$3Wrapped w(m);
+    w.id = 7;
+    w.name = "x";
+    w.values.push_back(int64_t{1});
+    return w.to_json() + std::to_string(w.hash_value());
+}
+EOF
+}
+
+step=$((MESSAGES / CONSUMERS > 0 ? MESSAGES / CONSUMERS : 1))
+indices=()
+for ((k = 0; k < CONSUMERS && k * step < MESSAGES; ++k)); do
+    indices+=($((k * step)))
+done
+for i in "${indices[@]}"; do
+    consumer single synth.sugar.h "$i"
+    consumer split "synth.M$i.sugar.h" "$i"
+done
+
+compile() { # <dir> <source>
+    # shellcheck disable=SC2086
+    $CXX $CXXFLAGS -I "$1" -I "$SUGAR_INCLUDE_DIR" -c "$1/$2" \
+        -o "$1/${2%.*}.o"
+}
+
+millis() { # <command...>; prints wall time in milliseconds
+    local start end
+    start=$(date +%s%N)
+    "$@"
+    end=$(date +%s%N)
+    echo $(((end - start) / 1000000))
+}
+
+secs() { # <milliseconds>
+    printf '%d.%02ds' $(($1 / 1000)) $(($1 % 1000 / 10))
+}
+
+echo "[3/4] Compiling one consumer TU..."
+single_one=$(millis compile single "consumer_${indices[0]}.cpp")
+split_one=$(millis compile split "consumer_${indices[0]}.cpp")
+
+echo "[4/4] Compiling ${#indices[@]} consumer TUs..."
+batch() { # <dir>
+    for i in "${indices[@]}"; do
+        compile "$1" "consumer_$i.cpp"
+    done
+}
+single_all=$(millis batch single)
+split_all=$(millis batch split)
+split_cc=$(millis compile split synth.sugar.cc)
+
+printf '\n%-36s %10s %10s\n' "" "single" "split"
+printf '%-36s %10s %10s\n' "one consumer TU" \
+    "$(secs "$single_one")" "$(secs "$split_one")"
+printf '%-36s %10s %10s\n' "${#indices[@]} consumer TUs" \
+    "$(secs "$single_all")" "$(secs "$split_all")"
+printf '%-36s %10s %10s\n' "synth.sugar.cc (once)" "-" "$(secs "$split_cc")"
+echo "work dir: $WORK_DIR"
@@ -0,0 +1,141 @@
+#include "bench_util.h"
+#include "user.pb.h"
+#include "user.sugar.h"
+
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <type_traits>
+
+using namespace std;
+
+using google::protobuf::FieldDescriptor;
+using google::protobuf::Message;
+
+// A generic CSV row writer (singular values, sizes of repeated and map
+// fields, submessages flattened) for a populated User, written once against
+// Descriptor/Reflection and once as a sugar::for_each_field visitor.
+
+namespace {
+
+User make_user() {
+  User u;
+  u.set_id(123456);
+  u.set_name("Ada Lovelace");
+  u.set_active(true);
+  u.set_score(98.5);
+  u.set_status(OK);
+  for (int i = 0; i < 10; ++i)
+    u.add_tags("tag-" + to_string(i));
+  for (int i = 0; i < 64; ++i)
+    u.add_numbers(i * 37);
+  for (int i = 0; i < 4; ++i)
+    u.add_profiles()->set_city("city-" + to_string(i));
+  for (int i = 0; i < 6; ++i)
+    (*u.mutable_meta())["key-" + to_string(i)] = "value-" + to_string(i);
+  u.set_email("ada@example.com");
+  u.mutable_profile()->set_city("London");
+  u.mutable_profile()->set_country("United Kingdom");
+  return u;
+}
+
+template <typename T> void append_number(string &out, T v) {
+  char buf[32];
+  out.append(buf, to_chars(buf, buf + sizeof(buf), v).ptr);
+}
+
+void reflect_row(const Message &m, string &out) {
+  const auto *d = m.GetDescriptor();
+  const auto *r = m.GetReflection();
+  for (int i = 0; i < d->field_count(); ++i) {
+    const FieldDescriptor *f = d->field(i);
+    if (f->is_repeated()) {
+      append_number(out, r->FieldSize(m, f));
+    } else {
+      switch (f->cpp_type()) {
+      case FieldDescriptor::CPPTYPE_INT32:
+        append_number(out, r->GetInt32(m, f));
+        break;
+      case FieldDescriptor::CPPTYPE_INT64:
+        append_number(out, r->GetInt64(m, f));
+        break;
+      case FieldDescriptor::CPPTYPE_UINT32:
+        append_number(out, r->GetUInt32(m, f));
+        break;
+      case FieldDescriptor::CPPTYPE_UINT64:
+        append_number(out, r->GetUInt64(m, f));
+        break;
+      case FieldDescriptor::CPPTYPE_DOUBLE:
+        append_number(out, r->GetDouble(m, f));
+        break;
+      case FieldDescriptor::CPPTYPE_FLOAT:
+        append_number(out, r->GetFloat(m, f));
+        break;
+      case FieldDescriptor::CPPTYPE_BOOL:
+        append_number(out, int{r->GetBool(m, f)});
+        break;
+      case FieldDescriptor::CPPTYPE_ENUM:
+        append_number(out, r->GetEnumValue(m, f));
+        break;
+      case FieldDescriptor::CPPTYPE_STRING:
+        out += r->GetStringReference(m, f, nullptr);
+        break;
+      case FieldDescriptor::CPPTYPE_MESSAGE:
+        reflect_row(r->GetMessage(m, f), out);
+        continue;
+      }
+    }
+    out += ',';
+  }
+}
+
+struct CsvRow {
+  string &out;
+
+  template <typename F, typename V>
+  void operator()(const F &, const V &value) const {
+    if constexpr (F::cardinality != sugar::Cardinality::kSingular) {
+      append_number(out, value.size());
+    } else if constexpr (F::kind == sugar::FieldKind::kMessage) {
+      sugar::for_each_field<typename F::wrapped>(value, *this);
+      return;
+    } else if constexpr (F::kind == sugar::FieldKind::kString ||
+                         F::kind == sugar::FieldKind::kBytes) {
+      out += value;
+    } else if constexpr (is_enum_v<V> || is_same_v<V, bool>) {
+      append_number(out, static_cast<int>(value));
+    } else {
+      append_number(out, value);
+    }
+    out += ',';
+  }
+};
+
+} // namespace
+
+int main() {
+  User u = make_user();
+  string reflected, visited;
+  reflect_row(u, reflected);
+  sugar::for_each_field(UserWrapped(u), CsvRow{visited});
+  if (reflected != visited) {
+    std::printf("rows differ:\n%s\n%s\n", reflected.c_str(), visited.c_str());
+    return EXIT_FAILURE;
+  }
+  std::printf("row: %s\n", visited.c_str());
+
+  constexpr size_t kIters = 1000000;
+  string row;
+  const double reflection = bench::run("Descriptor + Reflection", kIters, [&] {
+    row.clear();
+    reflect_row(u, row);
+    bench::do_not_optimize(row);
+  });
+  const double visitor = bench::run("sugar::for_each_field", kIters, [&] {
+    row.clear();
+    sugar::for_each_field(UserWrapped(u), CsvRow{row});
+    bench::do_not_optimize(row);
+  });
+  bench::ratio("  speedup", reflection, visitor);
+}
@@ -0,0 +1,176 @@
+#include "alloc_counter.h"
+#include "bench_util.h"
+#include "sugar_intern.h"
+#include "user.pb.h"
+#include "user.sugar.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// A batch of 20000 User records whose tags (8 each) come from 300 distinct
+// values, skewed towards the first ones, and whose meta keys come from 40.
+// Holding the batch's tags as per-record string copies vs a StringPool and
+// one code per tag, by heap bytes; then counting records per tag over the
+// copies, over the messages, and over the codes, and what building each
+// representation costs.
+
+namespace {
+
+constexpr int kRecords = 20000;
+constexpr int kTagsPerRecord = 8;
+constexpr int kDistinctTags = 300;
+constexpr int kDistinctKeys = 40;
+
+string tag_name(int i) { return "team/region-" + to_string(i) + "/service"; }
+
+vector<User> make_batch() {
+  vector<User> batch(kRecords);
+  uint32_t seed = 12345;
+  auto next = [&] {
+    seed = seed * 1664525u + 1013904223u;
+    return seed >> 8;
+  };
+  for (int r = 0; r < kRecords; ++r) {
+    User &u = batch[r];
+    u.set_id(r);
+    for (int t = 0; t < kTagsPerRecord; ++t) {
+      // Two draws and the smaller one: low tags are the common ones.
+      const uint32_t a = next() % kDistinctTags, b = next() % kDistinctTags;
+      u.add_tags(tag_name(static_cast<int>(a < b ? a : b)));
+    }
+    for (int k = 0; k < 3; ++k)
+      (*u.mutable_meta())["attribute." + to_string(next() % kDistinctKeys)] =
+          "v";
+  }
+  return batch;
+}
+
+} // namespace
+
+int main() {
+  vector<User> batch = make_batch();
+
+  // ---- Memory held for the batch's tags ------------------------------------
+  vector<vector<string>> copies;
+  const sugar::testing::AllocationStats copied =
+      sugar::testing::thread_allocation_stats();
+  copies.reserve(batch.size());
+  for (const User &u : batch)
+    copies.emplace_back(u.tags().begin(), u.tags().end());
+  const uint64_t copy_bytes =
+      sugar::testing::thread_allocation_stats().bytes - copied.bytes;
+
+  const sugar::testing::AllocationStats pooled =
+      sugar::testing::thread_allocation_stats();
+  sugar::StringPool pool;
+  vector<sugar::StringPool::Code> codes;
+  codes.reserve(batch.size() * kTagsPerRecord);
+  for (User &u : batch)
+    UserWrapped(u).tags.intern(pool, codes);
+  const uint64_t pool_bytes =
+      sugar::testing::thread_allocation_stats().bytes - pooled.bytes;
+
+  std::printf("%zu tags, %zu distinct\n", codes.size(), pool.size());
+  std::printf("%-48s %12llu bytes\n", "per-record string copies",
+              static_cast<unsigned long long>(copy_bytes));
+  std::printf("%-48s %12llu bytes\n", "StringPool + codes",
+              static_cast<unsigned long long>(pool_bytes));
+  bench::ratio("  smaller by", static_cast<double>(copy_bytes),
+               static_cast<double>(pool_bytes));
+
+  // ---- Records per tag ------------------------------------------------------
+  unordered_map<string_view, size_t> expected;
+  for (const auto &tags : copies)
+    for (const auto &t : tags)
+      ++expected[t];
+  vector<size_t> per_code(pool.size());
+  for (const auto c : codes)
+    ++per_code[c];
+  for (size_t c = 0; c < per_code.size(); ++c) {
+    if (expected[pool[static_cast<sugar::StringPool::Code>(c)]] !=
+        per_code[c]) {
+      std::printf("interned counts differ from string counts\n");
+      return EXIT_FAILURE;
+    }
+  }
+
+  constexpr size_t kIters = 20;
+  size_t sink = 0;
+  const double by_copy = bench::run("group copies by string", kIters, [&] {
+    unordered_map<string, size_t> counts;
+    for (const auto &tags : copies)
+      for (const auto &t : tags)
+        ++counts[t];
+    sink += counts.size();
+    bench::do_not_optimize(sink);
+  });
+  const double by_message =
+      bench::run("group messages by string_view", kIters, [&] {
+        unordered_map<string_view, size_t> counts;
+        for (const User &u : batch)
+          for (const auto &t : u.tags())
+            ++counts[t];
+        sink += counts.size();
+        bench::do_not_optimize(sink);
+      });
+  const double by_code = bench::run("group codes", kIters, [&] {
+    vector<size_t> counts(pool.size());
+    for (const auto c : codes)
+      ++counts[c];
+    sink += counts[0];
+    bench::do_not_optimize(sink);
+  });
+  bench::ratio("  vs copies", by_copy, by_code);
+  bench::ratio("  vs string_view", by_message, by_code);
+
+  const double intern_tags = bench::run("intern batch tags", kIters, [&] {
+    sugar::StringPool p;
+    vector<sugar::StringPool::Code> out;
+    out.reserve(codes.size());
+    for (User &u : batch)
+      UserWrapped(u).tags.intern(p, out);
+    sink += p.size();
+    bench::do_not_optimize(sink);
+  });
+  const double copy_tags = bench::run("copy batch tags", kIters, [&] {
+    vector<vector<string>> c;
+    c.reserve(batch.size());
+    for (const User &u : batch)
+      c.emplace_back(u.tags().begin(), u.tags().end());
+    sink += c.size();
+    bench::do_not_optimize(sink);
+  });
+  bench::ratio("  intern + group vs copy + group", copy_tags + by_copy,
+               intern_tags + by_code);
+
+  bench::run("intern batch meta keys", kIters, [&] {
+    sugar::StringPool p;
+    vector<sugar::StringPool::Code> out;
+    for (User &u : batch)
+      UserWrapped(u).meta.intern_keys(p, out);
+    sink += p.size();
+    bench::do_not_optimize(sink);
+  });
+
+  // ---- Writing codes back ---------------------------------------------------
+  User out;
+  const span<const sugar::StringPool::Code> first(codes.data(), kTagsPerRecord);
+  UserWrapped(out).tags.assign(pool, first);
+  if (out.tags_size() != kTagsPerRecord || out.tags(0) != batch[0].tags(0)) {
+    std::printf("assign wrote different tags\n");
+    return EXIT_FAILURE;
+  }
+  bench::run("assign 8 tags from codes", kIters * 10000, [&] {
+    UserWrapped(out).tags.assign(pool, first);
+    bench::do_not_optimize(out);
+  });
+}
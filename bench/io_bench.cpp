@@ -0,0 +1,96 @@
+#include "bench_util.h"
+#include "sugar_io.h"
+#include "sugar_iovec.h"
+#include "user.pb.h"
+#include "user.sugar.h"
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Output paths for a wrapped User: SerializeToString versus writing into a
+// reused caller buffer, and, for a message carrying a large string, one
+// write() of the serialized copy versus writev() of IovecWriter pieces that
+// reference the string in place. Writes go to /dev/null.
+
+namespace {
+
+void fill(User &u) {
+  u.set_id(123456);
+  u.set_name("john doe");
+  u.set_active(true);
+  u.set_score(98.75);
+  for (int i = 0; i < 16; ++i) {
+    u.add_tags("tag-" + to_string(i));
+    u.add_numbers(i * 1000);
+  }
+  (*u.mutable_meta())["lang"] = "c++";
+  u.mutable_profile()->set_city("Berlin");
+}
+
+void write_all(int fd, const void *data, size_t n) {
+  const char *p = static_cast<const char *>(data);
+  while (n) {
+    const ssize_t w = ::write(fd, p, n);
+    if (w <= 0)
+      return;
+    p += w;
+    n -= static_cast<size_t>(w);
+  }
+}
+
+} // namespace
+
+int main() {
+  constexpr size_t kIters = 200000;
+
+  User u;
+  fill(u);
+  UserWrapped w(u);
+
+  string out;
+  const double to_string_ns =
+      bench::run("small: SerializeToString", kIters, [&] {
+        u.SerializeToString(&out);
+        bench::do_not_optimize(out);
+      });
+  vector<byte> buf(4096);
+  const double into_ns = bench::run("small: serialize_into", kIters, [&] {
+    bench::do_not_optimize(sugar::serialize_into(w, buf));
+  });
+  bench::run("small: serialize_framed", kIters, [&] {
+    bench::do_not_optimize(sugar::serialize_framed(w, buf));
+  });
+  bench::ratio("serialize_into speedup", to_string_ns, into_ns);
+
+  const int devnull = ::open("/dev/null", O_WRONLY);
+  User big;
+  fill(big);
+  big.set_name(string(1 << 20, 'x'));
+  UserWrapped bw(big);
+
+  const double copy_ns =
+      bench::run("1MB field: SerializeToString + write", kIters / 100, [&] {
+        big.SerializeToString(&out);
+        write_all(devnull, out.data(), out.size());
+      });
+  vector<byte> big_buf(sugar::serialized_size(big));
+  bench::run("1MB field: serialize_into + write", kIters / 100, [&] {
+    const size_t n = sugar::serialize_into(bw, big_buf);
+    write_all(devnull, big_buf.data(), n);
+  });
+  sugar::IovecWriter writer;
+  const double iovec_ns =
+      bench::run("1MB field: IovecWriter + writev", kIters / 100, [&] {
+        writer.serialize(bw);
+        writer.write_to(devnull);
+      });
+  bench::ratio("IovecWriter speedup", copy_ns, iovec_ns);
+  ::close(devnull);
+}
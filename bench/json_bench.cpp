@@ -0,0 +1,77 @@
+#include "bench_util.h"
+#include "user.pb.h"
+#include "user.sugar.h"
+
+#include <google/protobuf/util/json_util.h>
+
+#include <string>
+
+using namespace std;
+
+namespace {
+
+void fill(User &u) {
+  u.set_id(123456);
+  u.set_name("john \"jd\" doe");
+  u.set_active(true);
+  u.set_score(98.75);
+  u.set_status(OK);
+  for (int i = 0; i < 16; ++i) {
+    u.add_tags("tag-" + to_string(i));
+    u.add_numbers(i * 1000);
+  }
+  for (int i = 0; i < 4; ++i) {
+    auto *p = u.add_profiles();
+    p->set_city("Istanbul");
+    p->set_country("TR");
+  }
+  (*u.mutable_meta())["lang"] = "c++";
+  (*u.mutable_meta())["level"] = "senior";
+  u.set_email("test@example.com");
+  u.mutable_profile()->set_city("Berlin");
+  u.mutable_profile()->set_country("DE");
+}
+
+} // namespace
+
+int main() {
+  constexpr size_t kIters = 200000;
+
+  User src;
+  fill(src);
+  UserWrapped wrapped(src);
+
+  string pb_json;
+  double pb_write = bench::run("encode protobuf MessageToJsonString", kIters,
+                               [&] {
+                                 pb_json.clear();
+                                 (void)google::protobuf::util::
+                                     MessageToJsonString(src, &pb_json);
+                                 bench::do_not_optimize(pb_json);
+                               });
+
+  string sugar_json;
+  double sugar_write =
+      bench::run("encode UserWrapped::to_json (reused buffer)", kIters, [&] {
+        wrapped.to_json(sugar_json);
+        bench::do_not_optimize(sugar_json);
+      });
+  bench::ratio("encode speedup", pb_write, sugar_write);
+
+  double pb_read =
+      bench::run("decode protobuf JsonStringToMessage", kIters, [&] {
+        User u;
+        (void)google::protobuf::util::JsonStringToMessage(pb_json, &u);
+        bench::do_not_optimize(u);
+      });
+
+  double sugar_read =
+      bench::run("decode UserWrapped::read_json", kIters, [&] {
+        User u;
+        sugar::json::Reader r(sugar_json);
+        UserWrapped::read_json(u, r);
+        bench::do_not_optimize(u);
+      });
+  bench::ratio("decode speedup", pb_read, sugar_read);
+  return 0;
+}
@@ -0,0 +1,144 @@
+#include "bench_util.h"
+#include "user.pb.h"
+#include "user.sugar.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// A batch of 1000 User records (8 tags, 32 numbers, 2 profiles, no meta so
+// that the bytes are comparable): a hot loop over the messages vs over
+// UserPlain mirrors, and parsing and serializing the batch with protobuf
+// vs UserPlain, conversions included where the hot code keeps messages.
+
+namespace {
+
+User make_user(int i) {
+  User u;
+  u.set_id(i);
+  u.set_name("user-" + to_string(i));
+  u.set_active(i % 3 != 0);
+  u.set_score(i * 0.25);
+  u.set_status(i % 2 ? OK : FAIL);
+  for (int t = 0; t < 8; ++t)
+    u.add_tags("tag-" + to_string((i + t) % 50));
+  for (int n = 0; n < 32; ++n)
+    u.add_numbers(i * 31 + n);
+  for (int p = 0; p < 2; ++p) {
+    Profile *pr = u.add_profiles();
+    pr->set_city("city-" + to_string(p));
+    pr->set_country("country-" + to_string(p));
+  }
+  u.set_email("user" + to_string(i) + "@example.com");
+  u.mutable_profile()->set_city("Berlin");
+  return u;
+}
+
+int64_t score(const User &u) {
+  int64_t s = u.active() ? u.id() : 0;
+  for (int32_t n : u.numbers())
+    s += n;
+  for (const auto &t : u.tags())
+    s += t.size();
+  return s;
+}
+
+int64_t score(const UserPlain &u) {
+  int64_t s = u.active ? u.id : 0;
+  for (int32_t n : u.numbers)
+    s += n;
+  for (const auto &t : u.tags)
+    s += t.size();
+  return s;
+}
+
+} // namespace
+
+int main() {
+  constexpr int kBatch = 1000;
+  vector<User> users;
+  vector<UserPlain> plains;
+  vector<string> wire;
+  for (int i = 0; i < kBatch; ++i) {
+    users.push_back(make_user(i));
+    plains.push_back(UserPlain::from_proto(users.back()));
+    wire.push_back(users.back().SerializeAsString());
+  }
+  for (int i = 0; i < kBatch; ++i) {
+    if (plains[i].serialize() != wire[i] ||
+        !(UserPlain::parse(wire[i]) == plains[i]) ||
+        score(users[i]) != score(plains[i])) {
+      std::printf("UserPlain differs from User for record %d\n", i);
+      return EXIT_FAILURE;
+    }
+  }
+
+  constexpr size_t kIters = 200;
+  int64_t sink = 0;
+  const double msg_loop = bench::run("hot loop over User", kIters, [&] {
+    for (const auto &u : users)
+      sink += score(u);
+    bench::do_not_optimize(sink);
+  });
+  const double plain_loop = bench::run("hot loop over UserPlain", kIters, [&] {
+    for (const auto &u : plains)
+      sink += score(u);
+    bench::do_not_optimize(sink);
+  });
+  bench::ratio("  vs User", msg_loop, plain_loop);
+
+  const double msg_parse = bench::run("User::ParseFromString", kIters, [&] {
+    User u;
+    for (const auto &w : wire) {
+      u.ParseFromString(w);
+      sink += u.id();
+    }
+    bench::do_not_optimize(sink);
+  });
+  const double plain_parse = bench::run("UserPlain::parse", kIters, [&] {
+    for (const auto &w : wire)
+      sink += UserPlain::parse(w).id;
+    bench::do_not_optimize(sink);
+  });
+  bench::ratio("  vs ParseFromString", msg_parse, plain_parse);
+  const double conv_parse =
+      bench::run("ParseFromString + UserPlain::from_proto", kIters, [&] {
+        User u;
+        for (const auto &w : wire) {
+          u.ParseFromString(w);
+          sink += UserPlain::from_proto(u).id;
+        }
+        bench::do_not_optimize(sink);
+      });
+  bench::ratio("  vs parse", plain_parse, conv_parse);
+
+  string out;
+  const double msg_write = bench::run("User::SerializeToString", kIters, [&] {
+    for (const auto &u : users) {
+      u.SerializeToString(&out);
+      sink += out.size();
+    }
+    bench::do_not_optimize(sink);
+  });
+  const double plain_write = bench::run("UserPlain::serialize", kIters, [&] {
+    for (const auto &u : plains)
+      sink += u.serialize().size();
+    bench::do_not_optimize(sink);
+  });
+  bench::ratio("  vs SerializeToString", msg_write, plain_write);
+  User scratch;
+  const double conv_write =
+      bench::run("UserPlain::to_proto + SerializeToString", kIters, [&] {
+        for (const auto &u : plains) {
+          u.to_proto(scratch);
+          scratch.SerializeToString(&out);
+          sink += out.size();
+        }
+        bench::do_not_optimize(sink);
+      });
+  bench::ratio("  vs serialize", plain_write, conv_write);
+}
@@ -0,0 +1,180 @@
+#include "bench_util.h"
+#include "runtime_bench_ops.h"
+#include "user.pb.h"
+#include "user.sugar.h"
+
+#include <google/protobuf/dynamic_message.h>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Wrapper construction and hot loops over the reflection-based proxy
+// setters. Built twice: header-only (bench_runtime) and against the compiled
+// sugar_runtime library (bench_runtime_lib); compare binary size with `size`,
+// and i-cache misses with e.g. `perf stat -e L1-icache-load-misses`.
+int main() {
+  constexpr size_t kIters = 1000000;
+
+  User u;
+  UserWrapped w(u);
+  int i = 0;
+  bench::run("construct UserWrapped", kIters, [&] {
+    UserWrapped tmp(u);
+    bench::do_not_optimize(tmp);
+  });
+  bench::run("construct UserWrapped + one assignment", kIters, [&] {
+    UserWrapped tmp(u);
+    tmp.id = ++i;
+    bench::do_not_optimize(u);
+  });
+  bench::run("FieldProxy scalar assignments", kIters, [&] {
+    w.id = ++i;
+    w.active = true;
+    w.score = 1.5;
+    w.status = 1;
+    bench::do_not_optimize(u);
+  });
+  bench::run("FieldProxy string assignment", kIters, [&] {
+    w.name = "john doe";
+    bench::do_not_optimize(u);
+  });
+  bench::run("RepeatedProxy push_back + set", kIters, [&] {
+    if (w.numbers.size() > 64)
+      u.clear_numbers();
+    w.numbers.push_back(++i);
+    w.numbers.set(0, i);
+    bench::do_not_optimize(u);
+  });
+  bench::run("mixed updates across TUs", kIters / 10, [&] {
+    u.clear_numbers();
+    u.clear_tags();
+    apply_update(u, ++i);
+    append_numbers(u, 8);
+    bench::do_not_optimize(u);
+  });
+
+  // Leaderboard rebuild: reorder 256 submessages by key, alternating the
+  // direction so every round does the same work.
+  User board;
+  for (int k = 0; k < 256; ++k)
+    board.add_profiles()->set_city("city-" + to_string(k * 7919 % 256));
+  UserWrapped bw(board);
+  bool up = true;
+  const double by_copy =
+      bench::run("sort 256 submessages: copy out and back", kIters / 1000, [&] {
+        vector<Profile> v(board.profiles().begin(), board.profiles().end());
+        std::sort(v.begin(), v.end(), [&](const Profile &a, const Profile &b) {
+          return up ? a.city() < b.city() : b.city() < a.city();
+        });
+        board.clear_profiles();
+        for (auto &p : v)
+          *board.add_profiles() = std::move(p);
+        up = !up;
+        bench::do_not_optimize(board);
+      });
+  const double in_place =
+      bench::run("sort 256 submessages: RepeatedProxy::sort", kIters / 1000,
+                 [&] {
+                   auto city = [](ProfileWrapped p) { return p.city.get(); };
+                   if (up)
+                     bw.profiles.sort(city);
+                   else
+                     bw.profiles.sort(city, std::greater<>());
+                   up = !up;
+                   bench::do_not_optimize(board);
+                 });
+  bench::ratio("in-place sort speedup", by_copy, in_place);
+
+  // Batching: move 64 submessages from one User to another, alternating
+  // direction; deep copy through push_back(Fn) versus take_from.
+  User incoming, batch;
+  for (int k = 0; k < 64; ++k) {
+    auto *p = incoming.add_profiles();
+    p->set_city("a city name past the short string buffer " + to_string(k));
+    p->set_country("a country name past the short string buffer");
+  }
+  UserWrapped win(incoming), wbatch(batch);
+  User *from = &incoming, *to = &batch;
+  const double by_deep_copy =
+      bench::run("move 64 submessages: push_back(Fn) copy", kIters / 1000,
+                 [&] {
+                   UserWrapped dst(*to);
+                   for (const auto &p : from->profiles())
+                     dst.profiles.push_back(
+                         [&](ProfileWrapped w) { *w._msg = p; });
+                   from->clear_profiles();
+                   std::swap(from, to);
+                   bench::do_not_optimize(*to);
+                 });
+  bool forward = true;
+  const double by_transfer =
+      bench::run("move 64 submessages: take_from", kIters / 1000, [&] {
+        if (forward)
+          wbatch.profiles.take_from(win.profiles);
+        else
+          win.profiles.take_from(wbatch.profiles);
+        forward = !forward;
+        bench::do_not_optimize(incoming);
+      });
+  bench::ratio("take_from speedup", by_deep_copy, by_transfer);
+
+  // Config-style overrides: a field name and a string value per update.
+  const auto *reflection = u.GetReflection();
+  const double by_descriptor = bench::run(
+      "by name: FindFieldByName + Reflection", kIters, [&] {
+        const auto *d = u.GetDescriptor();
+        reflection->SetInt32(&u, d->FindFieldByName("id"), std::stoi("42"));
+        reflection->SetString(&u, d->FindFieldByName("email"), "a@b.c");
+        bench::do_not_optimize(u);
+      });
+  const double by_table = bench::run("by name: set_by_name", kIters, [&] {
+    w.set_by_name("id", "42");
+    w.set_by_name("email", "a@b.c");
+    bench::do_not_optimize(u);
+  });
+  bench::ratio("set_by_name speedup", by_descriptor, by_table);
+
+  // The same User schema as a DynamicMessage, as if loaded at runtime.
+  google::protobuf::DynamicMessageFactory factory;
+  std::unique_ptr<google::protobuf::Message> dyn(
+      factory.GetPrototype(User::descriptor())->New());
+  const auto *dyn_reflection = dyn->GetReflection();
+  const double generated =
+      bench::run("generated UserWrapped: 2 fields", kIters, [&] {
+    w.id = ++i;
+    w.profile.city = "Berlin";
+    bench::do_not_optimize(u);
+  });
+  bench::run("DynamicMessage: FindFieldByName + Reflection", kIters, [&] {
+    const auto *d = dyn->GetDescriptor();
+    dyn_reflection->SetInt32(dyn.get(), d->FindFieldByName("id"), ++i);
+    auto *profile = dyn_reflection->MutableMessage(
+        dyn.get(), d->FindFieldByName("profile"));
+    profile->GetReflection()->SetString(
+        profile, profile->GetDescriptor()->FindFieldByName("city"), "Berlin");
+    bench::do_not_optimize(*dyn);
+  });
+  const double by_plan = bench::run("DynamicWrapped by name", kIters, [&] {
+    sugar::DynamicWrapped dw(*dyn);
+    dw["id"] = ++i;
+    dw["profile"]["city"] = "Berlin";
+    bench::do_not_optimize(*dyn);
+  });
+  const auto &plan = sugar::MessagePlan::of(User::descriptor());
+  const auto &id_slot = plan.slot("id");
+  const auto &profile_slot = plan.slot("profile");
+  const auto &city_slot = profile_slot.nested().slot("city");
+  const double by_slot = bench::run("DynamicWrapped by slot", kIters, [&] {
+    sugar::DynamicWrapped dw(*dyn, plan);
+    dw[id_slot] = ++i;
+    dw[profile_slot][city_slot] = "Berlin";
+    bench::do_not_optimize(*dyn);
+  });
+  bench::ratio("DynamicWrapped by name vs generated", generated, by_plan);
+  bench::ratio("DynamicWrapped by slot vs generated", generated, by_slot);
+}
@@ -0,0 +1,25 @@
+#include "runtime_bench_ops.h"
+#include "user.sugar.h"
+
+#include <string>
+#include <string_view>
+
+void apply_update(User &u, int round) {
+  UserWrapped w(u);
+  const long id = round;
+  w.id = id;
+  w.active = (round & 1) != 0;
+  w.score = round * 0.5f;
+  const std::string_view name = "update";
+  w.name = name;
+  w.meta.set(std::string("round"), std::to_string(round));
+}
+
+void append_numbers(User &u, int count) {
+  UserWrapped w(u);
+  for (short i = 0; i < count; ++i)
+    w.numbers.push_back(i);
+  w.tags.push_back("tag");
+  if (w.numbers.size() > 0)
+    w.numbers.set(0, static_cast<unsigned char>(count) + 0);
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "user.pb.h"
+
+// Proxy updates kept in a separate TU so both TUs instantiate setters.
+void apply_update(User &u, int round);
+void append_numbers(User &u, int count);
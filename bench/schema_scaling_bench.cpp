@@ -0,0 +1,373 @@
+#include "sugar_generator.h"
+
+#include <google/protobuf/compiler/code_generator.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+using namespace google::protobuf;
+
+// How protoc-gen-sugar scales with schema shape. Each shape grows one
+// dimension of a synthetic .proto file:
+//
+//   messages  N flat messages of 8 fields (scalars, a map, submessages)
+//   fields    one message with N fields of mixed types
+//   depth     a chain of N nested message types (at most 31)
+//   maps      one message with N map fields and an N-member oneof
+//
+// The schema is built as a FileDescriptorProto and SugarGenerator runs
+// in-process over an in-memory GeneratorContext, once per layout (single
+// header, split_headers). The table shows the best of three runs, the
+// output size and the cost per element. "growth" divides the time ratio
+// between consecutive sizes by the size ratio: about 1 is linear, 2 means
+// doubling the schema quadruples the time.
+//
+// With --compile, the single-layout header of each case is also written
+// out, protoc generates the matching .pb.h from a descriptor set, and the
+// table adds the time to compile a TU including the .pb.h alone and with
+// the .sugar.h.
+//
+// usage: bench_schema_scaling [--compile] [shape[=size] ...]
+// env:   PROTOC, CXX, CXXFLAGS, WORK_DIR (--compile)
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+double millis_since(Clock::time_point start) {
+  return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+// ---- Synthetic schemas -----------------------------------------------------
+
+FieldDescriptorProto *add_field(DescriptorProto *m, const string &name,
+                                FieldDescriptorProto::Type type,
+                                const string &type_name = {},
+                                bool repeated = false) {
+  auto *f = m->add_field();
+  f->set_name(name);
+  f->set_number(m->field_size());
+  f->set_type(type);
+  f->set_label(repeated ? FieldDescriptorProto::LABEL_REPEATED
+                        : FieldDescriptorProto::LABEL_OPTIONAL);
+  if (!type_name.empty())
+    f->set_type_name(type_name);
+  return f;
+}
+
+// map<key, value> name on m, whose full name is scope.
+void add_map(DescriptorProto *m, const string &scope, const string &name,
+             FieldDescriptorProto::Type key, FieldDescriptorProto::Type value,
+             const string &value_type = {}) {
+  string entry = name + "Entry";
+  entry[0] = static_cast<char>(toupper(entry[0]));
+  auto *e = m->add_nested_type();
+  e->set_name(entry);
+  e->mutable_options()->set_map_entry(true);
+  add_field(e, "key", key);
+  add_field(e, "value", value, value_type);
+  add_field(m, name, FieldDescriptorProto::TYPE_MESSAGE,
+            scope + "." + entry, true);
+}
+
+FileDescriptorProto new_file() {
+  FileDescriptorProto file;
+  file.set_name("synth.proto");
+  file.set_package("synth");
+  file.set_syntax("proto3");
+  auto *leaf = file.add_message_type();
+  leaf->set_name("Leaf");
+  add_field(leaf, "id", FieldDescriptorProto::TYPE_INT32);
+  add_field(leaf, "label", FieldDescriptorProto::TYPE_STRING);
+  return file;
+}
+
+FileDescriptorProto flat_messages(int n) {
+  FileDescriptorProto file = new_file();
+  for (int i = 0; i < n; ++i) {
+    auto *m = file.add_message_type();
+    m->set_name("M" + to_string(i));
+    add_field(m, "id", FieldDescriptorProto::TYPE_INT32);
+    add_field(m, "name", FieldDescriptorProto::TYPE_STRING);
+    add_field(m, "values", FieldDescriptorProto::TYPE_INT64, {}, true);
+    add_map(m, ".synth." + m->name(), "counts",
+            FieldDescriptorProto::TYPE_STRING, FieldDescriptorProto::TYPE_INT32);
+    add_field(m, "leaf", FieldDescriptorProto::TYPE_MESSAGE, ".synth.Leaf");
+    add_field(m, "leaves", FieldDescriptorProto::TYPE_MESSAGE, ".synth.Leaf",
+              true);
+    add_field(m, "score", FieldDescriptorProto::TYPE_DOUBLE);
+    add_field(m, "flag", FieldDescriptorProto::TYPE_BOOL);
+  }
+  return file;
+}
+
+FileDescriptorProto wide_message(int n) {
+  static const FieldDescriptorProto::Type kTypes[] = {
+      FieldDescriptorProto::TYPE_INT32,  FieldDescriptorProto::TYPE_INT64,
+      FieldDescriptorProto::TYPE_UINT32, FieldDescriptorProto::TYPE_STRING,
+      FieldDescriptorProto::TYPE_BYTES,  FieldDescriptorProto::TYPE_DOUBLE,
+      FieldDescriptorProto::TYPE_FLOAT,  FieldDescriptorProto::TYPE_BOOL,
+      FieldDescriptorProto::TYPE_MESSAGE};
+  FileDescriptorProto file = new_file();
+  auto *m = file.add_message_type();
+  m->set_name("Wide");
+  for (int i = 0; i < n; ++i) {
+    const auto type = kTypes[i % size(kTypes)];
+    add_field(m, "f" + to_string(i), type,
+              type == FieldDescriptorProto::TYPE_MESSAGE ? ".synth.Leaf" : "",
+              i % 4 == 3);
+  }
+  return file;
+}
+
+FileDescriptorProto nested_chain(int n) {
+  FileDescriptorProto file = new_file();
+  DescriptorProto *m = file.add_message_type();
+  string scope = ".synth.D0";
+  m->set_name("D0");
+  for (int i = 1; i <= n; ++i) {
+    add_field(m, "id", FieldDescriptorProto::TYPE_INT32);
+    add_field(m, "name", FieldDescriptorProto::TYPE_STRING);
+    if (i == n)
+      break;
+    DescriptorProto *next = m->add_nested_type();
+    next->set_name("D" + to_string(i));
+    const string next_scope = scope + "." + next->name();
+    add_field(m, "child", FieldDescriptorProto::TYPE_MESSAGE, next_scope);
+    add_field(m, "children", FieldDescriptorProto::TYPE_MESSAGE, next_scope,
+              true);
+    m = next;
+    scope = next_scope;
+  }
+  return file;
+}
+
+FileDescriptorProto maps_and_oneofs(int n) {
+  FileDescriptorProto file = new_file();
+  auto *m = file.add_message_type();
+  m->set_name("Maps");
+  for (int i = 0; i < n; ++i) {
+    const string name = "m" + to_string(i);
+    switch (i % 3) {
+    case 0:
+      add_map(m, ".synth.Maps", name, FieldDescriptorProto::TYPE_STRING,
+              FieldDescriptorProto::TYPE_INT32);
+      break;
+    case 1:
+      add_map(m, ".synth.Maps", name, FieldDescriptorProto::TYPE_INT64,
+              FieldDescriptorProto::TYPE_MESSAGE, ".synth.Leaf");
+      break;
+    default:
+      add_map(m, ".synth.Maps", name, FieldDescriptorProto::TYPE_UINT32,
+              FieldDescriptorProto::TYPE_STRING);
+    }
+  }
+  m->add_oneof_decl()->set_name("choice");
+  for (int i = 0; i < n; ++i) {
+    static const FieldDescriptorProto::Type kTypes[] = {
+        FieldDescriptorProto::TYPE_INT32, FieldDescriptorProto::TYPE_STRING,
+        FieldDescriptorProto::TYPE_MESSAGE};
+    const auto type = kTypes[i % size(kTypes)];
+    add_field(m, "o" + to_string(i), type,
+              type == FieldDescriptorProto::TYPE_MESSAGE ? ".synth.Leaf" : "")
+        ->set_oneof_index(0);
+  }
+  return file;
+}
+
+struct Shape {
+  string_view name;
+  FileDescriptorProto (*build)(int);
+  vector<int> sizes; // default sweep
+};
+
+const Shape kShapes[] = {
+    {"messages", flat_messages, {2500, 5000, 10000}},
+    {"fields", wide_message, {500, 1000, 2000}},
+    {"depth", nested_chain, {8, 16, 31}}, // protobuf stops at 32 levels
+    {"maps", maps_and_oneofs, {250, 500, 1000}},
+};
+
+// ---- In-process generation -------------------------------------------------
+
+class MemoryContext : public compiler::GeneratorContext {
+public:
+  io::ZeroCopyOutputStream *Open(const string &filename) override {
+    auto &[name, contents] = files.emplace_back(filename, string());
+    return new io::StringOutputStream(&contents);
+  }
+
+  size_t bytes() const {
+    size_t n = 0;
+    for (const auto &f : files)
+      n += f.second.size();
+    return n;
+  }
+
+  deque<pair<string, string>> files; // stable for the open streams
+};
+
+struct Generated {
+  double ms = 1e300; // best run
+  size_t bytes = 0;
+  size_t outputs = 0;
+  string header; // single layout only
+};
+
+Generated generate(const FileDescriptor *file, const string &parameter) {
+  const SugarGenerator gen;
+  Generated out;
+  for (int run = 0; run < 3; ++run) {
+    MemoryContext context;
+    string error;
+    const auto start = Clock::now();
+    if (!gen.GenerateAll({file}, parameter, &context, &error)) {
+      fprintf(stderr, "generation failed: %s\n", error.c_str());
+      exit(EXIT_FAILURE);
+    }
+    out.ms = min(out.ms, millis_since(start));
+    out.bytes = context.bytes();
+    out.outputs = context.files.size();
+    if (context.files.size() == 1)
+      out.header = std::move(context.files.front().second);
+  }
+  return out;
+}
+
+// ---- Downstream compile ----------------------------------------------------
+
+string env_or(const char *name, const char *fallback) {
+  const char *v = getenv(name);
+  return v && *v ? v : fallback;
+}
+
+double run_timed(const string &command) {
+  const auto start = Clock::now();
+  if (system(command.c_str()) != 0) {
+    fprintf(stderr, "failed: %s\n", command.c_str());
+    exit(EXIT_FAILURE);
+  }
+  return millis_since(start);
+}
+
+void write_file(const filesystem::path &path, string_view contents) {
+  ofstream(path, ios::binary).write(contents.data(),
+                                    static_cast<streamsize>(contents.size()));
+}
+
+struct Compiled {
+  double pb_ms;    // TU including synth.pb.h
+  double sugar_ms; // TU including synth.sugar.h
+};
+
+Compiled compile(const FileDescriptorProto &proto, const string &header,
+                 const filesystem::path &dir) {
+  filesystem::create_directories(dir);
+  FileDescriptorSet set;
+  *set.add_file() = proto;
+  string descriptors;
+  set.SerializeToString(&descriptors);
+  write_file(dir / "synth.desc", descriptors);
+  write_file(dir / "synth.sugar.h", header);
+  write_file(dir / "pb_only.cpp", "#include \"synth.pb.h\"\n");
+  write_file(dir / "sugar.cpp", "#include \"synth.sugar.h\"\n");
+
+  const string d = dir.string();
+  run_timed(env_or("PROTOC", SUGAR_BENCH_PROTOC) + " --descriptor_set_in=" +
+            d + "/synth.desc --cpp_out=" + d + " synth.proto");
+  const string cxx = env_or("CXX", SUGAR_BENCH_CXX) + " " +
+                     env_or("CXXFLAGS", "-std=c++20 -O2") + " -I" + d +
+                     " -I" SUGAR_BENCH_INCLUDE_DIR " -c ";
+  return {run_timed(cxx + d + "/pb_only.cpp -o " + d + "/pb_only.o"),
+          run_timed(cxx + d + "/sugar.cpp -o " + d + "/sugar.o")};
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  bool compile_headers = false;
+  vector<pair<const Shape *, vector<int>>> cases;
+  for (int i = 1; i < argc; ++i) {
+    const string_view arg = argv[i];
+    if (arg == "--compile") {
+      compile_headers = true;
+      continue;
+    }
+    const size_t eq = arg.find('=');
+    const auto *shape =
+        find_if(begin(kShapes), end(kShapes),
+                [&](const Shape &s) { return s.name == arg.substr(0, eq); });
+    if (shape == end(kShapes)) {
+      fprintf(stderr,
+              "usage: %s [--compile] [messages|fields|depth|maps[=size]] ...\n",
+              argv[0]);
+      return EXIT_FAILURE;
+    }
+    cases.emplace_back(shape, eq == string_view::npos
+                                  ? shape->sizes
+                                  : vector<int>{atoi(argv[i] + eq + 1)});
+  }
+  if (cases.empty())
+    for (const Shape &s : kShapes)
+      cases.emplace_back(&s, s.sizes);
+
+  const filesystem::path work =
+      env_or("WORK_DIR",
+             (filesystem::temp_directory_path() / "sugar_schema_scaling")
+                 .c_str());
+
+  printf("%-16s %-7s %10s %9s %8s %11s %7s", "shape", "layout", "generate",
+         "outputs", "size", "per elem", "growth");
+  if (compile_headers)
+    printf(" %10s %10s", "cc pb.h", "cc +sugar");
+  printf("\n");
+
+  for (const auto &[shape, sizes] : cases) {
+    double prev_ms[2] = {0, 0};
+    int prev_size = 0;
+    for (const int n : sizes) {
+      const FileDescriptorProto proto = shape->build(n);
+      DescriptorPool pool;
+      const FileDescriptor *file = pool.BuildFile(proto);
+      if (!file) {
+        fprintf(stderr, "%s=%d: invalid schema\n", shape->name.data(), n);
+        return EXIT_FAILURE;
+      }
+      const string label = string(shape->name) + "=" + to_string(n);
+      for (const int split : {0, 1}) {
+        const Generated g = generate(file, split ? "split_headers" : "jobs=1");
+        printf("%-16s %-7s %8.1fms %9zu %6zuKB %9.1fus", label.c_str(),
+               split ? "split" : "single", g.ms, g.outputs, g.bytes >> 10,
+               g.ms * 1000 / n);
+        if (prev_size)
+          printf(" %7.2f", g.ms / prev_ms[split] /
+                               (static_cast<double>(n) / prev_size));
+        else
+          printf(" %7s", "-");
+        prev_ms[split] = g.ms;
+        if (compile_headers && !split) {
+          const Compiled c = compile(proto, g.header, work / label);
+          printf(" %8.0fms %8.0fms", c.pb_ms, c.sugar_ms);
+        }
+        printf("\n");
+        fflush(stdout);
+      }
+      prev_size = n;
+    }
+  }
+}
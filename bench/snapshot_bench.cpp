@@ -0,0 +1,112 @@
+#include "bench_util.h"
+#include "sugar_snapshot.h"
+#include "user.pb.h"
+#include "user.sugar.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Reader scaling of a read-mostly shared User: N reader threads against one
+// writer publishing every millisecond, guarded by a shared_mutex versus
+// held in a sugar::Snapshot. Reports reads/s summed over all readers.
+
+namespace {
+
+constexpr auto kDuration = chrono::milliseconds(300);
+constexpr auto kWriteEvery = chrono::milliseconds(1);
+
+User make_user() {
+  User u;
+  u.set_id(1);
+  u.set_name("config");
+  u.mutable_profile()->set_city("Berlin");
+  for (int i = 0; i < 16; ++i)
+    u.add_numbers(i);
+  return u;
+}
+
+struct Locked {
+  mutable shared_mutex mu;
+  User user = make_user();
+
+  int64_t read() const {
+    shared_lock lock(mu);
+    return user.id() + user.profile().city().size();
+  }
+
+  void write() {
+    unique_lock lock(mu);
+    UserWrapped w(user);
+    w.id = w.id + 1;
+  }
+};
+
+struct Published {
+  sugar::Snapshot<UserWrapped> snap{make_user()};
+
+  int64_t read() const {
+    const auto r = snap.read();
+    return r->id() + r->profile().city().size();
+  }
+
+  void write() {
+    snap.update([](UserWrapped w) { w.id = w.id + 1; });
+  }
+};
+
+// Returns total reads per second across `readers` threads.
+template <typename Holder> double measure(Holder &h, int readers) {
+  atomic<bool> stop{false};
+  atomic<uint64_t> total{0};
+  vector<thread> threads;
+  for (int t = 0; t < readers; ++t)
+    threads.emplace_back([&] {
+      uint64_t n = 0;
+      int64_t sink = 0;
+      while (!stop.load(memory_order_relaxed)) {
+        for (int i = 0; i < 64; ++i)
+          sink += h.read();
+        n += 64;
+      }
+      bench::do_not_optimize(sink);
+      total.fetch_add(n);
+    });
+
+  const auto start = chrono::steady_clock::now();
+  while (chrono::steady_clock::now() - start < kDuration) {
+    h.write();
+    this_thread::sleep_for(kWriteEvery);
+  }
+  stop = true;
+  for (auto &t : threads)
+    t.join();
+  const double secs =
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  return static_cast<double>(total.load()) / secs;
+}
+
+} // namespace
+
+int main() {
+  const int max_readers =
+      static_cast<int>(max(8u, thread::hardware_concurrency()));
+
+  printf("%-8s %16s %16s %10s\n", "readers", "shared_mutex/s", "Snapshot/s",
+         "speedup");
+  for (int n = 1; n <= max_readers; n *= 2) {
+    Locked locked;
+    Published published;
+    const double a = measure(locked, n);
+    const double b = measure(published, n);
+    printf("%-8d %16.3e %16.3e %9.2fx\n", n, a, b, b / a);
+  }
+}
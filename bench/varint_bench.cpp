@@ -0,0 +1,123 @@
+#include "bench_util.h"
+#include "sugar_varint.h"
+#include "test_messages.pb.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Packed r_i32 / r_i64 / r_u64 fields of test_messages.proto holding 1M
+// values each: protobuf's parser and serializer on a message with just
+// that field against sugar::decode_varints (into the field's
+// RepeatedField and into a span, plus the scalar decoder alone) and
+// sugar::encode_varints.
+
+namespace {
+
+using Top = mypkg::Top;
+
+constexpr size_t kValues = 1 << 20;
+
+template <typename T, typename Gen> vector<T> make(Gen gen) {
+  mt19937_64 rng(7);
+  vector<T> v(kValues);
+  for (auto &x : v)
+    x = static_cast<T>(gen(rng()));
+  return v;
+}
+
+span<const byte> payload(const string &bytes) {
+  const byte *p = reinterpret_cast<const byte *>(bytes.data());
+  const byte *end = p + bytes.size();
+  uint64_t skip;
+  sugar::detail::read_varint(p, end, skip); // tag
+  sugar::detail::read_varint(p, end, skip); // length
+  return {p, end};
+}
+
+void report(double ns) {
+  std::printf("%-48s %12.1f M values/s\n", "",
+              static_cast<double>(kValues) / 1e6 / (ns / 1e9));
+}
+
+template <typename T, typename Field>
+void run(const char *label, const vector<T> &values,
+         Field *(Top::*mutable_field)()) {
+  Top src;
+  (src.*mutable_field)()->Add(values.begin(), values.end());
+  const string bytes = src.SerializeAsString();
+  const auto packed = payload(bytes);
+  std::printf("%s: %.2f bytes/value\n", label,
+              static_cast<double>(packed.size()) / kValues);
+
+  constexpr size_t kIters = 20;
+  Top m;
+  const double parse = bench::run("  decode: ParseFromString", kIters, [&] {
+    m.ParseFromString(bytes);
+    bench::do_not_optimize(m);
+  });
+  report(parse);
+  auto &field = *(m.*mutable_field)();
+  const double into_field = bench::run("  decode: decode_varints -> field", kIters, [&] {
+    field.Clear();
+    bench::do_not_optimize(sugar::decode_varints(packed, field));
+  });
+  report(into_field);
+  bench::ratio("    vs ParseFromString", parse, into_field);
+  vector<T> out(values.size());
+  const double into_span = bench::run("  decode: decode_varints -> span", kIters, [&] {
+    bench::do_not_optimize(sugar::decode_varints(packed, span(out)));
+  });
+  report(into_span);
+  bench::ratio("    vs ParseFromString", parse, into_span);
+  const double scalar = bench::run("  decode: scalar only -> span", kIters, [&] {
+    sugar::detail::decode_varints_scalar(packed.data(),
+                                         packed.data() + packed.size(),
+                                         out.data(), out.size());
+    bench::do_not_optimize(out);
+  });
+  report(scalar);
+  bench::ratio("    SIMD vs scalar", scalar, into_span);
+
+  // Room for the tag and length too, or protobuf gives up after sizing.
+  vector<byte> buf(bytes.size());
+  const double serialize = bench::run("  encode: SerializeToArray", kIters, [&] {
+    if (!src.SerializeToArray(buf.data(), static_cast<int>(buf.size())))
+      std::abort();
+    bench::do_not_optimize(buf);
+  });
+  report(serialize);
+  const double encode = bench::run("  encode: encode_varints", kIters, [&] {
+    bench::do_not_optimize(
+        sugar::encode_varints(span<const T>(values), span(buf)));
+  });
+  report(encode);
+  bench::ratio("    vs SerializeToArray", serialize, encode);
+}
+
+} // namespace
+
+int main() {
+  run("r_i32, 0..127", make<int32_t>([](uint64_t r) { return r & 0x7f; }),
+      &Top::mutable_r_i32);
+  run("r_i32, counts below 2^14",
+      make<int32_t>([](uint64_t r) { return (r & 0x3fff) >> (r >> 60); }),
+      &Top::mutable_r_i32);
+  run("r_i32, ids below 2^21", make<int32_t>([](uint64_t r) { return r >> 43; }),
+      &Top::mutable_r_i32);
+  run("r_i32, 1% negative", make<int32_t>([](uint64_t r) {
+        return r % 100 == 0 ? -static_cast<int64_t>(r >> 50) : (r >> 50);
+      }),
+      &Top::mutable_r_i32);
+  run("r_i64, mixed lengths below 2^28",
+      make<int64_t>([](uint64_t r) { return r >> (36 + r % 28); }),
+      &Top::mutable_r_i64);
+  run("r_u64, timestamps near 2^40",
+      make<uint64_t>([](uint64_t r) { return (uint64_t{1} << 40) + (r >> 32); }),
+      &Top::mutable_r_u64);
+}
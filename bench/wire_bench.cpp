@@ -0,0 +1,106 @@
+#include "bench_util.h"
+#include "sugar_wire.h"
+#include "user.pb.h"
+#include "user.sugar.h"
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+// Reading a few fields out of a serialized User of a few KB (50 tags, 200
+// numbers, 20 profiles, 20 meta entries): a full ParseFromString (into a
+// reused message) against sugar::WireView, which skips what it does not
+// read.
+
+namespace {
+
+User make_user() {
+  User u;
+  u.set_id(123456);
+  u.set_name("Ada Lovelace");
+  u.set_active(true);
+  u.set_score(98.5);
+  u.set_status(OK);
+  for (int i = 0; i < 50; ++i)
+    u.add_tags("tag-" + to_string(i));
+  for (int i = 0; i < 200; ++i)
+    u.add_numbers(i * 37);
+  for (int i = 0; i < 20; ++i) {
+    Profile *p = u.add_profiles();
+    p->set_city("city-" + to_string(i));
+    p->set_country("country-" + to_string(i));
+  }
+  for (int i = 0; i < 20; ++i)
+    (*u.mutable_meta())["key-" + to_string(i)] = "value-" + to_string(i);
+  u.mutable_profile()->set_city("Berlin");
+  u.mutable_profile()->set_country("Germany");
+  return u;
+}
+
+} // namespace
+
+int main() {
+  const string bytes = make_user().SerializeAsString();
+  std::printf("payload: %zu bytes\n", bytes.size());
+
+  constexpr size_t kIters = 200000;
+  User u;
+
+  const double parse_one = bench::run("ParseFromString + id", kIters, [&] {
+    u.ParseFromString(bytes);
+    bench::do_not_optimize(u.id());
+  });
+  const double view_one = bench::run("WireView get<id>", kIters, [&] {
+    const sugar::WireView<UserWrapped> v(bytes);
+    bench::do_not_optimize(v.get<"id">());
+  });
+  bench::ratio("  one field", parse_one, view_one);
+
+  const double parse_few =
+      bench::run("ParseFromString + id/status/name/city", kIters, [&] {
+        u.ParseFromString(bytes);
+        bench::do_not_optimize(u.id());
+        bench::do_not_optimize(u.status());
+        bench::do_not_optimize(u.name());
+        bench::do_not_optimize(u.profile().city());
+      });
+  const double view_few =
+      bench::run("WireView get<id, status, name, profile>", kIters, [&] {
+        const sugar::WireView<UserWrapped> v(bytes);
+        const auto [id, status, name, profile] =
+            v.get<"id", "status", "name", "profile">();
+        bench::do_not_optimize(id);
+        bench::do_not_optimize(status);
+        bench::do_not_optimize(name);
+        bench::do_not_optimize(profile.get<"city">());
+      });
+  bench::ratio("  few fields", parse_few, view_few);
+
+  const double parse_sum = bench::run("ParseFromString + sum(numbers)", kIters, [&] {
+    u.ParseFromString(bytes);
+    int64_t sum = 0;
+    for (int32_t n : u.numbers())
+      sum += n;
+    bench::do_not_optimize(sum);
+  });
+  const double view_sum = bench::run("WireView sum(get<numbers>)", kIters, [&] {
+    const sugar::WireView<UserWrapped> v(bytes);
+    int64_t sum = 0;
+    for (int32_t n : v.get<"numbers">())
+      sum += n;
+    bench::do_not_optimize(sum);
+  });
+  bench::ratio("  packed field", parse_sum, view_sum);
+
+  const double parse_meta = bench::run("ParseFromString + meta[key-7]", kIters, [&] {
+    u.ParseFromString(bytes);
+    bench::do_not_optimize(u.meta().at("key-7"));
+  });
+  const double view_meta = bench::run("WireView get<meta>.find(key-7)", kIters, [&] {
+    const sugar::WireView<UserWrapped> v(bytes);
+    bench::do_not_optimize(v.get<"meta">().find("key-7"));
+  });
+  bench::ratio("  map lookup", parse_meta, view_meta);
+}
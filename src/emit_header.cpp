@@ -1,18 +1,452 @@
 #include "emit_header.h"
+#include "sugar_core.h"
 
 #include <google/protobuf/descriptor.h>
 #include <google/protobuf/descriptor.pb.h>
 
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <map>
+#include <numeric>
 #include <ostream>
 #include <string>
+#include <utility>
+#include <vector>
 
 using google::protobuf::Descriptor;
 using google::protobuf::FieldDescriptor;
 
-static void emit_message_wrapper(const Descriptor *d, std::ostream &os);
+static void emit_message_wrapper(const Descriptor *d,
+                                 const EmitFeatures &features,
+                                 std::ostream &os);
 
-static void emit_field_member(const FieldDescriptor *f, std::ostream &os) {
+// Generated C++ name of a message or enum relative to its package, e.g.
+// "Top_Inner_Deeper" for the nested message mypkg.Top.Inner.Deeper.
+static std::string cpp_scoped_name(const std::string &full_name,
+                                   const std::string &package) {
+  std::string name = package.empty() ? full_name
+                                     : full_name.substr(package.size() + 1);
+  for (auto &c : name)
+    if (c == '.')
+      c = '_';
+  return name;
+}
+
+static std::string cpp_class_name(const Descriptor *d) {
+  return cpp_scoped_name(d->full_name(), d->file()->package());
+}
+
+static std::string
+cpp_namespace(const google::protobuf::FileDescriptor *file) {
+  std::string ns;
+  for (char c : file->package()) {
+    if (c == '.')
+      ns += "::";
+    else
+      ns += c;
+  }
+  return ns;
+}
+
+static std::string
+cpp_enum_name(const google::protobuf::EnumDescriptor *e) {
+  const std::string ns = cpp_namespace(e->file());
+  return (ns.empty() ? "::" : "::" + ns + "::") +
+         cpp_scoped_name(e->full_name(), e->file()->package());
+}
+
+// protoc lowercases field names for the generated accessors.
+static std::string accessor_name(const FieldDescriptor *f) {
+  std::string name = f->name();
+  for (auto &c : name)
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  return name;
+}
+
+// Files with `optimize_for = LITE_RUNTIME` have no descriptors or
+// reflection at runtime; their wrappers bind the generated accessors
+// through sugar_lite.h instead.
+static bool is_lite(const google::protobuf::FileDescriptor *file) {
+  return file->options().optimize_for() ==
+         google::protobuf::FileOptions::LITE_RUNTIME;
+}
+
+static std::string qualified_class_name(const Descriptor *d) {
+  const std::string ns = cpp_namespace(d->file());
+  return (ns.empty() ? "::" : "::" + ns + "::") + cpp_class_name(d);
+}
+
+// Element type of a RepeatedField; enums are stored as int.
+static std::string repeated_scalar_type(const FieldDescriptor *f) {
+  switch (f->cpp_type()) {
+  case FieldDescriptor::CPPTYPE_INT32:
+    return "int32_t";
+  case FieldDescriptor::CPPTYPE_INT64:
+    return "int64_t";
+  case FieldDescriptor::CPPTYPE_UINT32:
+    return "uint32_t";
+  case FieldDescriptor::CPPTYPE_UINT64:
+    return "uint64_t";
+  case FieldDescriptor::CPPTYPE_BOOL:
+    return "bool";
+  case FieldDescriptor::CPPTYPE_FLOAT:
+    return "float";
+  case FieldDescriptor::CPPTYPE_DOUBLE:
+    return "double";
+  default:
+    return "int";
+  }
+}
+
+static void emit_lite_field_member(const FieldDescriptor *f,
+                                   const std::string &indent,
+                                   std::ostream &os) {
+  const std::string acc =
+      cpp_class_name(f->containing_type()) + "::" + accessor_name(f);
+  const std::string mut = cpp_class_name(f->containing_type()) +
+                          "::mutable_" + accessor_name(f);
+
+  if (f->is_map()) {
+    os << indent << "sugar::lite::MapTag<Access, &" << mut << "> "
+       << f->name() << ";\n";
+  } else if (f->is_repeated()) {
+    os << indent << "sugar::lite::RepeatedTag<Access, ";
+    if (f->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE)
+      os << "google::protobuf::RepeatedPtrField<"
+         << qualified_class_name(f->message_type()) << ">, &" << mut << ", "
+         << f->message_type()->name() << "Wrapped";
+    else if (f->cpp_type() == FieldDescriptor::CPPTYPE_STRING)
+      os << "google::protobuf::RepeatedPtrField<std::string>, &" << mut;
+    else
+      os << "google::protobuf::RepeatedField<" << repeated_scalar_type(f)
+         << ">, &" << mut;
+    os << "> " << f->name() << ";\n";
+  } else if (f->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
+    const std::string fields = f->message_type()->name() + "Fields";
+    os << indent << fields << "<sugar::SubmessageAccess<Access, &" << mut
+       << ", " << fields << ", &" << acc << ">> " << f->name() << ";\n";
+  } else if (f->cpp_type() == FieldDescriptor::CPPTYPE_STRING) {
+    os << indent << "sugar::lite::StringTag<Access, &" << acc << ", &" << mut
+       << "> " << f->name() << ";\n";
+  } else {
+    os << indent << "sugar::lite::FieldTag<Access, &" << acc << ", &"
+       << cpp_class_name(f->containing_type()) << "::set_"
+       << accessor_name(f) << "> " << f->name() << ";\n";
+  }
+}
+
+// sugar::FieldKind of f; maps report the kind of their values.
+static const char *field_kind(const FieldDescriptor *f) {
+  if (f->is_map())
+    f = f->message_type()->FindFieldByName("value");
+  if (f->type() == FieldDescriptor::TYPE_BYTES)
+    return "kBytes";
+  switch (f->cpp_type()) {
+  case FieldDescriptor::CPPTYPE_INT32:
+    return "kInt32";
+  case FieldDescriptor::CPPTYPE_INT64:
+    return "kInt64";
+  case FieldDescriptor::CPPTYPE_UINT32:
+    return "kUInt32";
+  case FieldDescriptor::CPPTYPE_UINT64:
+    return "kUInt64";
+  case FieldDescriptor::CPPTYPE_BOOL:
+    return "kBool";
+  case FieldDescriptor::CPPTYPE_FLOAT:
+    return "kFloat";
+  case FieldDescriptor::CPPTYPE_DOUBLE:
+    return "kDouble";
+  case FieldDescriptor::CPPTYPE_ENUM:
+    return "kEnum";
+  case FieldDescriptor::CPPTYPE_STRING:
+    return "kString";
+  default:
+    return "kMessage";
+  }
+}
+
+static const char *cardinality(const FieldDescriptor *f) {
+  return f->is_map() ? "kMap" : f->is_repeated() ? "kRepeated" : "kSingular";
+}
+
+// constexpr field metadata standing in for the Descriptor in lite mode.
+static void emit_lite_field_table(const Descriptor *d, std::ostream &os) {
+  os << "    static constexpr std::array<sugar::lite::FieldInfo, "
+     << d->field_count() << "> kFields = {{\n";
+  for (int i = 0; i < d->field_count(); ++i) {
+    const auto *f = d->field(i);
+    const auto *oneof = f->real_containing_oneof();
+    os << "        {\"" << f->name() << "\", " << f->number()
+       << ", sugar::lite::FieldKind::" << field_kind(f)
+       << ", sugar::lite::Cardinality::" << cardinality(f) << ", "
+       << (oneof ? oneof->index() : -1) << "},\n";
+  }
+  os << "    }};\n";
+}
+
+// Singular fields reachable through set_by_name / get_by_name.
+static std::vector<const FieldDescriptor *> named_fields(const Descriptor *d) {
+  std::vector<const FieldDescriptor *> fields;
+  for (int i = 0; i < d->field_count(); ++i)
+    if (!d->field(i)->is_repeated())
+      fields.push_back(d->field(i));
+  return fields;
+}
+
+struct NameLayout {
+  std::vector<uint16_t> seeds;
+  std::vector<int> slots;
+};
+
+// Perfect hash over `names` using the runtime's name_hash/name_bucket/
+// name_slot: buckets are placed largest first, each with the first seed
+// that sends all of its names to free slots. Slots double until that works.
+static NameLayout name_layout(const std::vector<std::string> &names) {
+  const std::size_t n = names.size();
+  const std::size_t buckets = std::bit_ceil(std::max<std::size_t>(1, n / 4));
+  std::vector<std::vector<std::size_t>> members(buckets);
+  std::vector<uint64_t> hashes(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    hashes[i] = sugar::name_hash(names[i]);
+    members[sugar::name_bucket(hashes[i], buckets)].push_back(i);
+  }
+  std::vector<std::size_t> order(buckets);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](auto a, auto b) {
+    return members[a].size() > members[b].size();
+  });
+
+  for (std::size_t nslots = std::bit_ceil(std::max<std::size_t>(1, n + n / 2));;
+       nslots *= 2) {
+    NameLayout l{std::vector<uint16_t>(buckets, 0),
+                 std::vector<int>(nslots, -1)};
+    bool ok = true;
+    for (std::size_t b : order) {
+      bool placed = members[b].empty();
+      for (uint32_t seed = 0; !placed && seed <= UINT16_MAX; ++seed) {
+        std::vector<std::size_t> taken;
+        for (std::size_t i : members[b]) {
+          const std::size_t slot = sugar::name_slot(hashes[i], seed, nslots);
+          if (l.slots[slot] != -1 ||
+              std::find(taken.begin(), taken.end(), slot) != taken.end())
+            break;
+          taken.push_back(slot);
+        }
+        if (taken.size() != members[b].size())
+          continue;
+        for (std::size_t k = 0; k < taken.size(); ++k)
+          l.slots[taken[k]] = static_cast<int>(members[b][k]);
+        l.seeds[b] = static_cast<uint16_t>(seed);
+        placed = true;
+      }
+      if (!placed) {
+        ok = false;
+        break;
+      }
+    }
+    if (ok)
+      return l;
+  }
+}
+
+// The set/get thunks of a scalar field, as capture-less lambdas bound to
+// the generated accessors.
+static std::string name_setter(const FieldDescriptor *f) {
+  const std::string cls = cpp_class_name(f->containing_type());
+  const std::string acc = accessor_name(f);
+  std::string body;
+  switch (f->cpp_type()) {
+  case FieldDescriptor::CPPTYPE_STRING:
+    body = "const auto s = v.as<std::string_view>(); m.mutable_" + acc +
+           "()->assign(s.data(), s.size());";
+    break;
+  case FieldDescriptor::CPPTYPE_ENUM: {
+    const std::string e = cpp_enum_name(f->enum_type());
+    body = "static constexpr sugar::EnumName kNames[] = {";
+    for (int i = 0; i < f->enum_type()->value_count(); ++i) {
+      const auto *ev = f->enum_type()->value(i);
+      body += std::string(i ? ", " : "") + "{\"" + ev->name() + "\", " +
+              std::to_string(ev->number()) + "}";
+    }
+    body += "}; const int n = v.enum_number(kNames); ";
+    // Closed (proto2) enums reject numbers outside the definition.
+    if (f->enum_type()->file()->syntax() ==
+        google::protobuf::FileDescriptor::SYNTAX_PROTO2)
+      body += "if (!" + e +
+              "_IsValid(n)) throw std::out_of_range(\"enum value out of "
+              "range\"); ";
+    body += "m.set_" + acc + "(static_cast<" + e + ">(n));";
+    break;
+  }
+  default:
+    body = "m.set_" + acc + "(v.as<" + repeated_scalar_type(f) + ">());";
+    break;
+  }
+  return "[](" + cls + "& m, const sugar::FieldValue& v) { " + body + " }";
+}
+
+static void emit_name_table(const Descriptor *d, std::ostream &os) {
+  const std::string cls = cpp_class_name(d);
+  const auto fields = named_fields(d);
+  std::vector<std::string> names;
+  for (const auto *f : fields)
+    names.push_back(f->name());
+  const NameLayout l = name_layout(names);
+
+  os << "    static constexpr sugar::NameTable<" << cls << ", " << fields.size()
+     << ", " << l.seeds.size() << ", " << l.slots.size() << "> kByName = {\n";
+  if (fields.empty()) {
+    os << "        {},\n";
+  } else {
+    os << "        {{\n";
+    for (const auto *f : fields) {
+      os << "            {\"" << f->name() << "\", " << f->index() << ",\n";
+      if (f->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
+        const std::string wrapped = f->message_type()->name() + "Wrapped";
+        os << "             nullptr, nullptr,\n"
+           << "             &sugar::set_nested<" << cls << ", " << wrapped
+           << ", &" << cls << "::mutable_" << accessor_name(f) << ">,\n"
+           << "             &sugar::get_nested<" << cls << ", " << wrapped
+           << ", &" << cls << "::" << accessor_name(f) << ">},\n";
+      } else {
+        os << "             " << name_setter(f) << ",\n"
+           << "             [](const " << cls
+           << "& m) { return sugar::FieldValue(m." << accessor_name(f)
+           << "()); },\n"
+           << "             nullptr, nullptr},\n";
+      }
+    }
+    os << "        }},\n";
+  }
+  os << "        {{";
+  for (std::size_t i = 0; i < l.seeds.size(); ++i)
+    os << (i ? ", " : "") << l.seeds[i];
+  os << "}},\n        {{";
+  for (std::size_t i = 0; i < l.slots.size(); ++i)
+    os << (i ? ", " : "") << l.slots[i];
+  os << "}},\n    };\n";
+}
+
+static const char *wire_kind(const FieldDescriptor *f) {
+  switch (f->type()) {
+  case FieldDescriptor::TYPE_INT32:
+    return "kInt32";
+  case FieldDescriptor::TYPE_INT64:
+    return "kInt64";
+  case FieldDescriptor::TYPE_UINT32:
+    return "kUInt32";
+  case FieldDescriptor::TYPE_UINT64:
+    return "kUInt64";
+  case FieldDescriptor::TYPE_SINT32:
+    return "kSInt32";
+  case FieldDescriptor::TYPE_SINT64:
+    return "kSInt64";
+  case FieldDescriptor::TYPE_BOOL:
+    return "kBool";
+  case FieldDescriptor::TYPE_ENUM:
+    return "kEnum";
+  case FieldDescriptor::TYPE_FIXED32:
+    return "kFixed32";
+  case FieldDescriptor::TYPE_FIXED64:
+    return "kFixed64";
+  case FieldDescriptor::TYPE_SFIXED32:
+    return "kSFixed32";
+  case FieldDescriptor::TYPE_SFIXED64:
+    return "kSFixed64";
+  case FieldDescriptor::TYPE_FLOAT:
+    return "kFloat";
+  case FieldDescriptor::TYPE_DOUBLE:
+    return "kDouble";
+  case FieldDescriptor::TYPE_STRING:
+    return "kString";
+  case FieldDescriptor::TYPE_BYTES:
+    return "kBytes";
+  case FieldDescriptor::TYPE_GROUP:
+    return "kGroup";
+  default:
+    return "kMessage";
+  }
+}
+
+// kWireFields plus the wire_message overloads WireView resolves
+// submessage wrappers through.
+static void emit_wire_table(const Descriptor *d, std::ostream &os) {
+  os << "    static constexpr std::array<sugar::WireField, "
+     << d->field_count() << "> kWireFields = {{\n";
+  for (int i = 0; i < d->field_count(); ++i) {
+    const auto *f = d->field(i);
+    os << "        {\"" << f->name() << "\", " << f->number()
+       << ", sugar::WireKind::" << wire_kind(f);
+    if (f->is_map()) {
+      os << ", sugar::WireField::kMap, sugar::WireKind::"
+         << wire_kind(f->message_type()->map_key())
+         << ", sugar::WireKind::" << wire_kind(f->message_type()->map_value());
+    } else if (f->is_repeated()) {
+      os << ", sugar::WireField::kRepeated";
+    } else if (const auto *o = f->real_containing_oneof()) {
+      os << ", sugar::WireField::kSingular, sugar::WireKind::kInt32, "
+            "sugar::WireKind::kInt32, "
+         << o->index() + 1;
+    }
+    os << "},\n";
+  }
+  os << "    }};\n";
+  for (int i = 0; i < d->field_count(); ++i) {
+    const auto *f = d->field(i);
+    const auto *sub = f->is_map() ? f->message_type()->map_value() : f;
+    if (sub->type() == FieldDescriptor::TYPE_MESSAGE)
+      os << "    static " << sub->message_type()->name()
+         << "Wrapped wire_message(sugar::WireNumber<" << f->number()
+         << ">);\n";
+  }
+}
+
+// kFieldList, the tuple sugar::for_each_field unrolls over.
+static void emit_field_list(const Descriptor *d, std::ostream &os) {
+  const std::string wrapped = d->name() + "Wrapped";
+  const std::string cls = cpp_class_name(d);
+  os << "    static constexpr std::tuple<";
+  for (int i = 0; i < d->field_count(); ++i) {
+    const auto *f = d->field(i);
+    const auto *sub = f->is_map() ? f->message_type()->map_value() : f;
+    os << (i ? "," : "") << "\n        sugar::FieldMeta<&" << wrapped
+       << "::" << f->name() << ", sugar::getter(&" << cls
+       << "::" << accessor_name(f) << "), " << f->number()
+       << ", sugar::FieldKind::" << field_kind(f) << ", sugar::Cardinality::"
+       << cardinality(f);
+    if (sub->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE)
+      os << ", " << sub->message_type()->name() << "Wrapped";
+    os << ">";
+  }
+  os << ">\n        kFieldList{";
+  for (int i = 0; i < d->field_count(); ++i)
+    os << (i ? ", " : "") << "{\"" << d->field(i)->name() << "\"}";
+  os << "};\n";
+}
+
+static void emit_name_access(std::ostream &os) {
+  os << "    // Singular fields by name; dotted paths reach into submessages.\n"
+     << "    bool set_by_name(std::string_view path,\n"
+     << "                     const sugar::FieldValue& v) const {\n"
+     << "        return kByName.set(*_msg, path, v);\n"
+     << "    }\n"
+     << "    [[nodiscard]] sugar::FieldValue\n"
+     << "    get_by_name(std::string_view path) const {\n"
+     << "        return kByName.get(*_msg, path);\n"
+     << "    }\n";
+}
+
+// Tag member for field f, written inside a union whose `Access` policy
+// locates f's containing message.
+static void emit_field_member(const FieldDescriptor *f,
+                              const std::string &indent, std::ostream &os) {
+  if (is_lite(f->file())) {
+    emit_lite_field_member(f, indent, os);
+    return;
+  }
   const std::string &fname = f->name();
+  const std::string prefix = "Access, " + std::to_string(f->index()) + ", ";
 
   if (f->is_map()) {
     const auto *kv = f->message_type();
@@ -79,15 +513,15 @@ static void emit_field_member(const FieldDescriptor *f, std::ostream &os) {
       break;
     }
 
-    os << "    sugar::MapProxy<" << ktype << ", " << vtype << "> " << fname
-       << ";\n";
+    os << indent << "sugar::MapTag<" << prefix << ktype << ", " << vtype
+       << "> " << fname << ";\n";
     return;
   }
 
   if (f->is_repeated()) {
     if (f->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
-      os << "    sugar::RepeatedProxy<" << f->message_type()->name()
-         << "Wrapped> " << fname << ";\n";
+      os << indent << "sugar::RepeatedTag<" << prefix
+         << f->message_type()->name() << "Wrapped> " << fname << ";\n";
     } else {
       std::string elemType = "void";
       switch (f->cpp_type()) {
@@ -121,14 +555,18 @@ static void emit_field_member(const FieldDescriptor *f, std::ostream &os) {
       default:
         break;
       }
-      os << "    sugar::RepeatedProxy<" << elemType << "> " << fname << ";\n";
+      os << indent << "sugar::RepeatedTag<" << prefix << elemType << "> "
+         << fname << ";\n";
     }
     return;
   }
 
   if (f->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
-    const auto *md = f->message_type();
-    os << "    " << md->name() << "Wrapped " << fname << ";\n";
+    const std::string fields = f->message_type()->name() + "Fields";
+    const std::string cls = cpp_class_name(f->containing_type());
+    os << indent << fields << "<sugar::SubmessageAccess<Access, &" << cls
+       << "::mutable_" << accessor_name(f) << ", " << fields << ", &" << cls
+       << "::" << accessor_name(f) << ">> " << fname << ";\n";
     return;
   }
 
@@ -164,99 +602,1361 @@ static void emit_field_member(const FieldDescriptor *f, std::ostream &os) {
   default:
     break;
   }
-  os << "    sugar::FieldProxy<" << fieldType << "> " << fname << ";\n";
+  os << indent << "sugar::FieldTag<" << prefix << fieldType << "> " << fname
+     << ";\n";
 }
 
+// Whether member function bodies go into the wrapper struct (single
+// header) or are only declared there and emitted into the .sugar.cc.
+enum class Bodies { kInline, kOutOfLine };
+
 static void emit_ctor_init(const Descriptor *d, std::ostream &os) {
-  // 1) Normal ctor (Foo& m)
-  os << "    explicit " << d->name() << "Wrapped(" << d->name() << "& m)\n";
-  os << "        : _msg(m)";
+  const std::string wrapped = d->name() + "Wrapped";
+  const std::string cls = cpp_class_name(d);
+  os << "    explicit " << wrapped << "(" << cls
+     << "& m) noexcept : _msg(&m) {}\n";
+  os << "    explicit " << wrapped << "(google::protobuf::"
+     << (is_lite(d->file()) ? "MessageLite" : "Message") << "& m)\n"
+     << "        : " << wrapped << "(*google::protobuf::internal::DownCast<"
+     << cls << "*>(&m)) {}\n";
+}
+
+// Swap dispatches to InternalSwap when both messages share an arena, so a
+// subtree moves without a copy: `batch.profile.swap(incoming.profile)`.
+static void emit_swap(const Descriptor *d, std::ostream &os,
+                      const std::string &self) {
+  os << "    void swap(" << d->name() << "Wrapped other) const {\n"
+     << "        " << self << "Swap(other._msg);\n"
+     << "    }\n";
+}
+
+static void emit_oneofs(const Descriptor *d, const std::string &indent,
+                        std::ostream &os) {
+  for (int i = 0; i < d->oneof_decl_count(); ++i) {
+    const auto *o = d->oneof_decl(i);
+    if (is_lite(d->file())) {
+      std::string name = o->name();
+      for (auto &c : name)
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+      const std::string cls = cpp_class_name(d);
+      os << indent << "sugar::lite::OneofTag<Access, &" << cls << "::" << name
+         << "_case, &" << cls << "::clear_" << name << ", " << d->name()
+         << "Wrapped> " << o->name() << ";\n";
+    } else {
+      os << indent << "sugar::OneofTag<Access, " << i << "> " << o->name()
+         << ";\n";
+    }
+  }
+}
+
+static void emit_field_tags(const Descriptor *d, const std::string &indent,
+                            std::ostream &os) {
+  for (int i = 0; i < d->field_count(); ++i)
+    emit_field_member(d->field(i), indent, os);
+  emit_oneofs(d, indent, os);
+}
+
+static void emit_hash_decls(const Descriptor *d, std::ostream &os) {
+  const std::string wrapped = d->name() + "Wrapped";
+  const std::string cls = cpp_class_name(d);
+  os << "    [[nodiscard]] std::size_t hash_value() const noexcept {\n"
+     << "        return hash_of(*_msg);\n"
+     << "    }\n";
+  os << "    [[nodiscard]] static std::size_t hash_of(const " << cls
+     << "& m) noexcept;\n";
+  os << "    [[nodiscard]] static bool equal(const " << cls << "& a, const "
+     << cls << "& b) noexcept;\n";
+  os << "    friend bool operator==(const " << wrapped << "& a, const "
+     << wrapped << "& b) noexcept {\n"
+     << "        return equal(*a._msg, *b._msg);\n"
+     << "    }\n";
+  os << "    template <typename H>\n"
+     << "    friend H AbslHashValue(H h, const " << wrapped << "& w) {\n"
+     << "        return H::combine(std::move(h), w.hash_value());\n"
+     << "    }\n";
+}
+
+// Hasher / comparator argument passed to the sugar:: range helpers for
+// repeated and map fields; empty for scalar elements.
+static std::string element_functor(const FieldDescriptor *f,
+                                   const char *kind) {
+  const FieldDescriptor *elem = f;
+  if (f->is_map())
+    elem = f->message_type()->FindFieldByName("value");
+  if (elem->cpp_type() != FieldDescriptor::CPPTYPE_MESSAGE)
+    return "";
+  return std::string(", sugar::Message") + kind + "<" +
+         elem->message_type()->name() + "Wrapped>{}";
+}
+
+// Inequality of two singular scalars of f; floating point goes through
+// sugar::scalar_equal so it agrees with hash_scalar on NaN and -0.0.
+static std::string scalar_differs(const std::string &a, const std::string &b,
+                                  const FieldDescriptor *f) {
+  if (f->cpp_type() == FieldDescriptor::CPPTYPE_FLOAT ||
+      f->cpp_type() == FieldDescriptor::CPPTYPE_DOUBLE)
+    return "!sugar::scalar_equal(" + a + ", " + b + ")";
+  return a + " != " + b;
+}
+
+static void emit_hash_defs(const Descriptor *d, const char *linkage,
+                           std::ostream &os) {
+  const std::string wrapped = d->name() + "Wrapped";
+  const std::string cls = cpp_class_name(d);
+
+  os << linkage << "std::size_t " << wrapped << "::hash_of(const " << cls
+     << "& m) noexcept {\n";
+  os << "    std::size_t h = 0;\n";
   for (int i = 0; i < d->field_count(); ++i) {
     const auto *f = d->field(i);
-    const std::string &fname = f->name();
+    const std::string acc = accessor_name(f);
     if (f->is_map())
-      os << ",\n          " << fname
-         << "(_msg, *_msg.GetDescriptor()->FindFieldByName(\"" << fname
-         << "\"))";
+      os << "    sugar::hash_combine(h, sugar::hash_map(m." << acc << "()"
+         << element_functor(f, "Hash") << "));\n";
     else if (f->is_repeated())
-      os << ",\n          " << fname
-         << "(_msg, *_msg.GetDescriptor()->FindFieldByName(\"" << fname
-         << "\"))";
+      os << "    sugar::hash_combine(h, sugar::hash_range(m." << acc << "()"
+         << element_functor(f, "Hash") << "));\n";
     else if (f->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE)
-      os << ",\n          " << fname << "(*_msg.mutable_" << fname << "())";
+      os << "    if (m.has_" << acc << "())\n"
+         << "        sugar::hash_combine(h, " << f->message_type()->name()
+         << "Wrapped::hash_of(m." << acc << "()));\n";
+    else if (f->has_presence())
+      os << "    if (m.has_" << acc << "()) {\n"
+         << "        sugar::hash_combine(h, " << f->number() << ");\n"
+         << "        sugar::hash_combine(h, sugar::hash_scalar(m." << acc
+         << "()));\n"
+         << "    }\n";
     else
-      os << ",\n          " << fname
-         << "(_msg, *_msg.GetDescriptor()->FindFieldByName(\"" << fname
-         << "\"))";
+      os << "    sugar::hash_combine(h, sugar::hash_scalar(m." << acc
+         << "()));\n";
   }
-  for (int i = 0; i < d->oneof_decl_count(); ++i) {
-    const auto *o = d->oneof_decl(i);
-    os << ",\n          " << o->name()
-       << "(_msg, *_msg.GetDescriptor()->FindOneofByName(\"" << o->name()
-       << "\"))";
+  os << "    return h;\n";
+  os << "}\n";
+
+  os << linkage << "bool " << wrapped << "::equal(const " << cls
+     << "& a, const " << cls << "& b) noexcept {\n";
+  for (int i = 0; i < d->field_count(); ++i) {
+    const auto *f = d->field(i);
+    const std::string acc = accessor_name(f);
+    if (f->is_map())
+      os << "    if (!sugar::map_equal(a." << acc << "(), b." << acc << "()"
+         << element_functor(f, "Equal") << "))\n"
+         << "        return false;\n";
+    else if (f->is_repeated())
+      os << "    if (!sugar::range_equal(a." << acc << "(), b." << acc << "()"
+         << element_functor(f, "Equal") << "))\n"
+         << "        return false;\n";
+    else if (f->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE)
+      os << "    if (a.has_" << acc << "() != b.has_" << acc << "() ||\n"
+         << "        (a.has_" << acc << "() && !" << f->message_type()->name()
+         << "Wrapped::equal(a." << acc << "(), b." << acc << "())))\n"
+         << "        return false;\n";
+    else if (f->has_presence())
+      os << "    if (a.has_" << acc << "() != b.has_" << acc << "() ||\n"
+         << "        (a.has_" << acc << "() && "
+         << scalar_differs("a." + acc + "()", "b." + acc + "()", f)
+         << "))\n"
+         << "        return false;\n";
+    else
+      os << "    if ("
+         << scalar_differs("a." + acc + "()", "b." + acc + "()", f)
+         << ")\n"
+         << "        return false;\n";
   }
-  os << " {}\n";
+  os << "    return true;\n";
+  os << "}\n\n";
+}
 
-  os << "    explicit " << d->name()
-     << "Wrapped(google::protobuf::Message& m)\n"
-     << "        : " << d->name()
-     << "Wrapped(*google::protobuf::internal::DownCast<" << d->name()
-     << "*>(&m)) {}\n";
+static void emit_mask_decls(const Descriptor *d, std::ostream &os) {
+  const std::string cls = cpp_class_name(d);
+  os << "    // The fields of src selected by mask, see sugar_mask.h.\n"
+     << "    static void merge_masked(const " << cls << "& src, " << cls
+     << "& dst,\n"
+     << "                             const sugar::CompiledMask& mask);\n"
+     << "    static void copy_masked(const " << cls << "& src, " << cls
+     << "& dst,\n"
+     << "                            const sugar::CompiledMask& mask) {\n"
+     << "        dst.Clear();\n"
+     << "        merge_masked(src, dst, mask);\n"
+     << "    }\n";
 }
 
-static void emit_oneofs(const Descriptor *d, std::ostream &os) {
-  for (int i = 0; i < d->oneof_decl_count(); ++i) {
-    const auto *o = d->oneof_decl(i);
-    os << "    sugar::OneofProxy " << o->name() << ";\n";
+// One case per field of the switch over selected field indices, with
+// FieldMaskUtil::MergeMessageTo's default semantics.
+static void emit_mask_defs(const Descriptor *d, const char *linkage,
+                           std::ostream &os) {
+  const std::string cls = cpp_class_name(d);
+  os << linkage << "void " << d->name() << "Wrapped::merge_masked(const "
+     << cls << "& src, " << cls << "& dst,\n"
+     << "                             const sugar::CompiledMask& mask) {\n";
+  os << "    mask.check(" << cls << "::descriptor());\n";
+  if (d->field_count() == 0) {
+    os << "    (void)src;\n"
+       << "    (void)dst;\n"
+       << "}\n\n";
+    return;
   }
+  os << "    mask.for_each([&](int index, const sugar::CompiledMask* sub) {\n"
+     << "        switch (index) {\n";
+  bool any_sub = false;
+  for (int i = 0; i < d->field_count(); ++i) {
+    const auto *f = d->field(i);
+    const std::string acc = accessor_name(f);
+    if (f->is_map()) {
+      // Later entries win, as when reflection appends map entries.
+      os << "        case " << i << ": {\n"
+         << "            auto& m = *dst.mutable_" << acc << "();\n"
+         << "            for (const auto& kv : src." << acc << "())\n"
+         << "                m[kv.first] = kv.second;\n"
+         << "            break;\n"
+         << "        }\n";
+      continue;
+    }
+    os << "        case " << i << ":\n";
+    if (f->is_repeated()) {
+      os << "            dst.mutable_" << acc << "()->MergeFrom(src." << acc
+         << "());\n";
+    } else if (f->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
+      any_sub = true;
+      os << "            if (sub)\n"
+         << "                " << f->message_type()->name()
+         << "Wrapped::merge_masked(src." << acc << "(), *dst.mutable_" << acc
+         << "(), *sub);\n"
+         << "            else if (src.has_" << acc << "())\n"
+         << "                dst.mutable_" << acc << "()->MergeFrom(src." << acc
+         << "());\n";
+    } else if (f->has_presence()) {
+      os << "            if (src.has_" << acc << "())\n"
+         << "                dst.set_" << acc << "(src." << acc << "());\n"
+         << "            else\n"
+         << "                dst.clear_" << acc << "();\n";
+    } else {
+      os << "            dst.set_" << acc << "(src." << acc << "());\n";
+    }
+    os << "            break;\n";
+  }
+  os << "        }\n";
+  if (!any_sub)
+    os << "        (void)sub;\n";
+  os << "    });\n"
+     << "}\n\n";
+}
+
+static void emit_hash_specialization(const Descriptor *d,
+                                     const std::string &ns, std::ostream &os) {
+  const std::string qualified =
+      (ns.empty() ? "" : ns + "::") + d->name() + "Wrapped";
+  os << "template <> struct std::hash<" << qualified << "> {\n"
+     << "    std::size_t operator()(const " << qualified
+     << "& w) const noexcept {\n"
+     << "        return w.hash_value();\n"
+     << "    }\n"
+     << "};\n";
+}
+
+static void emit_json_decls(const Descriptor *d, Bodies bodies,
+                            std::ostream &os) {
+  const std::string cls = cpp_class_name(d);
+  os << "    static void write_json(const " << cls
+     << "& m, sugar::json::Writer& w);\n";
+  os << "    static void read_json(" << cls
+     << "& m, sugar::json::Reader& r);\n";
+  if (bodies == Bodies::kOutOfLine) {
+    os << "    [[nodiscard]] std::string to_json() const;\n"
+       << "    void to_json(std::string& out) const;\n"
+       << "    void from_json(std::string_view json,\n"
+       << "                   bool ignore_unknown_fields = false);\n";
+    return;
+  }
+  os << "    [[nodiscard]] std::string to_json() const {\n"
+     << "        std::string out;\n"
+     << "        to_json(out);\n"
+     << "        return out;\n"
+     << "    }\n";
+  os << "    void to_json(std::string& out) const {\n"
+     << "        out.clear();\n"
+     << "        sugar::json::Writer w(out);\n"
+     << "        write_json(*_msg, w);\n"
+     << "    }\n";
+  os << "    void from_json(std::string_view json,\n"
+     << "                   bool ignore_unknown_fields = false) {\n"
+     << "        sugar::json::Reader r(json, ignore_unknown_fields);\n"
+     << "        read_json(*_msg, r);\n"
+     << "        r.finish();\n"
+     << "    }\n";
+}
+
+static void emit_json_member_defs(const Descriptor *d, std::ostream &os) {
+  const std::string wrapped = d->name() + "Wrapped";
+  os << "std::string " << wrapped << "::to_json() const {\n"
+     << "    std::string out;\n"
+     << "    to_json(out);\n"
+     << "    return out;\n"
+     << "}\n";
+  os << "void " << wrapped << "::to_json(std::string& out) const {\n"
+     << "    out.clear();\n"
+     << "    sugar::json::Writer w(out);\n"
+     << "    write_json(*_msg, w);\n"
+     << "}\n";
+  os << "void " << wrapped << "::from_json(std::string_view json,\n"
+     << "                   bool ignore_unknown_fields) {\n"
+     << "    sugar::json::Reader r(json, ignore_unknown_fields);\n"
+     << "    read_json(*_msg, r);\n"
+     << "    r.finish();\n"
+     << "}\n";
 }
 
-static void emit_message_wrapper(const Descriptor *d, std::ostream &os) {
+// Writer/Reader method handling a field's (element) type; empty for
+// messages, which recurse into the nested wrapper instead.
+static std::string json_method(const FieldDescriptor *f) {
+  switch (f->type()) {
+  case FieldDescriptor::TYPE_INT32:
+  case FieldDescriptor::TYPE_SINT32:
+  case FieldDescriptor::TYPE_SFIXED32:
+    return "int32";
+  case FieldDescriptor::TYPE_INT64:
+  case FieldDescriptor::TYPE_SINT64:
+  case FieldDescriptor::TYPE_SFIXED64:
+    return "int64";
+  case FieldDescriptor::TYPE_UINT32:
+  case FieldDescriptor::TYPE_FIXED32:
+    return "uint32";
+  case FieldDescriptor::TYPE_UINT64:
+  case FieldDescriptor::TYPE_FIXED64:
+    return "uint64";
+  case FieldDescriptor::TYPE_FLOAT:
+    return "float32";
+  case FieldDescriptor::TYPE_DOUBLE:
+    return "float64";
+  case FieldDescriptor::TYPE_BOOL:
+    return "boolean";
+  case FieldDescriptor::TYPE_STRING:
+    return "string";
+  case FieldDescriptor::TYPE_BYTES:
+    return "bytes";
+  case FieldDescriptor::TYPE_ENUM:
+    return "enumeration";
+  default:
+    return "";
+  }
+}
+
+static std::string json_write_stmt(const FieldDescriptor *f,
+                                   const std::string &v) {
+  if (f->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE)
+    return f->message_type()->name() + "Wrapped::write_json(" + v + ", w);";
+  if (f->cpp_type() == FieldDescriptor::CPPTYPE_ENUM)
+    return "w.enumeration(static_cast<int>(" + v + "), " +
+           cpp_enum_name(f->enum_type()) + "_Name(" + v + "));";
+  return "w." + json_method(f) + "(" + v + ");";
+}
+
+// Expression reading one scalar or enum value of f's (element) type.
+static std::string json_read_expr(const FieldDescriptor *f) {
+  if (f->cpp_type() == FieldDescriptor::CPPTYPE_ENUM)
+    return "r.enumeration(&" + cpp_enum_name(f->enum_type()) + "_Parse)";
+  return "r." + json_method(f) + "()";
+}
+
+// Reads one value of f's (element) type into the lvalue target.
+static std::string json_read_stmt(const FieldDescriptor *f,
+                                  const std::string &target) {
+  if (f->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE)
+    return f->message_type()->name() + "Wrapped::read_json(" + target +
+           ", r);";
+  if (f->cpp_type() == FieldDescriptor::CPPTYPE_STRING)
+    return "r." + json_method(f) + "(" + target + ");";
+  return target + " = " + json_read_expr(f) + ";";
+}
+
+static std::string json_key_literal(const std::string &name) {
+  return "\"\\\"" + name + "\\\":\"";
+}
+
+static std::string map_key_type(const FieldDescriptor *kf) {
+  switch (kf->cpp_type()) {
+  case FieldDescriptor::CPPTYPE_STRING:
+    return "std::string";
+  case FieldDescriptor::CPPTYPE_INT32:
+    return "int32_t";
+  case FieldDescriptor::CPPTYPE_INT64:
+    return "int64_t";
+  case FieldDescriptor::CPPTYPE_UINT32:
+    return "uint32_t";
+  case FieldDescriptor::CPPTYPE_UINT64:
+    return "uint64_t";
+  default:
+    return "bool";
+  }
+}
+
+static void emit_json_write_def(const Descriptor *d, const char *linkage,
+                                std::ostream &os) {
+  os << linkage << "void " << d->name() << "Wrapped::write_json(const "
+     << cpp_class_name(d) << "& m, sugar::json::Writer& w) {\n";
+  os << "    w.begin_object();\n";
+  for (int i = 0; i < d->field_count(); ++i) {
+    const auto *f = d->field(i);
+    const std::string acc = accessor_name(f);
+    const std::string key = json_key_literal(f->json_name());
+    if (f->is_map()) {
+      const auto *vf = f->message_type()->FindFieldByName("value");
+      os << "    if (!m." << acc << "().empty()) {\n"
+         << "        w.key(" << key << ");\n"
+         << "        w.begin_object();\n"
+         << "        for (const auto& kv : m." << acc << "()) {\n"
+         << "            w.map_key(kv.first);\n"
+         << "            " << json_write_stmt(vf, "kv.second") << "\n"
+         << "        }\n"
+         << "        w.end_object();\n"
+         << "    }\n";
+    } else if (f->is_repeated()) {
+      os << "    if (m." << acc << "_size() > 0) {\n"
+         << "        w.key(" << key << ");\n"
+         << "        w.begin_array();\n"
+         << "        for (const auto& v : m." << acc << "()) {\n"
+         << "            w.element();\n"
+         << "            " << json_write_stmt(f, "v") << "\n"
+         << "        }\n"
+         << "        w.end_array();\n"
+         << "    }\n";
+    } else {
+      std::string cond;
+      if (f->has_presence())
+        cond = "m.has_" + acc + "()";
+      else if (f->cpp_type() == FieldDescriptor::CPPTYPE_STRING)
+        cond = "!m." + acc + "().empty()";
+      else if (f->cpp_type() == FieldDescriptor::CPPTYPE_BOOL)
+        cond = "m." + acc + "()";
+      else if (f->cpp_type() == FieldDescriptor::CPPTYPE_FLOAT ||
+               f->cpp_type() == FieldDescriptor::CPPTYPE_DOUBLE)
+        // -0.0 is not the default; protobuf serializes it too.
+        cond = "m." + acc + "() != 0 || std::signbit(m." + acc + "())";
+      else
+        cond = "m." + acc + "() != 0";
+      os << "    if (" << cond << ") {\n"
+         << "        w.key(" << key << ");\n"
+         << "        " << json_write_stmt(f, "m." + acc + "()") << "\n"
+         << "    }\n";
+    }
+  }
+  os << "    w.end_object();\n";
+  os << "}\n";
+}
+
+static void emit_json_read_def(const Descriptor *d, const char *linkage,
+                               std::ostream &os) {
+  os << linkage << "void " << d->name() << "Wrapped::read_json("
+     << cpp_class_name(d) << "& m, sugar::json::Reader& r) {\n";
+  os << "    r.begin_object();\n";
+  os << "    std::string_view key;\n";
+  os << "    while (r.next_key(key)) {\n";
+
+  // Both the JSON name and the original field name are accepted; bucket
+  // them by length so each key costs one switch and a few compares.
+  std::map<std::size_t, std::vector<std::pair<std::string, int>>> by_len;
+  for (int i = 0; i < d->field_count(); ++i) {
+    const auto *f = d->field(i);
+    by_len[f->json_name().size()].emplace_back(f->json_name(), f->number());
+    if (f->name() != f->json_name())
+      by_len[f->name().size()].emplace_back(f->name(), f->number());
+  }
+  os << "        int number = 0;\n";
+  os << "        switch (key.size()) {\n";
+  for (const auto &[len, names] : by_len) {
+    os << "        case " << len << ":\n";
+    for (std::size_t i = 0; i < names.size(); ++i)
+      os << "            " << (i ? "else if" : "if") << " (key == \""
+         << names[i].first << "\")\n"
+         << "                number = " << names[i].second << ";\n";
+    os << "            break;\n";
+  }
+  os << "        }\n";
+
+  os << "        switch (number) {\n";
+  for (int i = 0; i < d->field_count(); ++i) {
+    const auto *f = d->field(i);
+    const std::string acc = accessor_name(f);
+    os << "        case " << f->number() << ": {\n";
+    os << "            if (r.null()) {\n"
+       << "                m.clear_" << acc << "();\n"
+       << "                break;\n"
+       << "            }\n";
+    if (f->is_map()) {
+      const auto *kf = f->message_type()->FindFieldByName("key");
+      const auto *vf = f->message_type()->FindFieldByName("value");
+      os << "            r.begin_object();\n"
+         << "            std::string_view k;\n"
+         << "            while (r.next_key(k)) {\n"
+         << "                auto& v = (*m.mutable_" << acc
+         << "())[r.map_key_at_last<" << map_key_type(kf)
+         << ">(k)];\n"
+         << "                " << json_read_stmt(vf, "v") << "\n"
+         << "            }\n";
+    } else if (f->is_repeated()) {
+      os << "            r.begin_array();\n"
+         << "            while (r.next_element()) {\n";
+      if (f->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE ||
+          f->cpp_type() == FieldDescriptor::CPPTYPE_STRING) {
+        os << "                " << json_read_stmt(f, "*m.add_" + acc + "()")
+           << "\n";
+      } else {
+        os << "                m.add_" << acc << "(" << json_read_expr(f)
+           << ");\n";
+      }
+      os << "            }\n";
+    } else if (f->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE ||
+               f->cpp_type() == FieldDescriptor::CPPTYPE_STRING) {
+      os << "            " << json_read_stmt(f, "*m.mutable_" + acc + "()")
+         << "\n";
+    } else {
+      os << "            m.set_" << acc << "(" << json_read_expr(f)
+         << ");\n";
+    }
+    os << "            break;\n"
+       << "        }\n";
+  }
+  os << "        default:\n"
+     << "            r.unknown_field(key);\n"
+     << "        }\n";
+  os << "    }\n";
+  os << "}\n\n";
+}
+
+// Visits d and its nested messages (map entries excluded), nested first.
+template <typename Fn>
+static void for_each_message(const Descriptor *d, Fn fn) {
   for (int i = 0; i < d->nested_type_count(); ++i) {
     const auto *nested = d->nested_type(i);
     if (nested->options().map_entry())
       continue;
-    os << "struct " << nested->name() << "Wrapped;\n";
+    for_each_message(nested, fn);
   }
+  fn(d);
+}
 
-  os << "struct " << d->name() << "Wrapped {\n";
-  os << "    " << d->name() << "& _msg;\n";
+// merge_masked needs the full descriptor API, so lite files never get it.
+static bool emits_mask(const Descriptor *d, const EmitFeatures &features) {
+  return features.mask && !is_lite(d->file());
+}
 
-  for (int i = 0; i < d->field_count(); ++i)
-    emit_field_member(d->field(i), os);
+static void emit_wrapper_struct(const Descriptor *d, Bodies bodies,
+                                const EmitFeatures &features,
+                                std::ostream &os) {
+  const std::string wrapped = d->name() + "Wrapped";
+  os << "struct " << wrapped << " {\n";
+  os << "    using Access = sugar::RootAccess<" << wrapped << ", "
+     << cpp_class_name(d) << ">;\n";
+  if (is_lite(d->file()))
+    emit_lite_field_table(d, os);
+  os << "    union {\n";
+  os << "        " << cpp_class_name(d) << "* _msg;\n";
+  emit_field_tags(d, "        ", os);
+  os << "    };\n\n";
+  emit_name_table(d, os);
+  emit_wire_table(d, os);
+  emit_field_list(d, os);
 
-  emit_oneofs(d, os);
   emit_ctor_init(d, os);
+  emit_swap(d, os, "_msg->");
+  emit_hash_decls(d, os);
+  if (emits_mask(d, features))
+    emit_mask_decls(d, os);
+  if (features.json)
+    emit_json_decls(d, bodies, os);
+  emit_name_access(os);
+  os << "};\n\n";
+}
+
+// Tags of d for use as a singular submessage field of another wrapper:
+// `u.profile.city` goes through ProfileFields<...> without materialising a
+// ProfileWrapped. Converts to the full wrapper when one is needed.
+static void emit_fields_union(const Descriptor *d, std::ostream &os) {
+  const std::string fields = d->name() + "Fields";
+  const std::string wrapped = d->name() + "Wrapped";
+  os << "template <typename Access> union " << fields << " {\n";
+  emit_field_tags(d, "    ", os);
+  os << "\n    operator " << wrapped << "() const {\n"
+     << "        return " << wrapped << "(Access::message(this));\n"
+     << "    }\n";
+  emit_swap(d, os, "Access::message(this).");
+  os << "\n";
+  os << "private:\n"
+     << "    " << fields << "(const " << fields << "&) = default;\n"
+     << "    friend typename Access::parent::owner;\n";
+  os << "};\n\n";
+}
+
+// XBuilder: write-only tags over a sugar::WireWriter, for producers that
+// only build a message to serialize it. Groups get no member.
+static void emit_builder_struct(const Descriptor *d, std::ostream &os) {
+  const std::string builder = d->name() + "Builder";
+  os << "struct " << builder << " {\n";
+  os << "    union {\n";
+  os << "        sugar::WireWriter* _out;\n";
+  for (int i = 0; i < d->field_count(); ++i) {
+    const auto *f = d->field(i);
+    const std::string number = std::to_string(f->number());
+    const std::string kind = std::string("sugar::WireKind::") + wire_kind(f);
+    os << "        ";
+    if (f->type() == FieldDescriptor::TYPE_GROUP) {
+      os << "// " << f->name() << ": groups cannot be built\n";
+      continue;
+    }
+    if (f->is_map()) {
+      const auto *vf = f->message_type()->map_value();
+      os << "sugar::BuilderMap<" << number << ", sugar::WireKind::"
+         << wire_kind(f->message_type()->map_key()) << ", sugar::WireKind::"
+         << wire_kind(vf);
+      if (vf->type() == FieldDescriptor::TYPE_MESSAGE)
+        os << ", " << vf->message_type()->name() << "Builder";
+      os << ">";
+    } else if (f->type() == FieldDescriptor::TYPE_MESSAGE) {
+      os << (f->is_repeated() ? "sugar::BuilderRepeatedMessage<"
+                              : "sugar::BuilderMessage<")
+         << number << ", " << f->message_type()->name() << "Builder>";
+    } else if (f->is_repeated()) {
+      os << "sugar::BuilderRepeated<" << number << ", " << kind << ", "
+         << (f->is_packed() ? "true" : "false") << ">";
+    } else {
+      os << "sugar::BuilderField<" << number << ", " << kind;
+      if (f->has_presence())
+        os << ", sugar::Presence::kExplicit";
+      os << ">";
+    }
+    os << " " << f->name() << ";\n";
+  }
+  os << "    };\n\n";
+  os << "    explicit " << builder
+     << "(sugar::WireWriter& out) noexcept : _out(&out) {}\n";
+  os << "};\n\n";
+}
+
+// ---- Plain structs ---------------------------------------------------------
+//
+// XPlain: an aggregate copy of the message's values (see sugar_plain.h).
+// Only its serialization and conversion members are emitted out of the
+// struct, after every struct is complete, so repeated fields may name
+// messages defined later.
+
+static bool is_group(const FieldDescriptor *f) {
+  return f->type() == FieldDescriptor::TYPE_GROUP;
+}
+
+// Type of one value of f in an XPlain: the element type of a repeated
+// field, enums as int.
+static std::string plain_value_type(const FieldDescriptor *f) {
+  switch (f->cpp_type()) {
+  case FieldDescriptor::CPPTYPE_MESSAGE:
+    return f->message_type()->name() + "Plain";
+  case FieldDescriptor::CPPTYPE_STRING:
+    return "std::string";
+  default:
+    return repeated_scalar_type(f);
+  }
+}
+
+static std::string plain_member_type(const FieldDescriptor *f) {
+  if (f->is_map())
+    return "std::map<" + plain_value_type(f->message_type()->map_key()) +
+           ", " + plain_value_type(f->message_type()->map_value()) + ">";
+  if (f->is_repeated())
+    return "std::vector<" + plain_value_type(f) + ">";
+  if (f->has_presence())
+    return "std::optional<" + plain_value_type(f) + ">";
+  return plain_value_type(f);
+}
+
+// protoc's name for f's case of its oneof, e.g. kEmail.
+static std::string oneof_case_name(const FieldDescriptor *f) {
+  std::string name = f->camelcase_name();
+  name[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(name[0])));
+  return "k" + name;
+}
+
+static std::string oneof_accessor(const google::protobuf::OneofDescriptor *o) {
+  std::string name = o->name();
+  for (auto &c : name)
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  return name;
+}
+
+// Fields an XPlain has a member or variant alternative for.
+static std::vector<const FieldDescriptor *> plain_fields(const Descriptor *d) {
+  std::vector<const FieldDescriptor *> out;
+  for (int i = 0; i < d->field_count(); ++i)
+    if (!is_group(d->field(i)))
+      out.push_back(d->field(i));
+  return out;
+}
+
+// Index of f's alternative in its oneof's variant (after std::monostate).
+static int oneof_alternative(const FieldDescriptor *f) {
+  const auto *o = f->real_containing_oneof();
+  int i = 1;
+  for (int k = 0; k < o->field_count(); ++k) {
+    if (o->field(k) == f)
+      return i;
+    if (!is_group(o->field(k)))
+      ++i;
+  }
+  return i;
+}
+
+static std::string wire_kind_arg(const FieldDescriptor *f) {
+  return std::string("sugar::WireKind::") + wire_kind(f);
+}
+
+static void emit_plain_struct(const Descriptor *d, std::ostream &os) {
+  const std::string plain = d->name() + "Plain";
+  const std::string cls = cpp_class_name(d);
+  os << "struct " << plain << " {\n";
+  std::vector<const google::protobuf::OneofDescriptor *> oneofs;
+  for (int i = 0; i < d->field_count(); ++i) {
+    const auto *f = d->field(i);
+    if (is_group(f)) {
+      os << "    // " << f->name() << ": groups have no plain field\n";
+      continue;
+    }
+    if (const auto *o = f->real_containing_oneof()) {
+      if (std::find(oneofs.begin(), oneofs.end(), o) != oneofs.end())
+        continue;
+      oneofs.push_back(o);
+      os << "    std::variant<std::monostate";
+      for (int k = 0; k < o->field_count(); ++k)
+        if (!is_group(o->field(k)))
+          os << ", " << plain_value_type(o->field(k));
+      os << "> " << o->name() << ";\n";
+      continue;
+    }
+    const std::string type = plain_member_type(f);
+    const bool zeroed = !f->is_repeated() && !f->has_presence() &&
+                        f->cpp_type() != FieldDescriptor::CPPTYPE_STRING;
+    os << "    " << type << " " << f->name() << (zeroed ? "{}" : "") << ";\n";
+  }
+  if (!oneofs.empty())
+    os << "\n";
+  for (const auto *o : oneofs)
+    for (int k = 0; k < o->field_count(); ++k)
+      if (!is_group(o->field(k)))
+        os << "    static constexpr std::size_t "
+           << oneof_case_name(o->field(k)) << " = "
+           << oneof_alternative(o->field(k)) << ";\n";
+  os << "\n";
+  os << "    [[nodiscard]] static " << plain << " from_proto(const " << cls
+     << "& m);\n";
+  os << "    void to_proto(" << cls << "& m) const;\n";
+  os << "    [[nodiscard]] " << cls << " to_proto() const {\n"
+     << "        " << cls << " m;\n"
+     << "        to_proto(m);\n"
+     << "        return m;\n"
+     << "    }\n";
+  os << "\n";
+  os << "    [[nodiscard]] std::size_t byte_size() const;\n";
+  os << "    void write(sugar::WireWriter& out) const;\n";
+  os << "    std::size_t serialize(std::span<std::byte> out) const {\n"
+     << "        sugar::WireWriter w(out);\n"
+     << "        write(w);\n"
+     << "        return w.size();\n"
+     << "    }\n";
+  os << "    [[nodiscard]] std::string serialize() const {\n"
+     << "        std::string s(byte_size(), '\\0');\n"
+     << "        serialize(std::as_writable_bytes(std::span(s.data(), "
+        "s.size())));\n"
+     << "        return s;\n"
+     << "    }\n";
+  os << "    void merge_from(std::span<const std::byte> in);\n";
+  os << "    [[nodiscard]] static " << plain
+     << " parse(std::span<const std::byte> in) {\n"
+     << "        " << plain << " p;\n"
+     << "        p.merge_from(in);\n"
+     << "        return p;\n"
+     << "    }\n";
+  os << "    [[nodiscard]] static " << plain << " parse(std::string_view in) {\n"
+     << "        return parse(std::as_bytes(std::span(in.data(), in.size())));\n"
+     << "    }\n";
+  os << "\n";
+  os << "    bool operator==(const " << plain << "&) const = default;\n";
   os << "};\n\n";
+}
+
+// The value of f in a message as stored in an XPlain.
+static std::string plain_from_value(const FieldDescriptor *f,
+                                    const std::string &expr) {
+  if (f->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE)
+    return f->message_type()->name() + "Plain::from_proto(" + expr + ")";
+  return expr;
+}
+
+// An XPlain value of f as the message's setters take it.
+static std::string plain_to_value(const FieldDescriptor *f,
+                                  const std::string &expr) {
+  if (f->cpp_type() == FieldDescriptor::CPPTYPE_ENUM)
+    return "static_cast<" + cpp_enum_name(f->enum_type()) + ">(" + expr + ")";
+  return expr;
+}
+
+static void emit_plain_from_proto(const Descriptor *d, const char *linkage,
+                                  std::ostream &os) {
+  const std::string plain = d->name() + "Plain";
+  const std::string cls = cpp_class_name(d);
+  const auto fields = plain_fields(d);
+  os << linkage << plain << " " << plain << "::from_proto(const " << cls
+     << "& m) {\n";
+  os << "    " << plain << " p;\n";
+  if (fields.empty())
+    os << "    (void)m;\n";
+  std::vector<const google::protobuf::OneofDescriptor *> oneofs;
+  for (const auto *f : fields) {
+    const std::string acc = accessor_name(f);
+    const std::string name = f->name();
+    if (const auto *o = f->real_containing_oneof()) {
+      if (std::find(oneofs.begin(), oneofs.end(), o) != oneofs.end())
+        continue;
+      oneofs.push_back(o);
+      os << "    switch (m." << oneof_accessor(o) << "_case()) {\n";
+      for (int k = 0; k < o->field_count(); ++k) {
+        const auto *of = o->field(k);
+        if (is_group(of))
+          continue;
+        os << "    case " << cls << "::" << oneof_case_name(of) << ":\n"
+           << "        p." << o->name() << ".emplace<"
+           << oneof_case_name(of) << ">("
+           << plain_from_value(of, "m." + accessor_name(of) + "()") << ");\n"
+           << "        break;\n";
+      }
+      os << "    default:\n"
+         << "        break;\n"
+         << "    }\n";
+    } else if (f->is_map()) {
+      os << "    for (const auto& kv : m." << acc << "())\n"
+         << "        p." << name << ".emplace(kv.first, "
+         << plain_from_value(f->message_type()->map_value(), "kv.second")
+         << ");\n";
+    } else if (f->is_repeated() &&
+               f->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
+      os << "    p." << name << ".reserve(m." << acc << "_size());\n"
+         << "    for (const auto& v : m." << acc << "())\n"
+         << "        p." << name << ".push_back("
+         << plain_from_value(f, "v") << ");\n";
+    } else if (f->is_repeated()) {
+      os << "    p." << name << ".assign(m." << acc << "().begin(), m." << acc
+         << "().end());\n";
+    } else if (f->has_presence()) {
+      os << "    if (m.has_" << acc << "())\n"
+         << "        p." << name << " = "
+         << plain_from_value(f, "m." + acc + "()") << ";\n";
+    } else {
+      os << "    p." << name << " = m." << acc << "();\n";
+    }
+  }
+  os << "    return p;\n";
+  os << "}\n";
+}
 
+static void emit_plain_to_proto(const Descriptor *d, const char *linkage,
+                                std::ostream &os) {
+  const std::string plain = d->name() + "Plain";
+  const std::string cls = cpp_class_name(d);
+  os << linkage << "void " << plain << "::to_proto(" << cls
+     << "& m) const {\n";
+  os << "    m.Clear();\n";
+  std::vector<const google::protobuf::OneofDescriptor *> oneofs;
+  for (const auto *f : plain_fields(d)) {
+    const std::string acc = accessor_name(f);
+    const std::string name = f->name();
+    const bool message = f->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE;
+    if (const auto *o = f->real_containing_oneof()) {
+      if (std::find(oneofs.begin(), oneofs.end(), o) != oneofs.end())
+        continue;
+      oneofs.push_back(o);
+      os << "    switch (" << o->name() << ".index()) {\n";
+      for (int k = 0; k < o->field_count(); ++k) {
+        const auto *of = o->field(k);
+        if (is_group(of))
+          continue;
+        const std::string v =
+            "std::get<" + oneof_case_name(of) + ">(" + o->name() + ")";
+        os << "    case " << oneof_case_name(of) << ":\n";
+        if (of->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE)
+          os << "        " << v << ".to_proto(*m.mutable_"
+             << accessor_name(of) << "());\n";
+        else
+          os << "        m.set_" << accessor_name(of) << "("
+             << plain_to_value(of, v) << ");\n";
+        os << "        break;\n";
+      }
+      os << "    default:\n"
+         << "        break;\n"
+         << "    }\n";
+    } else if (f->is_map()) {
+      const auto *vf = f->message_type()->map_value();
+      os << "    for (const auto& [k, v] : " << name << ")\n";
+      if (vf->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE)
+        os << "        v.to_proto((*m.mutable_" << acc << "())[k]);\n";
+      else
+        os << "        (*m.mutable_" << acc << "())[k] = "
+           << plain_to_value(vf, "v") << ";\n";
+    } else if (f->is_repeated() &&
+               (message || f->cpp_type() == FieldDescriptor::CPPTYPE_STRING)) {
+      os << "    m.mutable_" << acc << "()->Reserve(static_cast<int>(" << name
+         << ".size()));\n"
+         << "    for (const auto& v : " << name << ")\n";
+      if (message)
+        os << "        v.to_proto(*m.add_" << acc << "());\n";
+      else
+        os << "        m.add_" << acc << "(v);\n";
+    } else if (f->is_repeated()) {
+      os << "    m.mutable_" << acc << "()->Add(" << name << ".begin(), "
+         << name << ".end());\n";
+    } else if (message) {
+      os << "    if (" << name << ")\n"
+         << "        " << name << "->to_proto(*m.mutable_" << acc << "());\n";
+    } else if (f->has_presence()) {
+      os << "    if (" << name << ")\n"
+         << "        m.set_" << acc << "(" << plain_to_value(f, "*" + name)
+         << ");\n";
+    } else {
+      os << "    m.set_" << acc << "(" << plain_to_value(f, name) << ");\n";
+    }
+  }
+  os << "}\n";
+}
+
+// sugar::plain call for f with the given prefix ("size" or "write") and
+// leading arguments, e.g. "sugar::plain::write_repeated<6, ..., false>(out, tags)".
+static std::string plain_wire_call(const FieldDescriptor *f,
+                                   const std::string &op,
+                                   const std::string &args) {
+  const std::string number = std::to_string(f->number());
+  const std::string sep = args.empty() ? "" : ", ";
+  std::string call = "sugar::plain::" + op;
+  if (const auto *o = f->real_containing_oneof())
+    return call + "_oneof<" + number + ", " + wire_kind_arg(f) + ", " +
+           oneof_case_name(f) + ">(" + args + sep + o->name() + ")";
+  if (f->is_map()) {
+    const auto *kv = f->message_type();
+    return call + "_map<" + number + ", " + wire_kind_arg(kv->map_key()) +
+           ", " + wire_kind_arg(kv->map_value()) + ">(" + args + sep +
+           f->name() + ")";
+  }
+  const bool message = f->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE;
+  if (message)
+    return call + (f->is_repeated() ? "_messages<" : "_message<") + number +
+           ">(" + args + sep + f->name() + ")";
+  if (f->is_repeated())
+    return call + "_repeated<" + number + ", " + wire_kind_arg(f) + ", " +
+           (f->is_packed() ? "true" : "false") + ">(" + args + sep +
+           f->name() + ")";
+  return call + "<" + number + ", " + wire_kind_arg(f) + ">(" + args + sep +
+         f->name() + ")";
+}
+
+// Fields in number order, as the serializer writes them.
+static std::vector<const FieldDescriptor *>
+plain_fields_by_number(const Descriptor *d) {
+  auto fields = plain_fields(d);
+  std::sort(fields.begin(), fields.end(),
+            [](const FieldDescriptor *a, const FieldDescriptor *b) {
+              return a->number() < b->number();
+            });
+  return fields;
+}
+
+static void emit_plain_wire_defs(const Descriptor *d, const char *linkage,
+                                 std::ostream &os) {
+  const std::string plain = d->name() + "Plain";
+  const auto fields = plain_fields_by_number(d);
+
+  os << linkage << "std::size_t " << plain << "::byte_size() const {\n";
+  os << "    std::size_t n = 0;\n";
+  for (const auto *f : fields)
+    os << "    n += " << plain_wire_call(f, "size", "") << ";\n";
+  os << "    return n;\n";
+  os << "}\n";
+
+  os << linkage << "void " << plain
+     << "::write(sugar::WireWriter& out) const {\n";
+  if (fields.empty())
+    os << "    (void)out;\n";
+  for (const auto *f : fields)
+    os << "    " << plain_wire_call(f, "write", "out") << ";\n";
+  os << "}\n";
+
+  os << linkage << "void " << plain
+     << "::merge_from(std::span<const std::byte> in) {\n";
+  os << "    const std::byte* p = in.data();\n"
+     << "    const std::byte* const end = p + in.size();\n"
+     << "    sugar::plain::Token t;\n"
+     << "    while (sugar::plain::next(p, end, t)) {\n"
+     << "        switch (t.number) {\n";
+  for (const auto *f : fields) {
+    os << "        case " << f->number() << ":\n"
+       << "            sugar::plain::";
+    const std::string kind = wire_kind_arg(f);
+    if (const auto *o = f->real_containing_oneof())
+      os << "read_oneof<" << kind << ", " << oneof_case_name(f) << ">(t, "
+         << o->name() << ");\n";
+    else if (f->is_map())
+      os << "read_map<" << wire_kind_arg(f->message_type()->map_key())
+         << ", " << wire_kind_arg(f->message_type()->map_value()) << ">(t, "
+         << f->name() << ");\n";
+    else if (f->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE)
+      os << (f->is_repeated() ? "read_messages" : "read_message") << "(t, "
+         << f->name() << ");\n";
+    else
+      os << (f->is_repeated() ? "read_repeated<" : "read<") << kind
+         << ">(t, " << f->name() << ");\n";
+    os << "            break;\n";
+  }
+  os << "        default:\n"
+     << "            break;\n"
+     << "        }\n"
+     << "    }\n";
+  os << "}\n\n";
+}
+
+static void emit_plain_defs(const Descriptor *d, const char *linkage,
+                            std::ostream &os) {
+  emit_plain_from_proto(d, linkage, os);
+  emit_plain_to_proto(d, linkage, os);
+  emit_plain_wire_defs(d, linkage, os);
+}
+
+static void emit_message_wrapper(const Descriptor *d,
+                                 const EmitFeatures &features,
+                                 std::ostream &os) {
   for (int i = 0; i < d->nested_type_count(); ++i) {
     const auto *nested = d->nested_type(i);
     if (nested->options().map_entry())
       continue;
-    emit_message_wrapper(nested, os);
+    os << "struct " << nested->name() << "Wrapped;\n";
+  }
+
+  // Nested Fields unions are embedded by value, so they must be complete
+  // first.
+  for (int i = 0; i < d->nested_type_count(); ++i) {
+    const auto *nested = d->nested_type(i);
+    if (nested->options().map_entry())
+      continue;
+    emit_message_wrapper(nested, features, os);
+  }
+
+  emit_wrapper_struct(d, Bodies::kInline, features, os);
+  emit_fields_union(d, os);
+  if (features.builder)
+    emit_builder_struct(d, os);
+  if (features.plain)
+    emit_plain_struct(d, os);
+}
+
+// ---- Supported schemas -----------------------------------------------------
+
+// Message type held by value: a singular or oneof message field. Repeated
+// and map fields go through containers, which may name incomplete types.
+static const Descriptor *embedded_message(const FieldDescriptor *f) {
+  return f->is_repeated() ? nullptr : f->message_type();
+}
+
+// Whether following embedded message fields from `from` leads to `target`.
+static bool reaches(const Descriptor *from, const Descriptor *target,
+                    std::vector<const Descriptor *> &seen) {
+  if (from == target)
+    return true;
+  if (std::find(seen.begin(), seen.end(), from) != seen.end())
+    return false;
+  seen.push_back(from);
+  for (int i = 0; i < from->field_count(); ++i)
+    if (const auto *sub = embedded_message(from->field(i)))
+      if (reaches(sub, target, seen))
+        return true;
+  return false;
+}
+
+std::string unsupported_field(const google::protobuf::FileDescriptor *file) {
+  std::string reason;
+  for (int i = 0; i < file->message_type_count() && reason.empty(); ++i)
+    for_each_message(file->message_type(i), [&](const Descriptor *d) {
+      for (int k = 0; k < d->field_count() && reason.empty(); ++k) {
+        const auto *f = d->field(k);
+        std::vector<const Descriptor *> seen;
+        if (embedded_message(f) && reaches(embedded_message(f), d, seen))
+          reason = f->full_name() +
+                   ": recursive message fields are not supported";
+      }
+    });
+  return reason;
+}
+
+static const char *
+runtime_header(const google::protobuf::FileDescriptor *file) {
+  return is_lite(file) ? "sugar_lite.h" : "sugar_runtime.h";
+}
+
+static std::string file_stem(const google::protobuf::FileDescriptor *file) {
+  return file->name().substr(0, file->name().find_last_of('.'));
+}
+
+static void emit_namespace_open(const std::string &ns, std::ostream &os) {
+  if (!ns.empty())
+    os << "namespace " << ns << " {\n";
+}
+
+static void emit_namespace_close(const std::string &ns, std::ostream &os) {
+  if (!ns.empty())
+    os << "} // namespace " << ns << "\n";
+}
+
+// Runtime headers of the optional features, in include order.
+static void emit_feature_includes(const google::protobuf::FileDescriptor *file,
+                                  const EmitFeatures &features,
+                                  std::ostream &os) {
+  if (features.builder)
+    os << "#include \"sugar_builder.h\"\n";
+  if (features.plain)
+    os << "#include \"sugar_plain.h\"\n";
+  if (features.mask && !is_lite(file))
+    os << "#include \"sugar_mask.h\"\n";
+}
+
+// Builders and plain structs name the types of their submessage fields
+// before those are defined.
+static void emit_feature_forwards(const Descriptor *d,
+                                  const EmitFeatures &features,
+                                  std::ostream &os) {
+  if (features.builder)
+    os << "struct " << d->name() << "Builder;\n";
+  if (features.plain)
+    os << "struct " << d->name() << "Plain;\n";
+}
+
+static void emit_feature_defs(const Descriptor *d, const char *linkage,
+                              const EmitFeatures &features,
+                              std::ostream &os) {
+  emit_hash_defs(d, linkage, os);
+  if (emits_mask(d, features))
+    emit_mask_defs(d, linkage, os);
+  if (features.json) {
+    emit_json_write_def(d, linkage, os);
+    emit_json_read_def(d, linkage, os);
   }
+  if (features.plain)
+    emit_plain_defs(d, linkage, os);
 }
 
 void emit_header_for_file(const google::protobuf::FileDescriptor *file,
-                          std::ostream &os) {
+                          std::ostream &os, const EmitFeatures &features) {
   os << "#pragma once\n";
-  os << "#include \"" << file->name().substr(0, file->name().find_last_of('.'))
-     << ".pb.h\"\n";
-  os << "#include \"sugar_runtime.h\"\n\n";
+  os << "#include \"" << file_stem(file) << ".pb.h\"\n";
+  os << "#include \"" << runtime_header(file) << "\"\n";
+  if (features.json)
+    os << "#include \"sugar_json.h\"\n";
+  emit_feature_includes(file, features, os);
+  os << "\n";
 
-  if (!file->package().empty())
-    os << "namespace " << file->package() << " {\n";
+  const std::string ns = cpp_namespace(file);
+  emit_namespace_open(ns, os);
+
+  if (features.builder || features.plain) {
+    for (int i = 0; i < file->message_type_count(); ++i)
+      for_each_message(file->message_type(i), [&](const Descriptor *d) {
+        emit_feature_forwards(d, features, os);
+      });
+    os << "\n";
+  }
+
+  for (int i = 0; i < file->message_type_count(); ++i)
+    emit_message_wrapper(file->message_type(i), features, os);
 
   for (int i = 0; i < file->message_type_count(); ++i)
-    emit_message_wrapper(file->message_type(i), os);
+    for_each_message(file->message_type(i), [&](const Descriptor *d) {
+      emit_feature_defs(d, "inline ", features, os);
+    });
+
+  emit_namespace_close(ns, os);
 
-  if (!file->package().empty())
-    os << "} // namespace " << file->package() << "\n";
+  for (int i = 0; i < file->message_type_count(); ++i)
+    for_each_message(file->message_type(i), [&](const Descriptor *d) {
+      emit_hash_specialization(d, ns, os);
+    });
 }
 
 std::string
 header_filename_for_file(const google::protobuf::FileDescriptor *file) {
-  const std::string stem =
-      file->name().substr(0, file->name().find_last_of('.'));
-  return stem + ".sugar.h";
+  return file_stem(file) + ".sugar.h";
+}
+
+// ---- Split layout ----------------------------------------------------------
+
+std::string
+forward_header_filename_for_file(const google::protobuf::FileDescriptor *file) {
+  return file_stem(file) + ".sugar.fwd.h";
+}
+
+std::string header_filename_for_message(const Descriptor *d) {
+  return file_stem(d->file()) + "." + cpp_class_name(d) + ".sugar.h";
+}
+
+std::string
+source_filename_for_file(const google::protobuf::FileDescriptor *file) {
+  return file_stem(file) + ".sugar.cc";
+}
+
+// Proxy specializations over message wrappers of the same file used by d's
+// fields, e.g. "sugar::RepeatedProxy<::mypkg::UserWrapped>". They are
+// declared extern in d's header (the element type may still be incomplete
+// there) and instantiated once in the .sugar.cc, both at global scope.
+static std::vector<std::string> wrapper_instantiations(const Descriptor *d) {
+  const std::string ns = cpp_namespace(d->file());
+  const std::string scope = ns.empty() ? "::" : "::" + ns + "::";
+  std::vector<std::string> out;
+  if (is_lite(d->file()))
+    return out; // lite tags use the generated containers directly
+  for (int i = 0; i < d->field_count(); ++i) {
+    const auto *f = d->field(i);
+    std::string type;
+    if (f->is_map()) {
+      const auto *kv = f->message_type();
+      const auto *vf = kv->FindFieldByName("value");
+      if (vf->message_type() && vf->message_type()->file() == d->file())
+        type = "sugar::MapProxy<" + map_key_type(kv->FindFieldByName("key")) +
+               ", " + scope + vf->message_type()->name() + "Wrapped>";
+    } else if (f->is_repeated() && f->message_type() &&
+               f->message_type()->file() == d->file()) {
+      type = "sugar::RepeatedProxy<" + scope + f->message_type()->name() +
+             "Wrapped>";
+    }
+    if (!type.empty() && std::find(out.begin(), out.end(), type) == out.end())
+      out.push_back(std::move(type));
+  }
+  return out;
+}
+
+void emit_forward_header_for_file(const google::protobuf::FileDescriptor *file,
+                                  std::ostream &os,
+                                  const EmitFeatures &features) {
+  os << "#pragma once\n\n";
+  os << "namespace google::protobuf {\n"
+     << (is_lite(file) ? "class MessageLite;\n" : "class Message;\n")
+     << "} // namespace google::protobuf\n";
+  if (features.json)
+    os << "namespace sugar::json {\n"
+       << "class Writer;\n"
+       << "class Reader;\n"
+       << "} // namespace sugar::json\n";
+  os << "\n";
+
+  const std::string ns = cpp_namespace(file);
+  emit_namespace_open(ns, os);
+  for (int i = 0; i < file->message_type_count(); ++i)
+    for_each_message(file->message_type(i), [&](const Descriptor *d) {
+      os << "class " << cpp_class_name(d) << ";\n";
+      os << "struct " << d->name() << "Wrapped;\n";
+      emit_feature_forwards(d, features, os);
+    });
+  emit_namespace_close(ns, os);
+}
+
+void emit_message_header(const Descriptor *d, std::ostream &os,
+                         const EmitFeatures &features) {
+  const auto *file = d->file();
+  os << "#pragma once\n";
+  os << "#include \"" << forward_header_filename_for_file(file) << "\"\n";
+  os << "#include \"" << file_stem(file) << ".pb.h\"\n";
+  os << "#include \"" << runtime_header(file) << "\"\n";
+  emit_feature_includes(file, features, os);
+
+  // Singular message fields embed their XFields union by value; repeated and
+  // map fields only need the forward declaration for the wrapper, but their
+  // XPlain vectors and maps are destroyed and copied wherever the including
+  // code does so. Nested wrappers come along so including a message header
+  // keeps giving access to them.
+  std::vector<std::string> includes;
+  auto include = [&](const Descriptor *dep) {
+    std::string inc = header_filename_for_message(dep);
+    if (dep != d &&
+        std::find(includes.begin(), includes.end(), inc) == includes.end())
+      includes.push_back(std::move(inc));
+  };
+  for (int i = 0; i < d->field_count(); ++i) {
+    const auto *f = d->field(i);
+    const auto *sub = f->is_map() ? f->message_type()->map_value() : f;
+    if (sub->message_type())
+      include(sub->message_type());
+  }
+  for (int i = 0; i < d->nested_type_count(); ++i)
+    if (!d->nested_type(i)->options().map_entry())
+      include(d->nested_type(i));
+  for (const auto &inc : includes)
+    os << "#include \"" << inc << "\"\n";
+  os << "\n";
+
+  for (const auto &t : wrapper_instantiations(d))
+    os << "extern template class " << t << ";\n";
+  const std::string ns = cpp_namespace(file);
+  emit_namespace_open(ns, os);
+  emit_wrapper_struct(d, Bodies::kOutOfLine, features, os);
+  emit_fields_union(d, os);
+  if (features.builder)
+    emit_builder_struct(d, os);
+  if (features.plain)
+    emit_plain_struct(d, os);
+  emit_namespace_close(ns, os);
+  emit_hash_specialization(d, ns, os);
+}
+
+void emit_source_for_file(const google::protobuf::FileDescriptor *file,
+                          std::ostream &os, const EmitFeatures &features) {
+  std::vector<const Descriptor *> messages;
+  for (int i = 0; i < file->message_type_count(); ++i)
+    for_each_message(file->message_type(i),
+                     [&](const Descriptor *d) { messages.push_back(d); });
+
+  for (const auto *d : messages)
+    os << "#include \"" << header_filename_for_message(d) << "\"\n";
+  if (features.json)
+    os << "#include \"sugar_json.h\"\n";
+  os << "\n";
+
+  std::vector<std::string> instantiations;
+  for (const auto *d : messages)
+    for (auto &t : wrapper_instantiations(d))
+      if (std::find(instantiations.begin(), instantiations.end(), t) ==
+          instantiations.end())
+        instantiations.push_back(std::move(t));
+
+  for (const auto &t : instantiations)
+    os << "template class " << t << ";\n";
+  os << "\n";
+
+  const std::string ns = cpp_namespace(file);
+  emit_namespace_open(ns, os);
+  for (const auto *d : messages) {
+    if (features.json)
+      emit_json_member_defs(d, os);
+    emit_feature_defs(d, "", features, os);
+  }
+  emit_namespace_close(ns, os);
+}
+
+std::vector<GeneratedOutput>
+split_outputs_for_file(const google::protobuf::FileDescriptor *file,
+                       const EmitFeatures &features) {
+  std::vector<GeneratedOutput> out;
+  out.push_back({forward_header_filename_for_file(file),
+                 [file, features](std::ostream &os) {
+                   emit_forward_header_for_file(file, os, features);
+                 }});
+  for (int i = 0; i < file->message_type_count(); ++i)
+    for_each_message(file->message_type(i), [&](const Descriptor *d) {
+      out.push_back({header_filename_for_message(d),
+                     [d, features](std::ostream &os) {
+                       emit_message_header(d, os, features);
+                     }});
+    });
+  out.push_back({source_filename_for_file(file),
+                 [file, features](std::ostream &os) {
+                   emit_source_for_file(file, os, features);
+                 }});
+  return out;
 }
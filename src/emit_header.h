@@ -2,9 +2,51 @@
 
 #include <google/protobuf/descriptor.h>
 
+#include <functional>
 #include <ostream>
 #include <string>
+#include <vector>
+
+// Why the emitter cannot handle file, naming the offending field, or empty
+// if it can. A singular or oneof message field that leads back to its own
+// message through such fields only has no wrapper or XPlain member: both
+// embed those submessages by value. Repeated and map fields may recurse.
+std::string unsupported_field(const google::protobuf::FileDescriptor *);
+
+// Per-message features beyond the wrappers, hashing and field tables. Each
+// is off by default, so a generated header includes only the runtime; the
+// generator turns them on with the options of the same name. Files whose
+// messages use each other's types must be generated with the same set.
+struct EmitFeatures {
+  bool json = false;    // write_json/read_json, to_json/from_json
+  bool builder = false; // XBuilder
+  bool plain = false;   // XPlain
+  bool mask = false;    // merge_masked/copy_masked; ignored for lite files
+};
 
 void emit_header_for_file(const google::protobuf::FileDescriptor *,
-                          std::ostream &);
+                          std::ostream &, const EmitFeatures & = {});
 std::string header_filename_for_file(const google::protobuf::FileDescriptor *);
+
+// Split layout (split_headers option): a forward-declaration header, one
+// header per message with declarations only, and a .sugar.cc holding the
+// hash and JSON bodies plus explicit proxy instantiations.
+void emit_forward_header_for_file(const google::protobuf::FileDescriptor *,
+                                  std::ostream &, const EmitFeatures & = {});
+void emit_message_header(const google::protobuf::Descriptor *, std::ostream &,
+                         const EmitFeatures & = {});
+void emit_source_for_file(const google::protobuf::FileDescriptor *,
+                          std::ostream &, const EmitFeatures & = {});
+std::string
+forward_header_filename_for_file(const google::protobuf::FileDescriptor *);
+std::string header_filename_for_message(const google::protobuf::Descriptor *);
+std::string source_filename_for_file(const google::protobuf::FileDescriptor *);
+
+struct GeneratedOutput {
+  std::string filename;
+  std::function<void(std::ostream &)> emit;
+};
+
+std::vector<GeneratedOutput>
+split_outputs_for_file(const google::protobuf::FileDescriptor *,
+                       const EmitFeatures & = {});
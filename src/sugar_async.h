@@ -0,0 +1,1081 @@
+#pragma once
+
+/*
+ * sugar_async.h
+ *
+ * Copyright 2025 M.Berkay Karatas
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Coroutine record pipeline over framed files (see sugar_io.h):
+//
+//   sugar::Task<void> copy(int in, int out) {
+//     sugar::AsyncRecordWriter writer(out);
+//     for (UserWrapped u : sugar::async_records<UserWrapped>(in)) {
+//       u.score = u.score * 2;
+//       co_await writer.write(u);
+//     }
+//     co_await writer.flush();
+//   }
+//   sugar::sync_wait(copy(in, out));
+//
+// async_records() reads ahead: while the records of one block are handed
+// out, the read of the next block is already in flight. The writer fills
+// one buffer while the previous one is being written.
+//
+// I/O goes through an IoBackend: io_uring where the kernel allows it (raw
+// syscalls, no liburing needed), otherwise a worker thread doing plain
+// read()/write(). Coroutines suspended on I/O are resumed on the backend's
+// resume thread, never on the thread doing the I/O, so a resumed coroutine
+// may block on a read without stalling the I/O it waits for.
+
+#include "sugar_io.h"
+
+#include <google/protobuf/message_lite.h>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define SUGAR_HAS_IO_URING 1
+#else
+#define SUGAR_HAS_IO_URING 0
+#endif
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace sugar {
+
+// ---- Coroutine types -------------------------------------------------------
+
+// Synchronous generator: `for (auto &v : gen())`. Values are references to
+// what the coroutine yielded and stay valid until the next increment.
+template <typename T> class Generator {
+public:
+  using value_type = std::remove_cvref_t<T>;
+
+  struct promise_type {
+    value_type *value = nullptr;
+    std::exception_ptr error;
+
+    Generator get_return_object() {
+      return Generator(handle::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    std::suspend_always yield_value(value_type &v) noexcept {
+      value = std::addressof(v);
+      return {};
+    }
+    // The temporary lives until the coroutine resumes.
+    std::suspend_always yield_value(value_type &&v) noexcept {
+      value = std::addressof(v);
+      return {};
+    }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { error = std::current_exception(); }
+    void await_transform() = delete;
+  };
+
+  using handle = std::coroutine_handle<promise_type>;
+
+  class iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = Generator::value_type;
+
+    iterator() = default;
+    explicit iterator(handle h) noexcept : h_(h) {}
+
+    value_type &operator*() const noexcept { return *h_.promise().value; }
+    value_type *operator->() const noexcept { return h_.promise().value; }
+    iterator &operator++() {
+      advance(h_);
+      return *this;
+    }
+    void operator++(int) { ++*this; }
+    bool operator==(std::default_sentinel_t) const noexcept {
+      return !h_ || h_.done();
+    }
+
+  private:
+    handle h_;
+  };
+
+  Generator(Generator &&o) noexcept : h_(std::exchange(o.h_, {})) {}
+  Generator &operator=(Generator o) noexcept {
+    std::swap(h_, o.h_);
+    return *this;
+  }
+  ~Generator() {
+    if (h_)
+      h_.destroy();
+  }
+
+  iterator begin() {
+    advance(h_);
+    return iterator(h_);
+  }
+  std::default_sentinel_t end() const noexcept { return {}; }
+
+private:
+  explicit Generator(handle h) noexcept : h_(h) {}
+
+  static void advance(handle h) {
+    h.resume();
+    if (h.done() && h.promise().error)
+      std::rethrow_exception(std::exchange(h.promise().error, nullptr));
+  }
+
+  handle h_;
+};
+
+template <typename T = void> class Task;
+
+namespace detail {
+template <typename T> struct TaskResult {
+  std::optional<T> value;
+  void return_value(T v) { value.emplace(std::move(v)); }
+  T take() { return std::move(*value); }
+};
+
+template <> struct TaskResult<void> {
+  void return_void() noexcept {}
+  void take() noexcept {}
+};
+
+// Resumes whoever awaited the task (symmetric transfer, no stack growth).
+struct TaskFinal {
+  bool await_ready() const noexcept { return false; }
+  template <typename P>
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+    auto c = h.promise().continuation;
+    return c ? c : std::noop_coroutine();
+  }
+  void await_resume() const noexcept {}
+};
+} // namespace detail
+
+// Lazily started coroutine; co_await it or hand it to sync_wait().
+template <typename T> class [[nodiscard]] Task {
+public:
+  struct promise_type : detail::TaskResult<T> {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    Task get_return_object() { return Task(handle::from_promise(*this)); }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    detail::TaskFinal final_suspend() noexcept { return {}; }
+    void unhandled_exception() noexcept { error = std::current_exception(); }
+  };
+
+  using handle = std::coroutine_handle<promise_type>;
+
+  Task(Task &&o) noexcept : h_(std::exchange(o.h_, {})) {}
+  Task &operator=(Task o) noexcept {
+    std::swap(h_, o.h_);
+    return *this;
+  }
+  ~Task() {
+    if (h_)
+      h_.destroy();
+  }
+
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> c) noexcept {
+    h_.promise().continuation = c;
+    return h_;
+  }
+  T await_resume() {
+    if (h_.promise().error)
+      std::rethrow_exception(h_.promise().error);
+    return h_.promise().take();
+  }
+
+private:
+  explicit Task(handle h) noexcept : h_(h) {}
+
+  handle h_;
+};
+
+namespace detail {
+// Signals under the mutex, so the waiter cannot return (and destroy the
+// mutex) while the signalling thread still holds it.
+struct SyncSignal {
+  std::mutex mu;
+  std::condition_variable cv;
+  bool done = false;
+
+  void set() {
+    std::lock_guard lock(mu);
+    done = true;
+    cv.notify_all();
+  }
+  void wait() {
+    std::unique_lock lock(mu);
+    cv.wait(lock, [&] { return done; });
+  }
+};
+
+struct SyncRunner {
+  struct promise_type {
+    SyncSignal *signal = nullptr;
+
+    SyncRunner get_return_object() {
+      return SyncRunner{
+          std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    auto final_suspend() noexcept {
+      struct Final {
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+          h.promise().signal->set();
+        }
+        void await_resume() const noexcept {}
+      };
+      return Final{};
+    }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { std::terminate(); }
+  };
+
+  std::coroutine_handle<promise_type> h;
+};
+
+template <typename T>
+SyncRunner run_sync(Task<T> &task, std::optional<TaskResult<T>> &out,
+                    std::exception_ptr &error) {
+  try {
+    out.emplace();
+    if constexpr (std::is_void_v<T>)
+      co_await task;
+    else
+      out->return_value(co_await task);
+  } catch (...) {
+    error = std::current_exception();
+  }
+}
+} // namespace detail
+
+// Runs task to completion on this thread (and whichever threads resume it)
+// and returns its result.
+template <typename T> T sync_wait(Task<T> task) {
+  std::optional<detail::TaskResult<T>> out;
+  std::exception_ptr error;
+  detail::SyncSignal signal;
+  auto runner = detail::run_sync(task, out, error);
+  runner.h.promise().signal = &signal;
+  runner.h.resume();
+  signal.wait();
+  runner.h.destroy();
+  if (error)
+    std::rethrow_exception(error);
+  return out->take();
+}
+
+// ---- I/O backends ----------------------------------------------------------
+
+class IoBackend;
+
+// One read or write. Reads may complete short (0 at end of input); writes
+// complete in full or fail. Either block in wait() or co_await the op.
+class IoOp {
+public:
+  enum class Kind : uint8_t { kRead, kWrite };
+
+  IoOp() = default;
+  IoOp(const IoOp &) = delete;
+  IoOp &operator=(const IoOp &) = delete;
+
+  // Offset -1 uses (and advances) the file position, which also works on
+  // pipes and sockets.
+  void prepare(Kind kind, int fd, void *buf, std::size_t len,
+               int64_t offset = -1) noexcept {
+    kind_ = kind;
+    fd_ = fd;
+    buf_ = static_cast<std::byte *>(buf);
+    len_ = len;
+    offset_ = offset;
+    progress_ = 0;
+    result_ = 0;
+    done_ = false;
+    waiter_ = {};
+  }
+
+  [[nodiscard]] bool done() const {
+    std::lock_guard lock(mu_);
+    return done_;
+  }
+
+  // Bytes transferred, or -errno.
+  ssize_t wait() {
+    std::unique_lock lock(mu_);
+    cv_.wait(lock, [&] { return done_; });
+    return result_;
+  }
+
+  bool await_ready() const { return done(); }
+  bool await_suspend(std::coroutine_handle<> h) {
+    std::lock_guard lock(mu_);
+    if (done_)
+      return false;
+    waiter_ = h;
+    return true;
+  }
+  ssize_t await_resume() const { return result_; }
+
+private:
+  friend class IoBackend;
+  friend class ThreadIoBackend;
+  friend class IoUringBackend;
+
+  Kind kind_ = Kind::kRead;
+  int fd_ = -1;
+  std::byte *buf_ = nullptr;
+  std::size_t len_ = 0;
+  int64_t offset_ = -1;
+  std::size_t progress_ = 0; // bytes of a write already done
+  ssize_t result_ = 0;
+  bool done_ = true;
+  std::coroutine_handle<> waiter_;
+  IoBackend *backend_ = nullptr;
+  mutable std::mutex mu_;
+  std::condition_variable cv_;
+};
+
+class IoBackend {
+public:
+  IoBackend() : resumer_([this] { resume_loop(); }) {}
+  virtual ~IoBackend() {
+    {
+      std::lock_guard lock(resume_mu_);
+      stopping_ = true;
+    }
+    resume_cv_.notify_all();
+    resumer_.join();
+  }
+
+  IoBackend(const IoBackend &) = delete;
+  IoBackend &operator=(const IoBackend &) = delete;
+
+  // Starts op; it must stay alive and untouched until it completes.
+  void submit(IoOp &op) {
+    op.backend_ = this;
+    start(op);
+  }
+
+  // Asks op, submitted here, to finish early. It still completes as usual,
+  // with -ECANCELED unless it got done first, so wait for it afterwards.
+  // A read blocked on an idle pipe or socket is cancelled; a write may
+  // run to the end.
+  void cancel(IoOp &op) { stop(op); }
+
+  [[nodiscard]] virtual std::string_view name() const noexcept = 0;
+
+protected:
+  virtual void start(IoOp &op) = 0;
+  virtual void stop(IoOp &op) = 0;
+
+  // Called by the I/O side once op is finished.
+  void complete(IoOp &op, ssize_t result) {
+    std::coroutine_handle<> waiter;
+    {
+      std::lock_guard lock(op.mu_);
+      op.result_ = result;
+      op.done_ = true;
+      waiter = std::exchange(op.waiter_, {});
+      op.cv_.notify_all();
+    }
+    if (waiter) {
+      std::lock_guard lock(resume_mu_);
+      resume_queue_.push_back(waiter);
+      resume_cv_.notify_one();
+    }
+  }
+
+private:
+  void resume_loop() {
+    std::unique_lock lock(resume_mu_);
+    for (;;) {
+      resume_cv_.wait(lock,
+                      [&] { return stopping_ || !resume_queue_.empty(); });
+      if (resume_queue_.empty())
+        return;
+      auto h = resume_queue_.front();
+      resume_queue_.pop_front();
+      lock.unlock();
+      h.resume();
+      lock.lock();
+    }
+  }
+
+  std::mutex resume_mu_;
+  std::condition_variable resume_cv_;
+  std::deque<std::coroutine_handle<>> resume_queue_;
+  bool stopping_ = false;
+  std::thread resumer_;
+};
+
+// Portable fallback: one worker thread running blocking syscalls in order.
+// Reads first poll() the file together with a wake-up pipe, so cancel() can
+// interrupt one that would block.
+class ThreadIoBackend final : public IoBackend {
+public:
+  ThreadIoBackend() {
+    if (::pipe2(wake_, O_CLOEXEC | O_NONBLOCK) != 0)
+      throw std::system_error(errno, std::generic_category(),
+                              "ThreadIoBackend: pipe");
+    worker_ = std::thread([this] { run(); });
+  }
+  ~ThreadIoBackend() override {
+    {
+      std::lock_guard lock(mu_);
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+    ::close(wake_[0]);
+    ::close(wake_[1]);
+  }
+
+  [[nodiscard]] std::string_view name() const noexcept override {
+    return "threads";
+  }
+
+protected:
+  void start(IoOp &op) override {
+    {
+      std::lock_guard lock(mu_);
+      queue_.push_back(&op);
+    }
+    cv_.notify_one();
+  }
+
+  void stop(IoOp &op) override {
+    {
+      std::lock_guard lock(mu_);
+      if (current_ == &op) {
+        cancel_current_ = true;
+        const char byte = 0;
+        [[maybe_unused]] const ssize_t r = ::write(wake_[1], &byte, 1);
+        return;
+      }
+      const auto it = std::find(queue_.begin(), queue_.end(), &op);
+      if (it == queue_.end())
+        return; // already done
+      queue_.erase(it);
+    }
+    complete(op, -ECANCELED);
+  }
+
+private:
+  // Waits until op's file is readable; false once op is cancelled.
+  bool readable(IoOp &op) {
+    pollfd fds[2] = {{op.fd_, POLLIN, 0}, {wake_[0], POLLIN, 0}};
+    for (;;) {
+      if (::poll(fds, 2, -1) < 0) {
+        if (errno == EINTR)
+          continue;
+        return true; // let the read report it
+      }
+      if (fds[1].revents) {
+        char drain[64];
+        while (::read(wake_[0], drain, sizeof drain) > 0)
+          ;
+        std::lock_guard lock(mu_);
+        if (cancel_current_)
+          return false;
+      }
+      if (fds[0].revents)
+        return true;
+    }
+  }
+
+  ssize_t perform(IoOp &op) {
+    for (;;) {
+      std::byte *p = op.buf_ + op.progress_;
+      const std::size_t n = op.len_ - op.progress_;
+      const int64_t off = op.offset_ < 0
+                              ? -1
+                              : op.offset_ + static_cast<int64_t>(op.progress_);
+      ssize_t r;
+      if (op.kind_ == IoOp::Kind::kRead && !readable(op))
+        return -ECANCELED;
+      if (op.kind_ == IoOp::Kind::kRead)
+        r = off < 0 ? ::read(op.fd_, p, n) : ::pread(op.fd_, p, n, off);
+      else
+        r = off < 0 ? ::write(op.fd_, p, n) : ::pwrite(op.fd_, p, n, off);
+      if (r < 0 && errno == EINTR)
+        continue;
+      if (r < 0)
+        return -errno;
+      if (op.kind_ == IoOp::Kind::kRead)
+        return r;
+      op.progress_ += static_cast<std::size_t>(r);
+      if (op.progress_ == op.len_)
+        return static_cast<ssize_t>(op.len_);
+    }
+  }
+
+  void run() {
+    std::unique_lock lock(mu_);
+    for (;;) {
+      cv_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+      if (queue_.empty())
+        return;
+      IoOp *op = queue_.front();
+      queue_.pop_front();
+      current_ = op;
+      cancel_current_ = false;
+      lock.unlock();
+      const ssize_t result = perform(*op);
+      lock.lock();
+      current_ = nullptr;
+      lock.unlock();
+      complete(*op, result);
+      lock.lock();
+    }
+  }
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::deque<IoOp *> queue_;
+  IoOp *current_ = nullptr; // being performed by the worker
+  bool cancel_current_ = false;
+  bool stopping_ = false;
+  int wake_[2] = {-1, -1};
+  std::thread worker_;
+};
+
+#if SUGAR_HAS_IO_URING
+// io_uring through the raw syscalls. A reaper thread blocks for
+// completions; short writes are resubmitted until done.
+class IoUringBackend final : public IoBackend {
+public:
+  // nullptr when the kernel (or a seccomp policy) refuses io_uring or lacks
+  // IORING_OP_READ / WRITE on the current file position (Linux < 5.6).
+  static std::unique_ptr<IoUringBackend> create(unsigned entries = 64) {
+    io_uring_params p{};
+    const int fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &p));
+    if (fd < 0)
+      return nullptr;
+    if (!(p.features & IORING_FEAT_RW_CUR_POS) ||
+        !(p.features & IORING_FEAT_SINGLE_MMAP)) {
+      ::close(fd);
+      return nullptr;
+    }
+    std::unique_ptr<IoUringBackend> b(new IoUringBackend(fd, p));
+    if (!b->sq_ring_)
+      return nullptr;
+    b->reaper_ = std::thread([raw = b.get()] { raw->reap(); });
+    return b;
+  }
+
+  ~IoUringBackend() override {
+    if (reaper_.joinable()) {
+      push({IORING_OP_NOP, -1, 0, 0, 0, kStop});
+      reaper_.join();
+    }
+    if (sqes_)
+      ::munmap(sqes_, sqes_size_);
+    if (sq_ring_)
+      ::munmap(sq_ring_, ring_size_);
+    ::close(fd_);
+  }
+
+  [[nodiscard]] std::string_view name() const noexcept override {
+    return "io_uring";
+  }
+
+protected:
+  void start(IoOp &op) override { push(entry_for(op)); }
+
+  // The op's own completion, -ECANCELED or its result, still follows.
+  void stop(IoOp &op) override {
+    push({IORING_OP_ASYNC_CANCEL, -1, reinterpret_cast<uint64_t>(&op), 0, 0,
+          kCancel});
+  }
+
+private:
+  static constexpr uint64_t kStop = 0;
+  static constexpr uint64_t kCancel = 1; // never an IoOp address
+
+  struct Entry {
+    uint8_t opcode;
+    int fd;
+    uint64_t addr;
+    uint32_t len;
+    uint64_t off;
+    uint64_t user_data;
+  };
+
+  IoUringBackend(int fd, const io_uring_params &p) : fd_(fd) {
+    ring_size_ =
+        std::max<std::size_t>(p.sq_off.array + p.sq_entries * sizeof(unsigned),
+                              p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe));
+    void *ring = ::mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED)
+      return;
+    sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      ::munmap(ring, ring_size_);
+      return;
+    }
+    auto *base = static_cast<char *>(ring);
+    sq_ring_ = ring;
+    sqes_ = static_cast<io_uring_sqe *>(sqes);
+    sq_head_ = reinterpret_cast<unsigned *>(base + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned *>(base + p.sq_off.tail);
+    sq_entries_ = p.sq_entries;
+    sq_mask_ = *reinterpret_cast<unsigned *>(base + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(base + p.sq_off.array);
+    cq_head_ = reinterpret_cast<unsigned *>(base + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(base + p.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned *>(base + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(base + p.cq_off.cqes);
+  }
+
+  static Entry entry_for(IoOp &op) {
+    const std::size_t left = op.len_ - op.progress_;
+    return {op.kind_ == IoOp::Kind::kRead ? uint8_t{IORING_OP_READ}
+                                          : uint8_t{IORING_OP_WRITE},
+            op.fd_, reinterpret_cast<uint64_t>(op.buf_ + op.progress_),
+            static_cast<uint32_t>(std::min<std::size_t>(left, INT_MAX)),
+            op.offset_ < 0 ? ~uint64_t{0}
+                           : static_cast<uint64_t>(op.offset_) + op.progress_,
+            reinterpret_cast<uint64_t>(&op)};
+  }
+
+  // Queues e and hands it to the kernel. The kernel may refuse with EAGAIN
+  // or EBUSY until completions are reaped, so retries happen without
+  // sq_mu_, leaving the reaper free to drain the ring meanwhile.
+  void push(const Entry &e) {
+    for (;;) {
+      {
+        std::lock_guard lock(sq_mu_);
+        if (enqueue_locked(e))
+          break;
+      }
+      submit_queued();
+      std::this_thread::yield();
+    }
+    while (!submit_queued())
+      std::this_thread::yield();
+  }
+
+  // False when the submission queue is full.
+  bool enqueue_locked(const Entry &e) {
+    std::atomic_ref<unsigned> head(*sq_head_), tail(*sq_tail_);
+    const unsigned t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == sq_entries_)
+      return false;
+    const unsigned idx = t & sq_mask_;
+    io_uring_sqe &sqe = sqes_[idx];
+    sqe = {};
+    sqe.opcode = e.opcode;
+    sqe.fd = e.fd;
+    sqe.addr = e.addr;
+    sqe.len = e.len;
+    sqe.off = e.off;
+    sqe.user_data = e.user_data;
+    sq_array_[idx] = idx;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Submits whatever is queued, whoever queued it; false when the kernel
+  // asks to try again.
+  bool submit_queued() {
+    if (::syscall(__NR_io_uring_enter, fd_, sq_entries_, 0, 0, nullptr, 0) >= 0)
+      return true;
+    return errno != EINTR && errno != EAGAIN && errno != EBUSY;
+  }
+
+  void reap() {
+    std::atomic_ref<unsigned> head(*cq_head_), tail(*cq_tail_);
+    // Remaining parts of short writes that found the queue full. The
+    // reaper never waits for room: only it can make room.
+    std::deque<IoOp *> resubmit;
+    for (;;) {
+      unsigned h = head.load(std::memory_order_relaxed);
+      if (h == tail.load(std::memory_order_acquire)) {
+        {
+          std::lock_guard lock(sq_mu_);
+          while (!resubmit.empty() && enqueue_locked(entry_for(*resubmit.front())))
+            resubmit.pop_front();
+        }
+        // Also submits what is queued, retried here rather than in place.
+        ::syscall(__NR_io_uring_enter, fd_, sq_entries_, 1,
+                  IORING_ENTER_GETEVENTS, nullptr, 0);
+        continue;
+      }
+      const io_uring_cqe cqe = cqes_[h & cq_mask_];
+      head.store(h + 1, std::memory_order_release);
+      if (cqe.user_data == kStop)
+        return;
+      if (cqe.user_data == kCancel)
+        continue;
+      auto &op = *reinterpret_cast<IoOp *>(cqe.user_data);
+      ssize_t result = cqe.res;
+      {
+        // op was prepared before its push(); the lock makes that ordering
+        // explicit instead of relying on the kernel's.
+        std::lock_guard lock(sq_mu_);
+        if (op.kind_ == IoOp::Kind::kWrite && cqe.res > 0) {
+          op.progress_ += static_cast<std::size_t>(cqe.res);
+          if (op.progress_ < op.len_) {
+            if (!enqueue_locked(entry_for(op)))
+              resubmit.push_back(&op);
+            continue;
+          }
+          result = static_cast<ssize_t>(op.len_);
+        }
+      }
+      complete(op, result);
+    }
+  }
+
+  int fd_;
+  std::size_t ring_size_ = 0;
+  std::size_t sqes_size_ = 0;
+  void *sq_ring_ = nullptr;
+  io_uring_sqe *sqes_ = nullptr;
+  unsigned *sq_head_ = nullptr;
+  unsigned *sq_tail_ = nullptr;
+  unsigned sq_entries_ = 0;
+  unsigned sq_mask_ = 0;
+  unsigned *sq_array_ = nullptr;
+  unsigned *cq_head_ = nullptr;
+  unsigned *cq_tail_ = nullptr;
+  unsigned cq_mask_ = 0;
+  io_uring_cqe *cqes_ = nullptr;
+  std::mutex sq_mu_;
+  std::thread reaper_;
+};
+#endif
+
+// Process-wide backend: io_uring when available, else a worker thread.
+inline IoBackend &default_io_backend() {
+  static const std::unique_ptr<IoBackend> backend = []() -> std::unique_ptr<IoBackend> {
+#if SUGAR_HAS_IO_URING
+    if (auto uring = IoUringBackend::create())
+      return uring;
+#endif
+    return std::make_unique<ThreadIoBackend>();
+  }();
+  return *backend;
+}
+
+struct AsyncIoOptions {
+  std::size_t block_size = std::size_t{1} << 20;
+  IoBackend *backend = nullptr; // default_io_backend() when null
+};
+
+// ---- Records ---------------------------------------------------------------
+
+namespace detail {
+// Two buffers: one being consumed, the other being filled.
+class ReadAhead {
+public:
+  ReadAhead(int fd, const AsyncIoOptions &opts)
+      : fd_(fd), io_(opts.backend ? *opts.backend : default_io_backend()) {
+    for (auto &b : buffers_)
+      b.resize(std::max<std::size_t>(opts.block_size, 1));
+    start(0);
+  }
+
+  // A read still in flight is cancelled rather than waited for, since on
+  // an idle pipe or socket it may never complete.
+  ~ReadAhead() {
+    if (in_flight_) {
+      io_.cancel(op_);
+      op_.wait();
+    }
+  }
+
+  ReadAhead(const ReadAhead &) = delete;
+  ReadAhead &operator=(const ReadAhead &) = delete;
+
+  // The next bytes of input, empty at the end; valid until the next call.
+  std::span<const std::byte> next() {
+    if (!in_flight_)
+      return {};
+    const ssize_t n = op_.wait();
+    in_flight_ = false;
+    if (n < 0)
+      throw std::system_error(static_cast<int>(-n), std::generic_category(),
+                              "async_records: read");
+    if (n == 0)
+      return {};
+    const int filled = filling_;
+    start(filled ^ 1);
+    return {buffers_[filled].data(), static_cast<std::size_t>(n)};
+  }
+
+private:
+  void start(int which) {
+    filling_ = which;
+    op_.prepare(IoOp::Kind::kRead, fd_, buffers_[which].data(),
+                buffers_[which].size());
+    in_flight_ = true;
+    io_.submit(op_);
+  }
+
+  int fd_;
+  IoBackend &io_;
+  std::vector<std::byte> buffers_[2];
+  int filling_ = 0;
+  bool in_flight_ = false;
+  IoOp op_;
+};
+
+// Length of the frame at the front of in (prefix included), or nullopt
+// while its length prefix is incomplete.
+inline std::optional<std::size_t> frame_extent(std::span<const std::byte> in) {
+  uint64_t len = 0;
+  for (std::size_t i = 0; i < in.size(); ++i) {
+    if (i == 5)
+      throw std::runtime_error("async_records: malformed length");
+    const auto b = std::to_integer<uint64_t>(in[i]);
+    len |= (b & 0x7f) << (7 * i);
+    if (!(b & 0x80)) {
+      if (len > static_cast<uint64_t>(INT_MAX))
+        throw std::runtime_error("async_records: record exceeds 2GB");
+      return i + 1 + static_cast<std::size_t>(len);
+    }
+  }
+  return std::nullopt;
+}
+
+inline void parse_frame(std::span<const std::byte> frame,
+                        google::protobuf::MessageLite &msg) {
+  std::size_t i = 0;
+  while (std::to_integer<uint8_t>(frame[i]) & 0x80)
+    ++i;
+  ++i;
+  if (!msg.ParseFromArray(frame.data() + i,
+                          static_cast<int>(frame.size() - i)))
+    throw std::runtime_error("async_records: invalid record");
+}
+} // namespace detail
+
+// Framed records of fd as Wrapped views over one reused message, each
+// valid until the next iteration. Reads ahead one block; records may span
+// blocks. Throws std::runtime_error on malformed or truncated input.
+template <typename Wrapped>
+Generator<Wrapped> async_records(int fd, AsyncIoOptions opts = {}) {
+  detail::ReadAhead in(fd, opts);
+  typename Wrapped::Access::message_type msg;
+  std::vector<std::byte> carry; // a record split across blocks
+
+  for (auto chunk = in.next(); !chunk.empty(); chunk = in.next()) {
+    std::size_t pos = 0;
+    if (!carry.empty()) {
+      std::optional<std::size_t> total;
+      while (pos < chunk.size()) {
+        total = detail::frame_extent(carry);
+        const std::size_t want = total ? *total - carry.size() : 1;
+        const std::size_t take = std::min(want, chunk.size() - pos);
+        carry.insert(carry.end(), chunk.begin() + pos,
+                     chunk.begin() + pos + take);
+        pos += take;
+        total = detail::frame_extent(carry);
+        if (total && carry.size() == *total)
+          break;
+      }
+      if (!total || carry.size() < *total)
+        continue;
+      detail::parse_frame(carry, msg);
+      carry.clear();
+      co_yield Wrapped(msg);
+    }
+    for (;;) {
+      const auto rest = chunk.subspan(pos);
+      const auto total = detail::frame_extent(rest);
+      if (!total || *total > rest.size()) {
+        carry.assign(rest.begin(), rest.end());
+        break;
+      }
+      detail::parse_frame(rest.first(*total), msg);
+      pos += *total;
+      co_yield Wrapped(msg);
+    }
+  }
+  if (!carry.empty())
+    throw std::runtime_error("async_records: truncated record at end of input");
+}
+
+// Appends framed records to fd, filling one buffer while the previous one
+// is written. co_await flush() before destroying the writer; the
+// destructor only waits for a write already in flight.
+class AsyncRecordWriter {
+public:
+  explicit AsyncRecordWriter(int fd, AsyncIoOptions opts = {})
+      : fd_(fd), io_(opts.backend ? *opts.backend : default_io_backend()) {
+    for (auto &b : buffers_)
+      b.resize(std::max<std::size_t>(opts.block_size, 1));
+  }
+
+  ~AsyncRecordWriter() {
+    if (in_flight_)
+      op_.wait();
+  }
+
+  AsyncRecordWriter(const AsyncRecordWriter &) = delete;
+  AsyncRecordWriter &operator=(const AsyncRecordWriter &) = delete;
+
+  class [[nodiscard]] WriteAwaiter {
+  public:
+    // Appends right away unless the buffer is full and the previous
+    // write is still in flight.
+    bool await_ready() {
+      if (w_->append(*msg_, size_))
+        return true;
+      if (w_->in_flight_ && !w_->op_.done())
+        return false;
+      w_->rotate_and_append(*msg_, size_);
+      return true;
+    }
+    bool await_suspend(std::coroutine_handle<> h) {
+      suspended_ = true;
+      return w_->op_.await_suspend(h);
+    }
+    void await_resume() {
+      if (suspended_)
+        w_->rotate_and_append(*msg_, size_);
+    }
+
+  private:
+    friend class AsyncRecordWriter;
+    WriteAwaiter(AsyncRecordWriter *w, const google::protobuf::MessageLite *m,
+                 std::size_t size) noexcept
+        : w_(w), msg_(m), size_(size) {}
+
+    AsyncRecordWriter *w_;
+    const google::protobuf::MessageLite *msg_;
+    std::size_t size_;
+    bool suspended_ = false;
+  };
+
+  // m is a message or any XWrapped.
+  template <typename T> WriteAwaiter write(const T &m) {
+    const auto &msg = detail::message_of(m);
+    const std::size_t n = detail::checked_size(msg.ByteSizeLong());
+    return WriteAwaiter(this, &msg, detail::varint_size(n) + n);
+  }
+
+  // Writes everything appended so far.
+  Task<void> flush() {
+    if (in_flight_)
+      co_await settle();
+    if (fill_) {
+      submit();
+      co_await settle();
+    }
+  }
+
+  // Bytes handed to the backend so far.
+  [[nodiscard]] uint64_t bytes_written() const noexcept { return written_; }
+
+private:
+  bool append(const google::protobuf::MessageLite &m, std::size_t size) {
+    auto &buf = buffers_[current_];
+    if (buf.size() - fill_ < size)
+      return false;
+    // write() already sized m; serialize from the cached sizes.
+    std::byte *body = detail::put_varint(
+        static_cast<uint64_t>(m.GetCachedSize()), buf.data() + fill_);
+    m.SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t *>(body));
+    fill_ += size;
+    return true;
+  }
+
+  void check(ssize_t r) {
+    in_flight_ = false;
+    if (r < 0)
+      throw std::system_error(static_cast<int>(-r), std::generic_category(),
+                              "AsyncRecordWriter: write");
+  }
+
+  void submit() {
+    op_.prepare(IoOp::Kind::kWrite, fd_, buffers_[current_].data(), fill_);
+    in_flight_ = true;
+    written_ += fill_;
+    io_.submit(op_);
+    current_ ^= 1;
+    fill_ = 0;
+  }
+
+  // The previous write is done: hand over the full buffer, then append.
+  void rotate_and_append(const google::protobuf::MessageLite &m,
+                         std::size_t size) {
+    if (in_flight_)
+      check(op_.wait());
+    if (fill_)
+      submit();
+    auto &buf = buffers_[current_];
+    if (buf.size() < size)
+      buf.resize(size);
+    append(m, size);
+  }
+
+  struct Settle {
+    AsyncRecordWriter *w;
+    bool await_ready() { return w->op_.await_ready(); }
+    bool await_suspend(std::coroutine_handle<> h) {
+      return w->op_.await_suspend(h);
+    }
+    void await_resume() { w->check(w->op_.await_resume()); }
+  };
+  Settle settle() noexcept { return Settle{this}; }
+
+  int fd_;
+  IoBackend &io_;
+  std::vector<std::byte> buffers_[2];
+  int current_ = 0;
+  std::size_t fill_ = 0;
+  bool in_flight_ = false;
+  uint64_t written_ = 0;
+  IoOp op_;
+};
+
+} // namespace sugar
@@ -0,0 +1,625 @@
+#pragma once
+
+/*
+ * sugar_blocks.h
+ *
+ * Copyright 2025 M.Berkay Karatas
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Block-structured record archives. A file is a sequence of blocks:
+//
+//   header   magic "SBLK", payload size, record count, flags, CRC32C of the
+//            payload, CRC32C of the preceding 20 header bytes (all u32 LE)
+//   payload  [dictionary] records
+//
+// Records are varint-framed messages (as in sugar_io.h). With the
+// dictionary flag the payload starts with a varint count of entries, each
+// a varint length plus bytes, and length-delimited fields of the records
+// whose payload is in the dictionary are stored as wire type 6 (invalid in
+// protobuf) followed by the varint entry index. This works on the wire
+// format alone, so it needs no reflection and applies to lite messages.
+//
+// Readers verify both checksums. A block with a bad payload is skipped by
+// its length; a damaged header is skipped by scanning for the next header
+// that checks out.
+
+#include "sugar_io.h"
+
+#include <google/protobuf/message_lite.h>
+
+#include <unistd.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define SUGAR_CRC32C_SSE42 1
+#else
+#define SUGAR_CRC32C_SSE42 0
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace sugar {
+
+// ---- CRC32C ----------------------------------------------------------------
+
+namespace detail {
+inline constexpr auto kCrc32cTables = [] {
+  std::array<std::array<uint32_t, 256>, 8> t{};
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; ++k)
+      c = (c >> 1) ^ ((c & 1) ? 0x82f63b78u : 0u);
+    t[0][i] = c;
+  }
+  for (std::size_t k = 1; k < 8; ++k)
+    for (std::size_t i = 0; i < 256; ++i)
+      t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+  return t;
+}();
+
+inline uint32_t load_u32le(const std::byte *p) noexcept {
+  return std::to_integer<uint32_t>(p[0]) |
+         std::to_integer<uint32_t>(p[1]) << 8 |
+         std::to_integer<uint32_t>(p[2]) << 16 |
+         std::to_integer<uint32_t>(p[3]) << 24;
+}
+
+inline void store_u32le(uint32_t v, std::byte *p) noexcept {
+  for (int i = 0; i < 4; ++i)
+    p[i] = static_cast<std::byte>(v >> (8 * i));
+}
+
+// Slicing-by-8.
+inline uint32_t crc32c_portable(uint32_t crc, const std::byte *p,
+                                std::size_t n) noexcept {
+  const auto &t = kCrc32cTables;
+  crc = ~crc;
+  for (; n >= 8; p += 8, n -= 8) {
+    const uint32_t lo = crc ^ load_u32le(p);
+    const uint32_t hi = load_u32le(p + 4);
+    crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^
+          t[4][lo >> 24] ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^
+          t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+  }
+  for (; n; ++p, --n)
+    crc = t[0][(crc ^ std::to_integer<uint32_t>(*p)) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+#if SUGAR_CRC32C_SSE42
+__attribute__((target("sse4.2"))) inline uint32_t
+crc32c_sse42(uint32_t crc, const std::byte *p, std::size_t n) noexcept {
+  uint64_t c = ~crc;
+  for (; n >= 8; p += 8, n -= 8) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    c = _mm_crc32_u64(c, v);
+  }
+  auto c32 = static_cast<uint32_t>(c);
+  for (; n; ++p, --n)
+    c32 = _mm_crc32_u8(c32, std::to_integer<uint8_t>(*p));
+  return ~c32;
+}
+#endif
+} // namespace detail
+
+// CRC32C (Castagnoli) of data, continuing from crc (0 to start). Uses the
+// SSE4.2 crc32 instruction when the CPU has it.
+inline uint32_t crc32c(std::span<const std::byte> data, uint32_t crc = 0) {
+#if SUGAR_CRC32C_SSE42
+  static const bool hw = __builtin_cpu_supports("sse4.2");
+  if (hw)
+    return detail::crc32c_sse42(crc, data.data(), data.size());
+#endif
+  return detail::crc32c_portable(crc, data.data(), data.size());
+}
+
+// ---- Wire helpers ----------------------------------------------------------
+
+namespace detail {
+inline constexpr uint32_t kBlockMagic = 0x4b4c4253; // "SBLK"
+inline constexpr std::size_t kBlockHeaderSize = 24;
+inline constexpr uint32_t kBlockHasDictionary = 1;
+
+inline void append_varint(std::vector<std::byte> &out, uint64_t v) {
+  std::byte buf[10];
+  out.insert(out.end(), buf, put_varint(v, buf));
+}
+
+// A sink writing everything to fd, retrying short writes. Throws
+// std::system_error labelled what if a write fails.
+inline std::function<void(std::span<const std::byte>)>
+fd_sink(int fd, const char *what) {
+  return [fd, what](std::span<const std::byte> bytes) {
+    while (!bytes.empty()) {
+      const ssize_t n = ::write(fd, bytes.data(), bytes.size());
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0)
+        throw std::system_error(errno, std::generic_category(), what);
+      bytes = bytes.subspan(static_cast<std::size_t>(n));
+    }
+  };
+}
+
+// Calls fn(token_begin, wire_type, field_number, value_begin, token_end)
+// for each field token of a serialized message; [value_begin, token_end)
+// is the payload of a length-delimited field and empty otherwise. Group
+// markers are tokens of their own, so fields inside groups are visited as
+// well. False if the bytes are not a well-formed token stream.
+template <typename Fn>
+bool for_each_token(const std::byte *p, const std::byte *end, Fn &&fn) {
+  while (p < end) {
+    const std::byte *start = p;
+    uint64_t tag;
+    if (!read_varint(p, end, tag))
+      return false;
+    const std::byte *value = p;
+    switch (tag & 7) {
+    case 0: {
+      uint64_t ignored;
+      if (!read_varint(p, end, ignored))
+        return false;
+      break;
+    }
+    case 1:
+      if (end - p < 8)
+        return false;
+      p += 8;
+      break;
+    case 2: {
+      uint64_t len;
+      if (!read_varint(p, end, len) ||
+          len > static_cast<uint64_t>(end - p))
+        return false;
+      value = p;
+      p += len;
+      break;
+    }
+    case 3:
+    case 4:
+      break;
+    case 5:
+      if (end - p < 4)
+        return false;
+      p += 4;
+      break;
+    case 6: {
+      uint64_t index;
+      if (!read_varint(p, end, index))
+        return false;
+      break;
+    }
+    default:
+      return false;
+    }
+    fn(start, static_cast<int>(tag & 7), tag >> 3,
+       (tag & 7) == 2 ? value : p, p);
+  }
+  return true;
+}
+
+using Dictionary = std::vector<std::span<const std::byte>>;
+
+// Expands dictionary references of an encoded record into out.
+inline bool expand_record(std::span<const std::byte> in, const Dictionary &dict,
+                          std::vector<std::byte> &out) {
+  out.clear();
+  bool ok = true;
+  const bool well_formed = for_each_token(
+      in.data(), in.data() + in.size(),
+      [&](const std::byte *start, int wire, uint64_t field, const std::byte *,
+          const std::byte *next) {
+        if (wire != 6) {
+          out.insert(out.end(), start, next);
+          return;
+        }
+        const std::byte *p = start;
+        uint64_t tag, index;
+        read_varint(p, next, tag);
+        read_varint(p, next, index);
+        if (index >= dict.size()) {
+          ok = false;
+          return;
+        }
+        append_varint(out, field << 3 | 2);
+        append_varint(out, dict[index].size());
+        out.insert(out.end(), dict[index].begin(), dict[index].end());
+      });
+  return ok && well_formed;
+}
+
+struct BlockRef {
+  std::span<const std::byte> payload;
+  uint32_t records;
+  uint32_t flags;
+  uint32_t crc;
+};
+} // namespace detail
+
+// ---- Writer ----------------------------------------------------------------
+
+struct BlockWriterOptions {
+  // Record bytes collected before a block is sealed.
+  std::size_t block_size = std::size_t{256} << 10;
+  bool dictionary = true;
+  // Shortest field payload considered for the dictionary.
+  std::size_t min_dictionary_length = 8;
+};
+
+// Collects records into blocks and hands each sealed block to a sink.
+// Call flush() at the end; the destructor does not write.
+class BlockWriter {
+public:
+  using Sink = std::function<void(std::span<const std::byte>)>;
+
+  explicit BlockWriter(Sink sink, BlockWriterOptions opts = {})
+      : sink_(std::move(sink)), opts_(opts) {}
+
+  // Appends blocks to fd. Throws std::system_error if a write fails.
+  explicit BlockWriter(int fd, BlockWriterOptions opts = {})
+      : BlockWriter(detail::fd_sink(fd, "BlockWriter: write"), opts) {}
+
+  // m is a message or any XWrapped.
+  template <typename T> void write(const T &m) {
+    const auto &msg = detail::message_of(m);
+    const std::size_t n = detail::checked_size(msg.ByteSizeLong());
+    const std::size_t at = records_.size();
+    records_.resize(at + detail::varint_size(n) + n);
+    std::byte *body = detail::put_varint(n, records_.data() + at);
+    msg.SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t *>(body));
+    ++count_;
+    if (records_.size() >= opts_.block_size)
+      flush();
+  }
+
+  // Seals the open block, if any.
+  void flush() {
+    if (!count_)
+      return;
+    block_.assign(detail::kBlockHeaderSize, std::byte{});
+    uint32_t flags = 0;
+    if (opts_.dictionary && encode_with_dictionary())
+      flags |= detail::kBlockHasDictionary;
+    else
+      block_.insert(block_.end(), records_.begin(), records_.end());
+
+    const auto payload = std::span(block_).subspan(detail::kBlockHeaderSize);
+    if (payload.size() > UINT32_MAX)
+      throw std::length_error("BlockWriter: block exceeds 4GB");
+    std::byte *h = block_.data();
+    detail::store_u32le(detail::kBlockMagic, h);
+    detail::store_u32le(static_cast<uint32_t>(payload.size()), h + 4);
+    detail::store_u32le(count_, h + 8);
+    detail::store_u32le(flags, h + 12);
+    detail::store_u32le(crc32c(payload), h + 16);
+    detail::store_u32le(crc32c({h, 20}), h + 20);
+    sink_(block_);
+
+    bytes_written_ += block_.size();
+    ++blocks_written_;
+    records_.clear();
+    count_ = 0;
+  }
+
+  [[nodiscard]] uint64_t blocks_written() const noexcept {
+    return blocks_written_;
+  }
+  [[nodiscard]] uint64_t bytes_written() const noexcept {
+    return bytes_written_;
+  }
+
+private:
+  using View = std::string_view;
+
+  struct Entry {
+    uint32_t uses = 0;
+    uint32_t index = UINT32_MAX; // UINT32_MAX: used once, stays inline
+  };
+
+  static View view(const std::byte *b, const std::byte *e) noexcept {
+    return {reinterpret_cast<const char *>(b), static_cast<std::size_t>(e - b)};
+  }
+
+  template <typename Fn> void for_each_record(Fn &&fn) const {
+    const std::byte *p = records_.data();
+    const std::byte *end = p + records_.size();
+    while (p < end) {
+      uint64_t n;
+      detail::read_varint(p, end, n);
+      fn(p, p + n);
+      p += n;
+    }
+  }
+
+  // Fills block_'s payload with a dictionary and the rewritten records;
+  // false (block_ untouched) when no field payload repeats.
+  bool encode_with_dictionary() {
+    entries_.clear();
+    order_.clear();
+    uses_.clear();
+    for_each_record([&](const std::byte *b, const std::byte *e) {
+      detail::for_each_token(
+          b, e,
+          [&](const std::byte *, int wire, uint64_t, const std::byte *vb,
+              const std::byte *ve) {
+            if (wire != 2 ||
+                static_cast<std::size_t>(ve - vb) < opts_.min_dictionary_length)
+              return;
+            auto [it, fresh] = entries_.try_emplace(view(vb, ve));
+            if (fresh)
+              order_.push_back(&*it);
+            ++it->second.uses;
+            uses_.push_back(&it->second);
+          });
+    });
+
+    uint32_t next = 0;
+    for (auto *entry : order_)
+      if (entry->second.uses > 1)
+        entry->second.index = next++;
+    if (!next)
+      return false;
+
+    detail::append_varint(block_, next);
+    for (const auto *entry : order_) {
+      if (entry->second.index == UINT32_MAX)
+        continue;
+      const View v = entry->first;
+      detail::append_varint(block_, v.size());
+      const auto *b = reinterpret_cast<const std::byte *>(v.data());
+      block_.insert(block_.end(), b, b + v.size());
+    }
+    // Same walk as above, so uses_ lines up with the candidate tokens.
+    std::size_t k = 0;
+    for_each_record([&](const std::byte *b, const std::byte *e) {
+      scratch_.clear();
+      detail::for_each_token(
+          b, e,
+          [&](const std::byte *start, int wire, uint64_t field,
+              const std::byte *vb, const std::byte *ve) {
+            if (wire == 2 &&
+                static_cast<std::size_t>(ve - vb) >= opts_.min_dictionary_length) {
+              const uint32_t index = uses_[k++]->index;
+              if (index != UINT32_MAX) {
+                detail::append_varint(scratch_, field << 3 | 6);
+                detail::append_varint(scratch_, index);
+                return;
+              }
+            }
+            scratch_.insert(scratch_.end(), start, ve);
+          });
+      detail::append_varint(block_, scratch_.size());
+      block_.insert(block_.end(), scratch_.begin(), scratch_.end());
+    });
+    return true;
+  }
+
+  Sink sink_;
+  BlockWriterOptions opts_;
+  std::vector<std::byte> records_; // framed records of the open block
+  uint32_t count_ = 0;
+  std::vector<std::byte> block_;
+  std::vector<std::byte> scratch_;
+  std::unordered_map<View, Entry> entries_;
+  // Entries by first appearance, for stable indices.
+  std::vector<std::pair<const View, Entry> *> order_;
+  std::vector<Entry *> uses_; // per candidate field, in record order
+  uint64_t blocks_written_ = 0;
+  uint64_t bytes_written_ = 0;
+};
+
+// ---- Reader ----------------------------------------------------------------
+
+struct BlockScanStats {
+  std::size_t blocks = 0; // intact blocks
+  std::size_t records = 0;
+  std::size_t corrupt_blocks = 0;
+  std::size_t skipped_bytes = 0;
+};
+
+// Reads blocks out of memory (a mapped or fully read file); data must
+// outlive the reader.
+class BlockReader {
+public:
+  explicit BlockReader(std::span<const std::byte> data) noexcept
+      : data_(data) {}
+
+  // Calls fn(Wrapped) for every record in file order on this thread. The
+  // wrapped message is reused and only valid during the call.
+  template <typename Wrapped, typename Fn> BlockScanStats for_each(Fn &&fn) const {
+    BlockScanStats stats;
+    typename Wrapped::Access::message_type msg;
+    Scratch scratch;
+    for (const auto &block : index(stats)) {
+      if (decode<Wrapped>(block, msg, scratch, fn, stats.records))
+        ++stats.blocks;
+      else
+        ++stats.corrupt_blocks;
+    }
+    return stats;
+  }
+
+  // Decodes blocks on `threads` workers (0: one per hardware thread), each
+  // parsing into its own reused message. fn(Wrapped) runs concurrently;
+  // records of one block arrive in order on one thread. An exception from
+  // fn stops the scan and is rethrown here.
+  template <typename Wrapped, typename Fn>
+  BlockScanStats parallel_for_each(Fn &&fn, unsigned threads = 0) const {
+    BlockScanStats stats;
+    const auto blocks = index(stats);
+    if (!threads)
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(
+        std::min<std::size_t>(threads, std::max<std::size_t>(blocks.size(), 1)));
+
+    std::atomic<std::size_t> next{0}, records{0}, intact{0}, corrupt{0};
+    std::atomic<bool> stop{false};
+    std::exception_ptr error;
+    std::mutex error_mu;
+    auto work = [&] {
+      typename Wrapped::Access::message_type msg;
+      Scratch scratch;
+      std::size_t mine = 0;
+      try {
+        while (!stop.load(std::memory_order_relaxed)) {
+          const std::size_t i = next.fetch_add(1);
+          if (i >= blocks.size())
+            break;
+          if (decode<Wrapped>(blocks[i], msg, scratch, fn, mine))
+            intact.fetch_add(1, std::memory_order_relaxed);
+          else
+            corrupt.fetch_add(1, std::memory_order_relaxed);
+        }
+      } catch (...) {
+        std::lock_guard lock(error_mu);
+        if (!error)
+          error = std::current_exception();
+        stop = true;
+      }
+      records.fetch_add(mine, std::memory_order_relaxed);
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+      pool.emplace_back(work);
+    work();
+    for (auto &t : pool)
+      t.join();
+    if (error)
+      std::rethrow_exception(error);
+    stats.records = records;
+    stats.blocks = intact;
+    stats.corrupt_blocks += corrupt;
+    return stats;
+  }
+
+private:
+  struct Scratch {
+    std::vector<std::byte> record;
+    detail::Dictionary dict;
+  };
+
+  static bool header_ok(const std::byte *h) noexcept {
+    return detail::load_u32le(h) == detail::kBlockMagic &&
+           detail::load_u32le(h + 20) == crc32c({h, 20});
+  }
+
+  // Walks the headers; damaged regions are counted in stats.
+  std::vector<detail::BlockRef> index(BlockScanStats &stats) const {
+    std::vector<detail::BlockRef> blocks;
+    const std::byte *p = data_.data();
+    const std::byte *end = p + data_.size();
+    while (p < end) {
+      if (static_cast<std::size_t>(end - p) >= detail::kBlockHeaderSize &&
+          header_ok(p)) {
+        const uint32_t size = detail::load_u32le(p + 4);
+        const std::byte *payload = p + detail::kBlockHeaderSize;
+        if (size <= static_cast<std::size_t>(end - payload)) {
+          blocks.push_back({{payload, size},
+                            detail::load_u32le(p + 8),
+                            detail::load_u32le(p + 12),
+                            detail::load_u32le(p + 16)});
+          p = payload + size;
+          continue;
+        }
+      }
+      // Resynchronize on the next header that checks out.
+      const std::byte *q = p + 1;
+      for (; q < end; ++q) {
+        if (static_cast<std::size_t>(end - q) < detail::kBlockHeaderSize) {
+          q = end;
+          break;
+        }
+        if (header_ok(q))
+          break;
+      }
+      ++stats.corrupt_blocks;
+      stats.skipped_bytes += static_cast<std::size_t>(q - p);
+      p = q;
+    }
+    return blocks;
+  }
+
+  // Verifies and parses one block, counting delivered records into
+  // records. False if the block is corrupt; records before the damage
+  // may already have been delivered when only the framing is bad.
+  template <typename Wrapped, typename Fn>
+  static bool decode(const detail::BlockRef &block,
+                     typename Wrapped::Access::message_type &msg,
+                     Scratch &scratch, Fn &fn, std::size_t &records) {
+    if (crc32c(block.payload) != block.crc)
+      return false;
+    const std::byte *p = block.payload.data();
+    const std::byte *end = p + block.payload.size();
+    const bool has_dict = block.flags & detail::kBlockHasDictionary;
+    if (has_dict) {
+      uint64_t n;
+      if (!detail::read_varint(p, end, n) ||
+          n > static_cast<uint64_t>(end - p))
+        return false;
+      scratch.dict.resize(static_cast<std::size_t>(n));
+      for (auto &entry : scratch.dict) {
+        uint64_t len;
+        if (!detail::read_varint(p, end, len) ||
+            len > static_cast<uint64_t>(end - p))
+          return false;
+        entry = {p, static_cast<std::size_t>(len)};
+        p += len;
+      }
+    }
+    for (uint32_t i = 0; i < block.records; ++i) {
+      uint64_t len;
+      if (!detail::read_varint(p, end, len) ||
+          len > static_cast<uint64_t>(end - p) || len > INT_MAX)
+        return false;
+      std::span<const std::byte> body(p, static_cast<std::size_t>(len));
+      p += len;
+      if (has_dict) {
+        if (!detail::expand_record(body, scratch.dict, scratch.record))
+          return false;
+        body = scratch.record;
+      }
+      if (!msg.ParseFromArray(body.data(), static_cast<int>(body.size())))
+        return false;
+      fn(Wrapped(msg));
+      ++records;
+    }
+    return p == end;
+  }
+
+  std::span<const std::byte> data_;
+};
+
+} // namespace sugar
@@ -0,0 +1,427 @@
+#pragma once
+
+/*
+ * sugar_builder.h
+ *
+ * Copyright 2025 M.Berkay Karatas
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Write-only producers: the generated XBuilder encodes each field into a
+// caller buffer as it is assigned, without a message object in between.
+//
+//   std::size_t n = sugar::build<UserBuilder>(buf, [&](UserBuilder u) {
+//     u.id = 7;
+//     u.name = "Ada";
+//     u.tags.add("admin");
+//     u.numbers = std::span<const int32_t>(ids);        // one packed run
+//     u.profiles.add([&](ProfileBuilder p) { p.city = "Berlin"; });
+//     u.meta.add("lang", "en");
+//     u.profile([&](ProfileBuilder p) { p.country = "DE"; });
+//   });
+//
+// Fields are written in the order they are assigned; in field-number
+// order the output is byte for byte what SerializeToString produces, and
+// any other order parses to the same message (a singular field written
+// twice keeps its last value). Fields without presence (proto3 scalars
+// outside a oneof) are skipped when zero or empty, as the serializer does.
+// A submessage reserves one byte for its length and moves its body up
+// once it turns out to need more, so each level of a large nested message
+// costs one move. Nothing is allocated; a full buffer throws
+// std::length_error and leaves its contents unspecified. Groups have no
+// builder field.
+
+#include "sugar_io.h"
+#include "sugar_varint.h"
+#include "sugar_wire.h"
+
+#include <google/protobuf/message_lite.h>
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace sugar {
+
+// Whether a singular field is written when it holds its default value.
+enum class Presence : bool { kImplicit, kExplicit };
+
+namespace detail {
+// The encoded tag of field Number with wire type Wire.
+template <int Number, int Wire> struct WireTag {
+  static constexpr uint64_t value =
+      static_cast<uint64_t>(Number) << 3 | static_cast<uint64_t>(Wire);
+  static constexpr std::size_t size = varint_size(value);
+  static constexpr std::array<std::byte, size> bytes = [] {
+    std::array<std::byte, size> b{};
+    uint64_t v = value;
+    for (std::size_t i = 0; i < size; ++i, v >>= 7)
+      b[i] = static_cast<std::byte>((v & 0x7f) | (i + 1 < size ? 0x80 : 0));
+    return b;
+  }();
+};
+
+template <typename T> std::byte *store_le(T v, std::byte *p) noexcept {
+  std::byte b[sizeof(T)];
+  std::memcpy(b, &v, sizeof(T));
+  if constexpr (std::endian::native == std::endian::little)
+    std::memcpy(p, b, sizeof(T));
+  else
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+      p[i] = b[sizeof(T) - 1 - i];
+  return p + sizeof(T);
+}
+
+// The varint of one value of kind K: negative int32 and enum values are
+// sign-extended to ten bytes, sint kinds are zigzag-encoded.
+template <WireKind K>
+[[nodiscard]] constexpr uint64_t varint_of(
+    typename WireValue<K>::type v) noexcept {
+  if constexpr (K == WireKind::kSInt32)
+    return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+  else if constexpr (K == WireKind::kSInt64)
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+  else if constexpr (std::is_signed_v<decltype(v)>)
+    return static_cast<uint64_t>(static_cast<int64_t>(v));
+  else
+    return static_cast<uint64_t>(v);
+}
+
+template <WireKind K>
+[[nodiscard]] constexpr bool is_default(typename WireValue<K>::type v) noexcept {
+  if constexpr (std::is_same_v<decltype(v), std::string_view>)
+    return v.empty();
+  else if constexpr (std::is_same_v<decltype(v), float>)
+    return std::bit_cast<uint32_t>(v) == 0;
+  else if constexpr (std::is_same_v<decltype(v), double>)
+    return std::bit_cast<uint64_t>(v) == 0;
+  else
+    return v == decltype(v){};
+}
+} // namespace detail
+
+// Encodes fields into the front of a caller buffer. The generated
+// builders are views over one of these; it can also be driven directly.
+class WireWriter {
+public:
+  explicit WireWriter(std::span<std::byte> out) noexcept
+      : begin_(out.data()), p_(out.data()), end_(out.data() + out.size()) {}
+
+  [[nodiscard]] std::size_t size() const noexcept {
+    return static_cast<std::size_t>(p_ - begin_);
+  }
+  [[nodiscard]] std::span<const std::byte> bytes() const noexcept {
+    return {begin_, size()};
+  }
+
+  template <int Number, WireKind K>
+  void scalar(typename detail::WireValue<K>::type v) {
+    using T = typename detail::WireValue<K>::type;
+    constexpr int wire = detail::wire_type_of(K);
+    using Tag = detail::WireTag<Number, wire>;
+    if constexpr (wire == detail::kWireVarint) {
+      const uint64_t bits = detail::varint_of<K>(v);
+      reserve(Tag::size + detail::varint_size(bits));
+      put_tag<Tag>();
+      p_ = detail::put_varint(bits, p_);
+    } else if constexpr (wire == detail::kWireLen) {
+      reserve(Tag::size + detail::varint_size(v.size()) + v.size());
+      put_tag<Tag>();
+      p_ = detail::put_varint(v.size(), p_);
+      if (!v.empty())
+        std::memcpy(p_, v.data(), v.size());
+      p_ += v.size();
+    } else {
+      using Raw = std::conditional_t<wire == detail::kWireFixed32, uint32_t,
+                                     uint64_t>;
+      reserve(Tag::size + sizeof(Raw));
+      put_tag<Tag>();
+      if constexpr (std::is_floating_point_v<T>)
+        p_ = detail::store_le(std::bit_cast<Raw>(v), p_);
+      else
+        p_ = detail::store_le(static_cast<Raw>(v), p_);
+    }
+  }
+
+  // Writes values as one packed field; nothing when empty.
+  template <int Number, WireKind K>
+  void packed(std::span<const typename detail::WireValue<K>::type> values) {
+    using T = typename detail::WireValue<K>::type;
+    using Tag = detail::WireTag<Number, detail::kWireLen>;
+    if (values.empty())
+      return;
+    constexpr int wire = detail::wire_type_of(K);
+    constexpr bool fast = VarintValue<T> && K != WireKind::kSInt32 &&
+                          K != WireKind::kSInt64 && wire == detail::kWireVarint;
+    std::size_t n = 0;
+    if constexpr (fast)
+      n = varints_size(values);
+    else if constexpr (wire == detail::kWireVarint)
+      for (const T v : values)
+        n += detail::varint_size(detail::varint_of<K>(v));
+    else
+      n = values.size() * (wire == detail::kWireFixed32 ? 4 : 8);
+    reserve(Tag::size + detail::varint_size(n) + n);
+    put_tag<Tag>();
+    p_ = detail::put_varint(n, p_);
+    if constexpr (fast) {
+      p_ += encode_varints(values, std::span(p_, n));
+    } else {
+      // sint and bool varints, fixed-width values little-endian.
+      for (const T v : values) {
+        if constexpr (wire == detail::kWireVarint) {
+          p_ = detail::put_varint(detail::varint_of<K>(v), p_);
+        } else {
+          using Raw = std::conditional_t<wire == detail::kWireFixed32,
+                                         uint32_t, uint64_t>;
+          if constexpr (std::is_floating_point_v<T>)
+            p_ = detail::store_le(std::bit_cast<Raw>(v), p_);
+          else
+            p_ = detail::store_le(static_cast<Raw>(v), p_);
+        }
+      }
+    }
+  }
+
+  // Packed run from any other sized range, e.g. std::vector<bool>.
+  template <int Number, WireKind K, std::ranges::sized_range R>
+    requires(!std::is_convertible_v<
+             const R &, std::span<const typename detail::WireValue<K>::type>>)
+  void packed(const R &values) {
+    static_assert(detail::wire_type_of(K) == detail::kWireVarint);
+    using Tag = detail::WireTag<Number, detail::kWireLen>;
+    if (std::ranges::empty(values))
+      return;
+    std::size_t n = 0;
+    for (const auto v : values)
+      n += detail::varint_size(detail::varint_of<K>(v));
+    reserve(Tag::size + detail::varint_size(n) + n);
+    put_tag<Tag>();
+    p_ = detail::put_varint(n, p_);
+    for (const auto v : values)
+      p_ = detail::put_varint(detail::varint_of<K>(v), p_);
+  }
+
+  // Starts submessage Number and returns the handle close() takes once
+  // its fields are written.
+  template <int Number> [[nodiscard]] std::size_t open() {
+    using Tag = detail::WireTag<Number, detail::kWireLen>;
+    reserve(Tag::size + 1);
+    put_tag<Tag>();
+    ++p_; // the length, if it fits in one byte
+    return size();
+  }
+
+  void close(std::size_t body) {
+    std::byte *b = begin_ + body;
+    const std::size_t len = detail::checked_size(static_cast<std::size_t>(p_ - b));
+    if (len < 0x80) {
+      b[-1] = static_cast<std::byte>(len);
+      return;
+    }
+    const std::size_t extra = detail::varint_size(len) - 1;
+    reserve(extra);
+    std::memmove(b + extra, b, len);
+    detail::put_varint(len, b - 1);
+    p_ += extra;
+  }
+
+  // Writes an existing message (or XWrapped) as submessage Number.
+  template <int Number, typename M> void message(const M &m) {
+    const auto &msg = detail::message_of(m);
+    using Tag = detail::WireTag<Number, detail::kWireLen>;
+    const std::size_t n = detail::checked_size(msg.ByteSizeLong());
+    reserve(Tag::size + detail::varint_size(n) + n);
+    put_tag<Tag>();
+    p_ = detail::put_varint(n, p_);
+    p_ = reinterpret_cast<std::byte *>(msg.SerializeWithCachedSizesToArray(
+        reinterpret_cast<uint8_t *>(p_)));
+  }
+
+  // The varint length prefix of protobuf's delimited format, back-patched
+  // like a submessage's.
+  [[nodiscard]] std::size_t open_frame() {
+    reserve(1);
+    ++p_;
+    return size();
+  }
+
+private:
+  void reserve(std::size_t n) const {
+    if (static_cast<std::size_t>(end_ - p_) < n)
+      throw std::length_error("WireWriter: buffer too small");
+  }
+
+  template <typename Tag> void put_tag() noexcept {
+    for (std::size_t i = 0; i < Tag::size; ++i)
+      p_[i] = Tag::bytes[i];
+    p_ += Tag::size;
+  }
+
+  std::byte *begin_;
+  std::byte *p_;
+  std::byte *end_;
+};
+
+namespace detail {
+// Builder fields share a union with the builder's WireWriter pointer.
+[[nodiscard]] inline WireWriter &builder_out(const void *self) noexcept {
+  return **static_cast<WireWriter *const *>(self);
+}
+
+template <typename Builder, int Number, typename Fn>
+void build_message(WireWriter &out, Fn &&fn) {
+  const std::size_t body = out.open<Number>();
+  std::forward<Fn>(fn)(Builder(out));
+  out.close(body);
+}
+} // namespace detail
+
+// Singular scalar, enum, string or bytes field: `u.id = 7`.
+template <int Number, WireKind K, Presence P = Presence::kImplicit>
+struct BuilderField {
+  using value_type = typename detail::WireValue<K>::type;
+
+  const BuilderField &operator=(value_type v) const {
+    if constexpr (P == Presence::kImplicit)
+      if (detail::is_default<K>(v))
+        return *this;
+    detail::builder_out(this).template scalar<Number, K>(v);
+    return *this;
+  }
+};
+
+// Singular submessage: `u.profile([&](ProfileBuilder p) { ... })` builds
+// it in place, `u.profile = msg` copies a message or XWrapped in.
+template <int Number, typename Builder> struct BuilderMessage {
+  template <typename Fn>
+    requires std::is_invocable_v<Fn, Builder>
+  void operator()(Fn &&fn) const {
+    detail::build_message<Builder, Number>(detail::builder_out(this),
+                                           std::forward<Fn>(fn));
+  }
+
+  template <typename M>
+    requires(!std::is_invocable_v<M, Builder>)
+  const BuilderMessage &operator=(const M &m) const {
+    detail::builder_out(this).template message<Number>(m);
+    return *this;
+  }
+};
+
+// Repeated scalar, enum, string or bytes field. Packed fields take the
+// whole run at once (`u.numbers = span`), the others also take add(v).
+template <int Number, WireKind K, bool Packed> struct BuilderRepeated {
+  using value_type = typename detail::WireValue<K>::type;
+
+  void add(value_type v) const
+    requires(!Packed)
+  {
+    detail::builder_out(this).template scalar<Number, K>(v);
+  }
+
+  const BuilderRepeated &operator=(std::span<const value_type> values) const {
+    if constexpr (Packed) {
+      detail::builder_out(this).template packed<Number, K>(values);
+    } else {
+      for (const value_type &v : values)
+        add(v);
+    }
+    return *this;
+  }
+  const BuilderRepeated &
+  operator=(std::initializer_list<value_type> values) const {
+    return *this = std::span<const value_type>(values.begin(), values.size());
+  }
+
+  // Any other range element by element, e.g. strings into string_views.
+  template <typename R>
+    requires(!Packed && !std::is_convertible_v<const R &,
+                                               std::span<const value_type>>)
+  const BuilderRepeated &operator=(const R &values) const {
+    for (const auto &v : values)
+      add(value_type(v));
+    return *this;
+  }
+};
+
+// Repeated submessage: add(fn) builds one element in place, add(msg)
+// copies one in.
+template <int Number, typename Builder> struct BuilderRepeatedMessage {
+  template <typename Fn>
+    requires std::is_invocable_v<Fn, Builder>
+  void add(Fn &&fn) const {
+    detail::build_message<Builder, Number>(detail::builder_out(this),
+                                           std::forward<Fn>(fn));
+  }
+
+  template <typename M>
+    requires(!std::is_invocable_v<M, Builder>)
+  void add(const M &m) const {
+    detail::builder_out(this).template message<Number>(m);
+  }
+};
+
+// Map field: one entry per add(key, value). Message values are built by
+// a function like singular submessages, or copied in. Both key and value
+// are written, as the serializer does for map entries.
+template <int Number, WireKind Key, WireKind Value, typename Builder = void>
+struct BuilderMap {
+  using key_type = typename detail::WireValue<Key>::type;
+
+  template <typename V> void add(key_type key, V &&value) const {
+    WireWriter &out = detail::builder_out(this);
+    const std::size_t body = out.open<Number>();
+    out.scalar<1, Key>(key);
+    if constexpr (Value != WireKind::kMessage) {
+      out.scalar<2, Value>(std::forward<V>(value));
+    } else if constexpr (std::is_invocable_v<V, Builder>) {
+      detail::build_message<Builder, 2>(out, std::forward<V>(value));
+    } else {
+      out.message<2>(value);
+    }
+    out.close(body);
+  }
+};
+
+// Runs fn on a Builder over the front of out and returns the bytes
+// written.
+template <typename Builder, typename Fn>
+std::size_t build(std::span<std::byte> out, Fn &&fn) {
+  WireWriter w(out);
+  std::forward<Fn>(fn)(Builder(w));
+  return w.size();
+}
+
+// build() with protobuf's varint length prefix in front, as read by
+// parse_framed.
+template <typename Builder, typename Fn>
+std::size_t build_framed(std::span<std::byte> out, Fn &&fn) {
+  WireWriter w(out);
+  const std::size_t body = w.open_frame();
+  std::forward<Fn>(fn)(Builder(w));
+  w.close(body);
+  return w.size();
+}
+
+} // namespace sugar
@@ -0,0 +1,1104 @@
+#pragma once
+
+/*
+ * sugar_columns.h
+ *
+ * Copyright 2025 M.Berkay Karatas
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Columnar files of one message type, for offline scans that read a few
+// fields of many records:
+//
+//   sugar::ColumnWriter w(User::descriptor(), fd);
+//   for (...) w.write(u);                     // message or XWrapped
+//   w.finish();                               // last row group and footer
+//
+//   sugar::ColumnReader r(mapped_file);
+//   r.scan<int32_t>("id", [&](const sugar::ColumnEntry<int32_t>& e) {...});
+//   r.scan<std::string_view>("profile.city", fn, {.min = "B", .max = "C"});
+//
+// Messages are shredded as in Dremel: each leaf field path is a column
+// (maps are repeated key/value entries) of (repetition level, definition
+// level, value) entries. The repetition level tells at which repeated field
+// of the path a new element starts, 0 being a new record. The definition
+// level counts the fields along the path that are present: repeated fields
+// when non-empty, submessages and scalars with presence when set. Entries
+// below the column's maximum definition level carry no value.
+//
+// Layout (fixed-width integers are little-endian, varints as in protobuf):
+//
+//   "SCOL"
+//   row groups  one chunk per column: [repetition levels][definition
+//               levels][encoding byte][values]
+//   footer      the columns, then per row group and column the chunk's
+//               offset, size, CRC32C, entry and value counts and min/max
+//   u32 footer size, u32 CRC32C of the footer, "SCOL"
+//
+// Levels are run-length encoded (varint run, level byte) and left out when
+// their maximum is 0. Each chunk stores its values in whichever encoding is
+// smallest for it: plain, delta or RLE for integers, plain or RLE for
+// floating point, plain or dictionary for strings and bytes. A reader
+// parses the footer and then touches only the chunks of the columns it
+// scans, skipping those whose min/max rule out the requested range. Full
+// runtime only: shredding walks fields by reflection.
+
+#include "sugar_blocks.h"
+#include "sugar_core.h"
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace sugar {
+
+struct ColumnInfo {
+  std::string path; // dotted field names, "profiles.city"
+  FieldKind kind;   // maps' columns are their key and value fields
+  uint8_t max_repetition;
+  uint8_t max_definition;
+};
+
+enum class ColumnEncoding : uint8_t { kPlain, kDelta, kRle, kDictionary };
+
+struct ColumnChunkInfo {
+  uint64_t offset; // from the start of the file
+  uint64_t size;
+  uint64_t entries; // levels, including null entries
+  uint64_t values;
+  ColumnEncoding encoding;
+};
+
+// One entry of a column scan. Strings and bytes point into the file.
+template <typename T> struct ColumnEntry {
+  T value{}; // T{} unless present
+  uint8_t repetition = 0;
+  uint8_t definition = 0;
+  bool present = false; // definition == max_definition
+};
+
+// Chunks whose min/max lie entirely outside [min, max] are skipped.
+template <typename T> struct ValueRange {
+  std::optional<T> min{};
+  std::optional<T> max{};
+};
+
+struct ColumnScanStats {
+  std::size_t chunks_read = 0;
+  std::size_t chunks_skipped = 0;
+  std::size_t entries = 0;
+};
+
+namespace detail {
+inline constexpr uint32_t kColumnMagic = 0x4c4f4353; // "SCOL"
+inline constexpr std::size_t kColumnTrailerSize = 12;
+
+// How a column's values are stored: integers as varints (signed ones
+// zigzagged), float and double as their bits, strings and bytes with a
+// varint length. In memory every number is a uint64_t holding the
+// sign-extended integer or the floating-point bits.
+enum class Physical : uint8_t { kSigned, kUnsigned, kFloat, kDouble, kBytes };
+
+constexpr Physical physical(FieldKind k) noexcept {
+  switch (k) {
+  case FieldKind::kInt32:
+  case FieldKind::kInt64:
+  case FieldKind::kEnum:
+    return Physical::kSigned;
+  case FieldKind::kUInt32:
+  case FieldKind::kUInt64:
+  case FieldKind::kBool:
+    return Physical::kUnsigned;
+  case FieldKind::kFloat:
+    return Physical::kFloat;
+  case FieldKind::kDouble:
+    return Physical::kDouble;
+  default:
+    return Physical::kBytes;
+  }
+}
+
+inline FieldKind column_kind(const google::protobuf::FieldDescriptor *f) {
+  using FD = google::protobuf::FieldDescriptor;
+  if (f->type() == FD::TYPE_BYTES)
+    return FieldKind::kBytes;
+  switch (f->cpp_type()) {
+  case FD::CPPTYPE_INT32:
+    return FieldKind::kInt32;
+  case FD::CPPTYPE_INT64:
+    return FieldKind::kInt64;
+  case FD::CPPTYPE_UINT32:
+    return FieldKind::kUInt32;
+  case FD::CPPTYPE_UINT64:
+    return FieldKind::kUInt64;
+  case FD::CPPTYPE_BOOL:
+    return FieldKind::kBool;
+  case FD::CPPTYPE_FLOAT:
+    return FieldKind::kFloat;
+  case FD::CPPTYPE_DOUBLE:
+    return FieldKind::kDouble;
+  case FD::CPPTYPE_ENUM:
+    return FieldKind::kEnum;
+  case FD::CPPTYPE_STRING:
+    return FieldKind::kString;
+  default:
+    return FieldKind::kMessage;
+  }
+}
+
+[[nodiscard]] constexpr uint64_t zigzag(uint64_t v) noexcept {
+  return (v << 1) ^ (0 - (v >> 63));
+}
+
+[[nodiscard]] constexpr uint64_t unzigzag(uint64_t v) noexcept {
+  return (v >> 1) ^ (0 - (v & 1));
+}
+
+[[nodiscard]] constexpr std::size_t plain_size(Physical p,
+                                               uint64_t v) noexcept {
+  switch (p) {
+  case Physical::kSigned:
+    return varint_size(zigzag(v));
+  case Physical::kFloat:
+    return 4;
+  case Physical::kDouble:
+    return 8;
+  default:
+    return varint_size(v);
+  }
+}
+
+inline void append_plain(std::vector<std::byte> &out, Physical p, uint64_t v) {
+  switch (p) {
+  case Physical::kSigned:
+    append_varint(out, zigzag(v));
+    break;
+  case Physical::kFloat:
+  case Physical::kDouble: {
+    const std::size_t n = p == Physical::kFloat ? 4 : 8;
+    for (std::size_t i = 0; i < n; ++i)
+      out.push_back(static_cast<std::byte>(v >> (8 * i)));
+    break;
+  }
+  default:
+    append_varint(out, v);
+  }
+}
+
+inline bool read_plain(const std::byte *&p, const std::byte *end, Physical k,
+                       uint64_t &v) noexcept {
+  if (k == Physical::kFloat || k == Physical::kDouble) {
+    const std::size_t n = k == Physical::kFloat ? 4 : 8;
+    if (static_cast<std::size_t>(end - p) < n)
+      return false;
+    v = 0;
+    for (std::size_t i = 0; i < n; ++i)
+      v |= std::to_integer<uint64_t>(p[i]) << (8 * i);
+    p += n;
+    return true;
+  }
+  if (!read_varint(p, end, v))
+    return false;
+  if (k == Physical::kSigned)
+    v = unzigzag(v);
+  return true;
+}
+
+inline void append_string(std::vector<std::byte> &out, std::string_view s) {
+  append_varint(out, s.size());
+  const auto *b = reinterpret_cast<const std::byte *>(s.data());
+  out.insert(out.end(), b, b + s.size());
+}
+
+inline bool read_string(const std::byte *&p, const std::byte *end,
+                        std::string_view &s) noexcept {
+  uint64_t n;
+  if (!read_varint(p, end, n) || n > static_cast<uint64_t>(end - p))
+    return false;
+  s = {reinterpret_cast<const char *>(p), static_cast<std::size_t>(n)};
+  p += n;
+  return true;
+}
+
+// Orders raw values of kind p; NaNs are never min or max.
+[[nodiscard]] inline bool raw_less(Physical p, uint64_t a,
+                                   uint64_t b) noexcept {
+  switch (p) {
+  case Physical::kSigned:
+    return static_cast<int64_t>(a) < static_cast<int64_t>(b);
+  case Physical::kFloat:
+    return std::bit_cast<float>(static_cast<uint32_t>(a)) <
+           std::bit_cast<float>(static_cast<uint32_t>(b));
+  case Physical::kDouble:
+    return std::bit_cast<double>(a) < std::bit_cast<double>(b);
+  default:
+    return a < b;
+  }
+}
+
+[[nodiscard]] inline bool is_nan(Physical p, uint64_t v) noexcept {
+  if (p == Physical::kFloat) {
+    const float f = std::bit_cast<float>(static_cast<uint32_t>(v));
+    return f != f;
+  }
+  if (p == Physical::kDouble) {
+    const double d = std::bit_cast<double>(v);
+    return d != d;
+  }
+  return false;
+}
+
+// Level runs: (varint run length, level byte) until n levels are covered.
+inline void append_levels(std::vector<std::byte> &out,
+                          const std::vector<uint8_t> &levels) {
+  for (std::size_t i = 0; i < levels.size();) {
+    std::size_t j = i + 1;
+    while (j < levels.size() && levels[j] == levels[i])
+      ++j;
+    append_varint(out, j - i);
+    out.push_back(static_cast<std::byte>(levels[i]));
+    i = j;
+  }
+}
+
+inline bool read_levels(const std::byte *&p, const std::byte *end,
+                        std::size_t n, uint8_t max,
+                        std::vector<uint8_t> &levels) {
+  levels.clear();
+  while (levels.size() < n) {
+    uint64_t run;
+    if (!read_varint(p, end, run) || p == end || run == 0 ||
+        run > n - levels.size())
+      return false;
+    const auto level = std::to_integer<uint8_t>(*p++);
+    if (level > max)
+      return false;
+    levels.insert(levels.end(), static_cast<std::size_t>(run), level);
+  }
+  return true;
+}
+
+// Column values of the open row group.
+struct ColumnBuffer {
+  std::vector<uint8_t> repetition;
+  std::vector<uint8_t> definition;
+  std::vector<uint64_t> numbers;
+  std::string bytes;               // strings back to back
+  std::vector<std::size_t> ends;   // end of each string in bytes
+
+  [[nodiscard]] std::string_view string(std::size_t i) const noexcept {
+    const std::size_t begin = i ? ends[i - 1] : 0;
+    return std::string_view(bytes).substr(begin, ends[i] - begin);
+  }
+
+  void clear() noexcept {
+    repetition.clear();
+    definition.clear();
+    numbers.clear();
+    bytes.clear();
+    ends.clear();
+  }
+};
+
+struct ChunkMeta {
+  uint64_t offset = 0;
+  uint64_t size = 0;
+  uint32_t crc = 0;
+  uint64_t entries = 0;
+  uint64_t values = 0;
+  ColumnEncoding encoding = ColumnEncoding::kPlain;
+  bool has_stats = false;
+  uint64_t min = 0, max = 0;           // numbers
+  std::string_view min_bytes, max_bytes; // strings; into the writer's
+                                         // footer storage or the file
+};
+} // namespace detail
+
+// ---- Writer ----------------------------------------------------------------
+
+struct ColumnWriterOptions {
+  // Records per row group; a row group holds one chunk per column.
+  std::size_t row_group_rows = std::size_t{64} << 10;
+  bool dictionary = true;
+};
+
+// Shreds messages of one type into row groups of column chunks and hands
+// each sealed row group, then the footer, to a sink. Call finish() at the
+// end; the destructor does not write.
+class ColumnWriter {
+public:
+  using Sink = std::function<void(std::span<const std::byte>)>;
+
+  // Throws std::invalid_argument for recursive message types, which have
+  // no fixed set of columns.
+  ColumnWriter(const google::protobuf::Descriptor *d, Sink sink,
+               ColumnWriterOptions opts = {})
+      : descriptor_(d), sink_(std::move(sink)), opts_(opts) {
+    std::vector<const google::protobuf::Descriptor *> stack{d};
+    build(d, "", 0, 0, nodes_, stack);
+    buffers_.resize(columns_.size());
+  }
+
+  // Appends to fd. Throws std::system_error if a write fails.
+  ColumnWriter(const google::protobuf::Descriptor *d, int fd,
+               ColumnWriterOptions opts = {})
+      : ColumnWriter(d, detail::fd_sink(fd, "ColumnWriter: write"), opts) {}
+
+  // m is a message of the writer's type or its XWrapped.
+  template <typename T> void write(const T &m) {
+    const auto &msg =
+        static_cast<const google::protobuf::Message &>(detail::message_of(m));
+    if (finished_)
+      throw std::runtime_error("ColumnWriter: write after finish");
+    if (msg.GetDescriptor() != descriptor_)
+      throw std::invalid_argument("ColumnWriter: expected " +
+                                  descriptor_->full_name() + ", got " +
+                                  msg.GetDescriptor()->full_name());
+    shred(msg, nodes_, 0, 0);
+    if (++open_rows_ == opts_.row_group_rows)
+      flush_row_group();
+  }
+
+  // Seals the open row group and writes the footer.
+  void finish() {
+    if (finished_)
+      return;
+    flush_row_group();
+    start();
+    encode_footer();
+    emit(out_);
+    finished_ = true;
+  }
+
+  [[nodiscard]] const std::vector<ColumnInfo> &columns() const noexcept {
+    return columns_;
+  }
+  [[nodiscard]] uint64_t rows_written() const noexcept { return rows_; }
+  [[nodiscard]] uint64_t bytes_written() const noexcept { return offset_; }
+
+private:
+  using FD = google::protobuf::FieldDescriptor;
+
+  struct Node {
+    const FD *field = nullptr;
+    int column = -1;              // leaves
+    std::size_t first = 0, last = 0; // leaf columns below, [first, last)
+    uint8_t repetition = 0;   // of this field's elements after the first
+    uint8_t definition = 0;   // when this field is present
+    std::vector<Node> children;
+  };
+
+  struct RowGroup {
+    uint64_t rows;
+    std::vector<detail::ChunkMeta> chunks;
+  };
+
+  static uint8_t level(int l) {
+    if (l > 255)
+      throw std::length_error("ColumnWriter: fields nested too deeply");
+    return static_cast<uint8_t>(l);
+  }
+
+  void build(const google::protobuf::Descriptor *d, const std::string &prefix,
+             int repetition, int definition, std::vector<Node> &out,
+             std::vector<const google::protobuf::Descriptor *> &stack) {
+    for (int i = 0; i < d->field_count(); ++i) {
+      const FD *f = d->field(i);
+      Node n;
+      n.field = f;
+      n.repetition = level(repetition + f->is_repeated());
+      n.definition = level(definition + (f->is_repeated() || f->has_presence()));
+      n.first = columns_.size();
+      const std::string path = prefix + f->name();
+      if (f->cpp_type() == FD::CPPTYPE_MESSAGE) {
+        const auto *sub = f->message_type();
+        if (std::find(stack.begin(), stack.end(), sub) != stack.end())
+          throw std::invalid_argument("ColumnWriter: " + f->full_name() +
+                                      " is recursive");
+        stack.push_back(sub);
+        build(sub, path + ".", n.repetition, n.definition, n.children, stack);
+        stack.pop_back();
+      } else {
+        n.column = static_cast<int>(columns_.size());
+        columns_.push_back(
+            {path, detail::column_kind(f), n.repetition, n.definition});
+      }
+      n.last = columns_.size();
+      out.push_back(std::move(n));
+    }
+  }
+
+  // Entries without a value for every column below n.
+  void nulls(const Node &n, uint8_t repetition, uint8_t definition) {
+    for (std::size_t c = n.first; c < n.last; ++c) {
+      buffers_[c].repetition.push_back(repetition);
+      buffers_[c].definition.push_back(definition);
+    }
+  }
+
+  // Appends the value of scalar field f (element i, or the singular value
+  // when i < 0) to its column.
+  void value(const Node &n, const google::protobuf::Message &m, int i,
+             uint8_t repetition) {
+    const auto *r = m.GetReflection();
+    const FD *f = n.field;
+    auto &b = buffers_[n.column];
+    b.repetition.push_back(repetition);
+    b.definition.push_back(n.definition);
+    const auto num = [&](auto v) {
+      if constexpr (std::is_floating_point_v<decltype(v)>)
+        b.numbers.push_back(std::bit_cast<
+                            std::conditional_t<sizeof(v) == 4, uint32_t,
+                                               uint64_t>>(v));
+      else if constexpr (std::is_signed_v<decltype(v)>)
+        b.numbers.push_back(static_cast<uint64_t>(static_cast<int64_t>(v)));
+      else
+        b.numbers.push_back(static_cast<uint64_t>(v));
+    };
+    switch (f->cpp_type()) {
+    case FD::CPPTYPE_INT32:
+      num(i < 0 ? r->GetInt32(m, f) : r->GetRepeatedInt32(m, f, i));
+      break;
+    case FD::CPPTYPE_INT64:
+      num(i < 0 ? r->GetInt64(m, f) : r->GetRepeatedInt64(m, f, i));
+      break;
+    case FD::CPPTYPE_UINT32:
+      num(i < 0 ? r->GetUInt32(m, f) : r->GetRepeatedUInt32(m, f, i));
+      break;
+    case FD::CPPTYPE_UINT64:
+      num(i < 0 ? r->GetUInt64(m, f) : r->GetRepeatedUInt64(m, f, i));
+      break;
+    case FD::CPPTYPE_BOOL:
+      num(i < 0 ? r->GetBool(m, f) : r->GetRepeatedBool(m, f, i));
+      break;
+    case FD::CPPTYPE_FLOAT:
+      num(i < 0 ? r->GetFloat(m, f) : r->GetRepeatedFloat(m, f, i));
+      break;
+    case FD::CPPTYPE_DOUBLE:
+      num(i < 0 ? r->GetDouble(m, f) : r->GetRepeatedDouble(m, f, i));
+      break;
+    case FD::CPPTYPE_ENUM:
+      num(i < 0 ? r->GetEnumValue(m, f) : r->GetRepeatedEnumValue(m, f, i));
+      break;
+    default: {
+      const std::string &s =
+          i < 0 ? r->GetStringReference(m, f, &scratch_)
+                : r->GetRepeatedStringReference(m, f, i, &scratch_);
+      b.bytes += s;
+      b.ends.push_back(b.bytes.size());
+    }
+    }
+  }
+
+  void shred(const google::protobuf::Message &m, const std::vector<Node> &nodes,
+             uint8_t repetition, uint8_t definition) {
+    const auto *r = m.GetReflection();
+    for (const Node &n : nodes) {
+      const FD *f = n.field;
+      const bool message = f->cpp_type() == FD::CPPTYPE_MESSAGE;
+      if (f->is_repeated()) {
+        const int size = r->FieldSize(m, f);
+        if (!size)
+          nulls(n, repetition, definition);
+        for (int i = 0; i < size; ++i) {
+          const uint8_t at = i ? n.repetition : repetition;
+          if (message)
+            shred(r->GetRepeatedMessage(m, f, i), n.children, at,
+                  n.definition);
+          else
+            value(n, m, i, at);
+        }
+      } else if (f->has_presence() && !r->HasField(m, f)) {
+        nulls(n, repetition, definition);
+      } else if (message) {
+        shred(r->GetMessage(m, f), n.children, repetition, n.definition);
+      } else {
+        value(n, m, -1, repetition);
+      }
+    }
+  }
+
+  void emit(std::span<const std::byte> bytes) {
+    sink_(bytes);
+    offset_ += bytes.size();
+  }
+
+  void start() {
+    if (offset_)
+      return;
+    std::byte magic[4];
+    detail::store_u32le(detail::kColumnMagic, magic);
+    emit(magic);
+  }
+
+  void flush_row_group() {
+    if (!open_rows_)
+      return;
+    start();
+    RowGroup group{open_rows_, {}};
+    out_.clear();
+    for (std::size_t c = 0; c < columns_.size(); ++c) {
+      detail::ChunkMeta meta;
+      meta.offset = offset_ + out_.size();
+      encode_chunk(columns_[c], buffers_[c], meta);
+      meta.size = offset_ + out_.size() - meta.offset;
+      meta.crc = crc32c(std::span(out_).last(meta.size));
+      group.chunks.push_back(meta);
+      buffers_[c].clear();
+    }
+    emit(out_);
+    rows_ += open_rows_;
+    open_rows_ = 0;
+    groups_.push_back(std::move(group));
+  }
+
+  // Keeps chunk statistics for the footer: the buffers are reused.
+  std::string_view keep(std::string_view s) {
+    return kept_.emplace_back(s);
+  }
+
+  void encode_chunk(const ColumnInfo &info, const detail::ColumnBuffer &b,
+                    detail::ChunkMeta &meta) {
+    meta.entries = b.definition.size();
+    if (info.max_repetition)
+      detail::append_levels(out_, b.repetition);
+    if (info.max_definition)
+      detail::append_levels(out_, b.definition);
+    const detail::Physical p = detail::physical(info.kind);
+    if (p == detail::Physical::kBytes)
+      encode_strings(b, meta);
+    else
+      encode_numbers(p, b.numbers, meta);
+  }
+
+  void encode_numbers(detail::Physical p, const std::vector<uint64_t> &v,
+                      detail::ChunkMeta &meta) {
+    meta.values = v.size();
+    const bool integer =
+        p == detail::Physical::kSigned || p == detail::Physical::kUnsigned;
+    std::size_t plain = 0, delta = 0, rle = 0;
+    uint64_t prev = 0;
+    for (std::size_t i = 0; i < v.size(); ++i) {
+      plain += detail::plain_size(p, v[i]);
+      delta += detail::varint_size(detail::zigzag(v[i] - prev));
+      prev = v[i];
+      if (!i || v[i] != v[i - 1]) {
+        std::size_t run = 1;
+        while (i + run < v.size() && v[i + run] == v[i])
+          ++run;
+        rle += detail::varint_size(run) + detail::plain_size(p, v[i]);
+      }
+      if (detail::is_nan(p, v[i]))
+        continue;
+      if (!meta.has_stats || detail::raw_less(p, v[i], meta.min))
+        meta.min = v[i];
+      if (!meta.has_stats || detail::raw_less(p, meta.max, v[i]))
+        meta.max = v[i];
+      meta.has_stats = true;
+    }
+    meta.encoding = ColumnEncoding::kPlain;
+    if (integer && delta < plain && delta <= rle)
+      meta.encoding = ColumnEncoding::kDelta;
+    else if (rle < plain)
+      meta.encoding = ColumnEncoding::kRle;
+    out_.push_back(static_cast<std::byte>(meta.encoding));
+
+    switch (meta.encoding) {
+    case ColumnEncoding::kDelta:
+      prev = 0;
+      for (uint64_t x : v) {
+        detail::append_varint(out_, detail::zigzag(x - prev));
+        prev = x;
+      }
+      break;
+    case ColumnEncoding::kRle:
+      for (std::size_t i = 0; i < v.size();) {
+        std::size_t j = i + 1;
+        while (j < v.size() && v[j] == v[i])
+          ++j;
+        detail::append_varint(out_, j - i);
+        detail::append_plain(out_, p, v[i]);
+        i = j;
+      }
+      break;
+    default:
+      for (uint64_t x : v)
+        detail::append_plain(out_, p, x);
+    }
+  }
+
+  void encode_strings(const detail::ColumnBuffer &b, detail::ChunkMeta &meta) {
+    const std::size_t n = b.ends.size();
+    meta.values = n;
+    std::size_t plain = 0;
+    std::string_view min, max;
+    dictionary_.clear();
+    indices_.clear();
+    std::size_t dict = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+      const std::string_view s = b.string(i);
+      plain += detail::varint_size(s.size()) + s.size();
+      if (!i || s < min)
+        min = s;
+      if (!i || max < s)
+        max = s;
+      if (!opts_.dictionary)
+        continue;
+      const auto [it, fresh] = dictionary_.try_emplace(
+          s, static_cast<uint32_t>(dictionary_.size()));
+      if (fresh)
+        dict += detail::varint_size(s.size()) + s.size();
+      indices_.push_back(it->second);
+    }
+    if (n) {
+      meta.has_stats = true;
+      meta.min_bytes = keep(min);
+      meta.max_bytes = keep(max);
+    }
+    if (opts_.dictionary && n) {
+      dict += detail::varint_size(dictionary_.size());
+      for (std::size_t i = 0; i < n;) {
+        std::size_t j = i + 1;
+        while (j < n && indices_[j] == indices_[i])
+          ++j;
+        dict += detail::varint_size(j - i) + detail::varint_size(indices_[i]);
+        i = j;
+      }
+    }
+    meta.encoding = opts_.dictionary && n && dict < plain
+                        ? ColumnEncoding::kDictionary
+                        : ColumnEncoding::kPlain;
+    out_.push_back(static_cast<std::byte>(meta.encoding));
+
+    if (meta.encoding == ColumnEncoding::kPlain) {
+      for (std::size_t i = 0; i < n; ++i)
+        detail::append_string(out_, b.string(i));
+      return;
+    }
+    entries_.assign(dictionary_.size(), {});
+    for (const auto &[s, index] : dictionary_)
+      entries_[index] = s;
+    detail::append_varint(out_, entries_.size());
+    for (std::string_view s : entries_)
+      detail::append_string(out_, s);
+    for (std::size_t i = 0; i < n;) {
+      std::size_t j = i + 1;
+      while (j < n && indices_[j] == indices_[i])
+        ++j;
+      detail::append_varint(out_, j - i);
+      detail::append_varint(out_, indices_[i]);
+      i = j;
+    }
+  }
+
+  void encode_footer() {
+    out_.clear();
+    detail::append_varint(out_, columns_.size());
+    for (const ColumnInfo &c : columns_) {
+      detail::append_string(out_, c.path);
+      out_.push_back(static_cast<std::byte>(c.kind));
+      out_.push_back(static_cast<std::byte>(c.max_repetition));
+      out_.push_back(static_cast<std::byte>(c.max_definition));
+    }
+    detail::append_varint(out_, groups_.size());
+    for (const RowGroup &g : groups_) {
+      detail::append_varint(out_, g.rows);
+      for (std::size_t c = 0; c < columns_.size(); ++c) {
+        const detail::ChunkMeta &m = g.chunks[c];
+        detail::append_varint(out_, m.offset);
+        detail::append_varint(out_, m.size);
+        std::byte crc[4];
+        detail::store_u32le(m.crc, crc);
+        out_.insert(out_.end(), crc, crc + 4);
+        detail::append_varint(out_, m.entries);
+        detail::append_varint(out_, m.values);
+        out_.push_back(static_cast<std::byte>(m.encoding));
+        out_.push_back(static_cast<std::byte>(m.has_stats));
+        if (!m.has_stats)
+          continue;
+        const detail::Physical p = detail::physical(columns_[c].kind);
+        if (p == detail::Physical::kBytes) {
+          detail::append_string(out_, m.min_bytes);
+          detail::append_string(out_, m.max_bytes);
+        } else {
+          detail::append_plain(out_, p, m.min);
+          detail::append_plain(out_, p, m.max);
+        }
+      }
+    }
+    const std::size_t size = out_.size();
+    if (size > UINT32_MAX)
+      throw std::length_error("ColumnWriter: footer exceeds 4GB");
+    std::byte trailer[detail::kColumnTrailerSize];
+    detail::store_u32le(static_cast<uint32_t>(size), trailer);
+    detail::store_u32le(crc32c(out_), trailer + 4);
+    detail::store_u32le(detail::kColumnMagic, trailer + 8);
+    out_.insert(out_.end(), trailer, trailer + sizeof(trailer));
+  }
+
+  const google::protobuf::Descriptor *descriptor_;
+  Sink sink_;
+  ColumnWriterOptions opts_;
+  std::vector<Node> nodes_;
+  std::vector<ColumnInfo> columns_;
+  std::vector<detail::ColumnBuffer> buffers_;
+  std::vector<RowGroup> groups_;
+  std::deque<std::string> kept_; // stable for the views into it
+  std::vector<std::byte> out_;
+  std::string scratch_;
+  std::unordered_map<std::string_view, uint32_t> dictionary_;
+  std::vector<uint32_t> indices_;
+  std::vector<std::string_view> entries_;
+  uint64_t open_rows_ = 0;
+  uint64_t rows_ = 0;
+  uint64_t offset_ = 0;
+  bool finished_ = false;
+};
+
+// ---- Reader ----------------------------------------------------------------
+
+// Reads a column file out of memory (a mapped or fully read file); data
+// must outlive the reader and the string values it hands out. Throws
+// std::runtime_error if the footer is damaged.
+class ColumnReader {
+public:
+  explicit ColumnReader(std::span<const std::byte> data) : data_(data) {
+    parse_footer();
+  }
+
+  [[nodiscard]] const std::vector<ColumnInfo> &columns() const noexcept {
+    return columns_;
+  }
+  [[nodiscard]] uint64_t rows() const noexcept { return rows_; }
+  [[nodiscard]] std::size_t row_groups() const noexcept {
+    return group_rows_.size();
+  }
+
+  // Index of the column at path; throws std::invalid_argument if there is
+  // none.
+  [[nodiscard]] std::size_t column(std::string_view path) const {
+    for (std::size_t c = 0; c < columns_.size(); ++c)
+      if (columns_[c].path == path)
+        return c;
+    throw std::invalid_argument("ColumnReader: no column \"" +
+                                std::string(path) + "\"");
+  }
+
+  [[nodiscard]] ColumnChunkInfo chunk(std::size_t row_group,
+                                      std::string_view path) const {
+    if (row_group >= row_groups())
+      throw std::out_of_range("ColumnReader: no such row group");
+    const auto &m = chunks_[row_group * columns_.size() + column(path)];
+    return {m.offset, m.size, m.entries, m.values, m.encoding};
+  }
+
+  // Calls fn(const ColumnEntry<T>&) for every entry of the column at path,
+  // in file order, reading only that column's chunks. T is the field's
+  // type: int32_t (also enums), int64_t, uint32_t, uint64_t, bool, float,
+  // double or std::string_view (string and bytes). Chunks whose min/max
+  // rule out range are skipped whole; the entries of chunks that are read
+  // all reach fn. Throws std::invalid_argument for an unknown path or a
+  // T that does not match, std::runtime_error for a corrupt chunk.
+  template <typename T, typename Fn>
+  ColumnScanStats scan(std::string_view path, Fn &&fn,
+                       const ValueRange<T> &range = {}) const {
+    const std::size_t c = column(path);
+    const ColumnInfo &info = columns_[c];
+    if (!holds<T>(info.kind))
+      throw std::invalid_argument("ColumnReader: column \"" + info.path +
+                                  "\" does not hold this type");
+    const detail::Physical p = detail::physical(info.kind);
+    ColumnScanStats stats;
+    Scratch s;
+    for (std::size_t g = 0; g < row_groups(); ++g) {
+      const detail::ChunkMeta &m = chunks_[g * columns_.size() + c];
+      if (!may_match(p, m, range)) {
+        ++stats.chunks_skipped;
+        continue;
+      }
+      decode(info, m, s);
+      std::size_t v = 0;
+      for (std::size_t e = 0; e < m.entries; ++e) {
+        ColumnEntry<T> entry;
+        entry.repetition = info.max_repetition ? s.repetition[e] : 0;
+        entry.definition = info.max_definition ? s.definition[e] : 0;
+        entry.present = entry.definition == info.max_definition;
+        if (entry.present) {
+          if constexpr (std::is_same_v<T, std::string_view>)
+            entry.value = s.strings[v++];
+          else
+            entry.value = from_raw<T>(p, s.numbers[v++]);
+        }
+        fn(std::as_const(entry));
+      }
+      ++stats.chunks_read;
+      stats.entries += m.entries;
+    }
+    return stats;
+  }
+
+private:
+  struct Scratch {
+    std::vector<uint8_t> repetition, definition;
+    std::vector<uint64_t> numbers;
+    std::vector<std::string_view> strings, dictionary;
+  };
+
+  template <typename T> static constexpr bool holds(FieldKind k) noexcept {
+    if constexpr (std::is_same_v<T, int32_t>)
+      return k == FieldKind::kInt32 || k == FieldKind::kEnum;
+    else if constexpr (std::is_same_v<T, int64_t>)
+      return k == FieldKind::kInt64;
+    else if constexpr (std::is_same_v<T, uint32_t>)
+      return k == FieldKind::kUInt32;
+    else if constexpr (std::is_same_v<T, uint64_t>)
+      return k == FieldKind::kUInt64;
+    else if constexpr (std::is_same_v<T, bool>)
+      return k == FieldKind::kBool;
+    else if constexpr (std::is_same_v<T, float>)
+      return k == FieldKind::kFloat;
+    else if constexpr (std::is_same_v<T, double>)
+      return k == FieldKind::kDouble;
+    else if constexpr (std::is_same_v<T, std::string_view>)
+      return k == FieldKind::kString || k == FieldKind::kBytes;
+    else
+      return false;
+  }
+
+  template <typename T>
+  static T from_raw(detail::Physical p, uint64_t v) noexcept {
+    if (p == detail::Physical::kFloat)
+      return static_cast<T>(std::bit_cast<float>(static_cast<uint32_t>(v)));
+    if (p == detail::Physical::kDouble)
+      return static_cast<T>(std::bit_cast<double>(v));
+    if constexpr (std::is_same_v<T, bool>)
+      return v != 0;
+    else
+      return static_cast<T>(v);
+  }
+
+  template <typename T>
+  static bool may_match(detail::Physical p, const detail::ChunkMeta &m,
+                        const ValueRange<T> &range) {
+    if (!range.min && !range.max)
+      return true;
+    if (!m.values)
+      return false; // nothing but null entries
+    if (!m.has_stats)
+      return true;
+    if constexpr (std::is_same_v<T, std::string_view>) {
+      return !(range.min && m.max_bytes < *range.min) &&
+             !(range.max && *range.max < m.min_bytes);
+    } else {
+      return !(range.min && from_raw<T>(p, m.max) < *range.min) &&
+             !(range.max && *range.max < from_raw<T>(p, m.min));
+    }
+  }
+
+  [[noreturn]] static void malformed(const char *what) {
+    throw std::runtime_error(std::string("ColumnReader: ") + what);
+  }
+
+  void decode(const ColumnInfo &info, const detail::ChunkMeta &m,
+              Scratch &s) const {
+    const auto bytes = data_.subspan(m.offset, m.size);
+    if (crc32c(bytes) != m.crc)
+      throw std::runtime_error("ColumnReader: corrupt chunk in column \"" +
+                               info.path + "\"");
+    const std::byte *p = bytes.data();
+    const std::byte *end = p + bytes.size();
+    const auto n = static_cast<std::size_t>(m.entries);
+    if ((info.max_repetition &&
+         !detail::read_levels(p, end, n, info.max_repetition, s.repetition)) ||
+        (info.max_definition &&
+         !detail::read_levels(p, end, n, info.max_definition, s.definition)))
+      malformed("bad levels");
+    if (p == end)
+      malformed("truncated chunk");
+    const auto encoding = static_cast<ColumnEncoding>(*p++);
+    const auto values = static_cast<std::size_t>(m.values);
+    const detail::Physical k = detail::physical(info.kind);
+    bool ok = true;
+    if (k == detail::Physical::kBytes) {
+      s.strings.clear();
+      if (encoding == ColumnEncoding::kPlain) {
+        std::string_view v;
+        while (ok && s.strings.size() < values)
+          if ((ok = detail::read_string(p, end, v)))
+            s.strings.push_back(v);
+      } else if (encoding == ColumnEncoding::kDictionary) {
+        uint64_t entries;
+        ok = detail::read_varint(p, end, entries) &&
+             entries <= static_cast<uint64_t>(end - p);
+        s.dictionary.resize(ok ? static_cast<std::size_t>(entries) : 0);
+        for (auto &v : s.dictionary)
+          ok = ok && detail::read_string(p, end, v);
+        while (ok && s.strings.size() < values) {
+          uint64_t run, index;
+          ok = detail::read_varint(p, end, run) &&
+               detail::read_varint(p, end, index) && run &&
+               run <= values - s.strings.size() && index < entries;
+          if (ok)
+            s.strings.insert(s.strings.end(), static_cast<std::size_t>(run),
+                             s.dictionary[static_cast<std::size_t>(index)]);
+        }
+      } else {
+        ok = false;
+      }
+    } else {
+      s.numbers.clear();
+      uint64_t v = 0;
+      switch (encoding) {
+      case ColumnEncoding::kPlain:
+        while (ok && s.numbers.size() < values)
+          if ((ok = detail::read_plain(p, end, k, v)))
+            s.numbers.push_back(v);
+        break;
+      case ColumnEncoding::kDelta: {
+        uint64_t prev = 0;
+        while (ok && s.numbers.size() < values)
+          if ((ok = detail::read_varint(p, end, v)))
+            s.numbers.push_back(prev += detail::unzigzag(v));
+        break;
+      }
+      case ColumnEncoding::kRle:
+        while (ok && s.numbers.size() < values) {
+          uint64_t run;
+          ok = detail::read_varint(p, end, run) && run &&
+               run <= values - s.numbers.size() &&
+               detail::read_plain(p, end, k, v);
+          if (ok)
+            s.numbers.insert(s.numbers.end(), static_cast<std::size_t>(run),
+                             v);
+        }
+        break;
+      default:
+        ok = false;
+      }
+    }
+    if (!ok || p != end)
+      malformed("bad values");
+    // scan() takes one value per entry at the maximum definition level.
+    const std::size_t present =
+        info.max_definition
+            ? static_cast<std::size_t>(std::count(s.definition.begin(),
+                                                  s.definition.end(),
+                                                  info.max_definition))
+            : n;
+    if (present != (k == detail::Physical::kBytes ? s.strings.size()
+                                                  : s.numbers.size()))
+      malformed("value count does not match levels");
+  }
+
+  void parse_footer() {
+    const std::size_t n = data_.size();
+    if (n < 4 + detail::kColumnTrailerSize ||
+        detail::load_u32le(data_.data()) != detail::kColumnMagic ||
+        detail::load_u32le(data_.data() + n - 4) != detail::kColumnMagic)
+      malformed("not a column file");
+    const std::byte *trailer = data_.data() + n - detail::kColumnTrailerSize;
+    const uint32_t size = detail::load_u32le(trailer);
+    if (size > n - 4 - detail::kColumnTrailerSize)
+      malformed("bad footer size");
+    const auto footer = std::span(trailer - size, size);
+    if (crc32c(footer) != detail::load_u32le(trailer + 4))
+      malformed("corrupt footer");
+    const std::byte *p = footer.data();
+    const std::byte *end = p + footer.size();
+    const uint64_t data_end = static_cast<uint64_t>(footer.data() - data_.data());
+
+    uint64_t count;
+    if (!detail::read_varint(p, end, count) ||
+        count > static_cast<uint64_t>(end - p))
+      malformed("bad column count");
+    for (uint64_t i = 0; i < count; ++i) {
+      std::string_view path;
+      if (!detail::read_string(p, end, path) || end - p < 3)
+        malformed("bad column");
+      const auto kind = std::to_integer<uint8_t>(p[0]);
+      if (kind > static_cast<uint8_t>(FieldKind::kBytes))
+        malformed("bad column kind");
+      columns_.push_back({std::string(path), static_cast<FieldKind>(kind),
+                          std::to_integer<uint8_t>(p[1]),
+                          std::to_integer<uint8_t>(p[2])});
+      p += 3;
+    }
+    uint64_t groups;
+    if (!detail::read_varint(p, end, groups) ||
+        groups > static_cast<uint64_t>(end - p))
+      malformed("bad row group count");
+    for (uint64_t g = 0; g < groups; ++g) {
+      uint64_t rows;
+      if (!detail::read_varint(p, end, rows))
+        malformed("bad row group");
+      group_rows_.push_back(rows);
+      rows_ += rows;
+      for (const ColumnInfo &c : columns_) {
+        detail::ChunkMeta m;
+        bool ok = detail::read_varint(p, end, m.offset) &&
+                  detail::read_varint(p, end, m.size) && end - p >= 4;
+        if (ok) {
+          m.crc = detail::load_u32le(p);
+          p += 4;
+          ok = detail::read_varint(p, end, m.entries) &&
+               detail::read_varint(p, end, m.values) && end - p >= 2;
+        }
+        if (!ok || m.offset < 4 || m.size > data_end - m.offset ||
+            m.offset > data_end || m.values > m.entries)
+          malformed("bad chunk");
+        m.encoding = static_cast<ColumnEncoding>(*p++);
+        m.has_stats = std::to_integer<uint8_t>(*p++) != 0;
+        if (!m.has_stats) {
+          chunks_.push_back(m);
+          continue;
+        }
+        const detail::Physical k = detail::physical(c.kind);
+        ok = k == detail::Physical::kBytes
+                 ? detail::read_string(p, end, m.min_bytes) &&
+                       detail::read_string(p, end, m.max_bytes)
+                 : detail::read_plain(p, end, k, m.min) &&
+                       detail::read_plain(p, end, k, m.max);
+        if (!ok)
+          malformed("bad chunk statistics");
+        chunks_.push_back(m);
+      }
+    }
+    if (p != end)
+      malformed("trailing footer bytes");
+  }
+
+  std::span<const std::byte> data_;
+  std::vector<ColumnInfo> columns_;
+  std::vector<uint64_t> group_rows_;
+  std::vector<detail::ChunkMeta> chunks_; // row group major
+  uint64_t rows_ = 0;
+};
+
+} // namespace sugar
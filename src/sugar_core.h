@@ -0,0 +1,562 @@
+#pragma once
+
+/*
+ * sugar_core.h
+ *
+ * Copyright 2025 M.Berkay Karatas
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Parts of the runtime shared by the reflection-based (sugar_runtime.h) and
+// the lite (sugar_lite.h) wrappers; nothing here touches descriptors.
+
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace sugar {
+
+// Access for the fields of XWrapped itself: `self` is the wrapper.
+template <typename Owner, typename Msg> struct RootAccess {
+  using message_type = Msg;
+  using owner = Owner;
+
+  [[nodiscard]] static Msg &message(const void *self) noexcept {
+    return **static_cast<Msg *const *>(self);
+  }
+
+  [[nodiscard]] static const Msg &read(const void *self) noexcept {
+    return message(self);
+  }
+};
+
+// Access for the fields of a singular submessage, reached through the
+// parent's `mutable_x()` accessor for writes. Reads go through the const
+// `x()` accessor when Get is given, so reading an unset submessage sees
+// the default instance instead of creating (and allocating) it. Fields is
+// the generated XFields union template holding the submessage's tags.
+template <typename Parent, auto Mutable, template <typename> class Fields,
+          auto Get = nullptr>
+struct SubmessageAccess {
+  using message_type = std::remove_pointer_t<decltype((
+      std::declval<typename Parent::message_type &>().*Mutable)())>;
+  using parent = Parent;
+  using owner = Fields<SubmessageAccess>;
+
+  [[nodiscard]] static message_type &message(const void *self) {
+    return *(Parent::message(self).*Mutable)();
+  }
+
+  [[nodiscard]] static const message_type &read(const void *self) {
+    if constexpr (std::is_null_pointer_v<decltype(Get)>)
+      return message(self);
+    else
+      return (Parent::read(self).*Get)();
+  }
+};
+
+// Hashing and equality helpers used by the generated hash_value() and
+// operator== of each XWrapped. They walk fields directly, so no
+// serialization is involved.
+
+[[nodiscard]] inline std::size_t hash_mix(std::size_t v) noexcept {
+  uint64_t x = static_cast<uint64_t>(v);
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return static_cast<std::size_t>(x);
+}
+
+inline void hash_combine(std::size_t &seed, std::size_t v) noexcept {
+  seed ^= hash_mix(v) + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+}
+
+template <typename T>
+[[nodiscard]] inline std::size_t hash_scalar(const T &v) noexcept {
+  if constexpr (std::is_same_v<T, std::string>)
+    return std::hash<std::string_view>{}(v);
+  else if constexpr (std::is_enum_v<T>)
+    return std::hash<int>{}(static_cast<int>(v));
+  else if constexpr (std::is_floating_point_v<T>)
+    return v == T{}        ? 0 // +0.0 == -0.0
+           : std::isnan(v) ? 1 // whatever the payload
+                           : std::hash<T>{}(v);
+  else
+    return std::hash<T>{}(v);
+}
+
+// Equality matching hash_scalar: any NaN equals any NaN, and +0.0 equals
+// -0.0, so messages that compare equal also hash alike.
+template <typename T>
+[[nodiscard]] inline bool scalar_equal(const T &a, const T &b) noexcept {
+  if constexpr (std::is_floating_point_v<T>)
+    return a == b || (std::isnan(a) && std::isnan(b));
+  else
+    return a == b;
+}
+
+struct ScalarHash {
+  template <typename T> std::size_t operator()(const T &v) const noexcept {
+    return hash_scalar(v);
+  }
+};
+
+struct ScalarEqual {
+  template <typename T>
+  bool operator()(const T &a, const T &b) const noexcept {
+    return scalar_equal(a, b);
+  }
+};
+
+template <typename Wrapped> struct MessageHash {
+  template <typename M> std::size_t operator()(const M &m) const noexcept {
+    return Wrapped::hash_of(m);
+  }
+};
+
+template <typename Wrapped> struct MessageEqual {
+  template <typename M> bool operator()(const M &a, const M &b) const noexcept {
+    return Wrapped::equal(a, b);
+  }
+};
+
+template <typename Range, typename H = ScalarHash>
+[[nodiscard]] std::size_t hash_range(const Range &r, H h = {}) noexcept {
+  std::size_t seed = static_cast<std::size_t>(r.size());
+  for (const auto &e : r)
+    hash_combine(seed, h(e));
+  return seed;
+}
+
+// Order-independent: protobuf maps have no defined iteration order.
+template <typename Map, typename H = ScalarHash>
+[[nodiscard]] std::size_t hash_map(const Map &m, H h = {}) noexcept {
+  std::size_t sum = 0;
+  for (const auto &kv : m) {
+    std::size_t e = hash_scalar(kv.first);
+    hash_combine(e, h(kv.second));
+    sum += hash_mix(e);
+  }
+  return sum ^ hash_mix(static_cast<std::size_t>(m.size()));
+}
+
+template <typename Range, typename Eq = ScalarEqual>
+[[nodiscard]] bool range_equal(const Range &a, const Range &b,
+                               Eq eq = {}) noexcept {
+  if (a.size() != b.size())
+    return false;
+  auto ib = b.begin();
+  for (const auto &e : a)
+    if (!eq(e, *ib++))
+      return false;
+  return true;
+}
+
+template <typename Map, typename Eq = ScalarEqual>
+[[nodiscard]] bool map_equal(const Map &a, const Map &b, Eq eq = {}) noexcept {
+  if (a.size() != b.size())
+    return false;
+  for (const auto &kv : a) {
+    auto it = b.find(kv.first);
+    if (it == b.end() || !eq(kv.second, it->second))
+      return false;
+  }
+  return true;
+}
+
+// ---- Access by name --------------------------------------------------------
+//
+// Each XWrapped carries a constexpr NameTable over its singular fields, so
+// `w.set_by_name("profile.city", "Berlin")` resolves the name with one hash
+// and one compare, then calls a thunk bound to the generated setter: no
+// descriptor pool, no std::string keys, no allocation.
+
+struct EnumName {
+  std::string_view name;
+  int number;
+};
+
+// A value passed to set_by_name or returned by get_by_name. Strings are
+// views, so a FieldValue must not outlive the string it was made from.
+// as<T>() converts between kinds where no information is lost and parses
+// strings, which is what command-line and environment overrides carry.
+class FieldValue {
+public:
+  enum class Kind : uint8_t { kNone, kInt, kUInt, kDouble, kBool, kString };
+
+  constexpr FieldValue() noexcept = default;
+  constexpr FieldValue(bool v) noexcept : kind_(Kind::kBool), b_(v) {}
+
+  template <typename T>
+    requires(std::is_integral_v<T> && !std::is_same_v<T, bool>)
+  constexpr FieldValue(T v) noexcept {
+    if constexpr (std::is_signed_v<T>) {
+      kind_ = Kind::kInt;
+      i_ = v;
+    } else {
+      kind_ = Kind::kUInt;
+      u_ = v;
+    }
+  }
+
+  template <typename T>
+    requires std::is_floating_point_v<T>
+  constexpr FieldValue(T v) noexcept : kind_(Kind::kDouble), d_(v) {}
+
+  template <typename E>
+    requires std::is_enum_v<E>
+  constexpr FieldValue(E v) noexcept
+      : FieldValue(static_cast<int64_t>(v)) {}
+
+  constexpr FieldValue(std::string_view v) noexcept
+      : kind_(Kind::kString), str_(v) {}
+  constexpr FieldValue(const char *v) noexcept
+      : FieldValue(std::string_view(v)) {}
+  FieldValue(const std::string &v) noexcept
+      : FieldValue(std::string_view(v)) {}
+
+  [[nodiscard]] constexpr Kind kind() const noexcept { return kind_; }
+  [[nodiscard]] constexpr bool has_value() const noexcept {
+    return kind_ != Kind::kNone;
+  }
+
+  // T is bool, a fixed-width integer, float, double or std::string_view.
+  // Throws std::invalid_argument for values that do not convert and
+  // std::out_of_range for integers that do not fit T.
+  template <typename T> [[nodiscard]] T as() const {
+    if constexpr (std::is_same_v<T, std::string_view>) {
+      if (kind_ != Kind::kString)
+        throw std::invalid_argument("field value is not a string");
+      return str_;
+    } else if constexpr (std::is_same_v<T, bool>) {
+      return to_bool();
+    } else if constexpr (std::is_integral_v<T>) {
+      switch (kind_) {
+      case Kind::kInt:
+        return checked<T>(i_);
+      case Kind::kUInt:
+        return checked<T>(u_);
+      case Kind::kString:
+        return checked<T>(
+            parse<std::conditional_t<std::is_signed_v<T>, int64_t, uint64_t>>(
+                str_));
+      default:
+        throw std::invalid_argument("field value is not an integer");
+      }
+    } else {
+      static_assert(std::is_floating_point_v<T>, "unsupported field type");
+      switch (kind_) {
+      case Kind::kDouble:
+        return static_cast<T>(d_);
+      case Kind::kInt:
+        return static_cast<T>(i_);
+      case Kind::kUInt:
+        return static_cast<T>(u_);
+      case Kind::kString:
+        return static_cast<T>(parse<double>(str_));
+      default:
+        throw std::invalid_argument("field value is not a number");
+      }
+    }
+  }
+
+  // Enum value from a number or one of `names`.
+  [[nodiscard]] int enum_number(std::span<const EnumName> names) const;
+
+private:
+  bool to_bool() const {
+    if (kind_ == Kind::kBool)
+      return b_;
+    if (kind_ == Kind::kString) {
+      if (str_ == "true" || str_ == "1")
+        return true;
+      if (str_ == "false" || str_ == "0")
+        return false;
+    }
+    if (kind_ == Kind::kInt && (i_ == 0 || i_ == 1))
+      return i_ != 0;
+    if (kind_ == Kind::kUInt && u_ <= 1)
+      return u_ != 0;
+    throw std::invalid_argument("field value is not a bool");
+  }
+
+  template <typename T, typename V> static T checked(V v) {
+    if (!std::in_range<T>(v))
+      throw std::out_of_range("field value out of range");
+    return static_cast<T>(v);
+  }
+
+  template <typename V> static V parse(std::string_view s) {
+    V v{};
+    const auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+    if (ec == std::errc::result_out_of_range)
+      throw std::out_of_range("field value out of range");
+    if (ec != std::errc() || end != s.data() + s.size())
+      throw std::invalid_argument("field value is not a number");
+    return v;
+  }
+
+  Kind kind_ = Kind::kNone;
+  union {
+    int64_t i_ = 0;
+    uint64_t u_;
+    double d_;
+    bool b_;
+  };
+  std::string_view str_;
+};
+
+inline int FieldValue::enum_number(std::span<const EnumName> names) const {
+  if (kind_ == Kind::kString) {
+    for (const auto &e : names)
+      if (e.name == str_)
+        return e.number;
+    if (str_.empty() || (str_[0] != '-' && (str_[0] < '0' || str_[0] > '9')))
+      throw std::invalid_argument("unknown enum value");
+  }
+  return as<int32_t>();
+}
+
+// Name hashing shared with the generator, which picks the per-bucket seeds
+// offline (hash-and-displace), so every lookup costs a single probe.
+[[nodiscard]] constexpr uint64_t name_hash(std::string_view s) noexcept {
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (char c : s) {
+    h ^= static_cast<unsigned char>(c);
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+[[nodiscard]] constexpr uint64_t name_mix(uint64_t x) noexcept {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdull;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ull;
+  return x ^ (x >> 33);
+}
+
+// `buckets` and `slots` are powers of two.
+[[nodiscard]] constexpr std::size_t name_bucket(uint64_t h,
+                                                std::size_t buckets) noexcept {
+  return static_cast<std::size_t>(name_mix(h)) & (buckets - 1);
+}
+
+[[nodiscard]] constexpr std::size_t name_slot(uint64_t h, uint32_t seed,
+                                              std::size_t slots) noexcept {
+  return static_cast<std::size_t>(
+             name_mix(h + (uint64_t{seed} + 1) * 0x9e3779b97f4a7c15ull)) &
+         (slots - 1);
+}
+
+// One singular field of Msg. Scalar fields have set/get; message fields
+// have set_nested/get_nested, which continue with the rest of a dotted path
+// in the submessage's table.
+template <typename Msg> struct NamedField {
+  std::string_view name;
+  int index;
+  void (*set)(Msg &, const FieldValue &);
+  FieldValue (*get)(const Msg &);
+  bool (*set_nested)(Msg &, std::string_view, const FieldValue &);
+  FieldValue (*get_nested)(const Msg &, std::string_view);
+};
+
+template <typename Msg, std::size_t N, std::size_t Buckets, std::size_t Slots>
+struct NameTable {
+  std::array<NamedField<Msg>, N> fields;
+  std::array<uint16_t, Buckets> seeds;
+  std::array<int16_t, Slots> slots; // index into fields, -1 when free
+
+  [[nodiscard]] constexpr const NamedField<Msg> *
+  find(std::string_view name) const noexcept {
+    if constexpr (N == 0) {
+      return nullptr;
+    } else {
+      const uint64_t h = name_hash(name);
+      const int i = slots[name_slot(h, seeds[name_bucket(h, Buckets)], Slots)];
+      return i >= 0 && fields[i].name == name ? &fields[i] : nullptr;
+    }
+  }
+
+  // False when `path` names no singular field of Msg (or a message field
+  // itself); conversion errors throw, see FieldValue::as.
+  bool set(Msg &m, std::string_view path, const FieldValue &v) const {
+    const auto dot = path.find('.');
+    const auto *f = find(path.substr(0, dot));
+    if (!f)
+      return false;
+    if (dot == std::string_view::npos) {
+      if (!f->set)
+        return false;
+      f->set(m, v);
+      return true;
+    }
+    return f->set_nested && f->set_nested(m, path.substr(dot + 1), v);
+  }
+
+  // An empty FieldValue when `path` names no singular scalar field.
+  [[nodiscard]] FieldValue get(const Msg &m, std::string_view path) const {
+    const auto dot = path.find('.');
+    const auto *f = find(path.substr(0, dot));
+    if (!f)
+      return {};
+    if (dot == std::string_view::npos)
+      return f->get ? f->get(m) : FieldValue();
+    return f->get_nested ? f->get_nested(m, path.substr(dot + 1))
+                         : FieldValue();
+  }
+};
+
+// Thunks for message fields. Wrapped is named through a template parameter
+// so its table is only needed once the thunk is instantiated, which lets
+// recursive messages refer to themselves.
+template <typename Msg, typename Wrapped, auto Mutable>
+bool set_nested(Msg &m, std::string_view path, const FieldValue &v) {
+  return Wrapped::kByName.set(*(m.*Mutable)(), path, v);
+}
+
+template <typename Msg, typename Wrapped, auto Get>
+FieldValue get_nested(const Msg &m, std::string_view path) {
+  return Wrapped::kByName.get((m.*Get)(), path);
+}
+
+// ---- Wire layout -----------------------------------------------------------
+//
+// Each XWrapped also carries kWireFields, the encoding of every field, and a
+// declaration-only `wire_message(WireNumber<N>)` per message field naming
+// the wrapper of the submessage (of the value, for maps). sugar::WireView
+// (sugar_wire.h) reads serialized bytes with them.
+
+enum class WireKind : uint8_t {
+  kInt32,
+  kInt64,
+  kUInt32,
+  kUInt64,
+  kSInt32,
+  kSInt64,
+  kBool,
+  kEnum,
+  kFixed32,
+  kFixed64,
+  kSFixed32,
+  kSFixed64,
+  kFloat,
+  kDouble,
+  kString,
+  kBytes,
+  kMessage,
+  kGroup,
+};
+
+struct WireField {
+  enum Shape : uint8_t { kSingular, kRepeated, kMap };
+
+  std::string_view name;
+  int number;
+  WireKind kind; // kMessage for maps
+  Shape shape = kSingular;
+  WireKind key = WireKind::kInt32; // maps only
+  WireKind value = WireKind::kInt32;
+  int oneof = 0; // 1 + index of the (non-synthetic) oneof holding it, or 0
+};
+
+template <int N> using WireNumber = std::integral_constant<int, N>;
+
+// ---- Field visitation ------------------------------------------------------
+//
+// Each XWrapped lists its fields in kFieldList, a constexpr tuple with one
+// FieldMeta per field in declaration order. for_each_field unrolls over it
+// and hands each field's value from the generated accessor (`m.id()`,
+// `m.tags()`, `m.profile()`), so generic code such as CSV writers, log
+// formats or metrics exporters is written once and compiles to the same
+// calls as hand-written code:
+//
+//   sugar::for_each_field(u, [&](auto field, const auto& value) {
+//       using F = decltype(field);
+//       if constexpr (F::cardinality == sugar::Cardinality::kSingular &&
+//                     F::kind != sugar::FieldKind::kMessage)
+//           out << field.name << '=' << value << '\n';
+//   });
+//
+// Maps report the kind of their values. `wrapped` is the XWrapped of the
+// submessage (of the value, for maps), void for other fields, so visitors
+// recurse with `sugar::for_each_field<typename F::wrapped>(value, visit)`.
+// `member` is the wrapper's tag, for visitors that write: `w.*F::member`.
+
+enum class FieldKind : uint8_t {
+  kInt32,
+  kInt64,
+  kUInt32,
+  kUInt64,
+  kBool,
+  kFloat,
+  kDouble,
+  kEnum,
+  kString,
+  kBytes,
+  kMessage,
+};
+
+enum class Cardinality : uint8_t { kSingular, kRepeated, kMap };
+
+// The const accessor without parameters, also for repeated fields whose
+// element accessor `x(int)` shares the name.
+template <typename R, typename Msg>
+[[nodiscard]] constexpr auto getter(R (Msg::*get)() const) noexcept {
+  return get;
+}
+
+template <auto Member, auto Get, int Number, FieldKind Kind, Cardinality Card,
+          typename Wrapped = void>
+struct FieldMeta {
+  static constexpr auto member = Member;
+  static constexpr auto get = Get;
+  static constexpr int number = Number;
+  static constexpr FieldKind kind = Kind;
+  static constexpr Cardinality cardinality = Card;
+  using wrapped = Wrapped;
+
+  std::string_view name;
+};
+
+// Calls visit(meta, value) for every field of m in declaration order.
+template <typename Wrapped, typename Visitor>
+constexpr void
+for_each_field(const typename Wrapped::Access::message_type &m,
+               Visitor &&visit) {
+  std::apply(
+      [&](const auto &...field) {
+        (visit(field, (m.*std::remove_cvref_t<decltype(field)>::get)()), ...);
+      },
+      Wrapped::kFieldList);
+}
+
+template <typename Wrapped, typename Visitor>
+constexpr void for_each_field(Wrapped w, Visitor &&visit) {
+  for_each_field<Wrapped>(*w._msg, std::forward<Visitor>(visit));
+}
+
+} // namespace sugar
@@ -0,0 +1,194 @@
+#include "sugar_generator.h"
+
+#include "emit_header.h"
+#include "zero_copy_streambuf.h"
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/io/zero_copy_stream.h>
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <exception>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+using google::protobuf::FileDescriptor;
+using google::protobuf::compiler::GeneratorContext;
+using google::protobuf::io::ZeroCopyOutputStream;
+
+namespace {
+
+struct GeneratorOptions {
+  // Worker threads for GenerateAll; 0 means one per hardware thread.
+  unsigned jobs = 0;
+  // Emit the split layout (see split_outputs_for_file) instead of a single
+  // .sugar.h per proto file.
+  bool split_headers = false;
+  EmitFeatures features;
+};
+
+// A boolean option: present alone or as key=true turns it on.
+bool parse_flag(const string &key, const string &value, bool &flag,
+                string *error) {
+  if (value.empty() || value == "true") {
+    flag = true;
+  } else if (value == "false") {
+    flag = false;
+  } else {
+    *error = "invalid value for " + key + ": " + value;
+    return false;
+  }
+  return true;
+}
+
+bool parse_options(const string &parameter, GeneratorOptions &opts,
+                   string *error) {
+  vector<pair<string, string>> params;
+  google::protobuf::compiler::ParseGeneratorParameter(parameter, &params);
+  for (const auto &[key, value] : params) {
+    if (key == "jobs") {
+      const char *end = value.data() + value.size();
+      auto [ptr, ec] = from_chars(value.data(), end, opts.jobs);
+      if (value.empty() || ec != errc() || ptr != end) {
+        *error = "invalid value for jobs: " + value;
+        return false;
+      }
+    } else if (key == "split_headers") {
+      if (!parse_flag(key, value, opts.split_headers, error))
+        return false;
+    } else if (key == "json") {
+      if (!parse_flag(key, value, opts.features.json, error))
+        return false;
+    } else if (key == "builder") {
+      if (!parse_flag(key, value, opts.features.builder, error))
+        return false;
+    } else if (key == "plain") {
+      if (!parse_flag(key, value, opts.features.plain, error))
+        return false;
+    } else if (key == "mask") {
+      if (!parse_flag(key, value, opts.features.mask, error))
+        return false;
+    } else {
+      *error = "unknown generator option: " + key;
+      return false;
+    }
+  }
+  return true;
+}
+
+vector<GeneratedOutput> outputs_for_file(const FileDescriptor *file,
+                                         const GeneratorOptions &opts) {
+  if (opts.split_headers)
+    return split_outputs_for_file(file, opts.features);
+  vector<GeneratedOutput> out;
+  out.push_back({header_filename_for_file(file),
+                 [file, features = opts.features](ostream &os) {
+                   emit_header_for_file(file, os, features);
+                 }});
+  return out;
+}
+
+bool check_supported(const FileDescriptor *file, string *error) {
+  string field = unsupported_field(file);
+  if (field.empty())
+    return true;
+  *error = std::move(field);
+  return false;
+}
+
+bool write_output(const GeneratedOutput &gen, ZeroCopyOutputStream *output) {
+  ZeroCopyStreambuf buf(output);
+  ostream os(&buf);
+  gen.emit(os);
+  os.flush();
+  return os.good() && buf.ok();
+}
+
+} // namespace
+
+bool SugarGenerator::Generate(const FileDescriptor *file,
+                              const string &parameter,
+                              GeneratorContext *context, string *error) const {
+  GeneratorOptions opts;
+  if (!parse_options(parameter, opts, error) ||
+      !check_supported(file, error))
+    return false;
+
+  for (const auto &gen : outputs_for_file(file, opts)) {
+    unique_ptr<ZeroCopyOutputStream> output(context->Open(gen.filename));
+    if (!write_output(gen, output.get())) {
+      *error = "failed to write " + gen.filename;
+      return false;
+    }
+  }
+  return true;
+}
+
+// GeneratorContext::Open is not thread-safe, so every output is opened up
+// front on this thread; the streams it hands out are independent and can
+// then be filled in parallel.
+bool SugarGenerator::GenerateAll(const vector<const FileDescriptor *> &files,
+                                 const string &parameter,
+                                 GeneratorContext *context,
+                                 string *error) const {
+  GeneratorOptions opts;
+  if (!parse_options(parameter, opts, error))
+    return false;
+
+  for (const auto *file : files)
+    if (!check_supported(file, error))
+      return false;
+
+  vector<GeneratedOutput> gens;
+  for (const auto *file : files)
+    for (auto &gen : outputs_for_file(file, opts))
+      gens.push_back(std::move(gen));
+
+  vector<unique_ptr<ZeroCopyOutputStream>> outputs;
+  outputs.reserve(gens.size());
+  for (const auto &gen : gens)
+    outputs.emplace_back(context->Open(gen.filename));
+
+  // An exception must not escape a pool thread (std::terminate), so each
+  // output's failure is recorded and reported below instead.
+  vector<string> failures(gens.size());
+  atomic<size_t> next{0};
+  auto worker = [&] {
+    for (size_t i; (i = next.fetch_add(1)) < gens.size();) {
+      try {
+        if (!write_output(gens[i], outputs[i].get()))
+          failures[i] = "failed to write " + gens[i].filename;
+      } catch (const exception &e) {
+        failures[i] = "failed to write " + gens[i].filename + ": " + e.what();
+      } catch (...) {
+        failures[i] = "failed to write " + gens[i].filename;
+      }
+    }
+  };
+
+  unsigned jobs = opts.jobs ? opts.jobs : thread::hardware_concurrency();
+  jobs = static_cast<unsigned>(
+      min<size_t>(max(jobs, 1u), max<size_t>(gens.size(), 1)));
+  vector<thread> pool;
+  pool.reserve(jobs - 1);
+  for (unsigned i = 1; i < jobs; ++i)
+    pool.emplace_back(worker);
+  worker();
+  for (auto &t : pool)
+    t.join();
+
+  for (auto &failure : failures) {
+    if (!failure.empty()) {
+      *error = std::move(failure);
+      return false;
+    }
+  }
+  return true;
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <google/protobuf/compiler/code_generator.h>
+#include <google/protobuf/descriptor.h>
+
+#include <string>
+#include <vector>
+
+// The protoc-gen-sugar code generator, usable in-process (benchmarks, other
+// protoc front ends) as well as from the plugin's main. Parameters:
+//   jobs=N          worker threads for GenerateAll; 0 (default) means one
+//                   per hardware thread
+//   split_headers   emit the split layout instead of one .sugar.h per file
+//   json, builder,  also emit JSON codecs, XBuilder, XPlain or masked
+//   plain, mask     copies (see EmitFeatures); off by default
+class SugarGenerator : public google::protobuf::compiler::CodeGenerator {
+public:
+  bool Generate(const google::protobuf::FileDescriptor *file,
+                const std::string &parameter,
+                google::protobuf::compiler::GeneratorContext *context,
+                std::string *error) const override;
+
+  // Emits all outputs concurrently.
+  bool GenerateAll(const std::vector<const google::protobuf::FileDescriptor *>
+                       &files,
+                   const std::string &parameter,
+                   google::protobuf::compiler::GeneratorContext *context,
+                   std::string *error) const override;
+};
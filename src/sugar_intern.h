@@ -0,0 +1,192 @@
+#pragma once
+
+/*
+ * sugar_intern.h
+ *
+ * Copyright 2025 M.Berkay Karatas
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// String interning for batches whose string fields repeat a small set of
+// values (tags, labels, map keys).
+//
+//   sugar::StringPool pool;
+//   std::vector<sugar::StringPool::Code> codes;
+//   for (auto &u : batch)
+//     UserWrapped(u).tags.intern(pool, codes);  // one code per element
+//   std::vector<int> per_tag(pool.size());
+//   for (auto c : codes)
+//     ++per_tag[c];                              // group by dense code
+//   pool[c];                                     // the string, as a view
+//
+// Each distinct string is copied once into the pool's blocks and gets the
+// next code, so codes are dense and index plain vectors. Views returned by
+// the pool stay valid until clear() or destruction, however many strings
+// are added later. RepeatedProxy<std::string>::assign(pool, codes) writes
+// codes back into a message as strings. Other string ranges, such as the
+// RepeatedPtrField behind a lite RepeatedTag, go through intern_all().
+//
+// A pool is not thread-safe; share one between threads behind a lock or
+// give each thread its own.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace sugar {
+
+class StringPool {
+public:
+  using Code = uint32_t;
+  static constexpr Code kNone = std::numeric_limits<Code>::max();
+
+  // Strings are copied into blocks of block_size bytes; longer strings
+  // get a block of their own.
+  explicit StringPool(std::size_t block_size = 16 * 1024)
+      : block_size_(block_size ? block_size : 1) {}
+
+  // Views and index keys point into the blocks, which never move, so
+  // they stay valid in the moved-to pool; the moved-from one is empty.
+  StringPool(StringPool &&o) noexcept
+      : block_size_(o.block_size_), blocks_(std::move(o.blocks_)),
+        cursor_(std::exchange(o.cursor_, nullptr)),
+        left_(std::exchange(o.left_, 0)), bytes_(std::exchange(o.bytes_, 0)),
+        capacity_(std::exchange(o.capacity_, 0)),
+        strings_(std::move(o.strings_)), index_(std::move(o.index_)) {
+    o.clear();
+  }
+  StringPool &operator=(StringPool &&o) noexcept {
+    if (this != &o) {
+      block_size_ = o.block_size_;
+      blocks_ = std::move(o.blocks_);
+      cursor_ = std::exchange(o.cursor_, nullptr);
+      left_ = std::exchange(o.left_, 0);
+      bytes_ = std::exchange(o.bytes_, 0);
+      capacity_ = std::exchange(o.capacity_, 0);
+      strings_ = std::move(o.strings_);
+      index_ = std::move(o.index_);
+      o.clear();
+    }
+    return *this;
+  }
+  StringPool(const StringPool &) = delete;
+  StringPool &operator=(const StringPool &) = delete;
+
+  // The code of s, adding it on first sight.
+  Code intern(std::string_view s) {
+    if (const auto it = index_.find(s); it != index_.end())
+      return it->second;
+    if (strings_.size() == kNone)
+      throw std::length_error("StringPool: too many strings");
+    const std::string_view stored = store(s);
+    const Code c = static_cast<Code>(strings_.size());
+    strings_.push_back(stored);
+    index_.emplace(stored, c);
+    return c;
+  }
+
+  // Interns every string of r and appends the codes to out.
+  template <std::ranges::input_range R>
+  void intern_all(const R &r, std::vector<Code> &out) {
+    for (const auto &s : r)
+      out.push_back(intern(std::string_view(s)));
+  }
+
+  // The code of s, or kNone if it has not been interned.
+  [[nodiscard]] Code find(std::string_view s) const noexcept {
+    const auto it = index_.find(s);
+    return it == index_.end() ? kNone : it->second;
+  }
+
+  [[nodiscard]] std::string_view operator[](Code c) const noexcept {
+    return strings_[c];
+  }
+  [[nodiscard]] std::string_view at(Code c) const {
+    if (c >= strings_.size())
+      throw std::out_of_range("StringPool: unknown code");
+    return strings_[c];
+  }
+
+  // Distinct strings, indexed by code.
+  [[nodiscard]] std::span<const std::string_view> strings() const noexcept {
+    return strings_;
+  }
+  [[nodiscard]] std::size_t size() const noexcept { return strings_.size(); }
+  [[nodiscard]] bool empty() const noexcept { return strings_.empty(); }
+
+  // Bytes of string data held, and bytes reserved for it in blocks.
+  [[nodiscard]] std::size_t bytes() const noexcept { return bytes_; }
+  [[nodiscard]] std::size_t capacity() const noexcept { return capacity_; }
+
+  // Drops every string; earlier views and codes are invalid afterwards.
+  void clear() noexcept {
+    index_.clear();
+    strings_.clear();
+    blocks_.clear();
+    cursor_ = nullptr;
+    left_ = 0;
+    bytes_ = 0;
+    capacity_ = 0;
+  }
+
+private:
+  std::string_view store(std::string_view s) {
+    if (s.empty())
+      return {};
+    bytes_ += s.size();
+    if (s.size() > left_) {
+      if (s.size() > block_size_ / 4) {
+        // Keep the current block's tail for the short strings to come.
+        char *own = add_block(s.size());
+        std::memcpy(own, s.data(), s.size());
+        return {own, s.size()};
+      }
+      cursor_ = add_block(block_size_);
+      left_ = block_size_;
+    }
+    char *p = cursor_;
+    std::memcpy(p, s.data(), s.size());
+    cursor_ += s.size();
+    left_ -= s.size();
+    return {p, s.size()};
+  }
+
+  char *add_block(std::size_t n) {
+    blocks_.push_back(std::make_unique_for_overwrite<char[]>(n));
+    capacity_ += n;
+    return blocks_.back().get();
+  }
+
+  std::size_t block_size_;
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char *cursor_ = nullptr;
+  std::size_t left_ = 0;
+  std::size_t bytes_ = 0;
+  std::size_t capacity_ = 0;
+  std::vector<std::string_view> strings_;
+  std::unordered_map<std::string_view, Code> index_;
+};
+
+} // namespace sugar
@@ -0,0 +1,156 @@
+#pragma once
+
+/*
+ * sugar_io.h
+ *
+ * Copyright 2025 M.Berkay Karatas
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Serialization into caller-owned memory, without the intermediate
+// std::string of SerializeToString. Everything here takes a raw message or
+// any XWrapped (full or lite runtime). Frames use protobuf's delimited
+// format, a varint length followed by the message, as read by
+// ParseDelimitedFromZeroCopyStream.
+
+#include <google/protobuf/message_lite.h>
+
+#include <bit>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+
+namespace sugar {
+
+namespace detail {
+template <typename T>
+[[nodiscard]] const google::protobuf::MessageLite &
+message_of(const T &x) noexcept {
+  if constexpr (std::is_base_of_v<google::protobuf::MessageLite, T>)
+    return x;
+  else
+    return *x._msg;
+}
+
+// Wrappers are views, so a const wrapper still reaches a mutable message.
+template <typename T>
+[[nodiscard]] google::protobuf::MessageLite &mutable_message_of(T &x) noexcept {
+  if constexpr (std::is_base_of_v<google::protobuf::MessageLite, T>)
+    return x;
+  else
+    return *x._msg;
+}
+
+// (bits * 9 + 64) / 64 is bits / 7 rounded up for 1..64 bits, without
+// the division.
+[[nodiscard]] constexpr std::size_t varint_size(uint64_t v) noexcept {
+  return static_cast<std::size_t>(std::bit_width(v | 1) * 9 + 64) / 64;
+}
+
+inline std::byte *put_varint(uint64_t v, std::byte *p) noexcept {
+  while (v >= 0x80) {
+    *p++ = static_cast<std::byte>(v | 0x80);
+    v >>= 7;
+  }
+  *p++ = static_cast<std::byte>(v);
+  return p;
+}
+
+// Reads a varint from [p, end); false on truncation or overflow.
+inline bool read_varint(const std::byte *&p, const std::byte *end,
+                        uint64_t &v) noexcept {
+  v = 0;
+  for (int shift = 0; shift < 64 && p < end; shift += 7) {
+    const auto b = std::to_integer<uint64_t>(*p++);
+    v |= (b & 0x7f) << shift;
+    if (!(b & 0x80))
+      return true;
+  }
+  return false;
+}
+
+[[nodiscard]] inline std::size_t checked_size(std::size_t n) {
+  if (n > static_cast<std::size_t>(INT_MAX))
+    throw std::length_error("message exceeds 2GB");
+  return n;
+}
+} // namespace detail
+
+template <typename T> [[nodiscard]] std::size_t serialized_size(const T &m) {
+  return detail::message_of(m).ByteSizeLong();
+}
+
+template <typename T> [[nodiscard]] std::size_t framed_size(const T &m) {
+  const std::size_t n = serialized_size(m);
+  return detail::varint_size(n) + n;
+}
+
+// Writes m to the front of out and returns the number of bytes written. The
+// size is computed once and nothing is allocated. Throws std::length_error,
+// writing nothing, if out is too small.
+template <typename T>
+std::size_t serialize_into(const T &m, std::span<std::byte> out) {
+  const auto &msg = detail::message_of(m);
+  const std::size_t n = detail::checked_size(msg.ByteSizeLong());
+  if (n > out.size())
+    throw std::length_error("serialize_into: buffer too small");
+  msg.SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t *>(out.data()));
+  return n;
+}
+
+// serialize_into with the varint length prefix in front.
+template <typename T>
+std::size_t serialize_framed(const T &m, std::span<std::byte> out) {
+  const auto &msg = detail::message_of(m);
+  const std::size_t n = detail::checked_size(msg.ByteSizeLong());
+  const std::size_t total = detail::varint_size(n) + n;
+  if (total > out.size())
+    throw std::length_error("serialize_framed: buffer too small");
+  std::byte *body = detail::put_varint(n, out.data());
+  msg.SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t *>(body));
+  return total;
+}
+
+// Parses the frame at the front of in into m (a message or XWrapped) and
+// returns the bytes consumed, or 0 if in holds only part of a frame. Throws
+// std::runtime_error on a malformed frame.
+template <typename T>
+std::size_t parse_framed(std::span<const std::byte> in, T &&m) {
+  uint64_t len = 0;
+  std::size_t i = 0;
+  for (int shift = 0;; shift += 7, ++i) {
+    if (i == in.size())
+      return 0;
+    if (shift > 28)
+      throw std::runtime_error("parse_framed: malformed length");
+    const auto b = std::to_integer<uint64_t>(in[i]);
+    len |= (b & 0x7f) << shift;
+    if (!(b & 0x80))
+      break;
+  }
+  ++i;
+  if (len > static_cast<uint64_t>(INT_MAX))
+    throw std::runtime_error("parse_framed: frame exceeds 2GB");
+  if (in.size() - i < len)
+    return 0;
+  if (!detail::mutable_message_of(m).ParseFromArray(in.data() + i,
+                                                    static_cast<int>(len)))
+    throw std::runtime_error("parse_framed: invalid message");
+  return i + static_cast<std::size_t>(len);
+}
+
+} // namespace sugar
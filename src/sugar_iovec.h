@@ -0,0 +1,338 @@
+#pragma once
+
+/*
+ * sugar_iovec.h
+ *
+ * Copyright 2025 M.Berkay Karatas
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Scatter-gather serialization for writev(). String and bytes fields of at
+// least `min_reference` bytes are referenced where they live in the message
+// instead of being copied; everything else is encoded into a buffer the
+// writer owns and reuses. Submessages smaller than `min_reference` cannot
+// hold such a field and are serialized whole by protobuf; larger ones are
+// walked with reflection, so this needs the full runtime.
+
+#include "sugar_io.h"
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
+#include <google/protobuf/unknown_field_set.h>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+namespace sugar {
+
+class IovecWriter {
+public:
+  explicit IovecWriter(std::size_t min_reference = 4096) noexcept
+      : min_reference_(std::max<std::size_t>(min_reference, 1)) {}
+
+  // Encodes m (a message or XWrapped) and returns the pieces, which stay
+  // valid until the next serialize() and while m is left unmodified.
+  template <typename T> std::span<const iovec> serialize(const T &m) {
+    const google::protobuf::Message &msg = full_message_of(m);
+    total_ = detail::checked_size(msg.ByteSizeLong());
+    if (capacity_ < total_) {
+      buffer_ = std::make_unique_for_overwrite<std::byte[]>(total_);
+      capacity_ = total_;
+    }
+    pieces_.clear();
+    pos_ = run_ = buffer_.get();
+    encode_message(msg);
+    close_run();
+    std::size_t written = 0;
+    for (const auto &p : pieces_)
+      written += p.iov_len;
+    if (written != total_)
+      throw std::runtime_error("IovecWriter: message changed while encoding");
+    return pieces_;
+  }
+
+  [[nodiscard]] std::span<const iovec> pieces() const noexcept {
+    return pieces_;
+  }
+
+  // Bytes in the last serialization.
+  [[nodiscard]] std::size_t size() const noexcept { return total_; }
+
+  // writev()s the last serialization to fd, resuming after partial writes
+  // and splitting at IOV_MAX. Consumes the pieces; throws std::system_error.
+  void write_to(int fd) {
+    std::size_t i = 0;
+    while (i < pieces_.size()) {
+      const auto n = std::min<std::size_t>(pieces_.size() - i, IOV_MAX);
+      const ssize_t w = ::writev(fd, pieces_.data() + i, static_cast<int>(n));
+      if (w < 0) {
+        if (errno == EINTR)
+          continue;
+        throw std::system_error(errno, std::generic_category(), "writev");
+      }
+      auto left = static_cast<std::size_t>(w);
+      while (i < pieces_.size() && left >= pieces_[i].iov_len)
+        left -= pieces_[i++].iov_len;
+      if (left) {
+        pieces_[i].iov_base = static_cast<char *>(pieces_[i].iov_base) + left;
+        pieces_[i].iov_len -= left;
+      }
+    }
+    pieces_.clear();
+  }
+
+private:
+  using FD = google::protobuf::FieldDescriptor;
+
+  enum WireType : uint32_t {
+    kVarint = 0,
+    kFixed64 = 1,
+    kLength = 2,
+    kStartGroup = 3,
+    kEndGroup = 4,
+    kFixed32 = 5,
+  };
+
+  template <typename T>
+  static const google::protobuf::Message &full_message_of(const T &x) {
+    if constexpr (std::is_base_of_v<google::protobuf::Message, T>)
+      return x;
+    else
+      return *x._msg;
+  }
+
+  static WireType wire_type(const FD &f) noexcept {
+    switch (f.type()) {
+    case FD::TYPE_FIXED64:
+    case FD::TYPE_SFIXED64:
+    case FD::TYPE_DOUBLE:
+      return kFixed64;
+    case FD::TYPE_FIXED32:
+    case FD::TYPE_SFIXED32:
+    case FD::TYPE_FLOAT:
+      return kFixed32;
+    case FD::TYPE_STRING:
+    case FD::TYPE_BYTES:
+    case FD::TYPE_MESSAGE:
+      return kLength;
+    case FD::TYPE_GROUP:
+      return kStartGroup;
+    default:
+      return kVarint;
+    }
+  }
+
+  // The field's value as the integer the wire format encodes: signed types
+  // sign-extended, floating point as raw bits, zigzag applied.
+  static uint64_t scalar_bits(const google::protobuf::Message &m,
+                              const FD &f, int idx) {
+    const auto *r = m.GetReflection();
+    const bool rep = idx >= 0;
+    switch (f.type()) {
+    case FD::TYPE_INT32:
+    case FD::TYPE_SFIXED32:
+      return static_cast<uint64_t>(static_cast<int64_t>(
+          rep ? r->GetRepeatedInt32(m, &f, idx) : r->GetInt32(m, &f)));
+    case FD::TYPE_SINT32: {
+      const int32_t v =
+          rep ? r->GetRepeatedInt32(m, &f, idx) : r->GetInt32(m, &f);
+      return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+    }
+    case FD::TYPE_INT64:
+    case FD::TYPE_SFIXED64:
+      return static_cast<uint64_t>(rep ? r->GetRepeatedInt64(m, &f, idx)
+                                       : r->GetInt64(m, &f));
+    case FD::TYPE_SINT64: {
+      const int64_t v =
+          rep ? r->GetRepeatedInt64(m, &f, idx) : r->GetInt64(m, &f);
+      return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+    }
+    case FD::TYPE_UINT32:
+    case FD::TYPE_FIXED32:
+      return rep ? r->GetRepeatedUInt32(m, &f, idx) : r->GetUInt32(m, &f);
+    case FD::TYPE_UINT64:
+    case FD::TYPE_FIXED64:
+      return rep ? r->GetRepeatedUInt64(m, &f, idx) : r->GetUInt64(m, &f);
+    case FD::TYPE_FLOAT:
+      return std::bit_cast<uint32_t>(rep ? r->GetRepeatedFloat(m, &f, idx)
+                                         : r->GetFloat(m, &f));
+    case FD::TYPE_DOUBLE:
+      return std::bit_cast<uint64_t>(rep ? r->GetRepeatedDouble(m, &f, idx)
+                                         : r->GetDouble(m, &f));
+    case FD::TYPE_BOOL:
+      return rep ? r->GetRepeatedBool(m, &f, idx) : r->GetBool(m, &f);
+    case FD::TYPE_ENUM:
+      return static_cast<uint64_t>(static_cast<int64_t>(
+          rep ? r->GetRepeatedEnumValue(m, &f, idx) : r->GetEnumValue(m, &f)));
+    default:
+      return 0;
+    }
+  }
+
+  static std::size_t scalar_size(WireType wt, uint64_t bits) noexcept {
+    return wt == kFixed64   ? 8
+           : wt == kFixed32 ? 4
+                            : detail::varint_size(bits);
+  }
+
+  void put_varint(uint64_t v) noexcept { pos_ = detail::put_varint(v, pos_); }
+
+  void put_tag(int number, WireType wt) noexcept {
+    put_varint((static_cast<uint64_t>(number) << 3) | wt);
+  }
+
+  void put_scalar(WireType wt, uint64_t bits) noexcept {
+    if (wt == kVarint) {
+      put_varint(bits);
+      return;
+    }
+    const std::size_t n = wt == kFixed64 ? 8 : 4;
+    for (std::size_t i = 0; i < n; ++i, bits >>= 8)
+      *pos_++ = static_cast<std::byte>(bits);
+  }
+
+  void put_bytes(const void *data, std::size_t n) noexcept {
+    if (n)
+      std::memcpy(pos_, data, n);
+    pos_ += n;
+  }
+
+  void close_run() {
+    if (pos_ != run_)
+      pieces_.push_back({run_, static_cast<std::size_t>(pos_ - run_)});
+    run_ = pos_;
+  }
+
+  void put_string(const google::protobuf::Message &m, const FD &f, int idx) {
+    const auto *r = m.GetReflection();
+    const std::string &s = idx < 0 ? r->GetStringReference(m, &f, &scratch_)
+                                   : r->GetRepeatedStringReference(
+                                         m, &f, idx, &scratch_);
+    put_varint(s.size());
+    // A reference to scratch_ means the field is not stored as a string
+    // (e.g. a Cord) and must be copied after all.
+    if (s.size() < min_reference_ || &s == &scratch_) {
+      put_bytes(s.data(), s.size());
+      return;
+    }
+    close_run();
+    pieces_.push_back({const_cast<char *>(s.data()), s.size()});
+  }
+
+  void encode_message(const google::protobuf::Message &m) {
+    if (static_cast<std::size_t>(m.GetCachedSize()) < min_reference_) {
+      pos_ = reinterpret_cast<std::byte *>(m.SerializeWithCachedSizesToArray(
+          reinterpret_cast<uint8_t *>(pos_)));
+      return;
+    }
+    const auto *r = m.GetReflection();
+    std::vector<const FD *> fields;
+    r->ListFields(m, &fields);
+    for (const FD *f : fields)
+      encode_field(m, *f);
+    const auto &unknown = r->GetUnknownFields(m);
+    if (!unknown.empty()) {
+      unknown.SerializeToString(&scratch_);
+      put_bytes(scratch_.data(), scratch_.size());
+    }
+  }
+
+  void encode_field(const google::protobuf::Message &m, const FD &f) {
+    const auto *r = m.GetReflection();
+    const WireType wt = wire_type(f);
+    if (!f.is_repeated()) {
+      put_tag(f.number(), wt);
+      encode_element(m, f, wt, -1);
+      return;
+    }
+    const int count = r->FieldSize(m, &f);
+    if (f.is_map()) {
+      // Entries are small and protobuf serializes them whole.
+      for (int i = 0; i < count; ++i) {
+        const auto &entry = r->GetRepeatedMessage(m, &f, i);
+        put_tag(f.number(), kLength);
+        put_varint(entry.ByteSizeLong());
+        pos_ = reinterpret_cast<std::byte *>(
+            entry.SerializeWithCachedSizesToArray(
+                reinterpret_cast<uint8_t *>(pos_)));
+      }
+      return;
+    }
+    if (f.is_packed()) {
+      std::size_t payload = 0;
+      for (int i = 0; i < count; ++i)
+        payload += scalar_size(wt, scalar_bits(m, f, i));
+      put_tag(f.number(), kLength);
+      put_varint(payload);
+      for (int i = 0; i < count; ++i)
+        put_scalar(wt, scalar_bits(m, f, i));
+      return;
+    }
+    for (int i = 0; i < count; ++i) {
+      put_tag(f.number(), wt);
+      encode_element(m, f, wt, i);
+    }
+  }
+
+  // One value of f after its tag.
+  void encode_element(const google::protobuf::Message &m, const FD &f,
+                      WireType wt, int idx) {
+    const auto *r = m.GetReflection();
+    switch (f.type()) {
+    case FD::TYPE_STRING:
+    case FD::TYPE_BYTES:
+      put_string(m, f, idx);
+      return;
+    case FD::TYPE_MESSAGE:
+    case FD::TYPE_GROUP: {
+      const auto &sub = idx < 0 ? r->GetMessage(m, &f)
+                                : r->GetRepeatedMessage(m, &f, idx);
+      if (wt == kLength)
+        put_varint(static_cast<uint64_t>(sub.GetCachedSize()));
+      encode_message(sub);
+      if (wt == kStartGroup)
+        put_tag(f.number(), kEndGroup);
+      return;
+    }
+    default:
+      put_scalar(wt, scalar_bits(m, f, idx));
+    }
+  }
+
+  std::size_t min_reference_;
+  std::size_t total_ = 0;
+  std::size_t capacity_ = 0;
+  std::unique_ptr<std::byte[]> buffer_;
+  std::byte *pos_ = nullptr;
+  std::byte *run_ = nullptr; // start of the buffer bytes not yet in pieces_
+  std::vector<iovec> pieces_;
+  std::string scratch_;
+};
+
+} // namespace sugar
@@ -0,0 +1,789 @@
+#pragma once
+
+/*
+ * sugar_json.h
+ *
+ * Copyright 2025 M.Berkay Karatas
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Building blocks for the schema-specialized JSON writers and readers that
+// protoc-gen-sugar emits (XWrapped::write_json / read_json). The encoding
+// follows the proto3 JSON mapping: lowerCamelCase keys, 64-bit integers as
+// strings, enums by name, bytes as base64 and default values omitted.
+
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SUGAR_JSON_SSE2 1
+#endif
+
+namespace sugar::json {
+
+class ParseError : public std::runtime_error {
+public:
+  ParseError(const char *what, std::size_t offset)
+      : std::runtime_error(std::string("json: ") + what + " at offset " +
+                           std::to_string(offset)),
+        offset_(offset) {}
+
+  [[nodiscard]] std::size_t offset() const noexcept { return offset_; }
+
+private:
+  std::size_t offset_;
+};
+
+namespace detail {
+
+// Length of the leading run of s that can be copied verbatim into a JSON
+// string, i.e. contains no '"', '\\' or control characters.
+[[nodiscard]] inline std::size_t escape_free_prefix(const char *s,
+                                                    std::size_t n) noexcept {
+  std::size_t i = 0;
+#ifdef SUGAR_JSON_SSE2
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i bslash = _mm_set1_epi8('\\');
+  const __m128i ctrl = _mm_set1_epi8(0x1F);
+  for (; i + 16 <= n; i += 16) {
+    const __m128i v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+    const __m128i hit = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bslash)),
+        _mm_cmpeq_epi8(_mm_max_epu8(v, ctrl), ctrl));
+    const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hit));
+    if (mask)
+      return i + static_cast<std::size_t>(std::countr_zero(mask));
+  }
+#endif
+  for (; i < n; ++i) {
+    const auto c = static_cast<unsigned char>(s[i]);
+    if (c == '"' || c == '\\' || c < 0x20)
+      break;
+  }
+  return i;
+}
+
+// Like escape_free_prefix but also stops at non-ASCII bytes, which the
+// reader validates as UTF-8 one sequence at a time.
+[[nodiscard]] inline std::size_t plain_ascii_prefix(const char *s,
+                                                    std::size_t n) noexcept {
+  std::size_t i = 0;
+#ifdef SUGAR_JSON_SSE2
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i bslash = _mm_set1_epi8('\\');
+  const __m128i ctrl = _mm_set1_epi8(0x1F);
+  for (; i + 16 <= n; i += 16) {
+    const __m128i v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+    const __m128i hit = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bslash)),
+        _mm_cmpeq_epi8(_mm_max_epu8(v, ctrl), ctrl));
+    const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hit)) |
+                          static_cast<unsigned>(_mm_movemask_epi8(v));
+    if (mask)
+      return i + static_cast<std::size_t>(std::countr_zero(mask));
+  }
+#endif
+  for (; i < n; ++i) {
+    const auto c = static_cast<unsigned char>(s[i]);
+    if (c == '"' || c == '\\' || c < 0x20 || c >= 0x80)
+      break;
+  }
+  return i;
+}
+
+// Length of the well-formed UTF-8 sequence starting at s, or 0.
+[[nodiscard]] inline std::size_t utf8_sequence(const unsigned char *s,
+                                               std::size_t n) noexcept {
+  const unsigned char c = s[0];
+  std::size_t len;
+  uint32_t cp;
+  if (c < 0x80)
+    return 1;
+  if (c >= 0xC2 && c <= 0xDF) {
+    len = 2;
+    cp = c & 0x1F;
+  } else if (c >= 0xE0 && c <= 0xEF) {
+    len = 3;
+    cp = c & 0x0F;
+  } else if (c >= 0xF0 && c <= 0xF4) {
+    len = 4;
+    cp = c & 0x07;
+  } else {
+    return 0;
+  }
+  if (n < len)
+    return 0;
+  for (std::size_t i = 1; i < len; ++i) {
+    if ((s[i] & 0xC0) != 0x80)
+      return 0;
+    cp = (cp << 6) | (s[i] & 0x3F);
+  }
+  if ((len == 3 && (cp < 0x800 || (cp >= 0xD800 && cp <= 0xDFFF))) ||
+      (len == 4 && (cp < 0x10000 || cp > 0x10FFFF)))
+    return 0;
+  return len;
+}
+
+inline void append_utf8(std::string &out, uint32_t cp) {
+  if (cp < 0x80) {
+    out.push_back(static_cast<char>(cp));
+  } else if (cp < 0x800) {
+    out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+    out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+  } else if (cp < 0x10000) {
+    out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+    out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+  } else {
+    out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+    out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+  }
+}
+
+inline constexpr char kBase64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Accepts both the standard and the URL-safe alphabet, as protobuf does.
+[[nodiscard]] constexpr int base64_value(char c) noexcept {
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A';
+  if (c >= 'a' && c <= 'z')
+    return c - 'a' + 26;
+  if (c >= '0' && c <= '9')
+    return c - '0' + 52;
+  if (c == '+' || c == '-')
+    return 62;
+  if (c == '/' || c == '_')
+    return 63;
+  return -1;
+}
+
+} // namespace detail
+
+// Appends JSON to a caller-owned string. Reusing the same string across
+// messages keeps its capacity, so steady-state encoding does not allocate.
+class Writer {
+public:
+  explicit Writer(std::string &out) noexcept : out_(out) {}
+
+  void begin_object() {
+    out_.push_back('{');
+    first_ = true;
+  }
+  void end_object() {
+    out_.push_back('}');
+    first_ = false;
+  }
+  void begin_array() {
+    out_.push_back('[');
+    first_ = true;
+  }
+  void end_array() {
+    out_.push_back(']');
+    first_ = false;
+  }
+
+  // quoted_key is the pre-escaped `"name":` literal emitted by the generator.
+  void key(std::string_view quoted_key) {
+    element();
+    out_.append(quoted_key);
+  }
+
+  void element() {
+    if (!first_)
+      out_.push_back(',');
+    first_ = false;
+  }
+
+  template <typename K> void map_key(const K &k) {
+    element();
+    if constexpr (std::is_same_v<K, std::string>)
+      string(k);
+    else if constexpr (std::is_same_v<K, bool>)
+      out_.append(k ? "\"true\"" : "\"false\"");
+    else
+      quoted_integer(k);
+    out_.push_back(':');
+  }
+
+  void int32(int32_t v) { integer(v); }
+  void uint32(uint32_t v) { integer(v); }
+  void int64(int64_t v) { quoted_integer(v); }
+  void uint64(uint64_t v) { quoted_integer(v); }
+  void boolean(bool v) { out_.append(v ? "true" : "false"); }
+  void float32(float v) { real(v); }
+  void float64(double v) { real(v); }
+
+  // Unknown values of open enums are written as numbers.
+  void enumeration(int number, std::string_view name) {
+    if (name.empty())
+      integer(number);
+    else
+      string(name);
+  }
+
+  void string(std::string_view s) {
+    out_.push_back('"');
+    const char *p = s.data();
+    std::size_t n = s.size();
+    while (n) {
+      const std::size_t run = detail::escape_free_prefix(p, n);
+      out_.append(p, run);
+      if (run == n)
+        break;
+      escape(static_cast<unsigned char>(p[run]));
+      p += run + 1;
+      n -= run + 1;
+    }
+    out_.push_back('"');
+  }
+
+  void bytes(std::string_view s) {
+    out_.push_back('"');
+    const auto *p = reinterpret_cast<const unsigned char *>(s.data());
+    std::size_t i = 0;
+    char quad[4];
+    for (; i + 3 <= s.size(); i += 3) {
+      const uint32_t v = (uint32_t{p[i]} << 16) | (uint32_t{p[i + 1]} << 8) |
+                         p[i + 2];
+      quad[0] = detail::kBase64[v >> 18];
+      quad[1] = detail::kBase64[(v >> 12) & 0x3F];
+      quad[2] = detail::kBase64[(v >> 6) & 0x3F];
+      quad[3] = detail::kBase64[v & 0x3F];
+      out_.append(quad, 4);
+    }
+    if (const std::size_t rest = s.size() - i) {
+      uint32_t v = uint32_t{p[i]} << 16;
+      if (rest == 2)
+        v |= uint32_t{p[i + 1]} << 8;
+      quad[0] = detail::kBase64[v >> 18];
+      quad[1] = detail::kBase64[(v >> 12) & 0x3F];
+      quad[2] = rest == 2 ? detail::kBase64[(v >> 6) & 0x3F] : '=';
+      quad[3] = '=';
+      out_.append(quad, 4);
+    }
+    out_.push_back('"');
+  }
+
+private:
+  template <typename I> void integer(I v) {
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    out_.append(buf, res.ptr);
+  }
+
+  template <typename I> void quoted_integer(I v) {
+    char buf[24];
+    buf[0] = '"';
+    auto res = std::to_chars(buf + 1, buf + sizeof(buf) - 1, v);
+    *res.ptr++ = '"';
+    out_.append(buf, res.ptr);
+  }
+
+  template <typename F> void real(F v) {
+    if (std::isnan(v)) {
+      out_.append("\"NaN\"");
+    } else if (std::isinf(v)) {
+      out_.append(v > 0 ? "\"Infinity\"" : "\"-Infinity\"");
+    } else {
+      char buf[32];
+      auto res = std::to_chars(buf, buf + sizeof(buf), v);
+      out_.append(buf, res.ptr);
+    }
+  }
+
+  void escape(unsigned char c) {
+    switch (c) {
+    case '"':
+      out_.append("\\\"");
+      break;
+    case '\\':
+      out_.append("\\\\");
+      break;
+    case '\b':
+      out_.append("\\b");
+      break;
+    case '\f':
+      out_.append("\\f");
+      break;
+    case '\n':
+      out_.append("\\n");
+      break;
+    case '\r':
+      out_.append("\\r");
+      break;
+    case '\t':
+      out_.append("\\t");
+      break;
+    default: {
+      static constexpr char hex[] = "0123456789abcdef";
+      const char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+      out_.append(esc, sizeof(esc));
+    }
+    }
+  }
+
+  std::string &out_;
+  bool first_ = true;
+};
+
+// Pull parser over a complete JSON document. Keys and escape-free strings
+// are returned as views into the input; errors throw ParseError.
+class Reader {
+public:
+  static constexpr int kMaxDepth = 100;
+
+  explicit Reader(std::string_view in,
+                  bool ignore_unknown_fields = false) noexcept
+      : begin_(in.data()), p_(in.data()), end_(in.data() + in.size()),
+        ignore_unknown_(ignore_unknown_fields) {}
+
+  void begin_object() { open('{'); }
+  void begin_array() { open('['); }
+
+  // Advances to the next member of the current object; false at its end.
+  bool next_key(std::string_view &key) {
+    if (!next('}'))
+      return false;
+    key_offset_ = static_cast<std::size_t>(p_ - begin_);
+    key = read_string_view();
+    skip_ws();
+    expect(':');
+    return true;
+  }
+
+  // Advances to the next element of the current array; false at its end.
+  bool next_element() { return next(']'); }
+
+  // Consumes a literal null. proto3 JSON treats null as the default value.
+  bool null() {
+    skip_ws();
+    if (end_ - p_ >= 4 && std::memcmp(p_, "null", 4) == 0) {
+      p_ += 4;
+      return true;
+    }
+    return false;
+  }
+
+  int32_t int32() {
+    return static_cast<int32_t>(integer(std::numeric_limits<int32_t>::min(),
+                                        std::numeric_limits<int32_t>::max()));
+  }
+  int64_t int64() {
+    return integer(std::numeric_limits<int64_t>::min(),
+                   std::numeric_limits<int64_t>::max());
+  }
+  uint32_t uint32() {
+    return static_cast<uint32_t>(
+        unsigned_integer(std::numeric_limits<uint32_t>::max()));
+  }
+  uint64_t uint64() {
+    return unsigned_integer(std::numeric_limits<uint64_t>::max());
+  }
+
+  bool boolean() {
+    skip_ws();
+    if (end_ - p_ >= 4 && std::memcmp(p_, "true", 4) == 0) {
+      p_ += 4;
+      return true;
+    }
+    if (end_ - p_ >= 5 && std::memcmp(p_, "false", 5) == 0) {
+      p_ += 5;
+      return false;
+    }
+    fail("expected boolean");
+  }
+
+  float float32() {
+    const double v = float64();
+    if (std::isfinite(v) && (v > std::numeric_limits<float>::max() ||
+                             v < -std::numeric_limits<float>::max()))
+      fail("float out of range");
+    return static_cast<float>(v);
+  }
+
+  double float64() {
+    skip_ws();
+    if (p_ < end_ && *p_ == '"') {
+      const std::string_view s = read_string_view();
+      if (s == "NaN")
+        return std::numeric_limits<double>::quiet_NaN();
+      if (s == "Infinity")
+        return std::numeric_limits<double>::infinity();
+      if (s == "-Infinity")
+        return -std::numeric_limits<double>::infinity();
+      return parse_double(s.data(), s.data() + s.size(), true);
+    }
+    return parse_double(p_, end_, false);
+  }
+
+  void string(std::string &out) {
+    out.clear();
+    skip_ws();
+    expect('"');
+    read_string_body(out);
+  }
+
+  void bytes(std::string &out) {
+    skip_ws();
+    const std::string_view s = read_string_view();
+    out.clear();
+    out.reserve(s.size() / 4 * 3 + 3);
+    uint32_t acc = 0;
+    int bits = 0;
+    for (char c : s) {
+      if (c == '=')
+        break;
+      const int v = detail::base64_value(c);
+      if (v < 0)
+        fail("invalid base64");
+      acc = (acc << 6) | static_cast<uint32_t>(v);
+      bits += 6;
+      if (bits >= 8) {
+        bits -= 8;
+        out.push_back(static_cast<char>((acc >> bits) & 0xFF));
+      }
+    }
+  }
+
+  // Accepts an enum value name or its number; parse is the protoc-generated
+  // Enum_Parse function.
+  template <typename E, typename Name>
+  E enumeration(bool (*parse)(Name, E *)) {
+    skip_ws();
+    if (p_ < end_ && *p_ == '"') {
+      const std::string name(read_string_view());
+      E e{};
+      if (!parse(name, &e))
+        fail("unknown enum value");
+      return e;
+    }
+    return static_cast<E>(int32());
+  }
+
+  // Map keys are always JSON strings; this converts them to the key type.
+  // Errors are reported at offset.
+  template <typename K>
+  static K map_key(std::string_view k, std::size_t offset = 0) {
+    if constexpr (std::is_same_v<K, std::string>) {
+      return std::string(k);
+    } else if constexpr (std::is_same_v<K, bool>) {
+      if (k == "true")
+        return true;
+      if (k == "false")
+        return false;
+      throw ParseError("invalid bool map key", offset);
+    } else {
+      K v{};
+      auto res = std::from_chars(k.data(), k.data() + k.size(), v);
+      if (res.ec != std::errc() || res.ptr != k.data() + k.size())
+        throw ParseError("invalid integer map key", offset);
+      return v;
+    }
+  }
+
+  // map_key() for k, the key next_key() returned last, reporting errors
+  // at its offset in the input.
+  template <typename K> K map_key_at_last(std::string_view k) const {
+    return map_key<K>(k, key_offset_);
+  }
+
+  // Called by the generated readers for keys that name no field.
+  void unknown_field(std::string_view) {
+    if (!ignore_unknown_)
+      fail("unknown field");
+    skip_value();
+  }
+
+  void skip_value() {
+    skip_ws();
+    if (p_ >= end_)
+      fail("unexpected end of input");
+    switch (*p_) {
+    case '{': {
+      begin_object();
+      std::string_view k;
+      while (next_key(k))
+        skip_value();
+      break;
+    }
+    case '[':
+      begin_array();
+      while (next_element())
+        skip_value();
+      break;
+    case '"':
+      read_string_view();
+      break;
+    case 't':
+    case 'f':
+      boolean();
+      break;
+    case 'n':
+      if (!null())
+        fail("unexpected token");
+      break;
+    default:
+      float64();
+    }
+  }
+
+  // Verifies that only whitespace follows the top-level value.
+  void finish() {
+    skip_ws();
+    if (p_ != end_)
+      fail("trailing characters");
+  }
+
+private:
+  [[noreturn]] void fail(const char *what) const {
+    throw ParseError(what, static_cast<std::size_t>(p_ - begin_));
+  }
+
+  void skip_ws() noexcept {
+    while (p_ < end_ &&
+           (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t'))
+      ++p_;
+  }
+
+  void expect(char c) {
+    if (p_ >= end_ || *p_ != c)
+      fail("unexpected character");
+    ++p_;
+  }
+
+  void open(char c) {
+    skip_ws();
+    expect(c);
+    if (++depth_ >= kMaxDepth)
+      fail("nesting too deep");
+    first_[depth_] = true;
+  }
+
+  bool next(char close) {
+    skip_ws();
+    if (p_ < end_ && *p_ == close) {
+      ++p_;
+      --depth_;
+      return false;
+    }
+    if (!first_[depth_]) {
+      expect(',');
+      skip_ws();
+    }
+    first_[depth_] = false;
+    return true;
+  }
+
+  // Reads a quoted string. Escape-free strings (the common case for keys,
+  // numbers, enum names and base64) are returned as views into the input;
+  // others are decoded into the scratch buffer.
+  std::string_view read_string_view() {
+    expect('"');
+    const char *start = p_;
+    const std::size_t run =
+        detail::escape_free_prefix(p_, static_cast<std::size_t>(end_ - p_));
+    if (p_ + run < end_ && p_[run] == '"') {
+      p_ += run + 1;
+      return {start, run};
+    }
+    read_string_body(scratch_);
+    return scratch_;
+  }
+
+  // Decodes the remainder of a string whose opening quote is consumed.
+  void read_string_body(std::string &out) {
+    out.clear();
+    for (;;) {
+      const std::size_t run =
+          detail::plain_ascii_prefix(p_, static_cast<std::size_t>(end_ - p_));
+      out.append(p_, run);
+      p_ += run;
+      if (p_ >= end_)
+        fail("unterminated string");
+      const auto c = static_cast<unsigned char>(*p_);
+      if (c == '"') {
+        ++p_;
+        return;
+      }
+      if (c == '\\') {
+        ++p_;
+        read_escape(out);
+      } else if (c >= 0x80) {
+        const std::size_t len =
+            detail::utf8_sequence(reinterpret_cast<const unsigned char *>(p_),
+                                  static_cast<std::size_t>(end_ - p_));
+        if (!len)
+          fail("invalid UTF-8");
+        out.append(p_, len);
+        p_ += len;
+      } else {
+        fail("control character in string");
+      }
+    }
+  }
+
+  void read_escape(std::string &out) {
+    if (p_ >= end_)
+      fail("unterminated escape");
+    switch (*p_++) {
+    case '"':
+      out.push_back('"');
+      break;
+    case '\\':
+      out.push_back('\\');
+      break;
+    case '/':
+      out.push_back('/');
+      break;
+    case 'b':
+      out.push_back('\b');
+      break;
+    case 'f':
+      out.push_back('\f');
+      break;
+    case 'n':
+      out.push_back('\n');
+      break;
+    case 'r':
+      out.push_back('\r');
+      break;
+    case 't':
+      out.push_back('\t');
+      break;
+    case 'u': {
+      uint32_t cp = read_hex4();
+      if (cp >= 0xD800 && cp <= 0xDBFF) {
+        if (end_ - p_ < 6 || p_[0] != '\\' || p_[1] != 'u')
+          fail("unpaired surrogate");
+        p_ += 2;
+        const uint32_t lo = read_hex4();
+        if (lo < 0xDC00 || lo > 0xDFFF)
+          fail("unpaired surrogate");
+        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+      } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+        fail("unpaired surrogate");
+      }
+      detail::append_utf8(out, cp);
+      break;
+    }
+    default:
+      fail("invalid escape");
+    }
+  }
+
+  uint32_t read_hex4() {
+    if (end_ - p_ < 4)
+      fail("truncated \\u escape");
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) {
+      const char c = *p_++;
+      v <<= 4;
+      if (c >= '0' && c <= '9')
+        v |= static_cast<uint32_t>(c - '0');
+      else if (c >= 'a' && c <= 'f')
+        v |= static_cast<uint32_t>(c - 'a' + 10);
+      else if (c >= 'A' && c <= 'F')
+        v |= static_cast<uint32_t>(c - 'A' + 10);
+      else
+        fail("invalid \\u escape");
+    }
+    return v;
+  }
+
+  // from_chars also takes "nan", "inf" and ".5", none of which are JSON
+  // numbers; the non-finite values are only accepted as quoted names.
+  double parse_double(const char *first, const char *last, bool whole) {
+    const char *digits = first < last && *first == '-' ? first + 1 : first;
+    if (digits == last || *digits < '0' || *digits > '9')
+      fail("invalid number");
+    double v = 0;
+    auto res = std::from_chars(first, last, v);
+    if (res.ec != std::errc() || (whole && res.ptr != last))
+      fail("invalid number");
+    if (!whole)
+      p_ = res.ptr;
+    return v;
+  }
+
+  // Integers may be quoted and may use exponent or fraction notation as
+  // long as the value is integral, per the proto3 JSON mapping.
+  template <typename I> I parse_integral(I lo, I hi) {
+    skip_ws();
+    const bool quoted = p_ < end_ && *p_ == '"';
+    const char *first;
+    const char *last;
+    if (quoted) {
+      const std::string_view s = read_string_view();
+      first = s.data();
+      last = s.data() + s.size();
+    } else {
+      first = p_;
+      last = end_;
+    }
+    I v{};
+    auto res = std::from_chars(first, last, v);
+    const bool more = res.ptr != last && (*res.ptr == '.' || *res.ptr == 'e' ||
+                                          *res.ptr == 'E');
+    if (res.ec == std::errc() && !more) {
+      if (quoted && res.ptr != last)
+        fail("invalid integer");
+      if (!quoted)
+        p_ = res.ptr;
+      if (v < lo || v > hi)
+        fail("integer out of range");
+      return v;
+    }
+    double d = 0;
+    auto dres = std::from_chars(first, last, d);
+    if (dres.ec != std::errc() || (quoted && dres.ptr != last))
+      fail("invalid integer");
+    if (!quoted)
+      p_ = dres.ptr;
+    if (d != std::floor(d) || d < static_cast<double>(lo) ||
+        !(d < static_cast<double>(hi) + 1.0))
+      fail("integer out of range");
+    return static_cast<I>(d);
+  }
+
+  int64_t integer(int64_t lo, int64_t hi) { return parse_integral(lo, hi); }
+  uint64_t unsigned_integer(uint64_t hi) {
+    return parse_integral<uint64_t>(0, hi);
+  }
+
+  const char *begin_;
+  const char *p_;
+  const char *end_;
+  bool ignore_unknown_;
+  std::size_t key_offset_ = 0; // of the last key next_key() read
+  int depth_ = 0;
+  bool first_[kMaxDepth] = {};
+  std::string scratch_;
+};
+
+} // namespace sugar::json
@@ -0,0 +1,316 @@
+#pragma once
+
+/*
+ * sugar_lite.h
+ *
+ * Copyright 2025 M.Berkay Karatas
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Runtime for wrappers over `optimize_for = LITE_RUNTIME` messages. Tags are
+// bound to the generated accessors at compile time, so nothing here needs
+// Reflection, descriptors or the descriptor pool; field metadata comes from
+// the constexpr kFields table generated into each XWrapped.
+
+#include "sugar_core.h"
+
+#include <google/protobuf/map.h>
+#include <google/protobuf/message_lite.h>
+#include <google/protobuf/repeated_field.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace sugar::lite {
+
+// Shared with kFieldList (sugar_core.h).
+using sugar::Cardinality;
+using sugar::FieldKind;
+
+struct FieldInfo {
+  std::string_view name;
+  int number;
+  FieldKind kind;
+  Cardinality cardinality;
+  int oneof_index; // -1 outside a oneof
+};
+
+template <std::size_t N>
+[[nodiscard]] constexpr const FieldInfo *
+find_field(const std::array<FieldInfo, N> &fields, int number) noexcept {
+  for (const auto &f : fields)
+    if (f.number == number)
+      return &f;
+  return nullptr;
+}
+
+template <std::size_t N>
+[[nodiscard]] constexpr const FieldInfo *
+find_field(const std::array<FieldInfo, N> &fields,
+           std::string_view name) noexcept {
+  for (const auto &f : fields)
+    if (f.name == name)
+      return &f;
+  return nullptr;
+}
+
+namespace detail {
+template <typename Access, auto Get>
+using value_t = std::remove_cvref_t<decltype((
+    std::declval<const typename Access::message_type &>().*Get)())>;
+
+template <typename V>
+[[nodiscard]] std::string_view as_string_view(const V &v) {
+  return std::string_view(v);
+}
+} // namespace detail
+
+// Numeric, bool and enum fields: `Get` / `Set` are the generated x() and
+// set_x(). Enum fields also accept their integer value.
+template <typename Access, auto Get, auto Set> class FieldTag {
+public:
+  using value_type = detail::value_t<Access, Get>;
+
+  [[nodiscard]] value_type get() const {
+    return (Access::read(this).*Get)();
+  }
+
+  [[nodiscard]] operator value_type() const { return get(); }
+
+  template <typename V> FieldTag &operator=(V &&v) {
+    if constexpr (std::is_enum_v<value_type>)
+      (Access::message(this).*Set)(static_cast<value_type>(v));
+    else
+      (Access::message(this).*Set)(std::forward<V>(v));
+    return *this;
+  }
+
+  FieldTag &operator=(const volatile FieldTag &) = delete;
+
+private:
+  FieldTag(const FieldTag &) = default;
+  friend typename Access::owner;
+};
+
+template <typename Access, auto Get, auto Set>
+std::ostream &operator<<(std::ostream &os,
+                         const FieldTag<Access, Get, Set> &t) {
+  return os << t.get();
+}
+
+// string and bytes fields: `Get` / `Mutable` are x() and mutable_x(), which
+// unlike the templated set_x() have a single overload to bind to.
+template <typename Access, auto Get, auto Mutable> class StringTag {
+public:
+  [[nodiscard]] const std::string &get() const {
+    return (Access::read(this).*Get)();
+  }
+
+  [[nodiscard]] operator const std::string &() const { return get(); }
+  [[nodiscard]] operator std::string_view() const { return get(); }
+
+  template <typename V> StringTag &operator=(V &&v) {
+    const std::string_view s = detail::as_string_view(v);
+    (Access::message(this).*Mutable)()->assign(s.data(), s.size());
+    return *this;
+  }
+
+  StringTag &operator=(const volatile StringTag &) = delete;
+
+private:
+  StringTag(const StringTag &) = default;
+  friend typename Access::owner;
+};
+
+template <typename Access, auto Get, auto Mutable>
+std::ostream &operator<<(std::ostream &os,
+                         const StringTag<Access, Get, Mutable> &t) {
+  return os << t.get();
+}
+
+// Repeated fields over the generated mutable_x() container. ElemT is the
+// element wrapper for message fields and void otherwise.
+template <typename Access, typename Container,
+          Container *(Access::message_type::*Mutable)(),
+          typename ElemT = void>
+class RepeatedTag {
+  static constexpr bool kMessages = !std::is_void_v<ElemT>;
+  static constexpr bool kStrings =
+      std::is_same_v<Container,
+                     google::protobuf::RepeatedPtrField<std::string>>;
+
+public:
+  // Elements are read by value (message wrappers) or const reference.
+  using reference = std::conditional_t<
+      kMessages, ElemT,
+      std::conditional_t<kStrings, const std::string &,
+                         const typename Container::value_type &>>;
+
+  // The underlying RepeatedField / RepeatedPtrField.
+  [[nodiscard]] Container &proxy() const {
+    return *(Access::message(this).*Mutable)();
+  }
+
+  [[nodiscard]] int size() const { return proxy().size(); }
+  [[nodiscard]] bool empty() const { return proxy().empty(); }
+
+  template <typename V> void push_back(V &&v) {
+    auto &c = proxy();
+    if constexpr (kMessages) {
+      static_assert(std::is_invocable_v<V, ElemT>,
+                    "push_back on a message field takes an init callback");
+      ElemT wrapper(*c.Add());
+      std::forward<V>(v)(wrapper);
+    } else if constexpr (kStrings) {
+      const std::string_view s = detail::as_string_view(v);
+      c.Add()->assign(s.data(), s.size());
+    } else {
+      c.Add(static_cast<typename Container::value_type>(v));
+    }
+  }
+
+  [[nodiscard]] google::protobuf::MessageLite &add_message()
+    requires kMessages
+  {
+    return *proxy().Add();
+  }
+
+  template <typename V> void set(int idx, V &&v)
+    requires(!kMessages)
+  {
+    auto &c = proxy();
+    check_index(c, idx);
+    if constexpr (kStrings) {
+      const std::string_view s = detail::as_string_view(v);
+      c.Mutable(idx)->assign(s.data(), s.size());
+    } else {
+      c.Set(idx, static_cast<typename Container::value_type>(v));
+    }
+  }
+
+  reference operator[](int idx) const {
+    auto &c = proxy();
+    check_index(c, idx);
+    if constexpr (kMessages)
+      return ElemT(*c.Mutable(idx));
+    else
+      return c.Get(idx);
+  }
+
+  reference at(int idx) const { return (*this)[idx]; }
+  reference front() const { return (*this)[0]; }
+  reference back() const { return (*this)[size() - 1]; }
+
+  class iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using difference_type = int;
+    using pointer = void;
+    using reference = RepeatedTag::reference;
+    using value_type = std::remove_cvref_t<reference>;
+
+    iterator(const RepeatedTag *tag, int i) : tag_(tag), index_(i) {}
+    reference operator*() const { return (*tag_)[index_]; }
+    iterator &operator++() {
+      ++index_;
+      return *this;
+    }
+    bool operator==(const iterator &o) const { return index_ == o.index_; }
+    bool operator!=(const iterator &o) const { return !(*this == o); }
+
+  private:
+    const RepeatedTag *tag_;
+    int index_;
+  };
+
+  iterator begin() const { return iterator(this, 0); }
+  iterator end() const { return iterator(this, size()); }
+
+  RepeatedTag &operator=(const RepeatedTag &) = delete;
+
+private:
+  static void check_index(const Container &c, int idx) {
+    if (idx < 0 || idx >= c.size())
+      throw std::out_of_range("repeated index out of range");
+  }
+
+  RepeatedTag(const RepeatedTag &) = default;
+  friend typename Access::owner;
+};
+
+// Map fields over the generated mutable_x() map.
+template <typename Access, auto Mutable> class MapTag {
+public:
+  using map_type = std::remove_pointer_t<decltype((
+      std::declval<typename Access::message_type &>().*Mutable)())>;
+  using key_type = typename map_type::key_type;
+  using mapped_type = typename map_type::mapped_type;
+
+  // The underlying google::protobuf::Map.
+  [[nodiscard]] map_type &proxy() const {
+    return *(Access::message(this).*Mutable)();
+  }
+
+  [[nodiscard]] std::size_t size() const { return proxy().size(); }
+  [[nodiscard]] bool empty() const { return proxy().empty(); }
+
+  template <typename KeyLike, typename ValLike>
+  void set(KeyLike &&k, ValLike &&v) {
+    static_assert(!std::is_base_of_v<google::protobuf::MessageLite,
+                                     mapped_type>,
+                  "map submessage not supported");
+    auto &m = proxy();
+    m[key_type(std::forward<KeyLike>(k))] =
+        mapped_type(std::forward<ValLike>(v));
+  }
+
+  MapTag &operator=(const MapTag &) = delete;
+
+private:
+  MapTag(const MapTag &) = default;
+  friend typename Access::owner;
+};
+
+// Oneofs: `Case` / `Clear` are the generated x_case() and clear_x();
+// Wrapped::kFields resolves the active field's metadata.
+template <typename Access, auto Case, auto Clear, typename Wrapped>
+class OneofTag {
+public:
+  // Field number of the active member, 0 when none is set.
+  [[nodiscard]] int active_number() const {
+    return static_cast<int>((Access::read(this).*Case)());
+  }
+
+  [[nodiscard]] const FieldInfo *active_field() const {
+    const int number = active_number();
+    return number ? find_field(Wrapped::kFields, number) : nullptr;
+  }
+
+  void clear() { (Access::message(this).*Clear)(); }
+
+  OneofTag &operator=(const OneofTag &) = delete;
+
+private:
+  OneofTag(const OneofTag &) = default;
+  friend typename Access::owner;
+};
+
+} // namespace sugar::lite
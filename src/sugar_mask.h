@@ -0,0 +1,143 @@
+#pragma once
+
+/*
+ * sugar_mask.h
+ *
+ * Copyright 2025 M.Berkay Karatas
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// FieldMask projection without path interpretation per message:
+//
+//   const sugar::CompiledMask mask(User::descriptor(), field_mask);  // once
+//   UserWrapped::copy_masked(src, dst, mask);   // dst = src's selected fields
+//   UserWrapped::merge_masked(src, dst, mask);  // FieldMaskUtil::MergeMessageTo
+//
+// A CompiledMask holds one bitset of selected field indices per message
+// level, and a nested mask for each singular submessage selected through
+// sub-paths ("profile.city"). The generated functions walk the set bits
+// and copy each field through its accessors. merge_masked follows
+// MergeMessageTo with default options: selected singular scalars are set
+// from src or cleared when src does not have them, submessages and
+// repeated fields merge, and a submessage reached through sub-paths is
+// created in dst even when src lacks it. Unlike FieldMaskUtil, which logs
+// and skips them, unknown fields and sub-paths below anything but a
+// singular message throw std::invalid_argument when the mask is compiled.
+// Full runtime only; lite messages have no descriptors to compile against.
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/field_mask.pb.h>
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace sugar {
+
+class CompiledMask {
+public:
+  // Selects nothing.
+  explicit CompiledMask(const google::protobuf::Descriptor *d)
+      : descriptor_(d), bits_((d->field_count() + 63) / 64),
+        child_of_(d->field_count(), -1) {}
+
+  CompiledMask(const google::protobuf::Descriptor *d,
+               const google::protobuf::FieldMask &mask)
+      : CompiledMask(d) {
+    for (const std::string &path : mask.paths())
+      add(path);
+  }
+
+  CompiledMask(const google::protobuf::Descriptor *d,
+               std::initializer_list<std::string_view> paths)
+      : CompiledMask(d) {
+    for (std::string_view path : paths)
+      add(path);
+  }
+
+  // Adds one dotted path. A path covering a field replaces any narrower
+  // paths below it, as in FieldMaskUtil's canonical form.
+  void add(std::string_view path) {
+    const std::size_t dot = path.find('.');
+    const std::string_view name = path.substr(0, dot);
+    const auto *f = descriptor_->FindFieldByName(std::string(name));
+    if (!f)
+      throw std::invalid_argument("CompiledMask: no field \"" +
+                                  std::string(name) + "\" in " +
+                                  descriptor_->full_name());
+    const int i = f->index();
+    if (dot == std::string_view::npos) {
+      bits_[i / 64] |= uint64_t{1} << (i % 64);
+      child_of_[i] = -1;
+      return;
+    }
+    if (f->is_repeated() ||
+        f->cpp_type() != google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE)
+      throw std::invalid_argument("CompiledMask: \"" + f->full_name() +
+                                  "\" is not a singular message field");
+    if (selected(i) && child_of_[i] < 0)
+      return; // already whole
+    if (child_of_[i] < 0) {
+      child_of_[i] = static_cast<int>(children_.size());
+      children_.emplace_back(f->message_type());
+      bits_[i / 64] |= uint64_t{1} << (i % 64);
+    }
+    children_[child_of_[i]].add(path.substr(dot + 1));
+  }
+
+  [[nodiscard]] const google::protobuf::Descriptor *
+  descriptor() const noexcept {
+    return descriptor_;
+  }
+
+  [[nodiscard]] bool selected(int index) const noexcept {
+    return bits_[index / 64] >> (index % 64) & 1;
+  }
+
+  // The mask for the fields of submessage `index` when only some of them
+  // are selected; nullptr when the whole field is.
+  [[nodiscard]] const CompiledMask *child(int index) const noexcept {
+    return child_of_[index] < 0 ? nullptr : &children_[child_of_[index]];
+  }
+
+  // Calls fn(index, child(index)) for each selected field in index order.
+  template <typename Fn> void for_each(Fn &&fn) const {
+    for (std::size_t w = 0; w < bits_.size(); ++w)
+      for (uint64_t b = bits_[w]; b; b &= b - 1) {
+        const int i = static_cast<int>(w * 64) + std::countr_zero(b);
+        fn(i, child(i));
+      }
+  }
+
+  // Throws std::invalid_argument unless the mask was compiled for d.
+  void check(const google::protobuf::Descriptor *d) const {
+    if (d != descriptor_)
+      throw std::invalid_argument("CompiledMask: compiled for " +
+                                  descriptor_->full_name() + ", used with " +
+                                  d->full_name());
+  }
+
+private:
+  const google::protobuf::Descriptor *descriptor_;
+  std::vector<uint64_t> bits_;
+  std::vector<int> child_of_; // index into children_, or -1
+  std::vector<CompiledMask> children_;
+};
+
+} // namespace sugar
@@ -0,0 +1,386 @@
+#pragma once
+
+/*
+ * sugar_plain.h
+ *
+ * Copyright 2025 M.Berkay Karatas
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Plain-value mirrors of messages for hot loops. The generator emits an
+// aggregate XPlain next to each XWrapped:
+//
+//   struct UserPlain {
+//     int32_t id{};
+//     std::string name;
+//     std::vector<std::string> tags;
+//     std::vector<ProfilePlain> profiles;
+//     std::map<std::string, std::string> meta;
+//     std::variant<std::monostate, std::string, std::string> contact;
+//     std::optional<ProfilePlain> profile;
+//     ...
+//   };
+//
+//   UserPlain p = UserPlain::from_proto(u);      // or UserPlain::parse(bytes)
+//   p.tags.push_back("admin");
+//   std::string bytes = p.serialize();           // or p.to_proto(u)
+//
+// Scalars, strings and enums (as int) are stored inline, repeated fields
+// in std::vector, maps in std::map, submessages and scalars with explicit
+// presence in std::optional. A oneof is a std::variant whose alternative
+// i + 1 is its i-th field; XPlain::kEmail names that index for the field
+// `email`. Submessage and map value types must be defined before the
+// message using them, as for the Fields unions, and the generator rejects
+// messages that contain themselves through singular or oneof fields only;
+// trees built from repeated or map fields are fine.
+//
+// serialize() writes fields in number order (map entries in key order),
+// so for messages without maps the output is byte for byte what
+// SerializeToString produces. parse() and merge_from() follow the parser:
+// the last occurrence of a singular field wins, submessages merge, packed
+// and unpacked repeated scalars are both accepted, and unknown fields and
+// fields with an unexpected wire type are dropped. Malformed input throws
+// std::runtime_error. Groups have no XPlain field and are skipped.
+//
+// The helpers below are what the generated members are written against.
+
+#include "sugar_builder.h"
+#include "sugar_io.h"
+#include "sugar_wire.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace sugar::plain {
+
+using Token = sugar::detail::WireToken;
+
+// Reads the next field of [p, end) into t; false at the end.
+inline bool next(const std::byte *&p, const std::byte *end, Token &t) {
+  return sugar::detail::next_token(p, end, t);
+}
+
+[[nodiscard]] inline std::span<const std::byte>
+payload(const Token &t) noexcept {
+  return {t.value, t.end};
+}
+
+namespace detail {
+using sugar::detail::WireTag;
+using sugar::detail::WireValue;
+
+template <WireKind K> constexpr int wire_of = sugar::detail::wire_type_of(K);
+
+template <WireKind K>
+constexpr bool is_packable =
+    K != WireKind::kString && K != WireKind::kBytes && K != WireKind::kMessage;
+
+// Encoded size of one value of kind K, without its tag.
+template <WireKind K>
+[[nodiscard]] constexpr std::size_t
+value_size(typename WireValue<K>::type v) noexcept {
+  if constexpr (wire_of<K> == sugar::detail::kWireFixed32)
+    return 4;
+  else if constexpr (wire_of<K> == sugar::detail::kWireFixed64)
+    return 8;
+  else if constexpr (wire_of<K> == sugar::detail::kWireLen)
+    return sugar::detail::varint_size(v.size()) + v.size();
+  else
+    return sugar::detail::varint_size(sugar::detail::varint_of<K>(v));
+}
+
+template <int Number, WireKind K>
+constexpr std::size_t tag_size = WireTag<Number, wire_of<K>>::size;
+
+template <typename T> [[nodiscard]] bool is_default(const T &v) noexcept {
+  if constexpr (std::is_same_v<T, std::string>)
+    return v.empty();
+  else if constexpr (std::is_floating_point_v<T>)
+    return sugar::detail::is_default<
+        std::is_same_v<T, float> ? WireKind::kFloat : WireKind::kDouble>(v);
+  else
+    return v == T{};
+}
+
+template <WireKind K, typename T> void assign(const Token &t, T &out) {
+  if constexpr (K == WireKind::kString || K == WireKind::kBytes) {
+    out.assign(reinterpret_cast<const char *>(t.value),
+               static_cast<std::size_t>(t.end - t.value));
+  } else {
+    const std::byte *p = t.value;
+    out = sugar::detail::read_scalar<K>(p, t.end);
+  }
+}
+} // namespace detail
+
+// ---- Sizes -----------------------------------------------------------------
+
+// Singular field; zero and empty values count nothing unless the field has
+// explicit presence (or is the active member of a oneof).
+template <int Number, WireKind K, Presence P = Presence::kImplicit, typename T>
+[[nodiscard]] std::size_t size(const T &v) noexcept {
+  if constexpr (P == Presence::kImplicit)
+    if (detail::is_default(v))
+      return 0;
+  return detail::tag_size<Number, K> + detail::value_size<K>(v);
+}
+
+template <int Number, WireKind K, typename T>
+[[nodiscard]] std::size_t size(const std::optional<T> &v) noexcept {
+  return v ? size<Number, K, Presence::kExplicit>(*v) : 0;
+}
+
+template <int Number, WireKind K, bool Packed, typename T>
+[[nodiscard]] std::size_t size_repeated(const std::vector<T> &values) noexcept {
+  std::size_t n = 0;
+  if constexpr (Packed) {
+    if (values.empty())
+      return 0;
+    constexpr int wire = detail::wire_of<K>;
+    if constexpr (wire == sugar::detail::kWireFixed32 ||
+                  wire == sugar::detail::kWireFixed64)
+      n = values.size() * (wire == sugar::detail::kWireFixed32 ? 4 : 8);
+    else
+      for (const auto v : values)
+        n += detail::value_size<K>(v);
+    return detail::tag_size<Number, WireKind::kBytes> +
+           sugar::detail::varint_size(n) + n;
+  } else {
+    for (const auto &v : values)
+      n += detail::tag_size<Number, K> + detail::value_size<K>(v);
+    return n;
+  }
+}
+
+template <int Number, typename P>
+[[nodiscard]] std::size_t size_message(const P &m) {
+  const std::size_t n = m.byte_size();
+  return detail::tag_size<Number, WireKind::kMessage> +
+         sugar::detail::varint_size(n) + n;
+}
+
+template <int Number, typename P>
+[[nodiscard]] std::size_t size_message(const std::optional<P> &m) {
+  return m ? size_message<Number>(*m) : 0;
+}
+
+template <int Number, typename P>
+[[nodiscard]] std::size_t size_messages(const std::vector<P> &ms) {
+  std::size_t n = 0;
+  for (const P &m : ms)
+    n += size_message<Number>(m);
+  return n;
+}
+
+// One entry message per pair, key and value always written.
+template <int Number, WireKind Key, WireKind Value, typename M>
+[[nodiscard]] std::size_t size_map(const M &map) {
+  std::size_t n = 0;
+  for (const auto &[k, v] : map) {
+    std::size_t entry = size<1, Key, Presence::kExplicit>(k);
+    if constexpr (Value == WireKind::kMessage)
+      entry += size_message<2>(v);
+    else
+      entry += size<2, Value, Presence::kExplicit>(v);
+    n += detail::tag_size<Number, WireKind::kMessage> +
+         sugar::detail::varint_size(entry) + entry;
+  }
+  return n;
+}
+
+template <int Number, WireKind K, std::size_t I, typename V>
+[[nodiscard]] std::size_t size_oneof(const V &oneof) {
+  if (oneof.index() != I)
+    return 0;
+  if constexpr (K == WireKind::kMessage)
+    return size_message<Number>(std::get<I>(oneof));
+  else
+    return size<Number, K, Presence::kExplicit>(std::get<I>(oneof));
+}
+
+// ---- Writing ---------------------------------------------------------------
+
+template <int Number, WireKind K, Presence P = Presence::kImplicit, typename T>
+void write(WireWriter &out, const T &v) {
+  if constexpr (P == Presence::kImplicit)
+    if (detail::is_default(v))
+      return;
+  out.scalar<Number, K>(v);
+}
+
+template <int Number, WireKind K, typename T>
+void write(WireWriter &out, const std::optional<T> &v) {
+  if (v)
+    out.scalar<Number, K>(*v);
+}
+
+template <int Number, WireKind K, bool Packed, typename T>
+void write_repeated(WireWriter &out, const std::vector<T> &values) {
+  if constexpr (Packed)
+    out.packed<Number, K>(values);
+  else
+    for (const auto &v : values)
+      out.scalar<Number, K>(v);
+}
+
+template <int Number, typename P>
+void write_message(WireWriter &out, const P &m) {
+  const std::size_t body = out.open<Number>();
+  m.write(out);
+  out.close(body);
+}
+
+template <int Number, typename P>
+void write_message(WireWriter &out, const std::optional<P> &m) {
+  if (m)
+    write_message<Number>(out, *m);
+}
+
+template <int Number, typename P>
+void write_messages(WireWriter &out, const std::vector<P> &ms) {
+  for (const P &m : ms)
+    write_message<Number>(out, m);
+}
+
+template <int Number, WireKind Key, WireKind Value, typename M>
+void write_map(WireWriter &out, const M &map) {
+  for (const auto &[k, v] : map) {
+    const std::size_t body = out.open<Number>();
+    out.scalar<1, Key>(k);
+    if constexpr (Value == WireKind::kMessage)
+      write_message<2>(out, v);
+    else
+      out.scalar<2, Value>(v);
+    out.close(body);
+  }
+}
+
+template <int Number, WireKind K, std::size_t I, typename V>
+void write_oneof(WireWriter &out, const V &oneof) {
+  if (oneof.index() != I)
+    return;
+  if constexpr (K == WireKind::kMessage)
+    write_message<Number>(out, std::get<I>(oneof));
+  else
+    out.scalar<Number, K>(std::get<I>(oneof));
+}
+
+// ---- Reading ---------------------------------------------------------------
+//
+// Each reader ignores a token whose wire type does not match the field.
+
+template <WireKind K, typename T> void read(const Token &t, T &out) {
+  if (t.wire == detail::wire_of<K>)
+    detail::assign<K>(t, out);
+}
+
+template <WireKind K, typename T>
+void read(const Token &t, std::optional<T> &out) {
+  if (t.wire == detail::wire_of<K>)
+    detail::assign<K>(t, out.emplace());
+}
+
+template <WireKind K, typename T>
+void read_repeated(const Token &t, std::vector<T> &out) {
+  if constexpr (detail::is_packable<K>) {
+    if (t.wire == sugar::detail::kWireLen) {
+      constexpr int wire = detail::wire_of<K>;
+      if constexpr (wire != sugar::detail::kWireVarint)
+        out.reserve(out.size() + static_cast<std::size_t>(t.end - t.value) /
+                                     (wire == sugar::detail::kWireFixed32 ? 4
+                                                                          : 8));
+      for (const std::byte *p = t.value; p != t.end;)
+        out.push_back(sugar::detail::read_scalar<K>(p, t.end));
+      return;
+    }
+  }
+  if (t.wire == detail::wire_of<K>)
+    detail::assign<K>(t, out.emplace_back());
+}
+
+// Vector<bool> elements are proxies; read them by value.
+template <WireKind K> void read_repeated(const Token &t, std::vector<bool> &out) {
+  if (t.wire == sugar::detail::kWireLen) {
+    for (const std::byte *p = t.value; p != t.end;)
+      out.push_back(sugar::detail::read_scalar<K>(p, t.end));
+  } else if (t.wire == detail::wire_of<K>) {
+    const std::byte *p = t.value;
+    out.push_back(sugar::detail::read_scalar<K>(p, t.end));
+  }
+}
+
+template <typename P> void read_message(const Token &t, P &m) {
+  if (t.wire == sugar::detail::kWireLen)
+    m.merge_from(payload(t));
+}
+
+template <typename P> void read_message(const Token &t, std::optional<P> &m) {
+  if (t.wire != sugar::detail::kWireLen)
+    return;
+  if (!m)
+    m.emplace();
+  m->merge_from(payload(t));
+}
+
+template <typename P> void read_messages(const Token &t, std::vector<P> &ms) {
+  if (t.wire == sugar::detail::kWireLen)
+    ms.emplace_back().merge_from(payload(t));
+}
+
+// A later entry for the same key replaces the earlier one.
+template <WireKind Key, WireKind Value, typename M>
+void read_map(const Token &t, M &map) {
+  if (t.wire != sugar::detail::kWireLen)
+    return;
+  typename M::key_type k{};
+  typename M::mapped_type v{};
+  const std::byte *p = t.value;
+  Token e;
+  while (next(p, t.end, e)) {
+    if (e.number == 1)
+      read<Key>(e, k);
+    else if (e.number == 2) {
+      if constexpr (Value == WireKind::kMessage)
+        read_message(e, v);
+      else
+        read<Value>(e, v);
+    }
+  }
+  map.insert_or_assign(std::move(k), std::move(v));
+}
+
+// Sets alternative I; a submessage already active merges.
+template <WireKind K, std::size_t I, typename V>
+void read_oneof(const Token &t, V &oneof) {
+  if (t.wire != detail::wire_of<K>)
+    return;
+  if constexpr (K == WireKind::kMessage) {
+    if (oneof.index() != I)
+      oneof.template emplace<I>();
+    std::get<I>(oneof).merge_from(payload(t));
+  } else {
+    detail::assign<K>(t, oneof.template emplace<I>());
+  }
+}
+
+} // namespace sugar::plain
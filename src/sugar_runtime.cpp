@@ -0,0 +1,53 @@
+/*
+ * sugar_runtime.cpp
+ *
+ * Copyright 2025 M.Berkay Karatas
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Single definition of the instantiations sugar_runtime.h declares extern
+// under SUGAR_RUNTIME_EXTERN_TEMPLATES.
+
+#include "sugar_runtime.h"
+
+namespace sugar {
+
+namespace detail {
+template struct FieldWriter<int64_t>;
+template struct FieldWriter<uint64_t>;
+template struct FieldWriter<bool>;
+template struct FieldWriter<float>;
+template struct FieldWriter<double>;
+template struct FieldWriter<std::string>;
+} // namespace detail
+
+template class FieldProxy<int32_t>;
+template class FieldProxy<int64_t>;
+template class FieldProxy<uint32_t>;
+template class FieldProxy<uint64_t>;
+template class FieldProxy<bool>;
+template class FieldProxy<float>;
+template class FieldProxy<double>;
+template class FieldProxy<std::string>;
+
+template class RepeatedProxy<int32_t>;
+template class RepeatedProxy<int64_t>;
+template class RepeatedProxy<uint32_t>;
+template class RepeatedProxy<uint64_t>;
+template class RepeatedProxy<bool>;
+template class RepeatedProxy<float>;
+template class RepeatedProxy<double>;
+template class RepeatedProxy<std::string>;
+
+} // namespace sugar
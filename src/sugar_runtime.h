@@ -18,17 +18,30 @@
  * limitations under the License.
  */
 
+#include "sugar_core.h"
+#include "sugar_intern.h"
+
 #include <google/protobuf/descriptor.h>
 #include <google/protobuf/message.h>
 #include <google/protobuf/reflection.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <ostream>
+#include <shared_mutex>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <string_view>
 #include <type_traits>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 namespace sugar {
 
@@ -59,12 +72,15 @@ inline std::string to_string_any(const char (&arr)[N]) {
   return std::string(arr);
 }
 
+// FindFieldByName takes a std::string; the per-thread key buffer keeps
+// repeated lookups from allocating once it has grown to the longest name.
 [[nodiscard]] inline const google::protobuf::FieldDescriptor *
-find_field(const google::protobuf::Descriptor *d,
-           std::string_view name) noexcept {
+find_field(const google::protobuf::Descriptor *d, std::string_view name) {
   if (!d)
     return nullptr;
-  return d->FindFieldByName(std::string{name});
+  thread_local std::string key;
+  key.assign(name);
+  return d->FindFieldByName(key);
 }
 
 template <typename T>
@@ -78,6 +94,350 @@ inline constexpr bool is_unsigned_int_v =
 
 template <typename T>
 inline constexpr bool is_float_v = std::is_floating_point_v<std::decay_t<T>>;
+
+// Argument types the setters below distinguish. Values are normalised to
+// one of these before dispatch, so each switch is instantiated once per
+// category instead of once per (cv/ref-qualified) argument type, and the
+// common ones can be compiled once into the sugar_runtime library.
+struct unsupported_value {};
+
+template <typename V> struct canonical {
+  using D = std::decay_t<V>;
+  using type = std::conditional_t<
+      is_string_like_v<V>, std::string,
+      std::conditional_t<
+          std::is_same_v<D, bool>, bool,
+          std::conditional_t<
+              is_signed_int_v<V>, int64_t,
+              std::conditional_t<
+                  is_unsigned_int_v<V>, uint64_t,
+                  std::conditional_t<is_float_v<V> || std::is_enum_v<D>, D,
+                                     unsupported_value>>>>>;
+};
+
+template <typename V> using canonical_t = typename canonical<V>::type;
+
+template <typename V> canonical_t<V> canonicalize(V &&v) {
+  using C = canonical_t<V>;
+  if constexpr (std::is_same_v<C, std::string>) {
+    if constexpr (std::is_same_v<std::decay_t<V>, std::string>)
+      return std::forward<V>(v);
+    else
+      return std::string(std::string_view(v));
+  } else if constexpr (std::is_same_v<C, unsupported_value>) {
+    return {};
+  } else {
+    return static_cast<C>(v);
+  }
+}
+
+// Reflection-based setters behind FieldProxy, RepeatedProxy and MapProxy.
+template <typename V> struct FieldWriter {
+  static void assign(google::protobuf::Message &m,
+                     const google::protobuf::FieldDescriptor &f, V v);
+  static void add(google::protobuf::Message &m,
+                  const google::protobuf::FieldDescriptor &f, V v);
+  static void set_repeated(google::protobuf::Message &m,
+                           const google::protobuf::FieldDescriptor &f, int idx,
+                           V v);
+  static void set_map_field(google::protobuf::Message &m,
+                            const google::protobuf::FieldDescriptor &f, V v);
+};
+
+template <typename V>
+void FieldWriter<V>::assign(google::protobuf::Message &m,
+                            const google::protobuf::FieldDescriptor &f, V v) {
+  auto *r = m.GetReflection();
+  using FD = google::protobuf::FieldDescriptor;
+  if (f.is_repeated())
+    throw std::runtime_error("assignment on repeated field");
+  switch (f.cpp_type()) {
+  case FD::CPPTYPE_INT32:
+    if constexpr (is_signed_int_v<V>)
+      r->SetInt32(&m, &f, static_cast<int32_t>(v));
+    else
+      throw std::runtime_error("type mismatch: expected int32");
+    break;
+  case FD::CPPTYPE_INT64:
+    if constexpr (is_signed_int_v<V>)
+      r->SetInt64(&m, &f, static_cast<int64_t>(v));
+    else
+      throw std::runtime_error("type mismatch: expected int64");
+    break;
+  case FD::CPPTYPE_UINT32:
+    if constexpr (is_unsigned_int_v<V>)
+      r->SetUInt32(&m, &f, static_cast<uint32_t>(v));
+    else
+      throw std::runtime_error("type mismatch: expected uint32");
+    break;
+  case FD::CPPTYPE_UINT64:
+    if constexpr (is_unsigned_int_v<V>)
+      r->SetUInt64(&m, &f, static_cast<uint64_t>(v));
+    else
+      throw std::runtime_error("type mismatch: expected uint64");
+    break;
+  case FD::CPPTYPE_FLOAT:
+    if constexpr (is_float_v<V> || is_signed_int_v<V> || is_unsigned_int_v<V>)
+      r->SetFloat(&m, &f, static_cast<float>(v));
+    else
+      throw std::runtime_error("type mismatch: expected float-like");
+    break;
+  case FD::CPPTYPE_DOUBLE:
+    if constexpr (is_float_v<V> || is_signed_int_v<V> || is_unsigned_int_v<V>)
+      r->SetDouble(&m, &f, static_cast<double>(v));
+    else
+      throw std::runtime_error("type mismatch: expected double-like");
+    break;
+  case FD::CPPTYPE_BOOL:
+    if constexpr (std::is_same_v<std::decay_t<V>, bool> ||
+                  is_signed_int_v<V> || is_unsigned_int_v<V>)
+      r->SetBool(&m, &f, static_cast<bool>(v));
+    else
+      throw std::runtime_error("type mismatch: expected bool-like");
+    break;
+  case FD::CPPTYPE_STRING:
+    if constexpr (is_string_like_v<V>)
+      r->SetString(&m, &f, std::move(v));
+    else
+      throw std::runtime_error("type mismatch: expected string");
+    break;
+  case FD::CPPTYPE_ENUM:
+    if constexpr (is_signed_int_v<V> || is_unsigned_int_v<V> ||
+                  std::is_enum_v<std::decay_t<V>>) {
+      const int n = static_cast<int>(v);
+      const auto *ev = f.enum_type()->FindValueByNumber(n);
+      if (!ev)
+        throw std::runtime_error("invalid enum value");
+      r->SetEnum(&m, &f, ev);
+    } else {
+      throw std::runtime_error("type mismatch: expected enum or number");
+    }
+    break;
+  case FD::CPPTYPE_MESSAGE:
+    throw std::runtime_error("assign to message not allowed");
+  }
+}
+
+template <typename V>
+void FieldWriter<V>::add(google::protobuf::Message &m,
+                         const google::protobuf::FieldDescriptor &f, V v) {
+  auto *r = m.GetReflection();
+  using FD = google::protobuf::FieldDescriptor;
+  switch (f.cpp_type()) {
+  case FD::CPPTYPE_INT32:
+    if constexpr (is_signed_int_v<V>)
+      r->AddInt32(&m, &f, static_cast<int32_t>(v));
+    else
+      throw std::runtime_error("type mismatch: expected int32");
+    break;
+  case FD::CPPTYPE_INT64:
+    if constexpr (is_signed_int_v<V>)
+      r->AddInt64(&m, &f, static_cast<int64_t>(v));
+    else
+      throw std::runtime_error("type mismatch: expected int64");
+    break;
+  case FD::CPPTYPE_UINT32:
+    if constexpr (is_unsigned_int_v<V>)
+      r->AddUInt32(&m, &f, static_cast<uint32_t>(v));
+    else
+      throw std::runtime_error("type mismatch: expected uint32");
+    break;
+  case FD::CPPTYPE_UINT64:
+    if constexpr (is_unsigned_int_v<V>)
+      r->AddUInt64(&m, &f, static_cast<uint64_t>(v));
+    else
+      throw std::runtime_error("type mismatch: expected uint64");
+    break;
+  case FD::CPPTYPE_FLOAT:
+    if constexpr (is_float_v<V> || is_signed_int_v<V> || is_unsigned_int_v<V>)
+      r->AddFloat(&m, &f, static_cast<float>(v));
+    else
+      throw std::runtime_error("type mismatch: expected float-like");
+    break;
+  case FD::CPPTYPE_DOUBLE:
+    if constexpr (is_float_v<V> || is_signed_int_v<V> || is_unsigned_int_v<V>)
+      r->AddDouble(&m, &f, static_cast<double>(v));
+    else
+      throw std::runtime_error("type mismatch: expected double-like");
+    break;
+  case FD::CPPTYPE_BOOL:
+    if constexpr (std::is_same_v<std::decay_t<V>, bool> ||
+                  is_signed_int_v<V> || is_unsigned_int_v<V>)
+      r->AddBool(&m, &f, static_cast<bool>(v));
+    else
+      throw std::runtime_error("type mismatch: expected bool-like");
+    break;
+  case FD::CPPTYPE_STRING:
+    if constexpr (is_string_like_v<V>)
+      r->AddString(&m, &f, std::move(v));
+    else
+      throw std::runtime_error("type mismatch: expected string");
+    break;
+  case FD::CPPTYPE_ENUM:
+    if constexpr (is_signed_int_v<V> || is_unsigned_int_v<V>) {
+      const int n = static_cast<int>(v);
+      const auto *ev = f.enum_type()->FindValueByNumber(n);
+      if (!ev)
+        throw std::runtime_error("invalid enum value");
+      r->SetEnum(&m, &f, ev);
+    } else if constexpr (std::is_enum_v<std::decay_t<V>>) {
+      const int n = static_cast<int>(v);
+      const auto *ev = f.enum_type()->FindValueByNumber(n);
+      if (!ev)
+        throw std::runtime_error("invalid enum value");
+      r->SetEnum(&m, &f, ev);
+    } else {
+      throw std::runtime_error("type mismatch: expected enum or number");
+    }
+    break;
+  case FD::CPPTYPE_MESSAGE:
+    throw std::runtime_error("use add_message() for repeated message");
+  }
+}
+
+template <typename V>
+void FieldWriter<V>::set_repeated(google::protobuf::Message &m,
+                                  const google::protobuf::FieldDescriptor &f,
+                                  int idx, V v) {
+  auto *r = m.GetReflection();
+  using FD = google::protobuf::FieldDescriptor;
+  switch (f.cpp_type()) {
+  case FD::CPPTYPE_INT32:
+    if constexpr (is_signed_int_v<V>)
+      r->SetRepeatedInt32(&m, &f, idx, static_cast<int32_t>(v));
+    else
+      throw std::runtime_error("type mismatch: expected int32");
+    break;
+  case FD::CPPTYPE_INT64:
+    if constexpr (is_signed_int_v<V>)
+      r->SetRepeatedInt64(&m, &f, idx, static_cast<int64_t>(v));
+    else
+      throw std::runtime_error("type mismatch: expected int64");
+    break;
+  case FD::CPPTYPE_UINT32:
+    if constexpr (is_unsigned_int_v<V>)
+      r->SetRepeatedUInt32(&m, &f, idx, static_cast<uint32_t>(v));
+    else
+      throw std::runtime_error("type mismatch: expected uint32");
+    break;
+  case FD::CPPTYPE_UINT64:
+    if constexpr (is_unsigned_int_v<V>)
+      r->SetRepeatedUInt64(&m, &f, idx, static_cast<uint64_t>(v));
+    else
+      throw std::runtime_error("type mismatch: expected uint64");
+    break;
+  case FD::CPPTYPE_FLOAT:
+    if constexpr (is_float_v<V> || is_signed_int_v<V> || is_unsigned_int_v<V>)
+      r->SetRepeatedFloat(&m, &f, idx, static_cast<float>(v));
+    else
+      throw std::runtime_error("type mismatch: expected float-like");
+    break;
+  case FD::CPPTYPE_DOUBLE:
+    if constexpr (is_float_v<V> || is_signed_int_v<V> || is_unsigned_int_v<V>)
+      r->SetRepeatedDouble(&m, &f, idx, static_cast<double>(v));
+    else
+      throw std::runtime_error("type mismatch: expected double-like");
+    break;
+  case FD::CPPTYPE_BOOL:
+    if constexpr (std::is_same_v<std::decay_t<V>, bool> ||
+                  is_signed_int_v<V> || is_unsigned_int_v<V>)
+      r->SetRepeatedBool(&m, &f, idx, static_cast<bool>(v));
+    else
+      throw std::runtime_error("type mismatch: expected bool-like");
+    break;
+  case FD::CPPTYPE_STRING:
+    if constexpr (is_string_like_v<V>)
+      r->SetRepeatedString(&m, &f, idx,
+                           std::move(v));
+    else
+      throw std::runtime_error("type mismatch: expected string");
+    break;
+  case FD::CPPTYPE_ENUM:
+    if constexpr (is_signed_int_v<V> || is_unsigned_int_v<V>) {
+      const int n = static_cast<int>(v);
+      const auto *ev = f.enum_type()->FindValueByNumber(n);
+      if (!ev)
+        throw std::runtime_error("invalid enum value");
+      r->SetRepeatedEnum(&m, &f, idx, ev);
+    } else
+      throw std::runtime_error("type mismatch: expected enum number");
+    break;
+  case FD::CPPTYPE_MESSAGE:
+    throw std::runtime_error("set on repeated message element not supported; "
+                             "access submessage via operator[]");
+  }
+}
+
+template <typename V>
+void FieldWriter<V>::set_map_field(google::protobuf::Message &m,
+                                   const google::protobuf::FieldDescriptor &f,
+                                   V v) {
+  auto *r = m.GetReflection();
+  using FD = google::protobuf::FieldDescriptor;
+  switch (f.cpp_type()) {
+  case FD::CPPTYPE_INT32:
+    if constexpr (is_signed_int_v<V>)
+      r->SetInt32(&m, &f, static_cast<int32_t>(v));
+    else
+      throw std::runtime_error("type mismatch: expected int32");
+    break;
+  case FD::CPPTYPE_INT64:
+    if constexpr (is_signed_int_v<V>)
+      r->SetInt64(&m, &f, static_cast<int64_t>(v));
+    else
+      throw std::runtime_error("type mismatch: expected int64");
+    break;
+  case FD::CPPTYPE_UINT32:
+    if constexpr (is_unsigned_int_v<V>)
+      r->SetUInt32(&m, &f, static_cast<uint32_t>(v));
+    else
+      throw std::runtime_error("type mismatch: expected uint32");
+    break;
+  case FD::CPPTYPE_UINT64:
+    if constexpr (is_unsigned_int_v<V>)
+      r->SetUInt64(&m, &f, static_cast<uint64_t>(v));
+    else
+      throw std::runtime_error("type mismatch: expected uint64");
+    break;
+  case FD::CPPTYPE_FLOAT:
+    if constexpr (is_float_v<V> || is_signed_int_v<V> || is_unsigned_int_v<V>)
+      r->SetFloat(&m, &f, static_cast<float>(v));
+    else
+      throw std::runtime_error("type mismatch: expected float-like");
+    break;
+  case FD::CPPTYPE_DOUBLE:
+    if constexpr (is_float_v<V> || is_signed_int_v<V> || is_unsigned_int_v<V>)
+      r->SetDouble(&m, &f, static_cast<double>(v));
+    else
+      throw std::runtime_error("type mismatch: expected double-like");
+    break;
+  case FD::CPPTYPE_BOOL:
+    if constexpr (std::is_same_v<std::decay_t<V>, bool> ||
+                  is_signed_int_v<V> || is_unsigned_int_v<V>)
+      r->SetBool(&m, &f, static_cast<bool>(v));
+    else
+      throw std::runtime_error("type mismatch: expected bool-like");
+    break;
+  case FD::CPPTYPE_STRING:
+    if constexpr (is_string_like_v<V>)
+      r->SetString(&m, &f, std::move(v));
+    else
+      throw std::runtime_error("type mismatch: expected string");
+    break;
+  case FD::CPPTYPE_ENUM:
+    if constexpr (is_signed_int_v<V> || is_unsigned_int_v<V>) {
+      const int n = static_cast<int>(v);
+      const auto *ev = f.enum_type()->FindValueByNumber(n);
+      if (!ev)
+        throw std::runtime_error("invalid enum");
+      r->SetEnum(&m, &f, ev);
+    } else
+      throw std::runtime_error("type mismatch: expected enum number");
+    break;
+  case FD::CPPTYPE_MESSAGE:
+    throw std::runtime_error("map submessage not supported");
+  }
+}
 } // namespace detail
 
 template <typename MsgT> class MessageWrapped;
@@ -89,78 +449,8 @@ public:
       : msg_(m), field_(f) {}
 
   template <typename V> FieldProxy &operator=(V &&v) {
-    auto *r = msg_.GetReflection();
-    using FD = google::protobuf::FieldDescriptor;
-    if (field_.is_repeated())
-      throw std::runtime_error("assignment on repeated field");
-    switch (field_.cpp_type()) {
-    case FD::CPPTYPE_INT32:
-      if constexpr (detail::is_signed_int_v<V>)
-        r->SetInt32(&msg_, &field_, static_cast<int32_t>(v));
-      else
-        throw std::runtime_error("type mismatch: expected int32");
-      break;
-    case FD::CPPTYPE_INT64:
-      if constexpr (detail::is_signed_int_v<V>)
-        r->SetInt64(&msg_, &field_, static_cast<int64_t>(v));
-      else
-        throw std::runtime_error("type mismatch: expected int64");
-      break;
-    case FD::CPPTYPE_UINT32:
-      if constexpr (detail::is_unsigned_int_v<V>)
-        r->SetUInt32(&msg_, &field_, static_cast<uint32_t>(v));
-      else
-        throw std::runtime_error("type mismatch: expected uint32");
-      break;
-    case FD::CPPTYPE_UINT64:
-      if constexpr (detail::is_unsigned_int_v<V>)
-        r->SetUInt64(&msg_, &field_, static_cast<uint64_t>(v));
-      else
-        throw std::runtime_error("type mismatch: expected uint64");
-      break;
-    case FD::CPPTYPE_FLOAT:
-      if constexpr (detail::is_float_v<V> || detail::is_signed_int_v<V> ||
-                    detail::is_unsigned_int_v<V>)
-        r->SetFloat(&msg_, &field_, static_cast<float>(v));
-      else
-        throw std::runtime_error("type mismatch: expected float-like");
-      break;
-    case FD::CPPTYPE_DOUBLE:
-      if constexpr (detail::is_float_v<V> || detail::is_signed_int_v<V> ||
-                    detail::is_unsigned_int_v<V>)
-        r->SetDouble(&msg_, &field_, static_cast<double>(v));
-      else
-        throw std::runtime_error("type mismatch: expected double-like");
-      break;
-    case FD::CPPTYPE_BOOL:
-      if constexpr (std::is_same_v<std::decay_t<V>, bool> ||
-                    detail::is_signed_int_v<V> || detail::is_unsigned_int_v<V>)
-        r->SetBool(&msg_, &field_, static_cast<bool>(v));
-      else
-        throw std::runtime_error("type mismatch: expected bool-like");
-      break;
-    case FD::CPPTYPE_STRING:
-      if constexpr (detail::is_string_like_v<V>)
-        r->SetString(&msg_, &field_, detail::to_string_any(std::forward<V>(v)));
-      else
-        throw std::runtime_error("type mismatch: expected string");
-      break;
-    case FD::CPPTYPE_ENUM:
-      if constexpr (detail::is_signed_int_v<V> ||
-                    detail::is_unsigned_int_v<V> ||
-                    std::is_enum_v<std::decay_t<V>>) {
-        const int n = static_cast<int>(v);
-        const auto *ev = field_.enum_type()->FindValueByNumber(n);
-        if (!ev)
-          throw std::runtime_error("invalid enum value");
-        r->SetEnum(&msg_, &field_, ev);
-      } else {
-        throw std::runtime_error("type mismatch: expected enum or number");
-      }
-      break;
-    case FD::CPPTYPE_MESSAGE:
-      throw std::runtime_error("assign to message not allowed");
-    }
+    detail::FieldWriter<detail::canonical_t<V>>::assign(
+        msg_, field_, detail::canonicalize(std::forward<V>(v)));
     return *this;
   }
 
@@ -227,6 +517,9 @@ std::ostream &operator<<(std::ostream &os, const FieldProxy<T> &fp) {
 }
 
 template <typename ElemT> class RepeatedProxy {
+  static constexpr bool kMessages =
+      std::is_class_v<ElemT> && !std::is_same_v<ElemT, std::string>;
+
 public:
   RepeatedProxy(google::protobuf::Message &m,
                 const google::protobuf::FieldDescriptor &f)
@@ -254,81 +547,8 @@ public:
   }
 
   template <typename V> void push_back(V &&v) {
-    auto *r = msg_.GetReflection();
-    using FD = google::protobuf::FieldDescriptor;
-    switch (field_.cpp_type()) {
-    case FD::CPPTYPE_INT32:
-      if constexpr (detail::is_signed_int_v<V>)
-        r->AddInt32(&msg_, &field_, static_cast<int32_t>(v));
-      else
-        throw std::runtime_error("type mismatch: expected int32");
-      break;
-    case FD::CPPTYPE_INT64:
-      if constexpr (detail::is_signed_int_v<V>)
-        r->AddInt64(&msg_, &field_, static_cast<int64_t>(v));
-      else
-        throw std::runtime_error("type mismatch: expected int64");
-      break;
-    case FD::CPPTYPE_UINT32:
-      if constexpr (detail::is_unsigned_int_v<V>)
-        r->AddUInt32(&msg_, &field_, static_cast<uint32_t>(v));
-      else
-        throw std::runtime_error("type mismatch: expected uint32");
-      break;
-    case FD::CPPTYPE_UINT64:
-      if constexpr (detail::is_unsigned_int_v<V>)
-        r->AddUInt64(&msg_, &field_, static_cast<uint64_t>(v));
-      else
-        throw std::runtime_error("type mismatch: expected uint64");
-      break;
-    case FD::CPPTYPE_FLOAT:
-      if constexpr (detail::is_float_v<V> || detail::is_signed_int_v<V> ||
-                    detail::is_unsigned_int_v<V>)
-        r->AddFloat(&msg_, &field_, static_cast<float>(v));
-      else
-        throw std::runtime_error("type mismatch: expected float-like");
-      break;
-    case FD::CPPTYPE_DOUBLE:
-      if constexpr (detail::is_float_v<V> || detail::is_signed_int_v<V> ||
-                    detail::is_unsigned_int_v<V>)
-        r->AddDouble(&msg_, &field_, static_cast<double>(v));
-      else
-        throw std::runtime_error("type mismatch: expected double-like");
-      break;
-    case FD::CPPTYPE_BOOL:
-      if constexpr (std::is_same_v<std::decay_t<V>, bool> ||
-                    detail::is_signed_int_v<V> || detail::is_unsigned_int_v<V>)
-        r->AddBool(&msg_, &field_, static_cast<bool>(v));
-      else
-        throw std::runtime_error("type mismatch: expected bool-like");
-      break;
-    case FD::CPPTYPE_STRING:
-      if constexpr (detail::is_string_like_v<V>)
-        r->AddString(&msg_, &field_, detail::to_string_any(std::forward<V>(v)));
-      else
-        throw std::runtime_error("type mismatch: expected string");
-      break;
-    case FD::CPPTYPE_ENUM:
-      if constexpr (detail::is_signed_int_v<V> ||
-                    detail::is_unsigned_int_v<V>) {
-        const int n = static_cast<int>(v);
-        const auto *ev = field_.enum_type()->FindValueByNumber(n);
-        if (!ev)
-          throw std::runtime_error("invalid enum value");
-        r->SetEnum(&msg_, &field_, ev);
-      } else if constexpr (std::is_enum_v<std::decay_t<V>>) {
-        const int n = static_cast<int>(v);
-        const auto *ev = field_.enum_type()->FindValueByNumber(n);
-        if (!ev)
-          throw std::runtime_error("invalid enum value");
-        r->SetEnum(&msg_, &field_, ev);
-      } else {
-        throw std::runtime_error("type mismatch: expected enum or number");
-      }
-      break;
-    case FD::CPPTYPE_MESSAGE:
-      throw std::runtime_error("use add_message() for repeated message");
-    }
+    detail::FieldWriter<detail::canonical_t<V>>::add(
+        msg_, field_, detail::canonicalize(std::forward<V>(v)));
   }
 
   [[nodiscard]] google::protobuf::Message &add_message() {
@@ -338,152 +558,447 @@ public:
   }
 
   template <typename V> void set(int idx, V &&v) {
-    auto *r = msg_.GetReflection();
-    using FD = google::protobuf::FieldDescriptor;
-    switch (field_.cpp_type()) {
-    case FD::CPPTYPE_INT32:
-      if constexpr (detail::is_signed_int_v<V>)
-        r->SetRepeatedInt32(&msg_, &field_, idx, static_cast<int32_t>(v));
-      else
-        throw std::runtime_error("type mismatch: expected int32");
-      break;
-    case FD::CPPTYPE_INT64:
-      if constexpr (detail::is_signed_int_v<V>)
-        r->SetRepeatedInt64(&msg_, &field_, idx, static_cast<int64_t>(v));
-      else
-        throw std::runtime_error("type mismatch: expected int64");
-      break;
-    case FD::CPPTYPE_UINT32:
-      if constexpr (detail::is_unsigned_int_v<V>)
-        r->SetRepeatedUInt32(&msg_, &field_, idx, static_cast<uint32_t>(v));
-      else
-        throw std::runtime_error("type mismatch: expected uint32");
-      break;
-    case FD::CPPTYPE_UINT64:
-      if constexpr (detail::is_unsigned_int_v<V>)
-        r->SetRepeatedUInt64(&msg_, &field_, idx, static_cast<uint64_t>(v));
-      else
-        throw std::runtime_error("type mismatch: expected uint64");
-      break;
-    case FD::CPPTYPE_FLOAT:
-      if constexpr (detail::is_float_v<V> || detail::is_signed_int_v<V> ||
-                    detail::is_unsigned_int_v<V>)
-        r->SetRepeatedFloat(&msg_, &field_, idx, static_cast<float>(v));
-      else
-        throw std::runtime_error("type mismatch: expected float-like");
-      break;
-    case FD::CPPTYPE_DOUBLE:
-      if constexpr (detail::is_float_v<V> || detail::is_signed_int_v<V> ||
-                    detail::is_unsigned_int_v<V>)
-        r->SetRepeatedDouble(&msg_, &field_, idx, static_cast<double>(v));
-      else
-        throw std::runtime_error("type mismatch: expected double-like");
-      break;
-    case FD::CPPTYPE_BOOL:
-      if constexpr (std::is_same_v<std::decay_t<V>, bool> ||
-                    detail::is_signed_int_v<V> || detail::is_unsigned_int_v<V>)
-        r->SetRepeatedBool(&msg_, &field_, idx, static_cast<bool>(v));
-      else
-        throw std::runtime_error("type mismatch: expected bool-like");
-      break;
-    case FD::CPPTYPE_STRING:
-      if constexpr (detail::is_string_like_v<V>)
-        r->SetRepeatedString(&msg_, &field_, idx,
-                             detail::to_string_any(std::forward<V>(v)));
-      else
-        throw std::runtime_error("type mismatch: expected string");
-      break;
-    case FD::CPPTYPE_ENUM:
-      if constexpr (detail::is_signed_int_v<V> ||
-                    detail::is_unsigned_int_v<V>) {
-        const int n = static_cast<int>(v);
-        const auto *ev = field_.enum_type()->FindValueByNumber(n);
-        if (!ev)
-          throw std::runtime_error("invalid enum value");
-        r->SetRepeatedEnum(&msg_, &field_, idx, ev);
-      } else
-        throw std::runtime_error("type mismatch: expected enum number");
-      break;
-    case FD::CPPTYPE_MESSAGE:
-      throw std::runtime_error("set on repeated message element not supported; "
-                               "access submessage via operator[]");
-    }
+    detail::FieldWriter<detail::canonical_t<V>>::set_repeated(
+        msg_, field_, idx, detail::canonicalize(std::forward<V>(v)));
   }
 
   ElemT at(int idx) const { return (*this)[idx]; }
 
   ElemT operator[](int idx) const {
-    auto *r = msg_.GetReflection();
-    using FD = google::protobuf::FieldDescriptor;
-    if (idx < 0 || idx >= r->FieldSize(msg_, &field_))
+    if (idx < 0 || idx >= size())
       throw std::out_of_range("repeated index out of range");
-
-    if constexpr (std::is_same_v<ElemT, std::string>) {
-      return r->GetRepeatedString(msg_, &field_, idx);
-    } else if constexpr (std::is_same_v<ElemT, bool>) {
-      return r->GetRepeatedBool(msg_, &field_, idx);
-    } else if constexpr (detail::is_signed_int_v<ElemT>) {
-      if (field_.cpp_type() == FD::CPPTYPE_INT32)
-        return static_cast<ElemT>(r->GetRepeatedInt32(msg_, &field_, idx));
-      if (field_.cpp_type() == FD::CPPTYPE_INT64)
-        return static_cast<ElemT>(r->GetRepeatedInt64(msg_, &field_, idx));
-      if (field_.cpp_type() == FD::CPPTYPE_ENUM)
-        return static_cast<ElemT>(
-            r->GetRepeatedEnum(msg_, &field_, idx)->number());
-      throw std::runtime_error("type mismatch for signed integer ElemT");
-    } else if constexpr (detail::is_unsigned_int_v<ElemT>) {
-      if (field_.cpp_type() == FD::CPPTYPE_UINT32)
-        return static_cast<ElemT>(r->GetRepeatedUInt32(msg_, &field_, idx));
-      if (field_.cpp_type() == FD::CPPTYPE_UINT64)
-        return static_cast<ElemT>(r->GetRepeatedUInt64(msg_, &field_, idx));
-      throw std::runtime_error("type mismatch for unsigned integer ElemT");
-    } else if constexpr (detail::is_float_v<ElemT>) {
-      if (field_.cpp_type() == FD::CPPTYPE_FLOAT)
-        return static_cast<ElemT>(r->GetRepeatedFloat(msg_, &field_, idx));
-      if (field_.cpp_type() == FD::CPPTYPE_DOUBLE)
-        return static_cast<ElemT>(r->GetRepeatedDouble(msg_, &field_, idx));
-      throw std::runtime_error("type mismatch for float ElemT");
-    } else if constexpr (std::is_constructible_v<ElemT,
-                                                 google::protobuf::Message &>) {
-      auto *sub = r->MutableRepeatedMessage(&msg_, &field_, idx);
-      return ElemT(*sub);
-    } else if constexpr (std::is_class_v<ElemT>) {
-      auto *sub = r->MutableRepeatedMessage(&msg_, &field_, idx);
-      return ElemT(*sub);
-    } else {
-      static_assert(sizeof(ElemT) == 0, "unsupported ElemT for repeated field");
-    }
+    return element(msg_, field_, idx);
   }
 
   ElemT front() const { return (*this)[0]; }
   ElemT back() const { return (*this)[size() - 1]; }
 
+  // Handle to one scalar or string element, returned by iterators: reads
+  // convert to ElemT, assignments write the value through, and swap()
+  // exchanges elements in place with SwapElements. This is what lets
+  // std::sort, std::nth_element and std::lower_bound run on the field.
+  class element_ref {
+  public:
+    element_ref(google::protobuf::Message *msg,
+                const google::protobuf::FieldDescriptor *field, int i) noexcept
+        : msg_(msg), field_(field), index_(i) {}
+
+    [[nodiscard]] ElemT get() const { return element(*msg_, *field_, index_); }
+    operator ElemT() const { return get(); }
+
+    // The string element in place, without copying it.
+    [[nodiscard]] std::string_view view() const
+      requires std::is_same_v<ElemT, std::string>
+    {
+      return msg_->GetReflection()->GetRepeatedStringReference(
+          *msg_, field_, index_, nullptr);
+    }
+
+    element_ref &operator=(const ElemT &v)
+      requires(!kMessages)
+    {
+      detail::FieldWriter<detail::canonical_t<ElemT>>::set_repeated(
+          *msg_, *field_, index_, detail::canonicalize(v));
+      return *this;
+    }
+
+    // Copies the value, not the handle, as the std algorithms expect.
+    element_ref &operator=(const element_ref &o)
+      requires(!kMessages)
+    {
+      return *this = o.get();
+    }
+
+    friend void swap(element_ref a, element_ref b) {
+      a.msg_->GetReflection()->SwapElements(a.msg_, a.field_, a.index_,
+                                            b.index_);
+    }
+
+    friend bool operator==(const element_ref &a, const element_ref &b) {
+      if constexpr (std::is_same_v<ElemT, std::string>)
+        return a.view() == b.view();
+      else
+        return a.get() == b.get();
+    }
+    friend auto operator<=>(const element_ref &a, const element_ref &b) {
+      if constexpr (std::is_same_v<ElemT, std::string>)
+        return a.view() <=> b.view();
+      else
+        return a.get() <=> b.get();
+    }
+
+    // std::string's operators are templates and ignore the conversion.
+    friend bool operator==(const element_ref &a, std::string_view b)
+      requires std::is_same_v<ElemT, std::string>
+    {
+      return a.view() == b;
+    }
+    friend auto operator<=>(const element_ref &a, std::string_view b)
+      requires std::is_same_v<ElemT, std::string>
+    {
+      return a.view() <=> b;
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const element_ref &r) {
+      return os << r.get();
+    }
+
+  private:
+    google::protobuf::Message *msg_;
+    const google::protobuf::FieldDescriptor *field_;
+    int index_;
+  };
+
+  // Random access. Message fields yield ElemT wrappers, which cannot be
+  // assigned by value; reorder them with sort(key) or iter_swap.
   class iterator {
   public:
-    using iterator_category = std::forward_iterator_tag;
+    using iterator_category = std::random_access_iterator_tag;
     using value_type = ElemT;
     using difference_type = int;
     using pointer = void;
-    using reference = ElemT;
+    using reference = std::conditional_t<kMessages, ElemT, element_ref>;
+
+    iterator() = default;
+
+    // Holds the message and field rather than the proxy, so iterators stay
+    // valid after the (often temporary) proxy that produced them is gone.
+    iterator(google::protobuf::Message *msg,
+             const google::protobuf::FieldDescriptor *field, int i)
+        : msg_(msg), field_(field), index_(i) {}
+
+    reference operator*() const {
+      if constexpr (kMessages)
+        return element(*msg_, *field_, index_);
+      else
+        return element_ref(msg_, field_, index_);
+    }
+    reference operator[](difference_type n) const { return *(*this + n); }
+
+    [[nodiscard]] int index() const noexcept { return index_; }
 
-    iterator(const RepeatedProxy *owner, int i) : owner_(owner), index_(i) {}
-    reference operator*() const { return (*owner_)[index_]; }
     iterator &operator++() {
       ++index_;
       return *this;
     }
+    iterator operator++(int) {
+      iterator old = *this;
+      ++index_;
+      return old;
+    }
+    iterator &operator--() {
+      --index_;
+      return *this;
+    }
+    iterator operator--(int) {
+      iterator old = *this;
+      --index_;
+      return old;
+    }
+    iterator &operator+=(difference_type n) {
+      index_ += n;
+      return *this;
+    }
+    iterator &operator-=(difference_type n) {
+      index_ -= n;
+      return *this;
+    }
+    friend iterator operator+(iterator it, difference_type n) {
+      return it += n;
+    }
+    friend iterator operator+(difference_type n, iterator it) {
+      return it += n;
+    }
+    friend iterator operator-(iterator it, difference_type n) {
+      return it -= n;
+    }
+    friend difference_type operator-(const iterator &a, const iterator &b) {
+      return a.index_ - b.index_;
+    }
+
     bool operator==(const iterator &o) const { return index_ == o.index_; }
     bool operator!=(const iterator &o) const { return !(*this == o); }
+    auto operator<=>(const iterator &o) const { return index_ <=> o.index_; }
+
+    friend void iter_swap(iterator a, iterator b) {
+      a.msg_->GetReflection()->SwapElements(a.msg_, a.field_, a.index_,
+                                            b.index_);
+    }
 
   private:
-    const RepeatedProxy *owner_;
-    int index_;
+    google::protobuf::Message *msg_ = nullptr;
+    const google::protobuf::FieldDescriptor *field_ = nullptr;
+    int index_ = 0;
   };
 
-  iterator begin() const { return iterator(this, 0); }
-  iterator end() const { return iterator(this, size()); }
+  iterator begin() const { return iterator(&msg_, &field_, 0); }
+  iterator end() const { return iterator(&msg_, &field_, size()); }
+
+  // Stable sort by key(element), in place. Keys are computed once per
+  // element and elements only move through SwapElements, so submessages
+  // are never copied.
+  template <typename Key = std::identity, typename Compare = std::ranges::less>
+  void sort(Key key = {}, Compare comp = {}) {
+    using K = std::remove_cvref_t<std::invoke_result_t<Key &, ElemT>>;
+    const int n = size();
+    std::vector<K> keys;
+    keys.reserve(n);
+    for (int i = 0; i < n; ++i)
+      keys.push_back(std::invoke(key, element(msg_, field_, i)));
+    std::vector<int> order(n);
+    for (int i = 0; i < n; ++i)
+      order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+      return std::invoke(comp, keys[a], keys[b]);
+    });
+
+    // at[p] is the original index of the element now at p; pos inverts it.
+    std::vector<int> at(n), pos(n);
+    for (int i = 0; i < n; ++i)
+      at[i] = pos[i] = i;
+    auto *r = msg_.GetReflection();
+    for (int i = 0; i < n; ++i) {
+      const int want = order[i];
+      const int from = pos[want];
+      if (from == i)
+        continue;
+      r->SwapElements(&msg_, &field_, i, from);
+      pos[at[i]] = from;
+      at[from] = at[i];
+      at[i] = want;
+      pos[want] = i;
+    }
+  }
+
+  // Removes [first, last), keeping the order of the remaining elements.
+  void erase(int first, int last) {
+    const int n = size();
+    if (first < 0 || first > last || last > n)
+      throw std::out_of_range("repeated erase range out of range");
+    auto *r = msg_.GetReflection();
+    for (int i = last; i < n; ++i)
+      r->SwapElements(&msg_, &field_, i - (last - first), i);
+    truncate(n - (last - first));
+  }
+
+  void erase(int idx) {
+    if (idx < 0 || idx >= size())
+      throw std::out_of_range("repeated index out of range");
+    erase(idx, idx + 1);
+  }
+
+  void erase(iterator first, iterator last) {
+    erase(first.index(), last.index());
+  }
+  void erase(iterator pos) { erase(pos.index()); }
+
+  // Drops the elements matching pred in one compacting pass followed by
+  // RemoveLast, keeping the order of the rest. Returns how many went.
+  template <typename Pred> int remove_if(Pred pred) {
+    const int n = size();
+    auto *r = msg_.GetReflection();
+    int kept = 0;
+    for (int i = 0; i < n; ++i) {
+      if (std::invoke(pred, element(msg_, field_, i)))
+        continue;
+      if (kept != i)
+        r->SwapElements(&msg_, &field_, kept, i);
+      ++kept;
+    }
+    truncate(kept);
+    return n - kept;
+  }
+
+  // Keeps the first n elements.
+  void truncate(int n) {
+    if (n < 0)
+      throw std::out_of_range("repeated truncate to negative size");
+    auto *r = msg_.GetReflection();
+    for (int i = size(); i > n; --i)
+      r->RemoveLast(&msg_, &field_);
+  }
+
+  // The field's RepeatedField, for bulk writes such as
+  // sugar::decode_varints. Enum fields are stored as int32.
+  [[nodiscard]] google::protobuf::RepeatedField<ElemT> &storage() const
+    requires std::is_arithmetic_v<ElemT>
+  {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+    return *msg_.GetReflection()->template MutableRepeatedField<ElemT>(
+        &msg_, &field_);
+#pragma GCC diagnostic pop
+  }
+
+  // ---- Interning (string fields) ------------------------------------------
+  //
+  // Elements are read in place; only strings new to the pool are copied.
+
+  // Appends the code of each element, in order, to out.
+  void intern(StringPool &pool, std::vector<StringPool::Code> &out) const
+    requires std::is_same_v<ElemT, std::string>
+  {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+    pool.intern_all(
+        msg_.GetReflection()->template GetRepeatedPtrField<std::string>(
+            msg_, &field_),
+        out);
+#pragma GCC diagnostic pop
+  }
+
+  [[nodiscard]] std::vector<StringPool::Code> intern(StringPool &pool) const
+    requires std::is_same_v<ElemT, std::string>
+  {
+    std::vector<StringPool::Code> out;
+    intern(pool, out);
+    return out;
+  }
+
+  // Replaces the elements with pool[c] for each code, reusing the buffers
+  // of the strings already there.
+  void assign(const StringPool &pool, std::span<const StringPool::Code> codes)
+    requires std::is_same_v<ElemT, std::string>
+  {
+    for (const StringPool::Code c : codes)
+      if (c >= pool.size())
+        throw std::out_of_range("assign: code not in pool");
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+    auto &f = *msg_.GetReflection()->template MutableRepeatedPtrField<
+        std::string>(&msg_, &field_);
+#pragma GCC diagnostic pop
+    const int n = static_cast<int>(codes.size());
+    for (int i = 0; i < n; ++i) {
+      const std::string_view s = pool[codes[i]];
+      (i < f.size() ? *f.Mutable(i) : *f.Add()).assign(s.data(), s.size());
+    }
+    if (f.size() > n)
+      f.DeleteSubrange(n, f.size() - n);
+  }
+
+  // ---- Ownership transfer (message fields) --------------------------------
+  //
+  // Elements move as pointers when both messages live on the same arena or
+  // both on the heap, and heap elements are adopted by an arena parent.
+  // Only elements leaving an arena are copied.
+
+  // Removes element idx, keeping the order of the rest, and hands it to the
+  // caller. An arena-owned element comes back as a heap copy.
+  [[nodiscard]] std::unique_ptr<google::protobuf::Message> release(int idx)
+    requires kMessages
+  {
+    const int n = size();
+    if (idx < 0 || idx >= n)
+      throw std::out_of_range("repeated index out of range");
+    auto *r = msg_.GetReflection();
+    for (int i = idx + 1; i < n; ++i)
+      r->SwapElements(&msg_, &field_, i - 1, i);
+    return std::unique_ptr<google::protobuf::Message>(
+        r->ReleaseLast(&msg_, &field_));
+  }
+
+  // Appends a heap-allocated element without copying it; a parent on an
+  // arena adopts it with Arena::Own.
+  ElemT add_allocated(std::unique_ptr<google::protobuf::Message> m)
+    requires kMessages
+  {
+    if (!m || m->GetDescriptor() != field_.message_type())
+      throw std::runtime_error("add_allocated: message type mismatch");
+    auto *r = msg_.GetReflection();
+    r->AddAllocatedMessage(&msg_, &field_, m.release());
+    return element(msg_, field_, size() - 1);
+  }
+
+  // Moves other's elements [first, last) to the end of this field, keeping
+  // their order and the order of the elements left behind.
+  void take_from(const RepeatedProxy &other, int first, int last)
+    requires kMessages
+  {
+    if (other.field_.message_type() != field_.message_type())
+      throw std::runtime_error("take_from: message type mismatch");
+    if (&other.msg_ == &msg_ && &other.field_ == &field_)
+      throw std::runtime_error("take_from: source is this field");
+    auto &src = other.msg_;
+    const auto *src_field = &other.field_;
+    const int n = other.size();
+    if (first < 0 || first > last || last > n)
+      throw std::out_of_range("repeated take_from range out of range");
+
+    // Reversing the tail and then everything from `first` leaves the range
+    // reversed at the end, so popping it appends in the original order.
+    auto *sr = src.GetReflection();
+    auto reverse = [&](int i, int j) {
+      for (--j; i < j; ++i, --j)
+        sr->SwapElements(&src, src_field, i, j);
+    };
+    reverse(last, n);
+    reverse(first, n);
+
+    auto *r = msg_.GetReflection();
+    const bool same_arena = src.GetArena() == msg_.GetArena();
+    for (int i = first; i < last; ++i) {
+      if (same_arena) {
+        r->UnsafeArenaAddAllocatedMessage(
+            &msg_, &field_, sr->UnsafeArenaReleaseLast(&src, src_field));
+      } else if (src.GetArena()) {
+        // Arena elements cannot leave their arena: copy once, straight
+        // into an element allocated where this message lives.
+        r->AddMessage(&msg_, &field_)
+            ->CopyFrom(sr->GetRepeatedMessage(src, src_field,
+                                              sr->FieldSize(src, src_field) -
+                                                  1));
+        sr->RemoveLast(&src, src_field);
+      } else {
+        r->AddAllocatedMessage(&msg_, &field_,
+                               sr->ReleaseLast(&src, src_field));
+      }
+    }
+  }
+
+  void take_from(const RepeatedProxy &other)
+    requires kMessages
+  {
+    take_from(other, 0, other.size());
+  }
 
 private:
+  // Unchecked read of element idx.
+  static ElemT element(google::protobuf::Message &m,
+                       const google::protobuf::FieldDescriptor &f, int idx) {
+    auto *r = m.GetReflection();
+    using FD = google::protobuf::FieldDescriptor;
+    if constexpr (std::is_same_v<ElemT, std::string>) {
+      return r->GetRepeatedString(m, &f, idx);
+    } else if constexpr (std::is_same_v<ElemT, bool>) {
+      return r->GetRepeatedBool(m, &f, idx);
+    } else if constexpr (detail::is_signed_int_v<ElemT>) {
+      if (f.cpp_type() == FD::CPPTYPE_INT32)
+        return static_cast<ElemT>(r->GetRepeatedInt32(m, &f, idx));
+      if (f.cpp_type() == FD::CPPTYPE_INT64)
+        return static_cast<ElemT>(r->GetRepeatedInt64(m, &f, idx));
+      if (f.cpp_type() == FD::CPPTYPE_ENUM)
+        return static_cast<ElemT>(r->GetRepeatedEnum(m, &f, idx)->number());
+      throw std::runtime_error("type mismatch for signed integer ElemT");
+    } else if constexpr (detail::is_unsigned_int_v<ElemT>) {
+      if (f.cpp_type() == FD::CPPTYPE_UINT32)
+        return static_cast<ElemT>(r->GetRepeatedUInt32(m, &f, idx));
+      if (f.cpp_type() == FD::CPPTYPE_UINT64)
+        return static_cast<ElemT>(r->GetRepeatedUInt64(m, &f, idx));
+      throw std::runtime_error("type mismatch for unsigned integer ElemT");
+    } else if constexpr (detail::is_float_v<ElemT>) {
+      if (f.cpp_type() == FD::CPPTYPE_FLOAT)
+        return static_cast<ElemT>(r->GetRepeatedFloat(m, &f, idx));
+      if (f.cpp_type() == FD::CPPTYPE_DOUBLE)
+        return static_cast<ElemT>(r->GetRepeatedDouble(m, &f, idx));
+      throw std::runtime_error("type mismatch for float ElemT");
+    } else if constexpr (std::is_class_v<ElemT>) {
+      return ElemT(*r->MutableRepeatedMessage(&m, &f, idx));
+    } else {
+      static_assert(sizeof(ElemT) == 0, "unsupported ElemT for repeated field");
+    }
+  }
+
   google::protobuf::Message &msg_;
   const google::protobuf::FieldDescriptor &field_;
 };
@@ -497,6 +1012,25 @@ public:
       throw std::runtime_error("MapProxy on non-map field");
   }
 
+  [[nodiscard]] int size() const noexcept {
+    return msg_.GetReflection()->FieldSize(msg_, &field_);
+  }
+
+  // Append the code of each entry's key or value to out. Both walk the
+  // entries in the same (unspecified) order, so the i-th key and value
+  // codes of one call each belong to one entry.
+  void intern_keys(StringPool &pool, std::vector<StringPool::Code> &out) const
+    requires std::is_same_v<K, std::string>
+  {
+    intern_part(pool, out, *field_.message_type()->map_key());
+  }
+  void intern_values(StringPool &pool,
+                     std::vector<StringPool::Code> &out) const
+    requires std::is_same_v<V, std::string>
+  {
+    intern_part(pool, out, *field_.message_type()->map_value());
+  }
+
   template <typename KeyLike, typename ValLike>
   void set(KeyLike &&k, ValLike &&v) {
     auto *r = msg_.GetReflection();
@@ -510,77 +1044,23 @@ public:
   }
 
 private:
+  void intern_part(StringPool &pool, std::vector<StringPool::Code> &out,
+                   const google::protobuf::FieldDescriptor &part) const {
+    auto *r = msg_.GetReflection();
+    const int n = r->FieldSize(msg_, &field_);
+    std::string scratch;
+    for (int i = 0; i < n; ++i) {
+      const auto &entry = r->GetRepeatedMessage(msg_, &field_, i);
+      out.push_back(pool.intern(
+          entry.GetReflection()->GetStringReference(entry, &part, &scratch)));
+    }
+  }
+
   template <typename X>
   static void set_field(google::protobuf::Message &m,
                         const google::protobuf::FieldDescriptor &f, X &&value) {
-    auto *r = m.GetReflection();
-    using FD = google::protobuf::FieldDescriptor;
-    switch (f.cpp_type()) {
-    case FD::CPPTYPE_INT32:
-      if constexpr (detail::is_signed_int_v<X>)
-        r->SetInt32(&m, &f, static_cast<int32_t>(value));
-      else
-        throw std::runtime_error("type mismatch: expected int32");
-      break;
-    case FD::CPPTYPE_INT64:
-      if constexpr (detail::is_signed_int_v<X>)
-        r->SetInt64(&m, &f, static_cast<int64_t>(value));
-      else
-        throw std::runtime_error("type mismatch: expected int64");
-      break;
-    case FD::CPPTYPE_UINT32:
-      if constexpr (detail::is_unsigned_int_v<X>)
-        r->SetUInt32(&m, &f, static_cast<uint32_t>(value));
-      else
-        throw std::runtime_error("type mismatch: expected uint32");
-      break;
-    case FD::CPPTYPE_UINT64:
-      if constexpr (detail::is_unsigned_int_v<X>)
-        r->SetUInt64(&m, &f, static_cast<uint64_t>(value));
-      else
-        throw std::runtime_error("type mismatch: expected uint64");
-      break;
-    case FD::CPPTYPE_FLOAT:
-      if constexpr (detail::is_float_v<X> || detail::is_signed_int_v<X> ||
-                    detail::is_unsigned_int_v<X>)
-        r->SetFloat(&m, &f, static_cast<float>(value));
-      else
-        throw std::runtime_error("type mismatch: expected float-like");
-      break;
-    case FD::CPPTYPE_DOUBLE:
-      if constexpr (detail::is_float_v<X> || detail::is_signed_int_v<X> ||
-                    detail::is_unsigned_int_v<X>)
-        r->SetDouble(&m, &f, static_cast<double>(value));
-      else
-        throw std::runtime_error("type mismatch: expected double-like");
-      break;
-    case FD::CPPTYPE_BOOL:
-      if constexpr (std::is_same_v<std::decay_t<X>, bool> ||
-                    detail::is_signed_int_v<X> || detail::is_unsigned_int_v<X>)
-        r->SetBool(&m, &f, static_cast<bool>(value));
-      else
-        throw std::runtime_error("type mismatch: expected bool-like");
-      break;
-    case FD::CPPTYPE_STRING:
-      if constexpr (detail::is_string_like_v<X>)
-        r->SetString(&m, &f, detail::to_string_any(std::forward<X>(value)));
-      else
-        throw std::runtime_error("type mismatch: expected string");
-      break;
-    case FD::CPPTYPE_ENUM:
-      if constexpr (detail::is_signed_int_v<X> ||
-                    detail::is_unsigned_int_v<X>) {
-        const int n = static_cast<int>(value);
-        const auto *ev = f.enum_type()->FindValueByNumber(n);
-        if (!ev)
-          throw std::runtime_error("invalid enum");
-        r->SetEnum(&m, &f, ev);
-      } else
-        throw std::runtime_error("type mismatch: expected enum number");
-      break;
-    case FD::CPPTYPE_MESSAGE:
-      throw std::runtime_error("map submessage not supported");
-    }
+    detail::FieldWriter<detail::canonical_t<X>>::set_map_field(
+        m, f, detail::canonicalize(std::forward<X>(value)));
   }
 
   google::protobuf::Message &msg_;
@@ -613,4 +1093,630 @@ private:
   const google::protobuf::OneofDescriptor &oneof_;
 };
 
+// ---- Compact wrappers ------------------------------------------------------
+//
+// A generated XWrapped is a single pointer: `_msg` shares an anonymous union
+// with one empty tag per field, so every tag sits at the wrapper's address
+// and recovers the message from `this` through its Access policy. Proxies
+// are built on access and descriptors are looked up once per field.
+//
+// Tags can only be copied as part of the wrapper that holds them (a lone
+// copy would point at nothing), so `auto x = w.id;` does not compile; use
+// `w.id.get()` or `w.id.proxy()` instead.
+
+template <typename Access, int Index, typename T> class FieldTag;
+
+namespace detail {
+template <typename V> inline constexpr bool is_field_tag_v = false;
+
+template <typename Access, int Index, typename T>
+inline constexpr bool is_field_tag_v<FieldTag<Access, Index, T>> = true;
+
+template <typename Msg, int Index>
+[[nodiscard]] const google::protobuf::FieldDescriptor &field_at() {
+  static const google::protobuf::FieldDescriptor *const f =
+      Msg::descriptor()->field(Index);
+  return *f;
+}
+
+template <typename Msg, int Index>
+[[nodiscard]] const google::protobuf::OneofDescriptor &oneof_at() {
+  static const google::protobuf::OneofDescriptor *const o =
+      Msg::descriptor()->oneof_decl(Index);
+  return *o;
+}
+} // namespace detail
+
+template <typename Access, int Index, typename T> class FieldTag {
+public:
+  [[nodiscard]] FieldProxy<T> proxy() const noexcept {
+    return FieldProxy<T>(
+        Access::message(this),
+        detail::field_at<typename Access::message_type, Index>());
+  }
+
+  [[nodiscard]] T get() const { return static_cast<T>(reader()); }
+
+  // Another tag (e.g. the same field of a second wrapper) assigns its
+  // value, like copying one struct member into another.
+  template <typename V> FieldTag &operator=(V &&v) {
+    if constexpr (detail::is_field_tag_v<std::remove_cvref_t<V>>)
+      proxy() = v.get();
+    else
+      proxy() = std::forward<V>(v);
+    return *this;
+  }
+
+  // Only here to suppress the implicit copy assignment, which would copy
+  // nothing and make the wrappers non-trivially copyable; the const volatile
+  // parameter leaves tag arguments to the template above.
+  FieldTag &operator=(const volatile FieldTag &) = delete;
+
+  [[nodiscard]] operator T() const { return get(); }
+
+  operator std::string_view() const
+    requires std::is_same_v<T, std::string>
+  {
+    return reader();
+  }
+
+private:
+  // Proxy for reads, over the default instance when the field sits in an
+  // unset submessage; only proxy() creates it.
+  [[nodiscard]] FieldProxy<T> reader() const noexcept {
+    return FieldProxy<T>(
+        const_cast<typename Access::message_type &>(Access::read(this)),
+        detail::field_at<typename Access::message_type, Index>());
+  }
+
+  FieldTag(const FieldTag &) = default;
+  friend typename Access::owner;
+};
+
+template <typename Access, int Index, typename T>
+std::ostream &operator<<(std::ostream &os,
+                         const FieldTag<Access, Index, T> &t) {
+  if constexpr (std::is_same_v<T, std::string>)
+    return os << static_cast<std::string_view>(t);
+  else
+    return os << t.get();
+}
+
+template <typename Access, int Index, typename ElemT> class RepeatedTag {
+public:
+  using iterator = typename RepeatedProxy<ElemT>::iterator;
+
+  [[nodiscard]] RepeatedProxy<ElemT> proxy() const {
+    return RepeatedProxy<ElemT>(
+        Access::message(this),
+        detail::field_at<typename Access::message_type, Index>());
+  }
+
+  [[nodiscard]] int size() const { return reader().size(); }
+  [[nodiscard]] bool empty() const { return reader().empty(); }
+
+  template <typename V> void push_back(V &&v) {
+    proxy().push_back(std::forward<V>(v));
+  }
+
+  [[nodiscard]] google::protobuf::Message &add_message() {
+    return proxy().add_message();
+  }
+
+  template <typename V> void set(int idx, V &&v) {
+    proxy().set(idx, std::forward<V>(v));
+  }
+
+  ElemT at(int idx) const { return reader()[idx]; }
+  ElemT operator[](int idx) const { return reader()[idx]; }
+  ElemT front() const { return reader().front(); }
+  ElemT back() const { return reader().back(); }
+
+  // Over an unset submessage these iterate its (empty) default instance.
+  iterator begin() const { return reader().begin(); }
+  iterator end() const { return reader().end(); }
+
+  template <typename Key = std::identity, typename Compare = std::ranges::less>
+  void sort(Key key = {}, Compare comp = {}) {
+    proxy().sort(std::move(key), std::move(comp));
+  }
+
+  void erase(int idx) { proxy().erase(idx); }
+  void erase(int first, int last) { proxy().erase(first, last); }
+  void erase(iterator pos) { proxy().erase(pos); }
+  void erase(iterator first, iterator last) { proxy().erase(first, last); }
+
+  template <typename Pred> int remove_if(Pred pred) {
+    return proxy().remove_if(std::move(pred));
+  }
+
+  void truncate(int n) { proxy().truncate(n); }
+
+  [[nodiscard]] google::protobuf::RepeatedField<ElemT> &storage() const
+    requires std::is_arithmetic_v<ElemT>
+  {
+    return proxy().storage();
+  }
+
+  [[nodiscard]] std::unique_ptr<google::protobuf::Message> release(int idx) {
+    return proxy().release(idx);
+  }
+
+  ElemT add_allocated(std::unique_ptr<google::protobuf::Message> m) {
+    return proxy().add_allocated(std::move(m));
+  }
+
+  void intern(StringPool &pool, std::vector<StringPool::Code> &out) const {
+    reader().intern(pool, out);
+  }
+  [[nodiscard]] std::vector<StringPool::Code> intern(StringPool &pool) const {
+    return reader().intern(pool);
+  }
+  void assign(const StringPool &pool,
+              std::span<const StringPool::Code> codes) {
+    proxy().assign(pool, codes);
+  }
+
+  // `other` is another RepeatedTag or a RepeatedProxy of the same type.
+  template <typename Other> void take_from(const Other &other) {
+    proxy().take_from(as_proxy(other));
+  }
+  template <typename Other>
+  void take_from(const Other &other, int first, int last) {
+    proxy().take_from(as_proxy(other), first, last);
+  }
+
+  RepeatedTag &operator=(const RepeatedTag &) = delete;
+
+private:
+  [[nodiscard]] RepeatedProxy<ElemT> reader() const {
+    return RepeatedProxy<ElemT>(
+        const_cast<typename Access::message_type &>(Access::read(this)),
+        detail::field_at<typename Access::message_type, Index>());
+  }
+
+  static const RepeatedProxy<ElemT> &
+  as_proxy(const RepeatedProxy<ElemT> &p) noexcept {
+    return p;
+  }
+  template <typename Other>
+  static RepeatedProxy<ElemT> as_proxy(const Other &tag) {
+    return tag.proxy();
+  }
+
+  RepeatedTag(const RepeatedTag &) = default;
+  friend typename Access::owner;
+};
+
+template <typename Access, int Index, typename K, typename V> class MapTag {
+public:
+  [[nodiscard]] MapProxy<K, V> proxy() const {
+    return MapProxy<K, V>(
+        Access::message(this),
+        detail::field_at<typename Access::message_type, Index>());
+  }
+
+  template <typename KeyLike, typename ValLike>
+  void set(KeyLike &&k, ValLike &&v) {
+    proxy().set(std::forward<KeyLike>(k), std::forward<ValLike>(v));
+  }
+
+  void intern_keys(StringPool &pool, std::vector<StringPool::Code> &out) const {
+    reader().intern_keys(pool, out);
+  }
+  void intern_values(StringPool &pool,
+                     std::vector<StringPool::Code> &out) const {
+    reader().intern_values(pool, out);
+  }
+
+  MapTag &operator=(const MapTag &) = delete;
+
+private:
+  [[nodiscard]] MapProxy<K, V> reader() const {
+    return MapProxy<K, V>(
+        const_cast<typename Access::message_type &>(Access::read(this)),
+        detail::field_at<typename Access::message_type, Index>());
+  }
+
+  MapTag(const MapTag &) = default;
+  friend typename Access::owner;
+};
+
+template <typename Access, int Index> class OneofTag {
+public:
+  [[nodiscard]] OneofProxy proxy() const noexcept {
+    return OneofProxy(
+        Access::message(this),
+        detail::oneof_at<typename Access::message_type, Index>());
+  }
+
+  [[nodiscard]] const google::protobuf::FieldDescriptor *
+  active_field() const {
+    return OneofProxy(
+               const_cast<typename Access::message_type &>(Access::read(this)),
+               detail::oneof_at<typename Access::message_type, Index>())
+        .active_field();
+  }
+
+  void clear() { proxy().clear(); }
+
+  template <typename F> void set(std::string_view field_name, F &&setter) {
+    proxy().set(field_name, std::forward<F>(setter));
+  }
+
+  OneofTag &operator=(const OneofTag &) = delete;
+
+private:
+  OneofTag(const OneofTag &) = default;
+  friend typename Access::owner;
+};
+
+// ---- Dynamic messages ------------------------------------------------------
+//
+// Types loaded at runtime (a FileDescriptorSet behind DynamicMessage) have
+// no generated XWrapped. DynamicWrapped gives them the same proxy syntax,
+// `w["profile"]["city"] = "Berlin"`, on top of a MessagePlan built once per
+// Descriptor: names are hashed against the plan instead of going through
+// FindFieldByName, and each access then costs what a generated tag's does.
+
+class MessagePlan {
+public:
+  struct Slot {
+    const google::protobuf::FieldDescriptor *field = nullptr;
+    std::string_view name;
+    google::protobuf::FieldDescriptor::CppType cpp_type{};
+    bool repeated = false;
+    bool map = false;
+
+    // Plan of a message field's type, resolved on first use so recursive
+    // types do not build each other up front.
+    [[nodiscard]] const MessagePlan &nested() const {
+      const MessagePlan *p = nested_.load(std::memory_order_acquire);
+      if (!p) {
+        p = &MessagePlan::of(field->message_type());
+        nested_.store(p, std::memory_order_release);
+      }
+      return *p;
+    }
+
+  private:
+    mutable std::atomic<const MessagePlan *> nested_{nullptr};
+  };
+
+  // The shared plan for d, built on first request. Safe to call from any
+  // thread; later calls for the same type take a shared lock, or no lock
+  // at all when the calling thread asked for the same type last.
+  [[nodiscard]] static const MessagePlan &
+  of(const google::protobuf::Descriptor *d) {
+    thread_local const MessagePlan *last = nullptr;
+    thread_local uint64_t last_generation = 0;
+    auto &c = cache();
+    const uint64_t generation = c.generation.load(std::memory_order_acquire);
+    if (last && last_generation == generation && last->descriptor_ == d)
+      return *last;
+    {
+      std::shared_lock lock(c.mu);
+      if (auto it = c.plans.find(d); it != c.plans.end()) {
+        last_generation = generation;
+        return *(last = it->second.get());
+      }
+    }
+    std::unique_lock lock(c.mu);
+    auto &plan = c.plans[d];
+    if (!plan)
+      plan.reset(new MessagePlan(d));
+    last_generation = generation;
+    return *(last = plan.get());
+  }
+
+  // Drops every cached plan. Call after destroying a DescriptorPool whose
+  // types were wrapped (its Descriptor addresses may be reused), and only
+  // while no DynamicWrapped over the old types is alive.
+  static void clear_cache() {
+    auto &c = cache();
+    std::unique_lock lock(c.mu);
+    c.plans.clear();
+    c.generation.fetch_add(1, std::memory_order_acq_rel);
+  }
+
+  [[nodiscard]] const google::protobuf::Descriptor *
+  descriptor() const noexcept {
+    return descriptor_;
+  }
+
+  // Slots in declaration order (slot i is descriptor()->field(i)).
+  [[nodiscard]] std::span<const Slot> slots() const noexcept {
+    return {slots_.get(), count_};
+  }
+
+  [[nodiscard]] const Slot *find(std::string_view name) const noexcept {
+    const uint64_t h = name_mix(name_hash(name));
+    const auto tag = static_cast<uint32_t>(h >> 32);
+    const std::size_t mask = index_.size() - 1;
+    for (std::size_t i = h & mask;; i = (i + 1) & mask) {
+      const IndexEntry &e = index_[i];
+      if (e.slot < 0)
+        return nullptr;
+      if (e.tag == tag && slots_[e.slot].name == name)
+        return &slots_[e.slot];
+    }
+  }
+
+  [[nodiscard]] const Slot &slot(std::string_view name) const {
+    const Slot *s = find(name);
+    if (!s)
+      throw std::runtime_error("field not found");
+    return *s;
+  }
+
+private:
+  explicit MessagePlan(const google::protobuf::Descriptor *d)
+      : descriptor_(d), count_(static_cast<std::size_t>(d->field_count())),
+        slots_(new Slot[count_]) {
+    // Open addressing at a load factor of at most 1/2; each entry keeps the
+    // high hash bits so most mismatches skip the string compare.
+    std::size_t size = 2;
+    while (size < 2 * count_)
+      size *= 2;
+    index_.assign(size, IndexEntry{});
+    for (std::size_t i = 0; i < count_; ++i) {
+      const auto *f = d->field(static_cast<int>(i));
+      slots_[i].field = f;
+      slots_[i].name = f->name();
+      slots_[i].cpp_type = f->cpp_type();
+      slots_[i].repeated = f->is_repeated();
+      slots_[i].map = f->is_map();
+      const uint64_t h = name_mix(name_hash(f->name()));
+      std::size_t b = h & (size - 1);
+      while (index_[b].slot >= 0)
+        b = (b + 1) & (size - 1);
+      index_[b] = IndexEntry{static_cast<uint32_t>(h >> 32),
+                             static_cast<int32_t>(i)};
+    }
+  }
+
+  struct IndexEntry {
+    uint32_t tag = 0;
+    int32_t slot = -1;
+  };
+
+  struct Cache {
+    std::shared_mutex mu;
+    std::unordered_map<const google::protobuf::Descriptor *,
+                       std::unique_ptr<MessagePlan>>
+        plans;
+    std::atomic<uint64_t> generation{1};
+  };
+
+  static Cache &cache() {
+    static Cache c;
+    return c;
+  }
+
+  const google::protobuf::Descriptor *descriptor_;
+  std::size_t count_;
+  std::unique_ptr<Slot[]> slots_;
+  std::vector<IndexEntry> index_;
+};
+
+class DynamicWrapped;
+
+// One field of a dynamic message; the counterpart of a generated tag.
+class DynamicField {
+public:
+  DynamicField(google::protobuf::Message &m,
+               const MessagePlan::Slot &s) noexcept
+      : msg_(m), slot_(s) {}
+  DynamicField(const DynamicField &) = default;
+
+  template <typename V>
+    requires(!std::is_same_v<std::remove_cvref_t<V>, DynamicField>)
+  DynamicField &operator=(V &&v) {
+    detail::FieldWriter<detail::canonical_t<V>>::assign(
+        msg_, *slot_.field, detail::canonicalize(std::forward<V>(v)));
+    return *this;
+  }
+
+  // Copies the value of another field, like assigning one tag to another.
+  DynamicField &operator=(const DynamicField &o) {
+    using FD = google::protobuf::FieldDescriptor;
+    switch (o.slot_.cpp_type) {
+    case FD::CPPTYPE_INT32:
+    case FD::CPPTYPE_ENUM:
+      return *this = o.get<int32_t>();
+    case FD::CPPTYPE_INT64:
+      return *this = o.get<int64_t>();
+    case FD::CPPTYPE_UINT32:
+      return *this = o.get<uint32_t>();
+    case FD::CPPTYPE_UINT64:
+      return *this = o.get<uint64_t>();
+    case FD::CPPTYPE_FLOAT:
+      return *this = o.get<float>();
+    case FD::CPPTYPE_DOUBLE:
+      return *this = o.get<double>();
+    case FD::CPPTYPE_BOOL:
+      return *this = o.get<bool>();
+    case FD::CPPTYPE_STRING:
+      return *this = o.get<std::string>();
+    case FD::CPPTYPE_MESSAGE:
+      if (slot_.cpp_type != FD::CPPTYPE_MESSAGE || slot_.repeated ||
+          o.slot_.repeated ||
+          slot_.field->message_type() != o.slot_.field->message_type())
+        throw std::runtime_error("type mismatch");
+      msg_.GetReflection()->MutableMessage(&msg_, slot_.field)->CopyFrom(
+          o.msg_.GetReflection()->GetMessage(o.msg_, o.slot_.field));
+      return *this;
+    }
+    return *this;
+  }
+
+  template <typename T> [[nodiscard]] T get() const {
+    return static_cast<T>(FieldProxy<T>(msg_, *slot_.field));
+  }
+
+  template <typename T>
+    requires std::is_arithmetic_v<T>
+  [[nodiscard]] operator T() const {
+    return get<T>();
+  }
+
+  operator std::string_view() const {
+    return FieldProxy<std::string>(msg_, *slot_.field);
+  }
+
+  // Fields of a singular message field; the submessage is created on write.
+  [[nodiscard]] DynamicField operator[](std::string_view name) const {
+    return (*this)[nested_plan().slot(name)];
+  }
+  [[nodiscard]] DynamicField operator[](const MessagePlan::Slot &s) const {
+    return DynamicField(mutable_message(), s);
+  }
+
+  [[nodiscard]] DynamicWrapped message() const;
+
+  template <typename ElemT>
+  [[nodiscard]] RepeatedProxy<ElemT> repeated() const {
+    return RepeatedProxy<ElemT>(msg_, *slot_.field);
+  }
+
+  template <typename K, typename V> [[nodiscard]] MapProxy<K, V> map() const {
+    return MapProxy<K, V>(msg_, *slot_.field);
+  }
+
+  [[nodiscard]] const google::protobuf::FieldDescriptor &
+  descriptor() const noexcept {
+    return *slot_.field;
+  }
+
+  friend std::ostream &operator<<(std::ostream &os, const DynamicField &f) {
+    using FD = google::protobuf::FieldDescriptor;
+    switch (f.slot_.cpp_type) {
+    case FD::CPPTYPE_INT32:
+    case FD::CPPTYPE_ENUM:
+      return os << f.get<int32_t>();
+    case FD::CPPTYPE_INT64:
+      return os << f.get<int64_t>();
+    case FD::CPPTYPE_UINT32:
+      return os << f.get<uint32_t>();
+    case FD::CPPTYPE_UINT64:
+      return os << f.get<uint64_t>();
+    case FD::CPPTYPE_FLOAT:
+      return os << f.get<float>();
+    case FD::CPPTYPE_DOUBLE:
+      return os << f.get<double>();
+    case FD::CPPTYPE_BOOL:
+      return os << f.get<bool>();
+    case FD::CPPTYPE_STRING:
+      return os << static_cast<std::string_view>(f);
+    case FD::CPPTYPE_MESSAGE:
+      if (f.slot_.repeated)
+        throw std::runtime_error("read on repeated field");
+      return os << f.msg_.GetReflection()
+                       ->GetMessage(f.msg_, f.slot_.field)
+                       .ShortDebugString();
+    }
+    return os;
+  }
+
+private:
+  const MessagePlan &nested_plan() const {
+    if (slot_.cpp_type !=
+            google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE ||
+        slot_.repeated)
+      throw std::runtime_error("not a singular message field");
+    return slot_.nested();
+  }
+
+  google::protobuf::Message &mutable_message() const {
+    nested_plan();
+    return *msg_.GetReflection()->MutableMessage(&msg_, slot_.field);
+  }
+
+  google::protobuf::Message &msg_;
+  const MessagePlan::Slot &slot_;
+};
+
+// Wrapper over any Message, typically a DynamicMessage, resolved through
+// its MessagePlan. Cheap to copy. In hot loops pass the plan in (the
+// Message& constructor pays for GetDescriptor()) and keep Slots from
+// plan().slot("id") to skip the name lookups.
+class DynamicWrapped {
+public:
+  explicit DynamicWrapped(google::protobuf::Message &m)
+      : msg_(&m), plan_(&MessagePlan::of(m.GetDescriptor())) {}
+  DynamicWrapped(google::protobuf::Message &m, const MessagePlan &plan) noexcept
+      : msg_(&m), plan_(&plan) {}
+
+  [[nodiscard]] DynamicField operator[](std::string_view name) const {
+    return DynamicField(*msg_, plan_->slot(name));
+  }
+  [[nodiscard]] DynamicField operator[](const MessagePlan::Slot &s) const {
+    return DynamicField(*msg_, s);
+  }
+
+  template <typename ElemT>
+  [[nodiscard]] RepeatedProxy<ElemT> repeated(std::string_view name) const {
+    return (*this)[name].template repeated<ElemT>();
+  }
+
+  template <typename K, typename V>
+  [[nodiscard]] MapProxy<K, V> map(std::string_view name) const {
+    return (*this)[name].template map<K, V>();
+  }
+
+  [[nodiscard]] OneofProxy oneof(std::string_view name) const {
+    const auto *d = plan_->descriptor();
+    for (int i = 0; i < d->oneof_decl_count(); ++i)
+      if (d->oneof_decl(i)->name() == name)
+        return OneofProxy(*msg_, *d->oneof_decl(i));
+    throw std::runtime_error("oneof not found");
+  }
+
+  [[nodiscard]] google::protobuf::Message &message() const noexcept {
+    return *msg_;
+  }
+  [[nodiscard]] const MessagePlan &plan() const noexcept { return *plan_; }
+
+private:
+  google::protobuf::Message *msg_;
+  const MessagePlan *plan_;
+};
+
+inline DynamicWrapped DynamicField::message() const {
+  return DynamicWrapped(mutable_message(), slot_.nested());
+}
+
+// Builds linking the compiled sugar_runtime library (which defines
+// SUGAR_RUNTIME_EXTERN_TEMPLATES) reuse its copies of the common proxy and
+// setter instantiations instead of emitting them in every TU; header-only
+// users keep instantiating them implicitly.
+#ifdef SUGAR_RUNTIME_EXTERN_TEMPLATES
+namespace detail {
+extern template struct FieldWriter<int64_t>;
+extern template struct FieldWriter<uint64_t>;
+extern template struct FieldWriter<bool>;
+extern template struct FieldWriter<float>;
+extern template struct FieldWriter<double>;
+extern template struct FieldWriter<std::string>;
+} // namespace detail
+
+extern template class FieldProxy<int32_t>;
+extern template class FieldProxy<int64_t>;
+extern template class FieldProxy<uint32_t>;
+extern template class FieldProxy<uint64_t>;
+extern template class FieldProxy<bool>;
+extern template class FieldProxy<float>;
+extern template class FieldProxy<double>;
+extern template class FieldProxy<std::string>;
+
+extern template class RepeatedProxy<int32_t>;
+extern template class RepeatedProxy<int64_t>;
+extern template class RepeatedProxy<uint32_t>;
+extern template class RepeatedProxy<uint64_t>;
+extern template class RepeatedProxy<bool>;
+extern template class RepeatedProxy<float>;
+extern template class RepeatedProxy<double>;
+extern template class RepeatedProxy<std::string>;
+#endif
+
 } // namespace sugar
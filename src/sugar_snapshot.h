@@ -0,0 +1,192 @@
+#pragma once
+
+/*
+ * sugar_snapshot.h
+ *
+ * Copyright 2025 M.Berkay Karatas
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Read-copy-update holder for messages that many threads read and one
+// occasionally replaces (configs, routing tables).
+//
+// The published message lives in an atomic shared_ptr tagged with a version
+// number. Each thread caches the shared_ptrs it last read, keyed by
+// version, so a read is one acquire load of the version and a lookup in a
+// thread-local array: no lock and no reference-count traffic on a shared
+// cache line. Only the first read after a publish touches the shared_ptr.
+//
+// A thread keeps its last snapshot alive until it reads again or exits, so
+// old messages are freed lazily by idle readers.
+
+#include "sugar_core.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <utility>
+
+namespace sugar {
+
+namespace detail {
+// Versions are unique across all Snapshots, so a cached entry can never be
+// mistaken for another (or a destroyed) holder's message.
+inline std::atomic<uint64_t> snapshot_versions{0};
+
+[[nodiscard]] inline uint64_t next_snapshot_version() noexcept {
+  return snapshot_versions.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+struct SnapshotCacheEntry {
+  uint64_t version = 0;
+  std::shared_ptr<const void> message;
+  unsigned pins = 0; // live Readers on this thread
+};
+
+struct SnapshotCache {
+  std::array<SnapshotCacheEntry, 4> entries;
+  std::size_t next = 0; // round-robin victim
+};
+
+inline thread_local SnapshotCache snapshot_cache;
+} // namespace detail
+
+// Wrapped is a generated XWrapped; the snapshot holds its message type.
+template <typename Wrapped> class Snapshot {
+public:
+  using message_type = typename Wrapped::Access::message_type;
+
+  // Read-only view of one published message, stable for the Reader's
+  // lifetime even if a writer publishes meanwhile. Readers belong to the
+  // thread that created them; use share() to hand the message elsewhere.
+  class Reader {
+  public:
+    Reader(const Reader &) = delete;
+    Reader &operator=(const Reader &) = delete;
+
+    ~Reader() {
+      if (entry_)
+        --entry_->pins;
+    }
+
+    [[nodiscard]] const message_type &operator*() const noexcept {
+      return *msg_;
+    }
+    [[nodiscard]] const message_type *operator->() const noexcept {
+      return msg_;
+    }
+
+    // Generated accessors without a mutable wrapper, which would create
+    // missing submessages on read.
+    [[nodiscard]] FieldValue get_by_name(std::string_view path) const {
+      return Wrapped::kByName.get(*msg_, path);
+    }
+    [[nodiscard]] std::size_t hash_value() const noexcept {
+      return Wrapped::hash_of(*msg_);
+    }
+
+    // Keeps the message alive beyond this Reader.
+    [[nodiscard]] std::shared_ptr<const message_type> share() const {
+      if (!entry_)
+        return owned_;
+      return std::shared_ptr<const message_type>(entry_->message, msg_);
+    }
+
+  private:
+    friend class Snapshot;
+
+    Reader(const message_type *m, detail::SnapshotCacheEntry *e) noexcept
+        : msg_(m), entry_(e) {}
+    explicit Reader(std::shared_ptr<const message_type> owned) noexcept
+        : msg_(owned.get()), owned_(std::move(owned)) {}
+
+    const message_type *msg_;
+    detail::SnapshotCacheEntry *entry_ = nullptr;
+    std::shared_ptr<const message_type> owned_;
+  };
+
+  Snapshot() : Snapshot(message_type()) {}
+  explicit Snapshot(message_type initial) {
+    publish(std::make_shared<const message_type>(std::move(initial)));
+  }
+
+  Snapshot(const Snapshot &) = delete;
+  Snapshot &operator=(const Snapshot &) = delete;
+
+  [[nodiscard]] Reader read() const {
+    const uint64_t v = version_.load(std::memory_order_acquire);
+    auto &cache = detail::snapshot_cache;
+    for (auto &e : cache.entries)
+      if (e.version == v)
+        return pin(e);
+
+    for (std::size_t k = 0; k < cache.entries.size(); ++k) {
+      auto &e = cache.entries[cache.next];
+      cache.next = (cache.next + 1) % cache.entries.size();
+      if (e.pins)
+        continue;
+      // May already be newer than v; the next read then just refreshes.
+      e.message = current_.load(std::memory_order_acquire);
+      e.version = v;
+      return pin(e);
+    }
+    // Every entry is pinned by outer Readers on this thread.
+    return Reader(current_.load(std::memory_order_acquire));
+  }
+
+  // The current message, counted; for holding on to it past a Reader.
+  [[nodiscard]] std::shared_ptr<const message_type> load() const {
+    return current_.load(std::memory_order_acquire);
+  }
+
+  // Copies the current message, lets fn edit the copy through a Wrapped
+  // and publishes the result. Writers are serialized among themselves;
+  // readers keep the previous message until the publish.
+  template <typename Fn> void update(Fn &&fn) {
+    std::lock_guard lock(write_mu_);
+    auto next = std::make_shared<message_type>(
+        *current_.load(std::memory_order_relaxed));
+    std::forward<Fn>(fn)(Wrapped(*next));
+    publish(std::move(next));
+  }
+
+  // Publishes m as a whole.
+  void store(message_type m) {
+    std::lock_guard lock(write_mu_);
+    publish(std::make_shared<const message_type>(std::move(m)));
+  }
+
+private:
+  Reader pin(detail::SnapshotCacheEntry &e) const noexcept {
+    ++e.pins;
+    return Reader(static_cast<const message_type *>(e.message.get()), &e);
+  }
+
+  // The message is stored before the version, so a reader that sees the
+  // new version also sees (at least) the new message.
+  void publish(std::shared_ptr<const message_type> next) {
+    current_.store(std::move(next), std::memory_order_release);
+    version_.store(detail::next_snapshot_version(), std::memory_order_release);
+  }
+
+  std::atomic<std::shared_ptr<const message_type>> current_;
+  std::atomic<uint64_t> version_{0};
+  std::mutex write_mu_;
+};
+
+} // namespace sugar
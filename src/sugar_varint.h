@@ -0,0 +1,525 @@
+#pragma once
+
+/*
+ * sugar_varint.h
+ *
+ * Copyright 2025 M.Berkay Karatas
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Bulk varint coding for the payload of a packed repeated int32, int64,
+// uint32, uint64 or enum field:
+//
+//   std::vector<int32_t> v(sugar::count_varints(payload));
+//   sugar::decode_varints(payload, std::span(v));
+//   sugar::decode_varints(payload, u.numbers);       // appends to the field
+//   std::size_t n = sugar::encode_varints(std::span(v), out);
+//
+// On x86-64 CPUs with SSSE3 the decoder reads 16 bytes at a time in the
+// manner of Masked VByte: the continuation bits of the first 12 bytes
+// select a precomputed shuffle that gathers six 1-2 byte or up to four 1-4
+// byte varints into vector lanes, and 16 one-byte values are widened
+// directly. Longer varints (large or negative values) are decoded one at a
+// time, as is everything on other CPUs. Values are truncated to 32 bits
+// the way protobuf's parser does, and enum values are not checked.
+
+#include "sugar_io.h"
+
+#include <google/protobuf/repeated_field.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#define SUGAR_VARINT_SSSE3 1
+#else
+#define SUGAR_VARINT_SSSE3 0
+#endif
+
+namespace sugar {
+
+template <typename T>
+concept VarintValue =
+    std::is_same_v<T, int32_t> || std::is_same_v<T, int64_t> ||
+    std::is_same_v<T, uint32_t> || std::is_same_v<T, uint64_t>;
+
+namespace detail {
+// int32 is sign-extended on the wire, so negative values take 10 bytes.
+template <VarintValue T> constexpr uint64_t varint_bits(T v) noexcept {
+  if constexpr (std::is_signed_v<T>)
+    return static_cast<uint64_t>(static_cast<int64_t>(v));
+  else
+    return v;
+}
+
+// One varint at p, unrolled as in protobuf's parser: each byte is added
+// whole and the continuation bit it carried is subtracted back out.
+inline uint64_t read_varint_unrolled(const std::byte *&p,
+                                     const std::byte *end) {
+  if (end - p < 10) {
+    uint64_t v;
+    if (!read_varint(p, end, v))
+      throw std::runtime_error("decode_varints: malformed varint");
+    return v;
+  }
+  const auto *b = reinterpret_cast<const uint8_t *>(p);
+  uint64_t v = b[0];
+  for (int i = 1; i < 10; ++i) {
+    if (b[i - 1] < 0x80) {
+      p += i;
+      return v;
+    }
+    v += (uint64_t{b[i]} - 1) << (7 * i);
+  }
+  if (b[9] >= 0x80)
+    throw std::runtime_error("decode_varints: malformed varint");
+  p += 10;
+  return v;
+}
+
+template <VarintValue T>
+inline const std::byte *decode_varints_scalar(const std::byte *p,
+                                              const std::byte *end, T *out,
+                                              std::size_t n) {
+  for (std::size_t i = 0; i < n; ++i) {
+    if (p != end && std::to_integer<uint8_t>(*p) < 0x80) {
+      out[i] = static_cast<T>(std::to_integer<uint8_t>(*p++));
+      continue;
+    }
+    out[i] = static_cast<T>(read_varint_unrolled(p, end));
+  }
+  return p;
+}
+
+#if SUGAR_VARINT_SSSE3
+inline bool cpu_has_ssse3() noexcept {
+  static const bool has = __builtin_cpu_supports("ssse3");
+  return has;
+}
+
+// How to decode the varints starting a 16-byte block, by the continuation
+// bits of its first 12 bytes. kind 1 gathers six 1-2 byte varints into
+// 16-bit lanes, kind 2 up to four 1-4 byte varints into 32-bit lanes, and
+// kind 0 leaves the block to the scalar decoder.
+struct VarintBlock {
+  std::array<uint8_t, 16> shuffle;
+  uint8_t consumed;
+  uint8_t count;
+  uint8_t kind;
+};
+
+consteval std::array<VarintBlock, 4096> make_varint_blocks() {
+  std::array<VarintBlock, 4096> table{};
+  for (unsigned mask = 0; mask < 4096; ++mask) {
+    int len[12] = {};
+    int n = 0;
+    for (int i = 0, start = 0; i < 12; ++i)
+      if (!(mask >> i & 1)) {
+        len[n++] = i + 1 - start;
+        start = i + 1;
+      }
+    int pairs = 0;
+    while (pairs < n && pairs < 6 && len[pairs] <= 2)
+      ++pairs;
+    int quads = 0;
+    while (quads < n && quads < 4 && len[quads] <= 4)
+      ++quads;
+
+    VarintBlock &b = table[mask];
+    b.shuffle.fill(0x80); // zero
+    const int lane = pairs == 6 ? 2 : 4;
+    const int count = pairs == 6 ? 6 : quads >= 2 ? quads : 0;
+    int pos = 0;
+    for (int j = 0; j < count; ++j) {
+      for (int k = 0; k < len[j]; ++k)
+        b.shuffle[static_cast<std::size_t>(j * lane + k)] =
+            static_cast<uint8_t>(pos + k);
+      pos += len[j];
+    }
+    b.consumed = static_cast<uint8_t>(pos);
+    b.count = static_cast<uint8_t>(count);
+    b.kind = count == 0 ? 0 : lane == 2 ? 1 : 2;
+  }
+  return table;
+}
+
+inline constexpr std::array<VarintBlock, 4096> kVarintBlocks =
+    make_varint_blocks();
+
+// Stores the 32-bit lanes of x as four Ts.
+template <VarintValue T>
+__attribute__((target("ssse3"))) inline void store_lanes32(T *out,
+                                                            __m128i x) {
+  if constexpr (sizeof(T) == 4) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), x);
+  } else {
+    const __m128i zero = _mm_setzero_si128();
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out),
+                     _mm_unpacklo_epi32(x, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2),
+                     _mm_unpackhi_epi32(x, zero));
+  }
+}
+
+template <VarintValue T>
+__attribute__((target("ssse3"))) inline void store_lanes16(T *out,
+                                                            __m128i x) {
+  const __m128i zero = _mm_setzero_si128();
+  store_lanes32(out, _mm_unpacklo_epi16(x, zero));
+  store_lanes32(out + 4, _mm_unpackhi_epi16(x, zero));
+}
+
+// Decodes from p while at least 16 input bytes and 16 output slots
+// remain; returns how many values were written.
+template <VarintValue T>
+__attribute__((target("ssse3"))) inline std::size_t
+decode_varints_ssse3(const std::byte *&p, const std::byte *end, T *out,
+                     std::size_t n) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i low7 = _mm_set1_epi32(0x7f);
+  std::size_t i = 0;
+  while (end - p >= 16 && n - i >= 16) {
+    const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    const auto mask = static_cast<unsigned>(_mm_movemask_epi8(in));
+    if (mask == 0) {
+      store_lanes16(out + i, _mm_unpacklo_epi8(in, zero));
+      store_lanes16(out + i + 8, _mm_unpackhi_epi8(in, zero));
+      p += 16;
+      i += 16;
+      continue;
+    }
+    const VarintBlock &b = kVarintBlocks[mask & 0xfff];
+    if (b.kind == 0) {
+      // Long varints tend to come in runs: take a few before looking again.
+      const std::size_t stop = i + std::min<std::size_t>(n - i, 16);
+      do
+        out[i++] = static_cast<T>(read_varint_unrolled(p, end));
+      while (i < stop && p != end);
+      continue;
+    }
+    const __m128i x = _mm_shuffle_epi8(
+        in, _mm_loadu_si128(reinterpret_cast<const __m128i *>(b.shuffle.data())));
+    if (b.kind == 1) {
+      const __m128i lo = _mm_and_si128(x, _mm_set1_epi16(0x7f));
+      const __m128i hi = _mm_and_si128(x, _mm_set1_epi16(0x7f00));
+      store_lanes16(out + i, _mm_or_si128(lo, _mm_srli_epi16(hi, 1)));
+    } else {
+      __m128i v = _mm_and_si128(x, low7);
+      v = _mm_or_si128(
+          v, _mm_srli_epi32(_mm_and_si128(x, _mm_slli_epi32(low7, 8)), 1));
+      v = _mm_or_si128(
+          v, _mm_srli_epi32(_mm_and_si128(x, _mm_slli_epi32(low7, 16)), 2));
+      v = _mm_or_si128(
+          v, _mm_srli_epi32(_mm_and_si128(x, _mm_slli_epi32(low7, 24)), 3));
+      store_lanes32(out + i, v);
+    }
+    p += b.consumed;
+    i += b.count;
+  }
+  return i;
+}
+
+// How to gather four varints of 1-4 bytes from 32-bit lanes into one run,
+// by their lengths minus one, two bits per lane.
+struct VarintPack {
+  std::array<uint8_t, 16> shuffle;
+  uint8_t size;
+};
+
+consteval std::array<VarintPack, 256> make_varint_packs() {
+  std::array<VarintPack, 256> table{};
+  for (unsigned code = 0; code < 256; ++code) {
+    VarintPack &pk = table[code];
+    pk.shuffle.fill(0x80);
+    std::size_t pos = 0;
+    for (unsigned j = 0; j < 4; ++j)
+      for (unsigned k = 0; k <= (code >> (2 * j) & 3); ++k)
+        pk.shuffle[pos++] = static_cast<uint8_t>(4 * j + k);
+    pk.size = static_cast<uint8_t>(pos);
+  }
+  return table;
+}
+
+inline constexpr std::array<VarintPack, 256> kVarintPacks =
+    make_varint_packs();
+
+// The encoding mirror of decode_varints_ssse3: four values below 2^28
+// are spread into 32-bit lanes, get their continuation bits from
+// comparisons and are gathered with one shuffle; after a group of
+// one-byte values, 16 at a time are narrowed with saturating packs.
+// Other groups are written one value at a time. Needs 16 bytes of room
+// before end for each store.
+template <VarintValue T>
+__attribute__((target("ssse3"))) inline std::size_t
+encode_varints_ssse3(const T *v, std::size_t n, std::byte *&p,
+                     std::byte *end) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i low7 = _mm_set1_epi32(0x7f);
+  const auto all_zero = [&](__m128i x) {
+    return _mm_movemask_epi8(_mm_cmpeq_epi32(x, zero)) == 0xffff;
+  };
+  std::size_t i = 0;
+  bool small = true; // the last group held one-byte values only
+  while (n - i >= 4 && end - p >= 16) {
+    if constexpr (sizeof(T) == 4) {
+      if (small && n - i >= 16) {
+        const auto *src = reinterpret_cast<const __m128i *>(v + i);
+        const __m128i a = _mm_loadu_si128(src), b = _mm_loadu_si128(src + 1),
+                      c = _mm_loadu_si128(src + 2),
+                      d = _mm_loadu_si128(src + 3);
+        if (all_zero(_mm_andnot_si128(
+                low7, _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d))))) {
+          _mm_storeu_si128(reinterpret_cast<__m128i *>(p),
+                           _mm_packus_epi16(_mm_packs_epi32(a, b),
+                                            _mm_packs_epi32(c, d)));
+          p += 16;
+          i += 16;
+          continue;
+        }
+      }
+    }
+    __m128i x;
+    bool fits;
+    if constexpr (sizeof(T) == 4) {
+      x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(v + i));
+      fits = all_zero(_mm_and_si128(x, _mm_set1_epi32(~0x0fffffff)));
+    } else {
+      const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(v + i));
+      const __m128i b =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(v + i + 2));
+      fits = all_zero(_mm_and_si128(_mm_or_si128(a, b),
+                                    _mm_set1_epi64x(~int64_t{0x0fffffff})));
+      x = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a),
+                                          _mm_castsi128_ps(b),
+                                          _MM_SHUFFLE(2, 0, 2, 0)));
+    }
+    if (!fits) {
+      for (const std::size_t stop = i + 4; i < stop; ++i)
+        p = put_varint(varint_bits(v[i]), p);
+      small = false;
+      continue;
+    }
+    const __m128i c1 = _mm_cmpgt_epi32(x, low7);
+    const __m128i c2 = _mm_cmpgt_epi32(x, _mm_set1_epi32(0x3fff));
+    const __m128i c3 = _mm_cmpgt_epi32(x, _mm_set1_epi32(0x1fffff));
+    __m128i bytes = _mm_and_si128(x, low7);
+    bytes = _mm_or_si128(
+        bytes, _mm_and_si128(_mm_slli_epi32(x, 1), _mm_slli_epi32(low7, 8)));
+    bytes = _mm_or_si128(
+        bytes, _mm_and_si128(_mm_slli_epi32(x, 2), _mm_slli_epi32(low7, 16)));
+    bytes = _mm_or_si128(
+        bytes, _mm_and_si128(_mm_slli_epi32(x, 3), _mm_slli_epi32(low7, 24)));
+    bytes = _mm_or_si128(bytes, _mm_and_si128(c1, _mm_set1_epi32(0x80)));
+    bytes = _mm_or_si128(bytes, _mm_and_si128(c2, _mm_set1_epi32(0x8000)));
+    bytes = _mm_or_si128(bytes, _mm_and_si128(c3, _mm_set1_epi32(0x800000)));
+    // Length - 1 per lane, narrowed to bytes and folded to two bits each.
+    const __m128i lens = _mm_sub_epi32(_mm_sub_epi32(_mm_sub_epi32(zero, c1), c2), c3);
+    const auto w = static_cast<uint32_t>(_mm_cvtsi128_si32(
+        _mm_packus_epi16(_mm_packs_epi32(lens, zero), zero)));
+    const unsigned code = (w | w >> 6 | w >> 12 | w >> 18) & 0xff;
+    const VarintPack &pk = kVarintPacks[code];
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i *>(p),
+        _mm_shuffle_epi8(bytes, _mm_loadu_si128(reinterpret_cast<const __m128i *>(
+                                    pk.shuffle.data()))));
+    p += pk.size;
+    i += 4;
+    small = code == 0;
+  }
+  return i;
+}
+#endif
+
+// Payload size four values at a time with SSE2 comparisons (baseline on
+// x86-64): a lane adds one byte per 7-bit threshold its value passes, and
+// negative int32 values take ten. 64-bit groups whose values all fit in
+// 32 bits are narrowed first; the rest are sized one by one.
+template <VarintValue T>
+std::size_t varints_size_sse2(const T *v, std::size_t n) noexcept {
+  const __m128i zero = _mm_setzero_si128();
+  // Unsigned comparison through signed compares on biased values.
+  const __m128i bias = _mm_set1_epi32(static_cast<int>(0x80000000u));
+  const auto threshold = [&](uint32_t t) {
+    return _mm_xor_si128(_mm_set1_epi32(static_cast<int>(t)), bias);
+  };
+  const __m128i t1 = threshold(0x7f), t2 = threshold(0x3fff),
+                t3 = threshold(0x1fffff), t4 = threshold(0xfffffff);
+  std::size_t size = 0;
+  std::size_t i = 0;
+  while (n - i >= 4) {
+    // Lanes gain at most 9 per group; flush before they can overflow.
+    const std::size_t stop = i + std::min<std::size_t>((n - i) & ~std::size_t{3},
+                                                       std::size_t{1} << 26);
+    __m128i acc = zero;
+    for (; i < stop; i += 4) {
+      __m128i x;
+      if constexpr (sizeof(T) == 4) {
+        x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(v + i));
+      } else {
+        const __m128 a = _mm_castsi128_ps(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(v + i)));
+        const __m128 b = _mm_castsi128_ps(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(v + i + 2)));
+        const __m128i high =
+            _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(high, zero)) != 0xffff) {
+          for (std::size_t k = i; k < i + 4; ++k)
+            size += varint_size(varint_bits(v[k])) - 1;
+          continue;
+        }
+        x = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+      }
+      const __m128i xb = _mm_xor_si128(x, bias);
+      acc = _mm_sub_epi32(acc, _mm_cmpgt_epi32(xb, t1));
+      acc = _mm_sub_epi32(acc, _mm_cmpgt_epi32(xb, t2));
+      acc = _mm_sub_epi32(acc, _mm_cmpgt_epi32(xb, t3));
+      acc = _mm_sub_epi32(acc, _mm_cmpgt_epi32(xb, t4));
+      if constexpr (std::is_same_v<T, int32_t>) {
+        // Negative values passed all four as unsigned: 5 bytes, plus 5.
+        acc = _mm_add_epi32(
+            acc, _mm_and_si128(_mm_cmplt_epi32(x, zero), _mm_set1_epi32(5)));
+      }
+    }
+    alignas(16) uint32_t lanes[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), acc);
+    size += std::size_t{lanes[0]} + lanes[1] + lanes[2] + lanes[3];
+  }
+  size += i; // the first byte of each
+  for (; i < n; ++i)
+    size += varint_size(varint_bits(v[i]));
+  return size;
+}
+
+// Decodes exactly n varints filling [p, end) into out.
+template <VarintValue T>
+void decode_varints_into(const std::byte *p, const std::byte *end, T *out,
+                         std::size_t n) {
+  std::size_t i = 0;
+#if SUGAR_VARINT_SSSE3
+  if (cpu_has_ssse3())
+    i = decode_varints_ssse3(p, end, out, n);
+#endif
+  if (decode_varints_scalar(p, end, out + i, n - i) != end)
+    throw std::runtime_error("decode_varints: malformed varint");
+}
+
+} // namespace detail
+
+// Number of varints in a packed payload. Throws std::runtime_error if the
+// last one is cut off.
+[[nodiscard]] inline std::size_t
+count_varints(std::span<const std::byte> packed) {
+  const std::byte *p = packed.data();
+  const std::byte *end = p + packed.size();
+  std::size_t continued = 0;
+  for (; end - p >= 8; p += 8) {
+    uint64_t w;
+    std::memcpy(&w, p, 8);
+    continued += ((w >> 7) & 0x0101010101010101ull) * 0x0101010101010101ull >> 56;
+  }
+  for (; p != end; ++p)
+    continued += std::to_integer<uint8_t>(*p) >> 7;
+  if (!packed.empty() && std::to_integer<uint8_t>(packed.back()) >= 0x80)
+    throw std::runtime_error("decode_varints: truncated varint");
+  return packed.size() - continued;
+}
+
+// Decodes a packed payload into the front of out and returns the number
+// of values. Throws std::length_error, writing nothing, if out is too
+// small, and std::runtime_error on malformed input.
+template <VarintValue T>
+std::size_t decode_varints(std::span<const std::byte> packed,
+                           std::span<T> out) {
+  const std::size_t n = count_varints(packed);
+  if (n > out.size())
+    throw std::length_error("decode_varints: output too small");
+  detail::decode_varints_into(packed.data(), packed.data() + packed.size(),
+                              out.data(), n);
+  return n;
+}
+
+// Appends the values of a packed payload to a RepeatedField, decoding
+// into its storage. Returns the number of values appended.
+template <VarintValue T>
+std::size_t decode_varints(std::span<const std::byte> packed,
+                           google::protobuf::RepeatedField<T> &out) {
+  const std::size_t n = count_varints(packed);
+  const int old = out.size();
+  out.Reserve(static_cast<int>(detail::checked_size(old + n)));
+  T *dst = out.AddNAlreadyReserved(static_cast<int>(n));
+  try {
+    detail::decode_varints_into(packed.data(), packed.data() + packed.size(),
+                                dst, n);
+  } catch (...) {
+    out.Truncate(old);
+    throw;
+  }
+  return n;
+}
+
+// Appends to a repeated field of a wrapper (u.numbers) or a RepeatedProxy.
+template <typename Field>
+  requires requires(const Field &f) { f.storage(); } ||
+           requires(const Field &f) { f.proxy().Reserve(0); }
+std::size_t decode_varints(std::span<const std::byte> packed,
+                           const Field &field) {
+  if constexpr (requires { field.storage(); })
+    return decode_varints(packed, field.storage());
+  else
+    return decode_varints(packed, field.proxy()); // lite tags
+}
+
+template <VarintValue T>
+[[nodiscard]] std::size_t varints_size(std::span<const T> values) noexcept {
+#if SUGAR_VARINT_SSSE3
+  return detail::varints_size_sse2(values.data(), values.size());
+#else
+  std::size_t n = 0;
+  for (const T v : values)
+    n += detail::varint_size(detail::varint_bits(v));
+  return n;
+#endif
+}
+
+// Writes values as a packed payload to the front of out and returns the
+// number of bytes written. Throws std::length_error, writing nothing, if
+// out is too small.
+template <VarintValue T>
+std::size_t encode_varints(std::span<const T> values,
+                           std::span<std::byte> out) {
+  const std::size_t size = varints_size(values);
+  if (size > out.size())
+    throw std::length_error("encode_varints: buffer too small");
+  std::byte *p = out.data();
+  std::size_t i = 0;
+#if SUGAR_VARINT_SSSE3
+  if (detail::cpu_has_ssse3())
+    i = detail::encode_varints_ssse3(values.data(), values.size(), p,
+                                     out.data() + size);
+#endif
+  for (; i < values.size(); ++i)
+    p = detail::put_varint(detail::varint_bits(values[i]), p);
+  return size;
+}
+
+} // namespace sugar
@@ -0,0 +1,728 @@
+#pragma once
+
+/*
+ * sugar_wire.h
+ *
+ * Copyright 2025 M.Berkay Karatas
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Read-only views over serialized messages, decoding only what is asked
+// for:
+//
+//   sugar::WireView<UserWrapped> v(payload);        // no parse, no copy
+//   int32_t id = v.get<"id">();
+//   auto [id, status] = v.get<"id", "status">();    // one pass
+//   std::string_view city = v.get<"profile">().get<"city">();
+//   for (int32_t n : v.get<"numbers">()) ...        // packed or not
+//   for (auto p : v.get<"profiles">()) ...          // nested views
+//   for (auto [k, val] : v.get<"meta">()) ...
+//
+// Field names resolve at compile time through the generated
+// XWrapped::kWireFields table. Each get() walks the top-level fields once,
+// skipping the ones it does not need by their wire type, so keep values
+// that are used repeatedly. Strings, bytes and submessage views point into
+// the input, which must outlive them. Like the parser, the last occurrence
+// of a singular field wins and fields whose wire type does not match the
+// schema are skipped as unknown. A singular submessage merges all of its
+// occurrences the same way: its view finds them again in the enclosing
+// message on every get(), so the fields of one nested n levels deep cost
+// a walk through each of the n levels above it. A member of a oneof clears
+// the members seen before it, a submessage on a view's path included.
+// Malformed input throws
+// std::runtime_error. Groups can be skipped but not viewed.
+
+#include "sugar_core.h"
+#include "sugar_io.h"
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace sugar {
+
+// A field name as a template argument: `v.get<"id">()`.
+template <std::size_t N> struct FieldName {
+  char chars[N]{};
+
+  constexpr FieldName(const char (&s)[N]) noexcept {
+    for (std::size_t i = 0; i < N; ++i)
+      chars[i] = s[i];
+  }
+  [[nodiscard]] constexpr std::string_view view() const noexcept {
+    return {chars, N - 1};
+  }
+};
+
+template <typename Wrapped, typename... Path> class WireView;
+
+namespace detail {
+enum : int {
+  kWireVarint = 0,
+  kWireFixed64 = 1,
+  kWireLen = 2,
+  kWireStartGroup = 3,
+  kWireEndGroup = 4,
+  kWireFixed32 = 5,
+};
+
+constexpr int wire_type_of(WireKind k) noexcept {
+  switch (k) {
+  case WireKind::kFixed64:
+  case WireKind::kSFixed64:
+  case WireKind::kDouble:
+    return kWireFixed64;
+  case WireKind::kFixed32:
+  case WireKind::kSFixed32:
+  case WireKind::kFloat:
+    return kWireFixed32;
+  case WireKind::kString:
+  case WireKind::kBytes:
+  case WireKind::kMessage:
+    return kWireLen;
+  case WireKind::kGroup:
+    return kWireStartGroup;
+  default:
+    return kWireVarint;
+  }
+}
+
+[[noreturn]] inline void malformed_wire() {
+  throw std::runtime_error("WireView: malformed input");
+}
+
+// One field of a serialized message. For length-delimited fields
+// [value, end) is the payload; otherwise value is where the encoded value
+// starts and end where the field ends.
+struct WireToken {
+  uint64_t number;
+  int wire;
+  const std::byte *value;
+  const std::byte *end;
+};
+
+inline void skip_wire_value(int wire, const std::byte *&p,
+                            const std::byte *end) {
+  uint64_t v;
+  switch (wire) {
+  case kWireVarint:
+    if (!read_varint(p, end, v))
+      malformed_wire();
+    return;
+  case kWireFixed64:
+    if (end - p < 8)
+      malformed_wire();
+    p += 8;
+    return;
+  case kWireLen:
+    if (!read_varint(p, end, v) || v > static_cast<uint64_t>(end - p))
+      malformed_wire();
+    p += v;
+    return;
+  case kWireFixed32:
+    if (end - p < 4)
+      malformed_wire();
+    p += 4;
+    return;
+  case kWireStartGroup:
+    // Nested fields up to the matching end-group marker.
+    for (int depth = 1; depth;) {
+      if (!read_varint(p, end, v))
+        malformed_wire();
+      const int w = static_cast<int>(v & 7);
+      if (w == kWireStartGroup)
+        ++depth;
+      else if (w == kWireEndGroup)
+        --depth;
+      else
+        skip_wire_value(w, p, end);
+    }
+    return;
+  default:
+    malformed_wire();
+  }
+}
+
+// Reads the field at p into t and moves p past it; false at the end.
+inline bool next_token(const std::byte *&p, const std::byte *end,
+                       WireToken &t) {
+  if (p == end)
+    return false;
+  uint64_t tag;
+  if (!read_varint(p, end, tag) || tag < 8)
+    malformed_wire();
+  t.number = tag >> 3;
+  t.wire = static_cast<int>(tag & 7);
+  if (t.wire == kWireLen) {
+    uint64_t len;
+    if (!read_varint(p, end, len) || len > static_cast<uint64_t>(end - p))
+      malformed_wire();
+    t.value = p;
+    p += len;
+  } else {
+    t.value = p;
+    skip_wire_value(t.wire, p, end);
+  }
+  t.end = p;
+  return true;
+}
+
+// 1 + index of the oneof holding field Number of Wrapped, 0 if none.
+template <typename Wrapped, int Number> constexpr int oneof_of() {
+  for (const WireField &f : Wrapped::kWireFields)
+    if (f.number == Number)
+      return f.oneof;
+  return 0;
+}
+
+// Whether t sets another member of the oneof holding field Number of
+// Wrapped, which clears that field.
+template <typename Wrapped, int Number>
+bool displaces(const WireToken &t) noexcept {
+  constexpr int oneof = oneof_of<Wrapped, Number>();
+  if constexpr (oneof == 0) {
+    return false;
+  } else {
+    if (t.number == static_cast<uint64_t>(Number))
+      return false;
+    for (const WireField &f : Wrapped::kWireFields)
+      if (f.oneof == oneof && t.number == static_cast<uint64_t>(f.number) &&
+          t.wire == wire_type_of(f.kind))
+        return true;
+    return false;
+  }
+}
+
+// One level of a submessage view's path: the singular message field
+// Number of Parent. Parent is void for map values, which no oneof holds.
+template <typename Parent, int Number> struct WireStep {
+  static constexpr int number = Number;
+  static constexpr bool in_oneof = oneof_of<Parent, Number>() != 0;
+  static bool displaced_by(const WireToken &t) noexcept {
+    return displaces<Parent, Number>(t);
+  }
+};
+template <int Number> struct WireStep<void, Number> {
+  static constexpr int number = Number;
+  static constexpr bool in_oneof = false;
+  static bool displaced_by(const WireToken &) noexcept { return false; }
+};
+
+// Field number of the token TokenCursor::next() reports when a oneof
+// sibling of a path field clears that field: everything read through it
+// so far no longer counts. Real field numbers start at 1.
+inline constexpr uint64_t kWireCleared = 0;
+
+// Walks the fields of the message reached from the outermost bytes through
+// the singular submessage fields Path (WireSteps), one per level. Every
+// occurrence of a submessage is entered in turn, so the fields come out as
+// the parser merges them: later singular values win and repeated elements
+// concatenate.
+template <typename... Path> class TokenCursor {
+public:
+  TokenCursor() noexcept = default;
+  explicit TokenCursor(std::span<const std::byte> bytes) noexcept {
+    p_[0] = bytes.data();
+    end_[0] = bytes.data() + bytes.size();
+  }
+
+  // Reads the next field into t; false at the end.
+  bool next(WireToken &t) {
+    if constexpr (kDepth == 0) {
+      return next_token(p_[0], end_[0], t);
+    } else {
+      for (;;) {
+        if (!next_token(p_[level_], end_[level_], t)) {
+          if (level_ == 0)
+            return false;
+          --level_;
+        } else if (level_ == kDepth) {
+          return true;
+        } else if (t.number == kPath[level_] && t.wire == kWireLen) {
+          ++level_;
+          p_[level_] = t.value;
+          end_[level_] = t.end;
+        } else if constexpr (kMayClear) {
+          if (kDisplaced[level_](t)) {
+            t.number = kWireCleared;
+            return true;
+          }
+        }
+      }
+    }
+  }
+
+  // Moves past the last kWireCleared token, leaving what still counts.
+  void skip_cleared() {
+    if constexpr (kMayClear) {
+      TokenCursor probe = *this;
+      WireToken t;
+      while (probe.next(t))
+        if (t.number == kWireCleared)
+          *this = probe;
+    }
+  }
+
+  friend bool operator==(const TokenCursor &a, const TokenCursor &b) noexcept {
+    if (a.level_ != b.level_)
+      return false;
+    for (std::size_t i = 0; i <= a.level_; ++i)
+      if (a.p_[i] != b.p_[i])
+        return false;
+    return true;
+  }
+
+private:
+  static constexpr std::size_t kDepth = sizeof...(Path);
+  static constexpr uint64_t kPath[kDepth + 1] = {
+      static_cast<uint64_t>(Path::number)..., 0};
+  static constexpr bool kMayClear = (Path::in_oneof || ...);
+  static constexpr bool (*kDisplaced[kDepth + 1])(const WireToken &) = {
+      &Path::displaced_by..., nullptr};
+
+  std::array<const std::byte *, kDepth + 1> p_{};
+  std::array<const std::byte *, kDepth + 1> end_{};
+  std::size_t level_ = 0;
+};
+
+template <WireKind K> struct WireValue;
+template <> struct WireValue<WireKind::kInt32> { using type = int32_t; };
+template <> struct WireValue<WireKind::kSInt32> { using type = int32_t; };
+template <> struct WireValue<WireKind::kSFixed32> { using type = int32_t; };
+template <> struct WireValue<WireKind::kInt64> { using type = int64_t; };
+template <> struct WireValue<WireKind::kSInt64> { using type = int64_t; };
+template <> struct WireValue<WireKind::kSFixed64> { using type = int64_t; };
+template <> struct WireValue<WireKind::kUInt32> { using type = uint32_t; };
+template <> struct WireValue<WireKind::kFixed32> { using type = uint32_t; };
+template <> struct WireValue<WireKind::kUInt64> { using type = uint64_t; };
+template <> struct WireValue<WireKind::kFixed64> { using type = uint64_t; };
+template <> struct WireValue<WireKind::kBool> { using type = bool; };
+template <> struct WireValue<WireKind::kEnum> { using type = int; };
+template <> struct WireValue<WireKind::kFloat> { using type = float; };
+template <> struct WireValue<WireKind::kDouble> { using type = double; };
+template <> struct WireValue<WireKind::kString> {
+  using type = std::string_view;
+};
+template <> struct WireValue<WireKind::kBytes> {
+  using type = std::string_view;
+};
+
+// Element type of field Number of Wrapped with kind K: submessages are
+// views over their own wrapper's table.
+template <typename Wrapped, WireKind K, int Number, bool = K == WireKind::kMessage>
+struct WireElement {
+  static_assert(K != WireKind::kGroup, "WireView cannot view groups");
+  using type = typename WireValue<K>::type;
+};
+template <typename Wrapped, WireKind K, int Number>
+struct WireElement<Wrapped, K, Number, true> {
+  using type =
+      WireView<decltype(Wrapped::wire_message(WireNumber<Number>{}))>;
+};
+
+// Type of singular field Number of Wrapped: a submessage is a view that
+// reaches it from the outermost bytes through Path.
+template <typename Wrapped, WireKind K, int Number, bool Message,
+          typename... Path>
+struct WireSingular : WireElement<Wrapped, K, Number> {};
+template <typename Wrapped, WireKind K, int Number, typename... Path>
+struct WireSingular<Wrapped, K, Number, true, Path...> {
+  using type = WireView<decltype(Wrapped::wire_message(WireNumber<Number>{})),
+                        Path...>;
+};
+
+template <typename T> T load_le(const std::byte *p) noexcept {
+  std::byte b[sizeof(T)];
+  if constexpr (std::endian::native == std::endian::little)
+    std::memcpy(b, p, sizeof(T));
+  else
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+      b[i] = p[sizeof(T) - 1 - i];
+  T v;
+  std::memcpy(&v, b, sizeof(T));
+  return v;
+}
+
+// Decodes one value of a scalar kind at p, advancing p.
+template <WireKind K>
+typename WireValue<K>::type read_scalar(const std::byte *&p,
+                                        const std::byte *end) {
+  using T = typename WireValue<K>::type;
+  constexpr int wire = wire_type_of(K);
+  if constexpr (wire == kWireFixed32 || wire == kWireFixed64) {
+    constexpr std::size_t n = wire == kWireFixed32 ? 4 : 8;
+    if (static_cast<std::size_t>(end - p) < n)
+      malformed_wire();
+    using Raw = std::conditional_t<n == 4, uint32_t, uint64_t>;
+    const Raw raw = load_le<Raw>(p);
+    p += n;
+    if constexpr (std::is_floating_point_v<T>)
+      return std::bit_cast<T>(raw);
+    else
+      return static_cast<T>(raw);
+  } else {
+    uint64_t v;
+    if (!read_varint(p, end, v))
+      malformed_wire();
+    if constexpr (K == WireKind::kSInt32)
+      return static_cast<int32_t>(static_cast<uint32_t>(v) >> 1) ^
+             -static_cast<int32_t>(v & 1);
+    else if constexpr (K == WireKind::kSInt64)
+      return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+    else if constexpr (K == WireKind::kBool)
+      return v != 0;
+    else
+      return static_cast<T>(v);
+  }
+}
+
+// The value of a token already known to have K's wire type.
+template <typename Wrapped, WireKind K, int Number>
+typename WireElement<Wrapped, K, Number>::type
+token_value(const WireToken &t) {
+  using T = typename WireElement<Wrapped, K, Number>::type;
+  if constexpr (K == WireKind::kMessage) {
+    return T(std::span<const std::byte>(t.value, t.end));
+  } else if constexpr (K == WireKind::kString || K == WireKind::kBytes) {
+    return {reinterpret_cast<const char *>(t.value),
+            static_cast<std::size_t>(t.end - t.value)};
+  } else {
+    const std::byte *p = t.value;
+    return read_scalar<K>(p, t.end);
+  }
+}
+
+template <typename Wrapped> constexpr std::size_t wire_index(std::string_view name) {
+  for (std::size_t i = 0; i < Wrapped::kWireFields.size(); ++i)
+    if (Wrapped::kWireFields[i].name == name)
+      return i;
+  return Wrapped::kWireFields.size();
+}
+} // namespace detail
+
+// Elements of a repeated field, decoded while iterating. Numeric fields
+// accept packed and unpacked encodings, mixed as the parser does. Path is
+// that of the view the field was read from.
+template <typename Wrapped, WireKind K, int Number, typename... Path>
+class WireRepeated {
+public:
+  using value_type = typename detail::WireElement<Wrapped, K, Number>::type;
+
+  class iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = WireRepeated::value_type;
+
+    iterator() = default;
+    explicit iterator(std::span<const std::byte> bytes)
+        : cursor_(bytes), done_(false) {
+      cursor_.skip_cleared();
+      advance();
+    }
+
+    const value_type &operator*() const noexcept { return value_; }
+    const value_type *operator->() const noexcept { return &value_; }
+    iterator &operator++() {
+      advance();
+      return *this;
+    }
+    iterator operator++(int) {
+      iterator old = *this;
+      advance();
+      return old;
+    }
+    bool operator==(std::default_sentinel_t) const noexcept { return done_; }
+    friend bool operator==(const iterator &a, const iterator &b) noexcept {
+      return a.done_ == b.done_ &&
+             (a.done_ || (a.cursor_ == b.cursor_ && a.run_ == b.run_));
+    }
+
+  private:
+    static constexpr bool kPackable =
+        detail::wire_type_of(K) != detail::kWireLen;
+
+    void advance() {
+      if constexpr (kPackable) {
+        if (run_ != run_end_) {
+          value_ = detail::read_scalar<K>(run_, run_end_);
+          return;
+        }
+      }
+      detail::WireToken t;
+      while (cursor_.next(t)) {
+        if (t.number != static_cast<uint64_t>(Number))
+          continue;
+        if (t.wire == detail::wire_type_of(K)) {
+          value_ = detail::token_value<Wrapped, K, Number>(t);
+          return;
+        }
+        if constexpr (kPackable) {
+          if (t.wire == detail::kWireLen && t.value != t.end) {
+            run_ = t.value;
+            run_end_ = t.end;
+            value_ = detail::read_scalar<K>(run_, run_end_);
+            return;
+          }
+        }
+      }
+      done_ = true;
+    }
+
+    detail::TokenCursor<Path...> cursor_;
+    const std::byte *run_ = nullptr; // rest of a packed run
+    const std::byte *run_end_ = nullptr;
+    value_type value_{};
+    bool done_ = true;
+  };
+
+  explicit WireRepeated(std::span<const std::byte> bytes) noexcept
+      : bytes_(bytes) {}
+
+  [[nodiscard]] iterator begin() const { return iterator(bytes_); }
+  [[nodiscard]] std::default_sentinel_t end() const noexcept { return {}; }
+  [[nodiscard]] bool empty() const { return begin() == end(); }
+  // Counts by walking the field.
+  [[nodiscard]] std::size_t size() const {
+    std::size_t n = 0;
+    for (auto it = begin(); it != end(); ++it)
+      ++n;
+    return n;
+  }
+
+private:
+  std::span<const std::byte> bytes_;
+};
+
+// Entries of a map field as (key, value) pairs, decoded while iterating.
+// Message values are views over their entry, merging every occurrence of
+// the value in it.
+template <typename Wrapped, WireKind KeyKind, WireKind ValueKind, int Number,
+          typename... Path>
+class WireMap {
+  // Entry messages are read with a raw walk; this only names their type.
+  struct Entry {
+    static Entry wire_message(WireNumber<Number>);
+  };
+  using Entries = WireRepeated<Entry, WireKind::kMessage, Number, Path...>;
+
+public:
+  using key_type = typename detail::WireValue<KeyKind>::type;
+  using mapped_type =
+      typename detail::WireSingular<Wrapped, ValueKind, Number,
+                                    ValueKind == WireKind::kMessage,
+                                    detail::WireStep<void, 2>>::type;
+  using value_type = std::pair<key_type, mapped_type>;
+
+  class iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = WireMap::value_type;
+
+    iterator() = default;
+    explicit iterator(typename Entries::iterator it)
+        : it_(it) {}
+
+    value_type operator*() const { return decode((*it_).bytes()); }
+    iterator &operator++() {
+      ++it_;
+      return *this;
+    }
+    iterator operator++(int) {
+      iterator old = *this;
+      ++it_;
+      return old;
+    }
+    bool operator==(std::default_sentinel_t s) const noexcept {
+      return it_ == s;
+    }
+    friend bool operator==(const iterator &, const iterator &) = default;
+
+  private:
+    typename Entries::iterator it_;
+  };
+
+  explicit WireMap(std::span<const std::byte> bytes) noexcept
+      : entries_(bytes) {}
+
+  [[nodiscard]] iterator begin() const { return iterator(entries_.begin()); }
+  [[nodiscard]] std::default_sentinel_t end() const noexcept { return {}; }
+  [[nodiscard]] bool empty() const { return entries_.empty(); }
+  // Counts entries by walking the field (duplicate keys included).
+  [[nodiscard]] std::size_t size() const { return entries_.size(); }
+
+  // The value of the last entry with this key.
+  [[nodiscard]] std::optional<mapped_type> find(const key_type &key) const {
+    std::optional<mapped_type> found;
+    for (const auto &[k, v] : *this)
+      if (k == key)
+        found = v;
+    return found;
+  }
+
+private:
+  static value_type decode(std::span<const std::byte> entry) {
+    value_type kv{};
+    if constexpr (ValueKind == WireKind::kMessage)
+      kv.second = mapped_type(entry);
+    const std::byte *p = entry.data();
+    const std::byte *end = p + entry.size();
+    detail::WireToken t;
+    while (detail::next_token(p, end, t)) {
+      if (t.number == 1 && t.wire == detail::wire_type_of(KeyKind))
+        kv.first = detail::token_value<Wrapped, KeyKind, 0>(t);
+      else if constexpr (ValueKind != WireKind::kMessage) {
+        if (t.number == 2 && t.wire == detail::wire_type_of(ValueKind))
+          kv.second = detail::token_value<Wrapped, ValueKind, Number>(t);
+      }
+    }
+    return kv;
+  }
+
+  Entries entries_;
+};
+
+// Path is empty for a view over a message's own bytes. A singular
+// submessage's view keeps the outermost bytes and appends a step for the
+// field, see detail::TokenCursor.
+template <typename Wrapped, typename... Path> class WireView {
+public:
+  // An empty message: every field reads as its default.
+  WireView() noexcept = default;
+  explicit WireView(std::span<const std::byte> bytes) noexcept
+      : bytes_(bytes) {}
+  explicit WireView(std::string_view bytes) noexcept
+      : bytes_(std::as_bytes(std::span(bytes.data(), bytes.size()))) {}
+  // A view would outlive a temporary string.
+  WireView(std::string &&) = delete;
+
+  // Singular fields give their value (the default when absent), repeated
+  // fields a WireRepeated range, maps a WireMap. Several singular names
+  // return a tuple read in one pass.
+  template <FieldName Name, FieldName... More> [[nodiscard]] auto get() const {
+    if constexpr (sizeof...(More) == 0) {
+      constexpr const WireField &f = field<Name>();
+      if constexpr (f.shape == WireField::kMap)
+        return WireMap<Wrapped, f.key, f.value, f.number, Path...>(bytes_);
+      else if constexpr (f.shape == WireField::kRepeated)
+        return WireRepeated<Wrapped, f.kind, f.number, Path...>(bytes_);
+      else
+        return std::get<0>(read_singular<Name>());
+    } else {
+      return read_singular<Name, More...>();
+    }
+  }
+
+  // Whether a singular field is on the wire, or a repeated or map field
+  // has elements.
+  template <FieldName Name> [[nodiscard]] bool has() const {
+    constexpr const WireField &f = field<Name>();
+    if constexpr (f.shape != WireField::kSingular) {
+      return !get<Name>().empty();
+    } else {
+      // A later oneof sibling, of the field or of a message on the path,
+      // clears an earlier occurrence.
+      detail::TokenCursor<Path...> c(bytes_);
+      detail::WireToken t;
+      bool found = false;
+      while (c.next(t)) {
+        if (t.number == static_cast<uint64_t>(f.number) &&
+            t.wire == detail::wire_type_of(f.kind))
+          found = true;
+        else if (t.number == detail::kWireCleared ||
+                 detail::displaces<Wrapped, f.number>(t))
+          found = false;
+      }
+      return found;
+    }
+  }
+
+  // The bytes the view reads: the message's own, or for a singular
+  // submessage those of the outermost message it was reached from.
+  [[nodiscard]] std::span<const std::byte> bytes() const noexcept {
+    return bytes_;
+  }
+
+private:
+  template <FieldName Name> static constexpr const WireField &field() {
+    constexpr std::size_t i = detail::wire_index<Wrapped>(Name.view());
+    static_assert(i < Wrapped::kWireFields.size(),
+                  "no field with this name in the message");
+    return Wrapped::kWireFields[i];
+  }
+
+  template <FieldName Name>
+  static constexpr bool is_message = field<Name>().kind == WireKind::kMessage;
+
+  template <FieldName Name>
+  using value_t = typename detail::WireSingular<
+      Wrapped, field<Name>().kind, field<Name>().number, is_message<Name>,
+      Path..., detail::WireStep<Wrapped, field<Name>().number>>::type;
+
+  // Submessage views need no walk: they find their occurrences when read.
+  template <FieldName Name> value_t<Name> initial() const noexcept {
+    if constexpr (is_message<Name>)
+      return value_t<Name>(bytes_);
+    else
+      return {};
+  }
+
+  template <FieldName... Names> std::tuple<value_t<Names>...> read_singular() const {
+    static_assert(((field<Names>().shape == WireField::kSingular) && ...),
+                  "only singular fields can be read together");
+    std::tuple<value_t<Names>...> out{initial<Names>()...};
+    if constexpr ((!is_message<Names> || ...)) {
+      detail::TokenCursor<Path...> c(bytes_);
+      detail::WireToken t;
+      while (c.next(t)) {
+        if (t.number == detail::kWireCleared)
+          out = {initial<Names>()...};
+        else
+          take<0, Names...>(t, out);
+      }
+    }
+    return out;
+  }
+
+  // A token sets the field it belongs to and resets its oneof siblings.
+  template <std::size_t I, FieldName Name, FieldName... Rest, typename Tuple>
+  static void take(const detail::WireToken &t, Tuple &out) {
+    constexpr const WireField &f = field<Name>();
+    if constexpr (!is_message<Name>) {
+      if (t.number == static_cast<uint64_t>(f.number) &&
+          t.wire == detail::wire_type_of(f.kind))
+        std::get<I>(out) = detail::token_value<Wrapped, f.kind, f.number>(t);
+      else if (detail::displaces<Wrapped, f.number>(t))
+        std::get<I>(out) = {};
+    }
+    if constexpr (sizeof...(Rest) > 0)
+      take<I + 1, Rest...>(t, out);
+  }
+
+  std::span<const std::byte> bytes_;
+};
+
+} // namespace sugar
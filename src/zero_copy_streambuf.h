@@ -0,0 +1,78 @@
+#pragma once
+
+#include <google/protobuf/io/zero_copy_stream.h>
+
+#include <algorithm>
+#include <cstring>
+#include <streambuf>
+
+// std::streambuf that writes straight into the buffers handed out by a
+// ZeroCopyOutputStream, so emit_* functions can target protoc's output
+// without an intermediate std::string. Unused buffer space is returned with
+// BackUp() on sync() and destruction.
+class ZeroCopyStreambuf : public std::streambuf {
+public:
+  explicit ZeroCopyStreambuf(google::protobuf::io::ZeroCopyOutputStream *out)
+      : out_(out) {}
+
+  ZeroCopyStreambuf(const ZeroCopyStreambuf &) = delete;
+  ZeroCopyStreambuf &operator=(const ZeroCopyStreambuf &) = delete;
+
+  ~ZeroCopyStreambuf() override { sync(); }
+
+  // False once the underlying stream refused to hand out a buffer.
+  [[nodiscard]] bool ok() const noexcept { return !failed_; }
+
+protected:
+  int_type overflow(int_type ch) override {
+    if (!next_buffer())
+      return traits_type::eof();
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(ch);
+      pbump(1);
+    }
+    return traits_type::not_eof(ch);
+  }
+
+  std::streamsize xsputn(const char *s, std::streamsize n) override {
+    std::streamsize written = 0;
+    while (written < n) {
+      if (pptr() == epptr() && !next_buffer())
+        break;
+      const std::streamsize chunk = std::min<std::streamsize>(
+          n - written, static_cast<std::streamsize>(epptr() - pptr()));
+      std::memcpy(pptr(), s + written, static_cast<std::size_t>(chunk));
+      pbump(static_cast<int>(chunk));
+      written += chunk;
+    }
+    return written;
+  }
+
+  int sync() override {
+    if (pptr() && pptr() < epptr())
+      out_->BackUp(static_cast<int>(epptr() - pptr()));
+    setp(nullptr, nullptr);
+    return failed_ ? -1 : 0;
+  }
+
+private:
+  bool next_buffer() {
+    if (failed_)
+      return false;
+    void *data = nullptr;
+    int size = 0;
+    do {
+      if (!out_->Next(&data, &size)) {
+        failed_ = true;
+        setp(nullptr, nullptr);
+        return false;
+      }
+    } while (size == 0);
+    char *begin = static_cast<char *>(data);
+    setp(begin, begin + size);
+    return true;
+  }
+
+  google::protobuf::io::ZeroCopyOutputStream *out_;
+  bool failed_ = false;
+};
@@ -3,15 +3,22 @@
 
 #include "emit_header.h"
 
+#include <google/protobuf/descriptor.pb.h>
+
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <sstream>
 #include <string>
+#include <vector>
 
 using namespace std;
 
 using namespace google::protobuf;
 
+// What the generator emits with json,builder,plain,mask.
+const EmitFeatures kAllFeatures{true, true, true, true};
+
 class EmitHeader_UsingPackagedFile : public ::testing::Test {
 protected:
   const FileDescriptor *fd{};
@@ -30,6 +37,21 @@ protected:
   }
 };
 
+// test_messages.proto rebuilt with `optimize_for = LITE_RUNTIME`.
+class EmitHeader_UsingLiteFile : public ::testing::Test {
+protected:
+  DescriptorPool pool;
+  const FileDescriptor *fd{};
+  void SetUp() override {
+    FileDescriptorProto proto;
+    mypkg::Top::descriptor()->file()->CopyTo(&proto);
+    proto.set_name("lite_top.proto");
+    proto.mutable_options()->set_optimize_for(FileOptions::LITE_RUNTIME);
+    fd = pool.BuildFile(proto);
+    ASSERT_NE(fd, nullptr);
+  }
+};
+
 TEST_F(EmitHeader_UsingPackagedFile, HeaderFilename_UsesStemAndSugarExt) {
   string out = header_filename_for_file(fd);
   EXPECT_EQ(out, string("test_messages.sugar.h"));
@@ -51,6 +73,53 @@ TEST_F(EmitHeader_UsingPackagedFile, IncludesAndNamespace_Emitted) {
   EXPECT_NE(code.find("} // namespace mypkg"), string::npos);
 }
 
+TEST_F(EmitHeader_UsingPackagedFile, Features_OffByDefault) {
+  const string features[] = {"sugar_json.h", "sugar_builder.h",
+                             "sugar_plain.h", "sugar_mask.h",
+                             "write_json",    "struct TopBuilder",
+                             "struct TopPlain", "merge_masked"};
+  ostringstream single;
+  emit_header_for_file(fd, single);
+  string split;
+  for (const auto &out : split_outputs_for_file(fd)) {
+    ostringstream os;
+    out.emit(os);
+    split += os.str();
+  }
+  for (const auto &code : {single.str(), split})
+    for (const auto &feature : features)
+      EXPECT_EQ(code.find(feature), string::npos) << feature;
+  EXPECT_NE(single.str().find("sugar::WireField"), string::npos);
+  EXPECT_NE(single.str().find("TopWrapped::hash_of"), string::npos);
+}
+
+TEST_F(EmitHeader_UsingPackagedFile, Features_EachAddsOnlyItself) {
+  auto code = [&](EmitFeatures features) {
+    ostringstream os;
+    emit_header_for_file(fd, os, features);
+    return os.str();
+  };
+  const string json = code({.json = true});
+  EXPECT_NE(json.find("#include \"sugar_json.h\""), string::npos);
+  EXPECT_NE(json.find("TopWrapped::write_json"), string::npos);
+  EXPECT_EQ(json.find("sugar_plain.h"), string::npos);
+
+  const string builder = code({.builder = true});
+  EXPECT_NE(builder.find("#include \"sugar_builder.h\""), string::npos);
+  EXPECT_NE(builder.find("struct TopBuilder {"), string::npos);
+  EXPECT_EQ(builder.find("struct TopPlain"), string::npos);
+
+  const string plain = code({.plain = true});
+  EXPECT_NE(plain.find("#include \"sugar_plain.h\""), string::npos);
+  EXPECT_NE(plain.find("std::optional<InnerPlain> inner;"), string::npos);
+  EXPECT_EQ(plain.find("Builder"), string::npos);
+
+  const string mask = code({.mask = true});
+  EXPECT_NE(mask.find("#include \"sugar_mask.h\""), string::npos);
+  EXPECT_NE(mask.find("TopWrapped::merge_masked"), string::npos);
+  EXPECT_EQ(mask.find("sugar_json.h"), string::npos);
+}
+
 TEST_F(EmitHeader_UsingNoPackageFile,
        IncludesAndNamespace_NotEmittedForNoPackage) {
   ostringstream os;
@@ -77,33 +146,39 @@ TEST_F(EmitHeader_UsingPackagedFile,
   string code = os.str();
   EXPECT_NE(code.find("struct InnerWrapped {"), string::npos);
   EXPECT_NE(code.find("struct DeeperWrapped {"), string::npos);
-  EXPECT_NE(code.find("Deeper& _msg;"), string::npos);
-  EXPECT_NE(code.find("sugar::FieldProxy<int32_t> x;"), string::npos);
+  EXPECT_NE(code.find("Deeper* _msg;"), string::npos);
+  EXPECT_NE(code.find("sugar::FieldTag<Access, 0, int32_t> x;"), string::npos);
 }
 
 TEST_F(EmitHeader_UsingPackagedFile, Field_Map_KeyAndValue_AllCppTypesCovered) {
   ostringstream os;
   emit_header_for_file(fd, os);
   string code = os.str();
-  EXPECT_NE(code.find("sugar::MapProxy<std::string, int32_t> string_to_int32;"),
+  EXPECT_NE(code.find("sugar::MapTag<Access, 0, std::string, int32_t> "
+                      "string_to_int32;"),
             string::npos);
-  EXPECT_NE(code.find("sugar::MapProxy<uint64_t, ChildWrapped> u64_to_child;"),
+  EXPECT_NE(code.find("sugar::MapTag<Access, 1, uint64_t, ChildWrapped> "
+                      "u64_to_child;"),
             string::npos);
-  EXPECT_NE(code.find("sugar::MapProxy<int32_t, std::string> m_i32_str;"),
+  EXPECT_NE(code.find("sugar::MapTag<Access, 16, int32_t, std::string> "
+                      "m_i32_str;"),
             string::npos);
-  EXPECT_NE(code.find("sugar::MapProxy<int64_t, double> m_i64_dbl;"),
+  EXPECT_NE(code.find("sugar::MapTag<Access, 17, int64_t, double> m_i64_dbl;"),
             string::npos);
-  EXPECT_NE(code.find("sugar::MapProxy<uint32_t, bool> m_u32_bool;"),
+  EXPECT_NE(code.find("sugar::MapTag<Access, 18, uint32_t, bool> m_u32_bool;"),
             string::npos);
-  EXPECT_NE(code.find("sugar::MapProxy<bool, uint64_t> m_bool_u64;"),
+  EXPECT_NE(code.find("sugar::MapTag<Access, 19, bool, uint64_t> m_bool_u64;"),
             string::npos);
-  EXPECT_NE(code.find("sugar::MapProxy<int32_t, int> m_i32_enum;"),
+  EXPECT_NE(code.find("sugar::MapTag<Access, 20, int32_t, int> m_i32_enum;"),
             string::npos);
-  EXPECT_NE(code.find("sugar::MapProxy<uint32_t, float> m_u32_float;"),
+  EXPECT_NE(code.find("sugar::MapTag<Access, 21, uint32_t, float> "
+                      "m_u32_float;"),
             string::npos);
-  EXPECT_NE(code.find("sugar::MapProxy<std::string, int64_t> m_str_i64;"),
+  EXPECT_NE(code.find("sugar::MapTag<Access, 22, std::string, int64_t> "
+                      "m_str_i64;"),
             string::npos);
-  EXPECT_NE(code.find("sugar::MapProxy<uint64_t, uint32_t> m_u64_u32;"),
+  EXPECT_NE(code.find("sugar::MapTag<Access, 23, uint64_t, uint32_t> "
+                      "m_u64_u32;"),
             string::npos);
 }
 
@@ -112,19 +187,27 @@ TEST_F(EmitHeader_UsingPackagedFile,
   ostringstream os;
   emit_header_for_file(fd, os);
   string code = os.str();
-  EXPECT_NE(code.find("sugar::RepeatedProxy<ChildWrapped> repeated_child;"),
+  EXPECT_NE(code.find("sugar::RepeatedTag<Access, 2, ChildWrapped> "
+                      "repeated_child;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::RepeatedTag<Access, 3, double> vals_double;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::RepeatedTag<Access, 24, std::string> r_str;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::RepeatedTag<Access, 25, int32_t> r_i32;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::RepeatedTag<Access, 26, int64_t> r_i64;"),
             string::npos);
-  EXPECT_NE(code.find("sugar::RepeatedProxy<double> vals_double;"),
+  EXPECT_NE(code.find("sugar::RepeatedTag<Access, 27, uint32_t> r_u32;"),
             string::npos);
-  EXPECT_NE(code.find("sugar::RepeatedProxy<std::string> r_str;"),
+  EXPECT_NE(code.find("sugar::RepeatedTag<Access, 28, uint64_t> r_u64;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::RepeatedTag<Access, 29, bool> r_bool;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::RepeatedTag<Access, 30, float> r_f;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::RepeatedTag<Access, 31, int> r_enum;"),
             string::npos);
-  EXPECT_NE(code.find("sugar::RepeatedProxy<int32_t> r_i32;"), string::npos);
-  EXPECT_NE(code.find("sugar::RepeatedProxy<int64_t> r_i64;"), string::npos);
-  EXPECT_NE(code.find("sugar::RepeatedProxy<uint32_t> r_u32;"), string::npos);
-  EXPECT_NE(code.find("sugar::RepeatedProxy<uint64_t> r_u64;"), string::npos);
-  EXPECT_NE(code.find("sugar::RepeatedProxy<bool> r_bool;"), string::npos);
-  EXPECT_NE(code.find("sugar::RepeatedProxy<float> r_f;"), string::npos);
-  EXPECT_NE(code.find("sugar::RepeatedProxy<int> r_enum;"), string::npos);
 }
 
 TEST_F(EmitHeader_UsingPackagedFile,
@@ -132,48 +215,558 @@ TEST_F(EmitHeader_UsingPackagedFile,
   ostringstream os;
   emit_header_for_file(fd, os);
   string code = os.str();
-  EXPECT_NE(code.find("ChildWrapped child;"), string::npos);
-  EXPECT_NE(code.find("sugar::FieldProxy<std::string> s;"), string::npos);
-  EXPECT_NE(code.find("sugar::FieldProxy<int32_t> i32;"), string::npos);
-  EXPECT_NE(code.find("sugar::FieldProxy<int64_t> i64;"), string::npos);
-  EXPECT_NE(code.find("sugar::FieldProxy<uint32_t> u32;"), string::npos);
-  EXPECT_NE(code.find("sugar::FieldProxy<uint64_t> u64;"), string::npos);
-  EXPECT_NE(code.find("sugar::FieldProxy<bool> b;"), string::npos);
-  EXPECT_NE(code.find("sugar::FieldProxy<float> f;"), string::npos);
-  EXPECT_NE(code.find("sugar::FieldProxy<double> d;"), string::npos);
-  EXPECT_NE(code.find("sugar::FieldProxy<int> e;"), string::npos);
-  EXPECT_NE(code.find("sugar::FieldProxy<int32_t> s_i32;"), string::npos);
-  EXPECT_NE(code.find("sugar::FieldProxy<int64_t> s_i64;"), string::npos);
-  EXPECT_NE(code.find("sugar::FieldProxy<uint32_t> s_u32;"), string::npos);
-  EXPECT_NE(code.find("sugar::FieldProxy<uint64_t> s_u64;"), string::npos);
-  EXPECT_NE(code.find("sugar::FieldProxy<bool> s_b;"), string::npos);
-  EXPECT_NE(code.find("sugar::FieldProxy<float> s_f;"), string::npos);
-  EXPECT_NE(code.find("sugar::FieldProxy<double> s_d;"), string::npos);
-  EXPECT_NE(code.find("sugar::FieldProxy<int> s_enum;"), string::npos);
+  EXPECT_NE(code.find("ChildFields<sugar::SubmessageAccess<Access, "
+                      "&Top::mutable_child, ChildFields, &Top::child>> child;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::FieldTag<Access, 5, std::string> s;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::FieldTag<Access, 6, int32_t> i32;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::FieldTag<Access, 7, int64_t> i64;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::FieldTag<Access, 8, uint32_t> u32;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::FieldTag<Access, 9, uint64_t> u64;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::FieldTag<Access, 10, bool> b;"), string::npos);
+  EXPECT_NE(code.find("sugar::FieldTag<Access, 11, float> f;"), string::npos);
+  EXPECT_NE(code.find("sugar::FieldTag<Access, 12, double> d;"), string::npos);
+  EXPECT_NE(code.find("sugar::FieldTag<Access, 13, int> e;"), string::npos);
+  EXPECT_NE(code.find("sugar::FieldTag<Access, 32, int32_t> s_i32;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::FieldTag<Access, 33, int64_t> s_i64;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::FieldTag<Access, 34, uint32_t> s_u32;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::FieldTag<Access, 35, uint64_t> s_u64;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::FieldTag<Access, 36, bool> s_b;"), string::npos);
+  EXPECT_NE(code.find("sugar::FieldTag<Access, 37, float> s_f;"), string::npos);
+  EXPECT_NE(code.find("sugar::FieldTag<Access, 38, double> s_d;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::FieldTag<Access, 39, int> s_enum;"),
+            string::npos);
 }
 
 TEST_F(EmitHeader_UsingPackagedFile, Oneof_And_CtorInit_AllPathsPresent) {
   ostringstream os;
   emit_header_for_file(fd, os);
   string code = os.str();
-  EXPECT_NE(code.find("sugar::OneofProxy choice;"), string::npos);
-  EXPECT_NE(
-      code.find("string_to_int32(_msg, "
-                "*_msg.GetDescriptor()->FindFieldByName(\"string_to_int32\"))"),
-      string::npos);
-  EXPECT_NE(
-      code.find("repeated_child(_msg, "
-                "*_msg.GetDescriptor()->FindFieldByName(\"repeated_child\"))"),
-      string::npos);
-  EXPECT_NE(code.find("child(*_msg.mutable_child())"), string::npos);
-  EXPECT_NE(code.find("s(_msg, *_msg.GetDescriptor()->FindFieldByName(\"s\"))"),
+  EXPECT_NE(code.find("sugar::OneofTag<Access, 0> choice;"), string::npos);
+  EXPECT_NE(code.find("explicit TopWrapped(Top& m) noexcept : _msg(&m) {}"),
+            string::npos);
+  EXPECT_NE(code.find("google::protobuf::internal::DownCast<Top*>(&m)"),
+            string::npos);
+  EXPECT_EQ(code.find("FindFieldByName"), string::npos);
+}
+
+TEST_F(EmitHeader_UsingPackagedFile, Layout_SinglePointerUnionOfTags) {
+  ostringstream os;
+  emit_header_for_file(fd, os);
+  string code = os.str();
+  EXPECT_NE(code.find("struct TopWrapped {\n"
+                      "    using Access = sugar::RootAccess<TopWrapped, Top>;\n"
+                      "    union {\n"
+                      "        Top* _msg;\n"),
+            string::npos);
+  EXPECT_NE(code.find("template <typename Access> union InnerFields {\n"
+                      "    DeeperFields<sugar::SubmessageAccess<Access, "
+                      "&Top_Inner::mutable_deep, DeeperFields, "
+                      "&Top_Inner::deep>> deep;"),
+            string::npos);
+  EXPECT_NE(code.find("    operator InnerWrapped() const {\n"
+                      "        return InnerWrapped(Access::message(this));"),
+            string::npos);
+  EXPECT_NE(code.find("    InnerFields(const InnerFields&) = default;\n"
+                      "    friend typename Access::parent::owner;"),
+            string::npos);
+  EXPECT_LT(code.find("union DeeperFields {"),
+            code.find("union InnerFields {"));
+  EXPECT_LT(code.find("union InnerFields {"), code.find("struct TopWrapped {"));
+}
+
+TEST_F(EmitHeader_UsingPackagedFile, Nested_UsesGeneratedClassName) {
+  ostringstream os;
+  emit_header_for_file(fd, os);
+  string code = os.str();
+  EXPECT_NE(code.find("Top_Inner_Deeper* _msg;"), string::npos);
+  EXPECT_NE(code.find("explicit NestedWrapped(Top_Nested& m)"), string::npos);
+  EXPECT_LT(code.find("struct DeeperWrapped {"),
+            code.find("struct InnerWrapped {"));
+  EXPECT_LT(code.find("struct InnerWrapped {"),
+            code.find("struct TopWrapped {"));
+}
+
+TEST_F(EmitHeader_UsingPackagedFile, Hash_DeclsDefsAndStdHash) {
+  ostringstream os;
+  emit_header_for_file(fd, os);
+  string code = os.str();
+  EXPECT_NE(code.find("static std::size_t hash_of(const Top& m) noexcept;"),
+            string::npos);
+  EXPECT_NE(code.find("friend bool operator==(const TopWrapped& a, const "
+                      "TopWrapped& b) noexcept"),
+            string::npos);
+  EXPECT_NE(code.find("friend H AbslHashValue(H h, const TopWrapped& w)"),
+            string::npos);
+  EXPECT_NE(code.find("inline std::size_t TopWrapped::hash_of(const Top& m)"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::hash_map(m.string_to_int32())"), string::npos);
+  EXPECT_NE(code.find("sugar::hash_map(m.u64_to_child(), "
+                      "sugar::MessageHash<ChildWrapped>{})"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::hash_range(m.repeated_child(), "
+                      "sugar::MessageHash<ChildWrapped>{})"),
+            string::npos);
+  EXPECT_NE(code.find("if (m.has_child())"), string::npos);
+  EXPECT_NE(code.find("if (m.has_o_s()) {"), string::npos);
+  EXPECT_NE(code.find("sugar::hash_combine(h, sugar::hash_scalar(m.i32()));"),
+            string::npos);
+  EXPECT_NE(code.find("!sugar::map_equal(a.u64_to_child(), b.u64_to_child(), "
+                      "sugar::MessageEqual<ChildWrapped>{})"),
+            string::npos);
+  EXPECT_NE(code.find("if (a.i32() != b.i32())"), string::npos);
+  EXPECT_NE(code.find("if (!sugar::scalar_equal(a.d(), b.d()))"),
+            string::npos);
+  EXPECT_NE(code.find("!sugar::range_equal(a.vals_double(), b.vals_double()))"),
+            string::npos);
+  EXPECT_NE(code.find("template <> struct std::hash<mypkg::TopWrapped> {"),
+            string::npos);
+  EXPECT_GT(code.find("template <> struct std::hash<mypkg::TopWrapped>"),
+            code.find("} // namespace mypkg"));
+}
+
+TEST_F(EmitHeader_UsingNoPackageFile, Hash_StdHashUnqualified) {
+  ostringstream os;
+  emit_header_for_file(fd, os);
+  string code = os.str();
+  EXPECT_NE(code.find("template <> struct std::hash<SoloWrapped> {"),
+            string::npos);
+}
+
+TEST_F(EmitHeader_UsingPackagedFile, Json_WriterUsesPrecomputedKeys) {
+  ostringstream os;
+  emit_header_for_file(fd, os, kAllFeatures);
+  string code = os.str();
+  EXPECT_NE(code.find("#include \"sugar_json.h\""), string::npos);
+  EXPECT_NE(code.find("static void write_json(const Top& m, "
+                      "sugar::json::Writer& w);"),
+            string::npos);
+  EXPECT_NE(code.find("w.key(\"\\\"stringToInt32\\\":\");"),
+            string::npos);
+  EXPECT_NE(code.find("w.map_key(kv.first);"), string::npos);
+  EXPECT_NE(code.find("ChildWrapped::write_json(kv.second, w);"),
+            string::npos);
+  EXPECT_NE(code.find("if (m.i32() != 0) {"), string::npos);
+  EXPECT_NE(code.find("if (m.d() != 0 || std::signbit(m.d())) {"),
+            string::npos);
+  EXPECT_NE(code.find("if (!m.s().empty()) {"), string::npos);
+  EXPECT_NE(code.find("if (m.has_o_s()) {"), string::npos);
+  EXPECT_NE(code.find("w.int64(m.i64());"), string::npos);
+  EXPECT_NE(code.find("w.enumeration(static_cast<int>(m.e()), "
+                      "::mypkg::MyEnum_Name(m.e()));"),
+            string::npos);
+}
+
+TEST_F(EmitHeader_UsingPackagedFile, Json_ReaderDispatchesByKeyLength) {
+  ostringstream os;
+  emit_header_for_file(fd, os, kAllFeatures);
+  string code = os.str();
+  EXPECT_NE(code.find("static void read_json(Top& m, sugar::json::Reader& r);"),
+            string::npos);
+  EXPECT_NE(code.find("switch (key.size()) {"), string::npos);
+  EXPECT_NE(code.find("if (key == \"stringToInt32\")"), string::npos);
+  EXPECT_NE(code.find("if (key == \"string_to_int32\")"),
+            string::npos);
+  EXPECT_NE(code.find("m.set_i32(r.int32());"), string::npos);
+  EXPECT_NE(code.find("m.set_e(r.enumeration(&::mypkg::MyEnum_Parse));"),
+            string::npos);
+  EXPECT_NE(code.find("r.string(*m.add_r_str());"), string::npos);
+  EXPECT_NE(code.find("r.map_key_at_last<uint64_t>(k)"),
+            string::npos);
+  EXPECT_NE(code.find("InnerWrapped::read_json(*m.mutable_inner(), r);"),
+            string::npos);
+  EXPECT_NE(code.find("m.clear_child();"), string::npos);
+  EXPECT_NE(code.find("r.unknown_field(key);"), string::npos);
+}
+
+TEST_F(EmitHeader_UsingPackagedFile, Split_OutputNames) {
+  EXPECT_EQ(forward_header_filename_for_file(fd), "test_messages.sugar.fwd.h");
+  EXPECT_EQ(source_filename_for_file(fd), "test_messages.sugar.cc");
+  EXPECT_EQ(header_filename_for_message(mypkg::Top_Inner::descriptor()),
+            "test_messages.Top_Inner.sugar.h");
+
+  vector<string> names;
+  for (const auto &out : split_outputs_for_file(fd))
+    names.push_back(out.filename);
+  ASSERT_GE(names.size(), 3u);
+  EXPECT_EQ(names.front(), "test_messages.sugar.fwd.h");
+  EXPECT_EQ(names.back(), "test_messages.sugar.cc");
+  EXPECT_NE(find(names.begin(), names.end(), "test_messages.Top.sugar.h"),
+            names.end());
+  EXPECT_NE(find(names.begin(), names.end(),
+                 "test_messages.Top_Inner_Deeper.sugar.h"),
+            names.end());
+}
+
+TEST_F(EmitHeader_UsingPackagedFile, Split_ForwardHeaderDeclaresOnly) {
+  ostringstream os;
+  emit_forward_header_for_file(fd, os, kAllFeatures);
+  string code = os.str();
+  EXPECT_NE(code.find("namespace mypkg {"), string::npos);
+  EXPECT_NE(code.find("class Top_Inner;"), string::npos);
+  EXPECT_NE(code.find("struct InnerWrapped;"), string::npos);
+  EXPECT_NE(code.find("class Writer;"), string::npos);
+  EXPECT_EQ(code.find("#include"), string::npos);
+}
+
+TEST_F(EmitHeader_UsingPackagedFile, Split_MessageHeaderDeclaresBodies) {
+  ostringstream os;
+  emit_message_header(mypkg::Top::descriptor(), os, kAllFeatures);
+  string code = os.str();
+  EXPECT_NE(code.find("#include \"test_messages.sugar.fwd.h\""),
+            string::npos);
+  EXPECT_NE(code.find("#include \"test_messages.Top_Inner.sugar.h\""),
+            string::npos);
+  EXPECT_EQ(code.find("#include \"sugar_json.h\""), string::npos);
+  EXPECT_NE(code.find("explicit TopWrapped(Top& m) noexcept : _msg(&m) {}"),
+            string::npos);
+  EXPECT_NE(code.find("template <typename Access> union TopFields {"),
+            string::npos);
+  EXPECT_EQ(code.find("FindFieldByName"), string::npos);
+  EXPECT_NE(code.find("[[nodiscard]] std::string to_json() const;"),
             string::npos);
+  EXPECT_NE(code.find("extern template class "
+                      "sugar::RepeatedProxy<::mypkg::ChildWrapped>;"),
+            string::npos);
+  EXPECT_NE(code.find("extern template class "
+                      "sugar::MapProxy<uint64_t, ::mypkg::ChildWrapped>;"),
+            string::npos);
+  EXPECT_NE(code.find("template <> struct std::hash<mypkg::TopWrapped>"),
+            string::npos);
+}
+
+TEST_F(EmitHeader_UsingPackagedFile, Split_SourceHoldsDefinitions) {
+  ostringstream os;
+  emit_source_for_file(fd, os, kAllFeatures);
+  string code = os.str();
+  EXPECT_NE(code.find("#include \"test_messages.Top.sugar.h\""),
+            string::npos);
+  EXPECT_NE(code.find("#include \"sugar_json.h\""), string::npos);
+  EXPECT_NE(code.find("\ntemplate class "
+                      "sugar::RepeatedProxy<::mypkg::ChildWrapped>;"),
+            string::npos);
+  EXPECT_EQ(code.find("TopWrapped::TopWrapped("), string::npos);
+  EXPECT_NE(code.find("std::size_t TopWrapped::hash_of(const Top& m)"),
+            string::npos);
+  EXPECT_NE(code.find("void TopWrapped::write_json(const Top& m"),
+            string::npos);
+  EXPECT_NE(code.find("void TopWrapped::from_json(std::string_view json"),
+            string::npos);
+  EXPECT_EQ(code.find("inline "), string::npos);
+}
+
+TEST_F(EmitHeader_UsingLiteFile, Lite_UsesLiteRuntimeAndFieldTable) {
+  ostringstream os;
+  emit_header_for_file(fd, os);
+  string code = os.str();
+  EXPECT_NE(code.find("#include \"sugar_lite.h\""), string::npos);
+  EXPECT_EQ(code.find("sugar_runtime.h"), string::npos);
   EXPECT_NE(
-      code.find(
-          "choice(_msg, *_msg.GetDescriptor()->FindOneofByName(\"choice\"))"),
+      code.find("static constexpr std::array<sugar::lite::FieldInfo, "),
       string::npos);
-  EXPECT_NE(code.find("google::protobuf::internal::DownCast<Top*>(&m)"),
+  EXPECT_NE(code.find("{\"i32\", "), string::npos);
+  EXPECT_NE(code.find("google::protobuf::MessageLite& m"), string::npos);
+  EXPECT_EQ(code.find("google::protobuf::Message& m"), string::npos);
+  EXPECT_EQ(code.find("FieldDescriptor"), string::npos);
+}
+
+TEST_F(EmitHeader_UsingLiteFile, Lite_TagsBindGeneratedAccessors) {
+  ostringstream os;
+  emit_header_for_file(fd, os);
+  string code = os.str();
+  EXPECT_NE(code.find("sugar::lite::FieldTag<Access, &Top::i32, "
+                      "&Top::set_i32> i32;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::lite::StringTag<Access, &Top::s, "
+                      "&Top::mutable_s> s;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::lite::MapTag<Access, "), string::npos);
+  EXPECT_NE(code.find("sugar::lite::OneofTag<Access, &Top::choice_case, "
+                      "&Top::clear_choice, TopWrapped> choice;"),
+            string::npos);
+  EXPECT_EQ(code.find("sugar::FieldTag<"), string::npos);
+}
+
+TEST_F(EmitHeader_UsingLiteFile, Lite_SplitSkipsInstantiations) {
+  for (const auto &out : split_outputs_for_file(fd)) {
+    ostringstream os;
+    out.emit(os);
+    EXPECT_EQ(os.str().find("template class sugar::"), string::npos)
+        << out.filename;
+  }
+}
+
+TEST_F(EmitHeader_UsingPackagedFile, ByName_TableAndThunks) {
+  ostringstream os;
+  emit_header_for_file(fd, os);
+  string code = os.str();
+  EXPECT_NE(code.find("static constexpr sugar::NameTable<Top, "),
+            string::npos);
+  EXPECT_NE(code.find("m.set_i32(v.as<int32_t>());"), string::npos);
+  EXPECT_NE(code.find("m.mutable_s()->assign(s.data(), s.size());"),
+            string::npos);
+  EXPECT_NE(code.find("{\"COLOR_BLUE\", 3}"), string::npos);
+  EXPECT_NE(code.find("m.set_e(static_cast<::mypkg::MyEnum>(n));"),
+            string::npos);
+  EXPECT_NE(code.find("&sugar::set_nested<Top, ChildWrapped, "
+                      "&Top::mutable_child>"),
+            string::npos);
+  EXPECT_NE(code.find("bool set_by_name(std::string_view path,"),
+            string::npos);
+  EXPECT_NE(code.find("get_by_name(std::string_view path) const"),
+            string::npos);
+  // Repeated and map fields have no entry.
+  const size_t table = code.find("sugar::NameTable<Top, ");
+  const string by_name =
+      code.substr(table, code.find("kWireFields", table) - table);
+  EXPECT_EQ(by_name.find("{\"r_str\", "), string::npos);
+  EXPECT_EQ(by_name.find("{\"m_str_i64\", "), string::npos);
+  EXPECT_NE(by_name.find("{\"i32\", "), string::npos);
+}
+
+TEST_F(EmitHeader_UsingPackagedFile, Swap_WrapperAndFieldsUnion) {
+  ostringstream os;
+  emit_header_for_file(fd, os);
+  string code = os.str();
+  EXPECT_NE(code.find("    void swap(ChildWrapped other) const {\n"
+                      "        _msg->Swap(other._msg);\n"),
+            string::npos);
+  EXPECT_NE(code.find("    void swap(ChildWrapped other) const {\n"
+                      "        Access::message(this).Swap(other._msg);\n"),
+            string::npos);
+}
+
+TEST_F(EmitHeader_UsingPackagedFile, WireView_FieldTableAndMessageTypes) {
+  ostringstream os;
+  emit_header_for_file(fd, os);
+  string code = os.str();
+  EXPECT_NE(code.find("static constexpr std::array<sugar::WireField, "),
+            string::npos);
+  EXPECT_NE(code.find("{\"i32\", 7, sugar::WireKind::kInt32},"),
+            string::npos);
+  EXPECT_NE(code.find("{\"r_str\", 30, sugar::WireKind::kString, "
+                      "sugar::WireField::kRepeated},"),
+            string::npos);
+  EXPECT_NE(code.find("{\"u64_to_child\", 2, sugar::WireKind::kMessage, "
+                      "sugar::WireField::kMap, sugar::WireKind::kUInt64, "
+                      "sugar::WireKind::kMessage},"),
+            string::npos);
+  EXPECT_NE(code.find("static ChildWrapped wire_message(sugar::WireNumber<2>);"),
+            string::npos);
+  EXPECT_NE(code.find("static ChildWrapped wire_message(sugar::WireNumber<5>);"),
             string::npos);
+  EXPECT_NE(code.find("static InnerWrapped wire_message(sugar::WireNumber<50>);"),
+            string::npos);
+  EXPECT_NE(code.find("{\"string_to_int32\", 1, sugar::WireKind::kMessage, "
+                      "sugar::WireField::kMap, sugar::WireKind::kString, "
+                      "sugar::WireKind::kInt32},"),
+            string::npos);
+  EXPECT_NE(code.find("{\"o_i32\", 16, sugar::WireKind::kInt32, "
+                      "sugar::WireField::kSingular, sugar::WireKind::kInt32, "
+                      "sugar::WireKind::kInt32, 1},"),
+            string::npos);
+}
+
+TEST_F(EmitHeader_UsingPackagedFile, Builder_FieldMembersByShape) {
+  ostringstream os;
+  emit_header_for_file(fd, os, kAllFeatures);
+  string code = os.str();
+  EXPECT_NE(code.find("#include \"sugar_builder.h\""), string::npos);
+  // Declared up front: Top's builder names ChildBuilder and InnerBuilder.
+  EXPECT_LT(code.find("struct ChildBuilder;"), code.find("struct TopBuilder {"));
+  EXPECT_NE(code.find("sugar::BuilderField<7, sugar::WireKind::kInt32> i32;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::BuilderField<16, sugar::WireKind::kInt32, "
+                      "sugar::Presence::kExplicit> o_i32;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::BuilderRepeated<31, sugar::WireKind::kInt32, "
+                      "true> r_i32;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::BuilderRepeated<30, sugar::WireKind::kString, "
+                      "false> r_str;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::BuilderMessage<5, ChildBuilder> child;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::BuilderRepeatedMessage<3, ChildBuilder> "
+                      "repeated_child;"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::BuilderMap<2, sugar::WireKind::kUInt64, "
+                      "sugar::WireKind::kMessage, ChildBuilder> u64_to_child;"),
+            string::npos);
+  EXPECT_NE(code.find("explicit TopBuilder(sugar::WireWriter& out) noexcept "
+                      ": _out(&out) {}"),
+            string::npos);
+}
+
+TEST_F(EmitHeader_UsingPackagedFile, FieldList_MetaPerFieldInOrder) {
+  ostringstream os;
+  emit_header_for_file(fd, os);
+  string code = os.str();
+  const size_t list = code.find("static constexpr std::tuple<\n"
+                                "        sugar::FieldMeta<&TopWrapped::");
+  ASSERT_NE(list, string::npos);
+  const string entries = code.substr(list, code.find("kFieldList{", list) - list);
+  EXPECT_NE(entries.find("sugar::FieldMeta<&TopWrapped::r_i32, "
+                         "sugar::getter(&Top::r_i32), 31, "
+                         "sugar::FieldKind::kInt32, "
+                         "sugar::Cardinality::kRepeated>"),
+            string::npos);
+  EXPECT_NE(entries.find("sugar::FieldMeta<&TopWrapped::child, "
+                         "sugar::getter(&Top::child), 5, "
+                         "sugar::FieldKind::kMessage, "
+                         "sugar::Cardinality::kSingular, ChildWrapped>"),
+            string::npos);
+  EXPECT_NE(entries.find("sugar::FieldMeta<&TopWrapped::u64_to_child, "
+                         "sugar::getter(&Top::u64_to_child), 2, "
+                         "sugar::FieldKind::kMessage, "
+                         "sugar::Cardinality::kMap, ChildWrapped>"),
+            string::npos);
+  EXPECT_LT(entries.find("TopWrapped::string_to_int32"),
+            entries.find("TopWrapped::inner"));
+  EXPECT_NE(code.find("kFieldList{{\"string_to_int32\"}, {\"u64_to_child\"}"),
+            string::npos);
+}
+
+TEST_F(EmitHeader_UsingPackagedFile, Mask_MergeMaskedPerField) {
+  ostringstream os;
+  emit_header_for_file(fd, os, kAllFeatures);
+  string code = os.str();
+  EXPECT_NE(code.find("#include \"sugar_mask.h\""), string::npos);
+  EXPECT_NE(code.find("static void merge_masked(const Top& src, Top& dst,"),
+            string::npos);
+  EXPECT_NE(code.find("inline void TopWrapped::merge_masked(const Top& src, "
+                      "Top& dst,"),
+            string::npos);
+  EXPECT_NE(code.find("mask.check(Top::descriptor());"), string::npos);
+  EXPECT_NE(code.find("ChildWrapped::merge_masked(src.child(), "
+                      "*dst.mutable_child(), *sub);"),
+            string::npos);
+  EXPECT_NE(code.find("for (const auto& kv : src.string_to_int32())"),
+            string::npos);
+  EXPECT_NE(code.find("dst.mutable_r_i32()->MergeFrom(src.r_i32());"),
+            string::npos);
+  EXPECT_NE(code.find("dst.clear_o_i32();"), string::npos);
+}
+
+TEST_F(EmitHeader_UsingPackagedFile, Plain_MembersConversionsAndWireIO) {
+  ostringstream os;
+  emit_header_for_file(fd, os, kAllFeatures);
+  string code = os.str();
+  EXPECT_NE(code.find("#include \"sugar_plain.h\""), string::npos);
+  EXPECT_LT(code.find("struct ChildPlain;"), code.find("struct TopPlain {"));
+  const size_t top = code.find("struct TopPlain {");
+  ASSERT_NE(top, string::npos);
+  const string body = code.substr(top, code.find("\n};\n", top) - top);
+  EXPECT_NE(body.find("std::map<uint64_t, ChildPlain> u64_to_child;"),
+            string::npos);
+  EXPECT_NE(body.find("std::vector<ChildPlain> repeated_child;"), string::npos);
+  EXPECT_NE(body.find("std::optional<ChildPlain> child;"), string::npos);
+  EXPECT_NE(body.find("int32_t i32{};"), string::npos);
+  EXPECT_NE(body.find("int e{};"), string::npos);
+  EXPECT_NE(body.find("std::variant<std::monostate, std::string, int32_t> "
+                      "choice;"),
+            string::npos);
+  EXPECT_NE(body.find("static constexpr std::size_t kOI32 = 2;"),
+            string::npos);
+  EXPECT_NE(body.find("bool operator==(const TopPlain&) const = default;"),
+            string::npos);
+
+  EXPECT_NE(code.find("inline TopPlain TopPlain::from_proto(const Top& m) {"),
+            string::npos);
+  EXPECT_NE(code.find("m.set_e(static_cast<::mypkg::MyEnum>(e));"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::plain::write_repeated<31, "
+                      "sugar::WireKind::kInt32, true>(out, r_i32);"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::plain::size_oneof<16, sugar::WireKind::kInt32, "
+                      "kOI32>(choice);"),
+            string::npos);
+  EXPECT_NE(code.find("sugar::plain::read_map<sugar::WireKind::kUInt64, "
+                      "sugar::WireKind::kMessage>(t, u64_to_child);"),
+            string::npos);
+  // Written in field number order.
+  EXPECT_LT(code.find("sugar::plain::write<6, sugar::WireKind::kString>"),
+            code.find("sugar::plain::write<7, sugar::WireKind::kInt32>"));
+}
+
+TEST(EmitHeader_Schemas, RecursiveMessagesAreDiagnosed) {
+  EXPECT_EQ(unsupported_field(mypkg::Top::descriptor()->file()), "");
+
+  // Node contains itself; A reaches itself through B's map values, which
+  // is fine, and then through a oneof member of B, which is not.
+  FileDescriptorProto proto;
+  proto.set_name("rec.proto");
+  proto.set_package("rec");
+  proto.set_syntax("proto3");
+  auto add_field = [](DescriptorProto *m, const string &name, int number,
+                      const string &type, bool repeated = false) {
+    auto *f = m->add_field();
+    f->set_name(name);
+    f->set_number(number);
+    f->set_type(FieldDescriptorProto::TYPE_MESSAGE);
+    f->set_type_name(type);
+    f->set_label(repeated ? FieldDescriptorProto::LABEL_REPEATED
+                          : FieldDescriptorProto::LABEL_OPTIONAL);
+  };
+  auto *node = proto.add_message_type();
+  node->set_name("Node");
+  add_field(node, "child", 1, ".rec.Node");
+  DescriptorPool pool;
+  const FileDescriptor *file = pool.BuildFile(proto);
+  ASSERT_NE(file, nullptr);
+  EXPECT_EQ(unsupported_field(file),
+            "rec.Node.child: recursive message fields are not supported");
+
+  proto.clear_message_type();
+  proto.set_name("mutual.proto");
+  auto *a = proto.add_message_type();
+  a->set_name("A");
+  add_field(a, "b", 1, ".rec.B");
+  auto *b = proto.add_message_type();
+  b->set_name("B");
+  auto *entry = b->add_nested_type();
+  entry->set_name("ByNameEntry");
+  entry->mutable_options()->set_map_entry(true);
+  auto *key = entry->add_field();
+  key->set_name("key");
+  key->set_number(1);
+  key->set_type(FieldDescriptorProto::TYPE_STRING);
+  key->set_label(FieldDescriptorProto::LABEL_OPTIONAL);
+  add_field(entry, "value", 2, ".rec.A");
+  add_field(b, "by_name", 1, ".rec.B.ByNameEntry", true);
+  add_field(a, "bs", 2, ".rec.B", true);
+  file = pool.BuildFile(proto);
+  ASSERT_NE(file, nullptr);
+  EXPECT_EQ(unsupported_field(file), "");
+
+  proto.set_name("oneof.proto");
+  b = proto.mutable_message_type(1);
+  b->add_oneof_decl()->set_name("pick");
+  add_field(b, "a", 2, ".rec.A");
+  b->mutable_field(1)->set_oneof_index(0);
+  DescriptorPool oneof_pool;
+  file = oneof_pool.BuildFile(proto);
+  ASSERT_NE(file, nullptr);
+  EXPECT_EQ(unsupported_field(file),
+            "rec.A.b: recursive message fields are not supported");
+}
+
+TEST_F(EmitHeader_UsingLiteFile, Lite_NoMaskedCopies) {
+  ostringstream os;
+  emit_header_for_file(fd, os, kAllFeatures);
+  string code = os.str();
+  EXPECT_EQ(code.find("sugar_mask.h"), string::npos);
+  EXPECT_EQ(code.find("merge_masked"), string::npos);
 }
 
 TEST(DefaultBranchCoverage, FakeMapKeyType_Default) {
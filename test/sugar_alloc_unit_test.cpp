@@ -0,0 +1,215 @@
+#include "alloc_counter.h"
+#include "sugar_intern.h"
+#include "sugar_runtime.h"
+#include "test_messages.pb.h"
+#include "test_messages_sugar.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+using namespace sugar;
+using sugar::testing::allocations_in;
+using sugar::testing::AllocationScope;
+
+namespace {
+using Top = mypkg::Top;
+using Msg = google::protobuf::Message;
+using FD = google::protobuf::FieldDescriptor;
+using mypkg::TopWrapped;
+
+// Longer than any small-string buffer, so copies of it allocate.
+const string kLong(64, 'x');
+
+Top populated() {
+  Top m;
+  m.set_s(kLong);
+  m.set_i32(7);
+  for (int i = 0; i < 8; ++i) {
+    m.add_vals_double(i * 0.5);
+    m.add_r_i32(i);
+    m.add_r_str(kLong + to_string(i));
+  }
+  m.set_o_i32(3);
+  return m;
+}
+
+// Allocations of fn once descriptors, field caches and per-thread buffers
+// have been set up by a first call.
+template <typename Fn> uint64_t steady_allocations(Fn &&fn) {
+  fn();
+  return allocations_in(fn);
+}
+} // namespace
+
+TEST(AllocCounter_Scope, CountsOperatorNewPerScope) {
+  const AllocationScope outer;
+  {
+    const AllocationScope inner;
+    auto p = make_unique<int>(1);
+    vector<char> v(100);
+    EXPECT_EQ(inner.allocations(), 2u);
+    EXPECT_GE(inner.stats().bytes, 100u + sizeof(int));
+  }
+  EXPECT_EQ(outer.stats().allocations, 2u);
+  EXPECT_EQ(outer.stats().deallocations, 2u);
+  EXPECT_EQ(allocations_in([] { auto p = make_unique<int[]>(4); }), 1u);
+  EXPECT_EQ(allocations_in([] {}), 0u);
+}
+
+TEST(AllocCounter_Fields, ScalarsDoNotAllocate) {
+  Top m = populated();
+  TopWrapped w(m);
+  int32_t sum = 0;
+  EXPECT_EQ(steady_allocations([&] { sum += w.i32; }), 0u);
+  EXPECT_EQ(steady_allocations([&] { sum += w.i32.get(); }), 0u);
+  EXPECT_EQ(steady_allocations([&] { w.i32 = sum; }), 0u);
+  EXPECT_EQ(steady_allocations([&] { w.i32 = w.i32 + 1; }), 0u);
+  EXPECT_EQ(steady_allocations([&] { sum += w.i32.proxy(); }), 0u);
+}
+
+TEST(AllocCounter_Fields, StringsAllocateOnlyForCopies) {
+  Top m = populated();
+  TopWrapped w(m);
+  size_t n = 0;
+  EXPECT_EQ(steady_allocations([&] {
+              n += static_cast<string_view>(w.s).size();
+            }),
+            0u);
+  EXPECT_EQ(steady_allocations([&] { n += string_view(w.s) == kLong; }), 0u);
+  // get() returns a copy.
+  EXPECT_EQ(steady_allocations([&] { n += w.s.get().size(); }), 1u);
+  // Reflection's SetString takes its value as a std::string, built once.
+  EXPECT_EQ(steady_allocations([&] { w.s = string_view(kLong); }), 1u);
+}
+
+TEST(AllocCounter_Fields, UnsetSubmessageReadsDoNotCreateIt) {
+  Top m;
+  TopWrapped w(m);
+  size_t n = 0;
+  EXPECT_EQ(steady_allocations([&] {
+              n += static_cast<string_view>(w.child.child_str).size();
+            }),
+            0u);
+  EXPECT_EQ(steady_allocations([&] { n += w.inner.deep.x; }), 0u);
+  EXPECT_FALSE(m.has_child());
+  EXPECT_FALSE(m.has_inner());
+
+  // Writes create the submessage, once.
+  EXPECT_EQ(allocations_in([&] { w.inner.deep.x = 5; }), 2u);
+  EXPECT_EQ(steady_allocations([&] { w.inner.deep.x = 6; }), 0u);
+  EXPECT_EQ(m.inner().deep().x(), 6);
+}
+
+TEST(AllocCounter_Repeated, ReadsDoNotAllocate) {
+  Top m = populated();
+  TopWrapped w(m);
+  double sum = 0;
+  EXPECT_EQ(steady_allocations([&] {
+              sum += w.vals_double.size() + w.vals_double.empty();
+            }),
+            0u);
+  EXPECT_EQ(steady_allocations([&] {
+              sum += w.vals_double[2] + w.vals_double.front() +
+                     w.vals_double.back();
+            }),
+            0u);
+  EXPECT_EQ(steady_allocations([&] {
+              for (double v : w.vals_double)
+                sum += v;
+              for (int32_t v : w.r_i32)
+                sum += v;
+            }),
+            0u);
+  // String elements compare in place, without copies.
+  EXPECT_EQ(steady_allocations([&] {
+              for (const auto &v : w.r_str)
+                sum += v == kLong;
+              sum += *w.r_str.begin() < *(w.r_str.end() - 1);
+            }),
+            0u);
+  EXPECT_EQ(steady_allocations([&] { sum += w.r_str[0].size(); }), 1u);
+
+  // Appends into reserved capacity do not allocate.
+  m.mutable_r_i32()->Reserve(1 << 16);
+  EXPECT_EQ(allocations_in([&] {
+              for (int i = 0; i < 1000; ++i)
+                w.r_i32.push_back(i);
+            }),
+            0u);
+}
+
+TEST(AllocCounter_Oneof, AccessDoesNotAllocate) {
+  Top m = populated();
+  TopWrapped w(m);
+  const FD *active = nullptr;
+  EXPECT_EQ(steady_allocations([&] { active = w.choice.active_field(); }), 0u);
+  EXPECT_EQ(active->name(), "o_i32");
+  // set() looks the member up through find_field, whose per-thread key
+  // buffer (FindFieldByName takes a std::string) allocates until it has
+  // grown to the longest name asked for; warm it with this test's names.
+  for (string_view name : {"o_s", "o_i32"})
+    ASSERT_NE(detail::find_field(Top::descriptor(), name), nullptr);
+  EXPECT_EQ(allocations_in([&] {
+              w.choice.set("o_i32", [](Msg &msg, const FD &f) {
+                msg.GetReflection()->SetInt32(&msg, &f, 4);
+              });
+            }),
+            0u);
+  EXPECT_EQ(m.o_i32(), 4);
+}
+
+
+TEST(AllocCounter_Map, AllocatesOnlyToInsert) {
+  Top m;
+  TopWrapped w(m);
+  w.string_to_int32.set("warm", 0); // descriptors, entry type and reflection
+  int sum = 0;
+
+  // MapProxy::set() adds an entry message through reflection: it and its
+  // key string are allocated, plus now and then a larger entry array.
+  for (int i = 0; i < 8; ++i) {
+    const uint64_t n =
+        allocations_in([&] { w.string_to_int32.set(to_string(i), i); });
+    EXPECT_GE(n, 2u) << i;
+    EXPECT_LE(n, 3u) << i;
+  }
+  EXPECT_EQ(allocations_in([&] { w.string_to_int32.set(kLong, 9); }) -
+                allocations_in([&] { w.string_to_int32.set("k", 9); }),
+            1u); // the key's buffer
+
+  // Lookups and walks read in place once the map is built from the
+  // entries written above.
+  EXPECT_EQ(steady_allocations([&] {
+              sum += w.string_to_int32.proxy().size();
+              sum += m.string_to_int32().at(kLong);
+              sum += m.string_to_int32().count("missing");
+            }),
+            0u);
+  EXPECT_EQ(steady_allocations([&] {
+              for (const auto &[key, value] : m.string_to_int32())
+                sum += value + static_cast<int>(key.size());
+            }),
+            0u);
+  StringPool pool;
+  vector<StringPool::Code> codes;
+  codes.reserve(64);
+  EXPECT_EQ(steady_allocations([&] {
+              codes.clear();
+              w.string_to_int32.intern_keys(pool, codes);
+            }),
+            0u);
+  EXPECT_EQ(codes.size(), 11u);
+
+  // Erasing frees and never allocates.
+  EXPECT_EQ(allocations_in([&] {
+              sum += static_cast<int>(m.mutable_string_to_int32()->erase(kLong));
+            }),
+            0u);
+  EXPECT_EQ(m.string_to_int32().count(kLong), 0u);
+}
@@ -0,0 +1,164 @@
+#include "sugar_async.h"
+#include "sugar_runtime.h"
+#include "test_messages.pb.h"
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+using namespace sugar;
+
+namespace {
+using Top = mypkg::Top;
+
+struct TopAsync {
+  using Access = RootAccess<TopAsync, Top>;
+  union {
+    Top *_msg;
+    FieldTag<Access, 5, string> s;
+    FieldTag<Access, 6, int32_t> i32;
+  };
+
+  explicit TopAsync(Top &m) noexcept : _msg(&m) {}
+};
+
+// Mixes records smaller and larger than the 64 byte blocks used below.
+Top record(int i) {
+  Top m;
+  m.set_i32(i);
+  m.set_s(string(static_cast<size_t>(i % 7 == 0 ? 300 : i % 13), 'a' + i % 26));
+  return m;
+}
+
+vector<unique_ptr<IoBackend>> backends() {
+  vector<unique_ptr<IoBackend>> out;
+  out.push_back(make_unique<ThreadIoBackend>());
+#if SUGAR_HAS_IO_URING
+  if (auto uring = IoUringBackend::create())
+    out.push_back(std::move(uring));
+#endif
+  return out;
+}
+
+Task<void> write_records(int fd, int n, AsyncIoOptions opts) {
+  AsyncRecordWriter writer(fd, opts);
+  for (int i = 0; i < n; ++i) {
+    Top m = record(i);
+    co_await writer.write(TopAsync(m));
+  }
+  co_await writer.flush();
+}
+
+Task<int> add(int a, int b) { co_return a + b; }
+
+Task<int> add_twice(int a) {
+  const int x = co_await add(a, a);
+  co_return co_await add(x, 1);
+}
+
+Task<void> fail() {
+  co_await add(1, 2);
+  throw runtime_error("boom");
+}
+} // namespace
+
+TEST(Task, ReturnsValuesAndPropagatesExceptions) {
+  EXPECT_EQ(sync_wait(add_twice(20)), 41);
+  EXPECT_THROW(sync_wait(fail()), runtime_error);
+}
+
+TEST(AsyncRecords, RoundTripsAcrossBlocksOnEveryBackend) {
+  for (auto &io : backends()) {
+    SCOPED_TRACE(string(io->name()));
+    FILE *f = tmpfile();
+    ASSERT_NE(f, nullptr);
+    const AsyncIoOptions opts{64, io.get()};
+    sync_wait(write_records(fileno(f), 500, opts));
+    ASSERT_EQ(lseek(fileno(f), 0, SEEK_SET), 0);
+
+    int i = 0;
+    for (TopAsync t : async_records<TopAsync>(fileno(f), opts)) {
+      ASSERT_EQ(t.i32.get(), i);
+      EXPECT_EQ(t._msg->s(), record(i).s());
+      ++i;
+    }
+    EXPECT_EQ(i, 500);
+    fclose(f);
+  }
+}
+
+TEST(AsyncRecords, ReadsPipesAndRejectsTruncatedInput) {
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+  string data;
+  for (int i = 0; i < 200; ++i) {
+    Top m = record(i);
+    string frame(framed_size(m), '\0');
+    serialize_framed(m, as_writable_bytes(span(frame)));
+    data += frame;
+  }
+  data.pop_back();
+  thread producer([&] {
+    // Dribble the bytes so reads come back short.
+    for (size_t pos = 0; pos < data.size(); pos += 37)
+      ASSERT_GT(write(fds[1], data.data() + pos, min<size_t>(37, data.size() - pos)), 0);
+    close(fds[1]);
+  });
+
+  int seen = 0;
+  EXPECT_THROW(
+      {
+        for (TopAsync t : async_records<TopAsync>(fds[0], {4096, nullptr}))
+          EXPECT_EQ(t.i32.get(), seen++);
+      },
+      runtime_error);
+  EXPECT_EQ(seen, 199);
+  producer.join();
+  close(fds[0]);
+}
+
+TEST(AsyncRecords, StoppingEarlyCancelsAReadOnAnIdlePipe) {
+  for (auto &io : backends()) {
+    SCOPED_TRACE(string(io->name()));
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    string data;
+    for (int i = 0; i < 3; ++i) {
+      Top m = record(i);
+      string frame(framed_size(m), '\0');
+      serialize_framed(m, as_writable_bytes(span(frame)));
+      data += frame;
+    }
+    ASSERT_EQ(write(fds[1], data.data(), data.size()),
+              static_cast<ssize_t>(data.size()));
+
+    // The write end stays open, so the read ahead of the first record
+    // never completes on its own; leaving the loop must not wait for it.
+    int seen = 0;
+    for (TopAsync t : async_records<TopAsync>(fds[0], {4096, io.get()})) {
+      EXPECT_EQ(t.i32.get(), seen++);
+      break;
+    }
+    EXPECT_EQ(seen, 1);
+
+    // The backend keeps working afterwards.
+    IoOp op;
+    char c = 0;
+    op.prepare(IoOp::Kind::kRead, fds[0], &c, 1);
+    io->submit(op);
+    ASSERT_EQ(write(fds[1], "x", 1), 1);
+    EXPECT_EQ(op.wait(), 1);
+    EXPECT_EQ(c, 'x');
+    close(fds[0]);
+    close(fds[1]);
+  }
+}
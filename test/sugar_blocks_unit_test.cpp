@@ -0,0 +1,158 @@
+#include "sugar_blocks.h"
+#include "sugar_runtime.h"
+#include "test_messages.pb.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+using namespace sugar;
+
+namespace {
+using Top = mypkg::Top;
+
+struct TopBlocks {
+  using Access = RootAccess<TopBlocks, Top>;
+  union {
+    Top *_msg;
+    FieldTag<Access, 6, int32_t> i32;
+  };
+
+  explicit TopBlocks(Top &m) noexcept : _msg(&m) {}
+};
+
+Top record(int i) {
+  Top m;
+  m.set_i32(i);
+  m.set_s(i % 3 ? "a string shared by many records" : "unique-" + to_string(i));
+  m.add_r_str("category-" + to_string(i % 4));
+  m.add_r_i32(i);
+  (*m.mutable_m_i32_str())[i % 2] = "map value shared as well";
+  m.mutable_child()->set_child_str("shared child payload");
+  return m;
+}
+
+vector<byte> archive(int n, BlockWriterOptions opts) {
+  vector<byte> out;
+  BlockWriter writer(
+      [&](span<const byte> block) { out.insert(out.end(), block.begin(), block.end()); },
+      opts);
+  for (int i = 0; i < n; ++i) {
+    Top m = record(i);
+    writer.write(TopBlocks(m));
+  }
+  writer.flush();
+  return out;
+}
+
+// Offsets of the block headers of a well-formed archive.
+vector<size_t> block_offsets(const vector<byte> &file) {
+  vector<size_t> offsets;
+  for (size_t pos = 0; pos < file.size();
+       pos += detail::kBlockHeaderSize + detail::load_u32le(&file[pos + 4]))
+    offsets.push_back(pos);
+  return offsets;
+}
+} // namespace
+
+TEST(Crc32c, MatchesReferenceAndPortableFallback) {
+  const string check = "123456789";
+  EXPECT_EQ(crc32c(as_bytes(span(check))), 0xe3069283u);
+
+  vector<byte> data(1000);
+  mt19937 rng(7);
+  for (auto &b : data)
+    b = static_cast<byte>(rng());
+  for (size_t off : {0, 1, 3}) {
+    const auto part = span(data).subspan(off, 997 - off);
+    EXPECT_EQ(crc32c(part), detail::crc32c_portable(0, part.data(), part.size()));
+    // Continuing from a prefix gives the CRC of the whole.
+    EXPECT_EQ(crc32c(part.subspan(100), crc32c(part.first(100))), crc32c(part));
+  }
+}
+
+TEST(BlockArchive, RoundTripsWithDictionaryAndInParallel) {
+  BlockWriterOptions opts;
+  opts.block_size = 2048;
+  const auto compact = archive(1000, opts);
+  opts.dictionary = false;
+  const auto plain = archive(1000, opts);
+  EXPECT_LT(compact.size(), plain.size() * 3 / 4);
+  EXPECT_GT(block_offsets(compact).size(), 10u);
+
+  for (const auto *file : {&compact, &plain}) {
+    int i = 0;
+    const auto stats = BlockReader(*file).for_each<TopBlocks>([&](TopBlocks t) {
+      EXPECT_EQ(t._msg->SerializeAsString(), record(i).SerializeAsString());
+      ++i;
+    });
+    EXPECT_EQ(i, 1000);
+    EXPECT_EQ(stats.records, 1000u);
+    EXPECT_EQ(stats.corrupt_blocks, 0u);
+  }
+
+  mutex mu;
+  vector<int> seen;
+  const auto stats = BlockReader(compact).parallel_for_each<TopBlocks>(
+      [&](TopBlocks t) {
+        EXPECT_EQ(t._msg->s(), record(t.i32.get()).s());
+        lock_guard lock(mu);
+        seen.push_back(t.i32.get());
+      },
+      4);
+  EXPECT_EQ(stats.records, 1000u);
+  sort(seen.begin(), seen.end());
+  for (int i = 0; i < 1000; ++i)
+    ASSERT_EQ(seen[static_cast<size_t>(i)], i);
+
+  EXPECT_THROW(BlockReader(compact).parallel_for_each<TopBlocks>(
+                   [](TopBlocks t) {
+                     if (t.i32.get() == 500)
+                       throw runtime_error("stop");
+                   },
+                   3),
+               runtime_error);
+}
+
+TEST(BlockArchive, SkipsCorruptBlocksAndKeepsScanning) {
+  BlockWriterOptions opts;
+  opts.block_size = 1024;
+  auto file = archive(300, opts);
+  const auto offsets = block_offsets(file);
+  ASSERT_GE(offsets.size(), 6u);
+
+  auto count_in = [&](size_t block) {
+    const vector<byte> one(file.begin() + offsets[block],
+                           file.begin() + offsets[block + 1]);
+    return BlockReader(one).for_each<TopBlocks>([](TopBlocks) {}).records;
+  };
+  const size_t lost = count_in(1) + count_in(3);
+
+  // A flipped payload byte fails the checksum; a damaged header forces a
+  // scan for the next one; trailing garbage is skipped.
+  file[offsets[1] + detail::kBlockHeaderSize + 5] ^= byte{0x40};
+  file[offsets[3] + 4] ^= byte{0x01};
+  file.insert(file.end(), {byte{1}, byte{2}, byte{3}});
+
+  size_t delivered = 0;
+  const auto stats =
+      BlockReader(file).for_each<TopBlocks>([&](TopBlocks) { ++delivered; });
+  EXPECT_EQ(stats.corrupt_blocks, 3u);
+  EXPECT_EQ(stats.records, 300 - lost);
+  EXPECT_EQ(delivered, stats.records);
+  EXPECT_EQ(stats.blocks, offsets.size() - 2);
+  EXPECT_GE(stats.skipped_bytes, 3u);
+
+  const auto parallel =
+      BlockReader(file).parallel_for_each<TopBlocks>([](TopBlocks) {}, 2);
+  EXPECT_EQ(parallel.records, stats.records);
+  EXPECT_EQ(parallel.corrupt_blocks, 3u);
+}
@@ -0,0 +1,194 @@
+#include "sugar_builder.h"
+#include "sugar_io.h"
+#include "test_messages.pb.h"
+#include "test_messages_sugar.h"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+using namespace sugar;
+
+namespace {
+using Top = mypkg::Top;
+using mypkg::ChildBuilder;
+using mypkg::DeeperBuilder;
+using mypkg::InnerBuilder;
+using mypkg::TopBuilder;
+
+string as_string(span<const byte> bytes) {
+  return string(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+}
+} // namespace
+
+TEST(Builder_Output, MatchesSerializeToStringInFieldOrder) {
+  Top m;
+  (*m.mutable_string_to_int32())["k"] = 0;
+  (*m.mutable_u64_to_child())[7].set_child_str("seven");
+  m.add_repeated_child()->set_child_str("x");
+  m.add_repeated_child();
+  m.add_vals_double(0.5);
+  m.add_vals_double(-1e300);
+  m.mutable_child()->set_child_str("c");
+  m.set_s("hello");
+  m.set_i32(-7);
+  m.set_i64(int64_t{1} << 40);
+  m.set_u32(300);
+  m.set_u64(~uint64_t{0});
+  m.set_b(true);
+  m.set_f(1.5f);
+  m.set_d(-2.25);
+  m.set_e(mypkg::COLOR_BLUE);
+  m.set_o_i32(0);
+  m.add_r_str("a");
+  m.add_r_str("");
+  for (int32_t v : {-1, 0, 127, 128, 1 << 30})
+    m.add_r_i32(v);
+  m.add_r_u64(uint64_t{1} << 63);
+  m.add_r_bool(true);
+  m.add_r_bool(false);
+  m.add_r_f(-0.0f);
+  m.add_r_enum(mypkg::ONE);
+  m.add_r_enum(static_cast<mypkg::MyEnum>(-3));
+  m.mutable_inner()->mutable_deep()->set_x(9);
+  const string expected = m.SerializeAsString();
+
+  array<byte, 512> buf;
+  const vector<string> strs{"a", ""};
+  const size_t n = build<TopBuilder>(buf, [&](TopBuilder t) {
+    t.string_to_int32.add("k", 0);
+    t.u64_to_child.add(7, [](ChildBuilder c) { c.child_str = "seven"; });
+    t.repeated_child.add([](ChildBuilder c) { c.child_str = "x"; });
+    t.repeated_child.add(mypkg::Child());
+    t.vals_double = {0.5, -1e300};
+    t.child([](ChildBuilder c) { c.child_str = "c"; });
+    t.s = "hello";
+    t.i32 = -7;
+    t.i64 = int64_t{1} << 40;
+    t.u32 = 300u;
+    t.u64 = ~uint64_t{0};
+    t.b = true;
+    t.f = 1.5f;
+    t.d = -2.25;
+    t.e = mypkg::COLOR_BLUE;
+    t.o_i32 = 0; // oneof members are written even when zero
+    t.r_str = strs;
+    t.r_i32 = {-1, 0, 127, 128, 1 << 30};
+    t.r_u64 = {uint64_t{1} << 63};
+    t.r_bool = {true, false};
+    t.r_f = {-0.0f};
+    t.r_enum = {1, -3};
+    t.inner([](InnerBuilder i) { i.deep([](DeeperBuilder d) { d.x = 9; }); });
+  });
+  EXPECT_EQ(as_string(span(buf).first(n)), expected);
+}
+
+TEST(Builder_Output, SkipsDefaultsAndGrowsLongSubmessageLengths) {
+  array<byte, 16> small;
+  EXPECT_EQ(build<TopBuilder>(small, [](TopBuilder t) {
+              t.i32 = 0;
+              t.s = "";
+              t.f = 0.0f;
+              t.r_i32 = vector<int32_t>();
+            }),
+            0u);
+
+  // Lengths of one, two and three bytes, nested, with unpacked input too.
+  vector<byte> buf(1 << 17);
+  const string mid(200, 'm'), big(40000, 'b');
+  const size_t n = build<TopBuilder>(buf, [&](TopBuilder t) {
+    t.repeated_child.add([&](ChildBuilder c) { c.child_str = mid; });
+    t.u64_to_child.add(1, [&](ChildBuilder c) { c.child_str = big; });
+    t.child([&](ChildBuilder c) { c.child_str = mid + big; });
+    t.r_str = vector<string>{mid, big};
+  });
+  Top m;
+  ASSERT_TRUE(m.ParseFromArray(buf.data(), static_cast<int>(n)));
+  EXPECT_EQ(m.repeated_child(0).child_str(), mid);
+  EXPECT_EQ(m.u64_to_child().at(1).child_str(), big);
+  EXPECT_EQ(m.child().child_str(), mid + big);
+  EXPECT_EQ(m.r_str_size(), 2);
+  EXPECT_EQ(n, m.ByteSizeLong());
+
+  // Framed output round-trips through parse_framed.
+  const size_t framed = build_framed<TopBuilder>(buf, [&](TopBuilder t) {
+    t.child([&](ChildBuilder c) { c.child_str = big; });
+    t.i32 = 5;
+  });
+  Top back;
+  EXPECT_EQ(parse_framed(span<const byte>(buf).first(framed), back), framed);
+  EXPECT_EQ(back.child().child_str(), big);
+  EXPECT_EQ(back.i32(), 5);
+}
+
+TEST(Builder_Output, EdgeValuesMatchProtobuf) {
+  // -0.0 and NaN are not defaults; empty keys, NULs and negative enums
+  // are written as they are; a map entry of defaults still has its tags.
+  Top m;
+  m.set_d(-0.0);
+  m.set_f(numeric_limits<float>::quiet_NaN());
+  m.set_s(string("a\0b", 3));
+  m.set_e(static_cast<mypkg::MyEnum>(-1));
+  m.set_i64(numeric_limits<int64_t>::min());
+  (*m.mutable_string_to_int32())[""] = 0;
+  (*m.mutable_m_bool_u64())[false] = 0;
+  const string expected = m.SerializeAsString();
+
+  array<byte, 128> buf;
+  const size_t n = build<TopBuilder>(buf, [](TopBuilder t) {
+    t.string_to_int32.add("", 0);
+    t.s = string_view("a\0b", 3);
+    t.i64 = numeric_limits<int64_t>::min();
+    t.f = numeric_limits<float>::quiet_NaN();
+    t.d = -0.0;
+    t.e = -1;
+    t.m_bool_u64.add(false, 0u);
+  });
+  EXPECT_EQ(as_string(span(buf).first(n)), expected);
+
+  // Both members of a oneof are written; the parser keeps the last.
+  const size_t both = build<TopBuilder>(buf, [](TopBuilder t) {
+    t.o_s = "first";
+    t.o_i32 = 2;
+  });
+  Top parsed;
+  ASSERT_TRUE(parsed.ParseFromArray(buf.data(), static_cast<int>(both)));
+  EXPECT_EQ(parsed.choice_case(), Top::kOI32);
+  EXPECT_EQ(parsed.o_i32(), 2);
+}
+
+TEST(Builder_Capacity, ThrowsWhenTheBufferIsFull) {
+  const string mid(200, 'm');
+  const auto fill = [&](TopBuilder t) {
+    t.repeated_child.add([&](ChildBuilder c) { c.child_str = mid; });
+    t.vals_double = {1.0, 2.0};
+    t.s = "hello";
+    t.i64 = -1;
+    t.r_i32 = {1, 300, 70000};
+  };
+  vector<byte> buf(512);
+  const size_t n = build<TopBuilder>(buf, fill);
+  for (size_t size = 0; size < n; ++size)
+    EXPECT_THROW((void)build<TopBuilder>(span(buf).first(size), fill),
+                 length_error)
+        << size;
+  EXPECT_EQ(build<TopBuilder>(span(buf).first(n), fill), n);
+
+  // The writer can be driven without a builder.
+  WireWriter w(buf);
+  w.scalar<7, WireKind::kInt32>(3);
+  w.packed<31, WireKind::kInt32>(vector<int32_t>{1, 2});
+  Top m;
+  ASSERT_TRUE(m.ParseFromArray(w.bytes().data(), static_cast<int>(w.size())));
+  EXPECT_EQ(m.i32(), 3);
+  EXPECT_EQ(m.r_i32_size(), 2);
+}
@@ -0,0 +1,299 @@
+#include "sugar_columns.h"
+#include "test_messages.pb.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+using namespace std;
+
+using namespace sugar;
+
+namespace {
+using Top = mypkg::Top;
+
+vector<byte> write_file(const vector<Top> &rows,
+                        ColumnWriterOptions opts = {}) {
+  vector<byte> file;
+  ColumnWriter w(
+      Top::descriptor(),
+      [&](span<const byte> b) { file.insert(file.end(), b.begin(), b.end()); },
+      opts);
+  for (const Top &m : rows)
+    w.write(m);
+  w.finish();
+  EXPECT_EQ(w.bytes_written(), file.size());
+  return file;
+}
+
+// (repetition, definition, value or "-") per entry.
+vector<tuple<int, int, string>> entries(const ColumnReader &r,
+                                        string_view path) {
+  vector<tuple<int, int, string>> out;
+  r.scan<string_view>(path, [&](const ColumnEntry<string_view> &e) {
+    out.emplace_back(e.repetition, e.definition,
+                     e.present ? string(e.value) : "-");
+  });
+  return out;
+}
+
+const ColumnInfo &info(const ColumnReader &r, string_view path) {
+  return r.columns()[r.column(path)];
+}
+
+// A file with one int32 column "i32" of `levels` entries, none of them
+// null, whose plain chunk holds `stored` and whose footer claims `claimed`
+// values. Both CRCs are valid.
+vector<byte> forged_file(uint8_t levels, const vector<int32_t> &stored,
+                         uint8_t claimed) {
+  vector<byte> file(4);
+  detail::store_u32le(detail::kColumnMagic, file.data());
+  vector<byte> chunk{byte{static_cast<uint8_t>(ColumnEncoding::kPlain)}};
+  for (int32_t v : stored)
+    detail::append_varint(chunk, detail::zigzag(v));
+  file.insert(file.end(), chunk.begin(), chunk.end());
+
+  vector<byte> footer;
+  detail::append_varint(footer, 1); // columns
+  detail::append_varint(footer, 3);
+  for (char c : string_view("i32"))
+    footer.push_back(byte(c));
+  footer.push_back(byte{static_cast<uint8_t>(FieldKind::kInt32)});
+  footer.push_back(byte{0}); // max repetition
+  footer.push_back(byte{0}); // max definition
+  detail::append_varint(footer, 1); // row groups
+  detail::append_varint(footer, levels);
+  detail::append_varint(footer, 4);
+  detail::append_varint(footer, chunk.size());
+  footer.resize(footer.size() + 4);
+  detail::store_u32le(crc32c(chunk), footer.data() + footer.size() - 4);
+  detail::append_varint(footer, levels);
+  detail::append_varint(footer, claimed);
+  footer.push_back(byte{static_cast<uint8_t>(ColumnEncoding::kPlain)});
+  footer.push_back(byte{0}); // no statistics
+  file.insert(file.end(), footer.begin(), footer.end());
+
+  byte trailer[detail::kColumnTrailerSize];
+  detail::store_u32le(static_cast<uint32_t>(footer.size()), trailer);
+  detail::store_u32le(crc32c(footer), trailer + 4);
+  detail::store_u32le(detail::kColumnMagic, trailer + 8);
+  file.insert(file.end(), begin(trailer), end(trailer));
+  return file;
+}
+} // namespace
+
+TEST(Columns_Shredding, NestedAndRepeatedFieldsBecomeLevels) {
+  vector<Top> rows(4);
+  rows[0].add_repeated_child()->set_child_str("a");
+  rows[0].add_repeated_child()->set_child_str("b");
+  rows[2].add_repeated_child()->set_child_str("c");
+  rows[0].set_o_s("x");
+  rows[1].set_o_i32(1);
+  rows[1].mutable_inner();
+  rows[2].mutable_inner()->mutable_deep()->set_x(5);
+  rows[3].mutable_inner()->mutable_deep();
+  (*rows[3].mutable_u64_to_child())[7].set_child_str("m");
+  (*rows[3].mutable_u64_to_child())[8];
+
+  const vector<byte> file = write_file(rows);
+  const ColumnReader r(file);
+  EXPECT_EQ(r.rows(), 4u);
+  EXPECT_EQ(r.row_groups(), 1u);
+
+  EXPECT_EQ(info(r, "repeated_child.child_str").max_repetition, 1);
+  EXPECT_EQ(info(r, "repeated_child.child_str").max_definition, 1);
+  EXPECT_EQ(info(r, "inner.deep.x").max_repetition, 0);
+  EXPECT_EQ(info(r, "inner.deep.x").max_definition, 2);
+  EXPECT_EQ(info(r, "o_i32").max_definition, 1);
+  EXPECT_EQ(info(r, "i32").max_definition, 0);
+  EXPECT_EQ(info(r, "string_to_int32.key").kind, FieldKind::kString);
+  EXPECT_EQ(info(r, "u64_to_child.value.child_str").max_repetition, 1);
+  EXPECT_EQ(info(r, "u64_to_child.value.child_str").max_definition, 2);
+  EXPECT_THROW((void)r.column("inner.deep"), invalid_argument);
+
+  using E = vector<tuple<int, int, string>>;
+  EXPECT_EQ(entries(r, "repeated_child.child_str"),
+            (E{{0, 1, "a"}, {1, 1, "b"}, {0, 0, "-"}, {0, 1, "c"},
+               {0, 0, "-"}}));
+  EXPECT_EQ(entries(r, "o_s"),
+            (E{{0, 1, "x"}, {0, 0, "-"}, {0, 0, "-"}, {0, 0, "-"}}));
+  // Map entries are repeated key/value messages, in map order.
+  const E children = entries(r, "u64_to_child.value.child_str");
+  ASSERT_EQ(children.size(), 5u);
+  EXPECT_EQ(get<0>(children[3]), 0);
+  EXPECT_EQ(get<0>(children[4]), 1);
+  EXPECT_TRUE(get<2>(children[3]) == "m" || get<2>(children[4]) == "m");
+
+  vector<tuple<int, int, int32_t>> deep;
+  r.scan<int32_t>("inner.deep.x", [&](const ColumnEntry<int32_t> &e) {
+    EXPECT_EQ(e.present, e.definition == 2);
+    deep.emplace_back(e.repetition, e.definition, e.value);
+  });
+  EXPECT_EQ(deep, (vector<tuple<int, int, int32_t>>{
+                      {0, 0, 0}, {0, 1, 0}, {0, 2, 5}, {0, 2, 0}}));
+}
+
+TEST(Columns_Shredding, EmptyInputsAndEmptyRows) {
+  // No rows: a valid file with every column and no row groups.
+  const vector<byte> none = write_file({});
+  const ColumnReader r0(none);
+  EXPECT_EQ(r0.rows(), 0u);
+  EXPECT_EQ(r0.row_groups(), 0u);
+  EXPECT_TRUE(entries(r0, "s").empty());
+
+  // Rows with nothing set still get one null or default entry per column.
+  const vector<byte> blank = write_file(vector<Top>(3));
+  const ColumnReader r(blank);
+  EXPECT_EQ(r.rows(), 3u);
+  using E = vector<tuple<int, int, string>>;
+  EXPECT_EQ(entries(r, "repeated_child.child_str"),
+            (E{{0, 0, "-"}, {0, 0, "-"}, {0, 0, "-"}}));
+  EXPECT_EQ(entries(r, "s"), (E{{0, 0, ""}, {0, 0, ""}, {0, 0, ""}}));
+}
+
+TEST(Columns_Encoding, PickedPerChunkAndRoundTrips) {
+  vector<Top> rows(300);
+  for (int i = 0; i < 300; ++i) {
+    rows[i].set_i64(int64_t{1} << 40 | i * 1000); // delta
+    rows[i].set_u32(7);                           // RLE
+    rows[i].set_s("city-" + to_string(i % 3));    // dictionary
+    rows[i].set_d(i * 0.5);                       // plain
+    rows[i].set_e(mypkg::COLOR_BLUE);
+    rows[i].set_s_i32(-i);
+    for (int j = 0; j < i % 4; ++j)
+      rows[i].add_r_str(to_string(i) + "/" + to_string(j));
+  }
+  const vector<byte> file = write_file(rows, {.row_group_rows = 100});
+  const ColumnReader r(file);
+  ASSERT_EQ(r.row_groups(), 3u);
+  EXPECT_EQ(r.chunk(1, "i64").encoding, ColumnEncoding::kDelta);
+  EXPECT_EQ(r.chunk(1, "u32").encoding, ColumnEncoding::kRle);
+  EXPECT_EQ(r.chunk(1, "s").encoding, ColumnEncoding::kDictionary);
+  EXPECT_EQ(r.chunk(1, "d").encoding, ColumnEncoding::kPlain);
+  EXPECT_EQ(r.chunk(1, "r_str").encoding, ColumnEncoding::kPlain);
+  EXPECT_EQ(r.chunk(2, "i64").entries, 100u);
+  EXPECT_THROW((void)r.chunk(3, "i64"), out_of_range);
+
+  int i = 0;
+  r.scan<int64_t>("i64", [&](const ColumnEntry<int64_t> &e) {
+    EXPECT_EQ(e.value, int64_t{1} << 40 | i++ * 1000);
+  });
+  EXPECT_EQ(i, 300);
+  i = 0;
+  r.scan<uint32_t>("u32",
+                   [&](const ColumnEntry<uint32_t> &e) { EXPECT_EQ(e.value, 7u); });
+  r.scan<string_view>("s", [&](const ColumnEntry<string_view> &e) {
+    EXPECT_EQ(e.value, "city-" + to_string(i++ % 3));
+  });
+  i = 0;
+  r.scan<double>("d", [&](const ColumnEntry<double> &e) {
+    EXPECT_EQ(e.value, i++ * 0.5);
+  });
+  i = 0;
+  r.scan<int32_t>("e", [&](const ColumnEntry<int32_t> &e) {
+    EXPECT_EQ(e.value, mypkg::COLOR_BLUE);
+  });
+  r.scan<int32_t>("s_i32", [&](const ColumnEntry<int32_t> &e) {
+    EXPECT_EQ(e.value, -i++);
+  });
+
+  // Rebuild r_str from its levels.
+  vector<vector<string>> rebuilt;
+  r.scan<string_view>("r_str", [&](const ColumnEntry<string_view> &e) {
+    if (e.repetition == 0)
+      rebuilt.emplace_back();
+    if (e.present)
+      rebuilt.back().emplace_back(e.value);
+  });
+  ASSERT_EQ(rebuilt.size(), 300u);
+  for (int k = 0; k < 300; ++k)
+    EXPECT_EQ(rebuilt[k], vector<string>(rows[k].r_str().begin(),
+                                         rows[k].r_str().end()));
+
+  // Without dictionaries strings stay plain.
+  const vector<byte> plain = write_file(rows, {.dictionary = false});
+  EXPECT_EQ(ColumnReader(plain).chunk(0, "s").encoding, ColumnEncoding::kPlain);
+}
+
+TEST(Columns_Statistics, SkipChunks) {
+  vector<Top> rows(300);
+  for (int i = 0; i < 300; ++i) {
+    rows[i].set_i32(i);
+    rows[i].set_s(string(1, static_cast<char>('a' + i / 100)));
+    if (i >= 100)
+      rows[i].add_r_i32(i);
+  }
+  const vector<byte> file = write_file(rows, {.row_group_rows = 100});
+  const ColumnReader r(file);
+
+  vector<int32_t> seen;
+  const auto fn = [&](const ColumnEntry<int32_t> &e) { seen.push_back(e.value); };
+  ColumnScanStats stats = r.scan<int32_t>("i32", fn, {.min = 150, .max = 160});
+  EXPECT_EQ(stats.chunks_read, 1u);
+  EXPECT_EQ(stats.chunks_skipped, 2u);
+  EXPECT_EQ(stats.entries, 100u);
+  ASSERT_EQ(seen.size(), 100u);
+  EXPECT_EQ(seen.front(), 100);
+
+  stats = r.scan<int32_t>("i32", fn, {.min = 1000});
+  EXPECT_EQ(stats.chunks_skipped, 3u);
+  stats = r.scan<string_view>(
+      "s", [](const auto &) {}, {.min = "b", .max = "c"});
+  EXPECT_EQ(stats.chunks_read, 2u);
+  // A chunk of nulls only holds nothing in any range.
+  stats = r.scan<int32_t>("r_i32", fn, {.max = 1000});
+  EXPECT_EQ(stats.chunks_skipped, 1u);
+  stats = r.scan<int32_t>("r_i32", fn);
+  EXPECT_EQ(stats.chunks_read, 3u);
+}
+
+TEST(Columns_Corruption, ErrorsAreReported) {
+  vector<Top> rows(10);
+  for (int i = 0; i < 10; ++i) {
+    rows[i].set_i32(i);
+    rows[i].set_i64(i);
+  }
+  vector<byte> file = write_file(rows);
+  {
+    const ColumnReader r(file);
+    EXPECT_THROW(r.scan<int32_t>("nope", [](const auto &) {}), invalid_argument);
+    EXPECT_THROW(r.scan<int64_t>("i32", [](const auto &) {}), invalid_argument);
+    EXPECT_THROW(r.scan<string_view>("i32", [](const auto &) {}),
+                 invalid_argument);
+
+    // Damage the i64 chunk: only scans of that column notice.
+    const ColumnChunkInfo chunk = r.chunk(0, "i64");
+    file[chunk.offset + chunk.size - 1] ^= byte{1};
+    int32_t sum = 0;
+    r.scan<int32_t>("i32",
+                    [&](const ColumnEntry<int32_t> &e) { sum += e.value; });
+    EXPECT_EQ(sum, 45);
+    EXPECT_THROW(r.scan<int64_t>("i64", [](const auto &) {}), runtime_error);
+  }
+  file[file.size() - 20] ^= byte{1}; // in the footer
+  EXPECT_THROW(ColumnReader{file}, runtime_error);
+  EXPECT_THROW(ColumnReader(span(file).first(8)), runtime_error);
+
+  ColumnWriter w(Top::descriptor(), [](span<const byte>) {});
+  EXPECT_THROW(w.write(mypkg::Child()), invalid_argument);
+  w.finish();
+  EXPECT_THROW(w.write(Top()), runtime_error);
+}
+
+TEST(Columns_Corruption, ValueCountsMustMatchLevels) {
+  int32_t sum = 0;
+  auto add = [&](const ColumnEntry<int32_t> &e) { sum += e.value; };
+  ColumnReader(forged_file(3, {1, 2, 3}, 3)).scan<int32_t>("i32", add);
+  EXPECT_EQ(sum, 6);
+
+  // Three present entries but only two values: scan must not read a third.
+  const vector<byte> file = forged_file(3, {1, 2}, 2);
+  const ColumnReader r(file);
+  EXPECT_EQ(r.chunk(0, "i32").values, 2u);
+  EXPECT_THROW(r.scan<int32_t>("i32", add), runtime_error);
+}
@@ -0,0 +1,182 @@
+#include "recursive_messages.pb.h"
+#include "solo.pb.h"
+#include "test_messages.pb.h"
+
+#include "recursive_messages.sugar.h"
+#include "sugar_generator.h"
+
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
+#include <gtest/gtest.h>
+
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+using namespace google::protobuf;
+
+namespace {
+
+// Collects every output in memory, in the order it was opened.
+class MemoryContext : public compiler::GeneratorContext {
+public:
+  io::ZeroCopyOutputStream *Open(const string &filename) override {
+    auto &[name, contents] = files.emplace_back(filename, string());
+    return new io::StringOutputStream(&contents);
+  }
+
+  deque<pair<string, string>> files; // stable for the open streams
+};
+
+// Refuses, or throws on, the first buffer asked for `broken`.
+class BrokenContext : public MemoryContext {
+public:
+  BrokenContext(string broken, bool throws)
+      : broken_(std::move(broken)), throws_(throws) {}
+
+  io::ZeroCopyOutputStream *Open(const string &filename) override {
+    if (filename != broken_)
+      return MemoryContext::Open(filename);
+    if (!throws_)
+      return new io::ArrayOutputStream(buffer_, sizeof buffer_);
+    return new ThrowingStream;
+  }
+
+private:
+  struct ThrowingStream : io::ZeroCopyOutputStream {
+    bool Next(void **, int *) override { throw runtime_error("disk gone"); }
+    void BackUp(int) override {}
+    int64_t ByteCount() const override { return 0; }
+  };
+
+  string broken_;
+  bool throws_;
+  char buffer_[16];
+};
+
+vector<const FileDescriptor *> all_files() {
+  return {mypkg::Top::descriptor()->file(), Solo::descriptor()->file()};
+}
+
+deque<pair<string, string>> generate_all(const string &parameter) {
+  MemoryContext context;
+  string error;
+  EXPECT_TRUE(SugarGenerator().GenerateAll(all_files(), parameter, &context,
+                                           &error))
+      << error;
+  return context.files;
+}
+
+deque<pair<string, string>> generate_each(const string &parameter) {
+  MemoryContext context;
+  string error;
+  for (const auto *file : all_files())
+    EXPECT_TRUE(SugarGenerator().Generate(file, parameter, &context, &error))
+        << error;
+  return context.files;
+}
+
+} // namespace
+
+TEST(SugarGenerator_Jobs, OutputDoesNotDependOnJobs) {
+  for (string layout : {"", "split_headers,"}) {
+    SCOPED_TRACE(layout);
+    auto serial = generate_all(layout + "jobs=1");
+    ASSERT_FALSE(serial.empty());
+    for (const auto &[name, contents] : serial)
+      EXPECT_FALSE(contents.empty()) << name;
+    EXPECT_EQ(generate_all(layout + "jobs=4"), serial);
+    EXPECT_EQ(generate_all(layout + "jobs=0"), serial);
+    EXPECT_EQ(generate_each(layout.empty() ? "" : "split_headers"), serial);
+  }
+  EXPECT_EQ(generate_all("jobs=1").front().first, "test_messages.sugar.h");
+  // test_messages: fwd, five messages, .cc; solo: fwd, Solo, .cc.
+  EXPECT_EQ(generate_all("split_headers,jobs=1").size(), 7u + 3u);
+}
+
+TEST(SugarGenerator_Jobs, InvalidValuesAreRejected) {
+  for (string jobs : {"", "x", "-1", "4x", "99999999999"}) {
+    MemoryContext context;
+    string error;
+    EXPECT_FALSE(SugarGenerator().GenerateAll(all_files(), "jobs=" + jobs,
+                                              &context, &error))
+        << jobs;
+    EXPECT_EQ(error, "invalid value for jobs: " + jobs);
+    EXPECT_TRUE(context.files.empty());
+  }
+}
+
+TEST(SugarGenerator_Options, FeaturesAndUnknownKeys) {
+  // Feature flags only add to the header; the default has none of them.
+  const string plain = generate_all("").front().second;
+  const string all = generate_all("json,builder=true,plain,mask").front().second;
+  EXPECT_EQ(plain.find("sugar_json.h"), string::npos);
+  EXPECT_NE(all.find("#include \"sugar_json.h\""), string::npos);
+  EXPECT_NE(all.find("struct TopBuilder"), string::npos);
+  EXPECT_GT(all.size(), plain.size());
+
+  for (auto [bad, message] :
+       {pair{"json=1", "invalid value for json: 1"},
+        pair{"mask=false,bogus", "unknown generator option: bogus"},
+        pair{"split_headers=x", "invalid value for split_headers: x"}}) {
+    MemoryContext context;
+    string error;
+    EXPECT_FALSE(SugarGenerator().GenerateAll(all_files(), bad, &context,
+                                              &error));
+    EXPECT_EQ(error, message);
+    EXPECT_TRUE(context.files.empty()) << bad;
+  }
+}
+
+TEST(SugarGenerator_Errors, FailingOutputsAreReported) {
+  for (string jobs : {"jobs=1", "jobs=4"}) {
+    SCOPED_TRACE(jobs);
+    string error;
+    BrokenContext full("test_messages.sugar.h", false);
+    EXPECT_FALSE(
+        SugarGenerator().GenerateAll(all_files(), jobs, &full, &error));
+    EXPECT_EQ(error, "failed to write test_messages.sugar.h");
+
+    // A throwing stream is reported too rather than ending the process.
+    error.clear();
+    BrokenContext throwing("solo.sugar.h", true);
+    EXPECT_FALSE(
+        SugarGenerator().GenerateAll(all_files(), jobs, &throwing, &error));
+    EXPECT_EQ(error.rfind("failed to write solo.sugar.h", 0), 0u) << error;
+  }
+
+  string error;
+  BrokenContext full("solo.sugar.h", false);
+  EXPECT_FALSE(
+      SugarGenerator().Generate(Solo::descriptor()->file(), "", &full, &error));
+  EXPECT_EQ(error, "failed to write solo.sugar.h");
+}
+
+// Node reaches itself through repeated and map fields only, so its header
+// is generated (see generate_test_sugar) and every part of it compiles.
+TEST(SugarGenerator_RecursiveSchema, TreesThroughRepeatedAndMapFields) {
+  rec::Node root;
+  root.set_v(1);
+  auto *kid = root.add_children();
+  kid->set_v(2);
+  (*kid->mutable_named())["leaf"].set_v(3);
+  (*root.mutable_named())["other"].add_children()->set_v(4);
+
+  rec::Node copy = root;
+  EXPECT_TRUE(rec::NodeWrapped::equal(root, copy));
+  EXPECT_EQ(rec::NodeWrapped::hash_of(root), rec::NodeWrapped::hash_of(copy));
+  copy.mutable_children(0)->mutable_named()->at("leaf").set_v(5);
+  EXPECT_FALSE(rec::NodeWrapped::equal(root, copy));
+
+  const auto plain = rec::NodePlain::from_proto(root);
+  EXPECT_EQ(plain.children.at(0).named.at("leaf").v, 3);
+  EXPECT_EQ(plain.named.at("other").children.at(0).v, 4);
+  EXPECT_EQ(rec::NodePlain::parse(root.SerializeAsString()), plain);
+  rec::Node back;
+  plain.to_proto(back);
+  EXPECT_TRUE(rec::NodeWrapped::equal(root, back));
+}
@@ -0,0 +1,155 @@
+#include "sugar_intern.h"
+#include "sugar_runtime.h"
+#include "test_messages.pb.h"
+
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+using namespace sugar;
+
+namespace {
+using Top = mypkg::Top;
+using Code = StringPool::Code;
+
+// Hand-written counterpart of the generated wrapper's string fields.
+struct TopStrings {
+  using Access = RootAccess<TopStrings, Top>;
+  union {
+    Top *_msg;
+    MapTag<Access, 0, string, int32_t> string_to_int32;
+    MapTag<Access, 16, int32_t, string> m_i32_str;
+    RepeatedTag<Access, 24, string> r_str;
+  };
+
+  explicit TopStrings(Top &m) noexcept : _msg(&m) {}
+};
+
+vector<string_view> decode(const StringPool &pool, const vector<Code> &codes) {
+  vector<string_view> out;
+  for (const Code c : codes)
+    out.push_back(pool[c]);
+  return out;
+}
+} // namespace
+
+TEST(StringPool, DenseCodesAndStableViews) {
+  StringPool pool(64);
+  EXPECT_EQ(pool.intern("red"), 0u);
+  EXPECT_EQ(pool.intern("green"), 1u);
+  EXPECT_EQ(pool.intern(string("red")), 0u);
+  EXPECT_EQ(pool.intern(""), 2u);
+  EXPECT_EQ(pool.size(), 3u);
+  EXPECT_EQ(pool.bytes(), 8u);
+  EXPECT_EQ(pool.find("green"), 1u);
+  EXPECT_EQ(pool.find("blue"), StringPool::kNone);
+  EXPECT_THROW((void)pool.at(3), out_of_range);
+
+  // Views survive any number of later blocks, short or oversized.
+  const string_view red = pool[0];
+  const string long_one(200, 'x');
+  for (int i = 0; i < 100; ++i)
+    pool.intern("value-" + to_string(i));
+  EXPECT_EQ(pool[pool.intern(long_one)], long_one);
+  EXPECT_EQ(red, "red");
+  EXPECT_EQ(red.data(), pool[0].data());
+  EXPECT_EQ(pool.strings()[2], "");
+
+  // Moving keeps the strings where they are.
+  StringPool moved = std::move(pool);
+  EXPECT_EQ(moved[0].data(), red.data());
+  EXPECT_EQ(moved.find("value-7"), 10u);
+  EXPECT_TRUE(pool.empty());
+  EXPECT_EQ(pool.intern("fresh"), 0u);
+  EXPECT_EQ(moved[0], "red");
+
+  vector<Code> codes;
+  moved.intern_all(vector<string>{"green", "red", "new"}, codes);
+  EXPECT_EQ(codes, (vector<Code>{1, 0, static_cast<Code>(moved.size() - 1)}));
+  moved.clear();
+  EXPECT_EQ(moved.size(), 0u);
+  EXPECT_EQ(moved.bytes(), 0u);
+}
+
+TEST(StringPool, RepeatedFieldsAcrossABatch) {
+  vector<Top> batch(3);
+  batch[0].add_r_str("a");
+  batch[0].add_r_str("b");
+  batch[1].add_r_str("b");
+  batch[2].add_r_str("c");
+  batch[2].add_r_str("a");
+
+  StringPool pool;
+  vector<Code> codes;
+  for (Top &m : batch)
+    TopStrings(m).r_str.intern(pool, codes);
+  EXPECT_EQ(codes, (vector<Code>{0, 1, 1, 2, 0}));
+  EXPECT_EQ(pool.size(), 3u);
+
+  RepeatedProxy<string> p(batch[2],
+                          *Top::descriptor()->FindFieldByName("r_str"));
+  EXPECT_EQ(p.intern(pool), (vector<Code>{2, 0}));
+
+  // Writing codes back grows, overwrites and shrinks the field.
+  const vector<Code> more{1, 1, 0, 2};
+  p.assign(pool, more);
+  EXPECT_EQ(vector<string>(batch[2].r_str().begin(), batch[2].r_str().end()),
+            (vector<string>{"b", "b", "a", "c"}));
+  TopStrings(batch[2]).r_str.assign(pool, vector<Code>{2});
+  ASSERT_EQ(batch[2].r_str_size(), 1);
+  EXPECT_EQ(batch[2].r_str(0), "c");
+  EXPECT_THROW(p.assign(pool, vector<Code>{0, 7}), out_of_range);
+  EXPECT_EQ(batch[2].r_str(0), "c");
+
+  // Reading an unset field interns nothing.
+  Top empty;
+  vector<Code> none;
+  TopStrings(empty).r_str.intern(pool, none);
+  EXPECT_TRUE(none.empty());
+}
+
+TEST(StringPool, MapKeysAndValuesStayAligned) {
+  Top m;
+  (*m.mutable_string_to_int32())["x"] = 1;
+  (*m.mutable_string_to_int32())["y"] = 2;
+  (*m.mutable_m_i32_str())[1] = "one";
+  (*m.mutable_m_i32_str())[2] = "two";
+  (*m.mutable_m_i32_str())[3] = "one";
+
+  StringPool pool;
+  vector<Code> keys;
+  TopStrings w(m);
+  w.string_to_int32.intern_keys(pool, keys);
+  ASSERT_EQ(keys.size(), 2u);
+  const vector<string_view> names = decode(pool, keys);
+  EXPECT_TRUE((names == vector<string_view>{"x", "y"} ||
+               names == vector<string_view>{"y", "x"}));
+
+  vector<Code> values;
+  w.m_i32_str.intern_values(pool, values);
+  ASSERT_EQ(values.size(), 3u);
+  EXPECT_EQ(pool.size(), 4u); // x, y, one, two
+  EXPECT_EQ(pool.find("one"), pool.intern("one"));
+
+  // The i-th value belongs to the i-th entry.
+  const auto *f = Top::descriptor()->FindFieldByName("m_i32_str");
+  const auto *r = m.GetReflection();
+  for (int i = 0; i < 3; ++i) {
+    const auto &entry = r->GetRepeatedMessage(m, f, i);
+    const int32_t k = entry.GetReflection()->GetInt32(
+        entry, f->message_type()->map_key());
+    EXPECT_EQ(pool[values[i]], m.m_i32_str().at(k));
+  }
+
+  MapProxy<string, int32_t> proxy(
+      m, *Top::descriptor()->FindFieldByName("string_to_int32"));
+  EXPECT_EQ(proxy.size(), 2);
+  proxy.set(pool[pool.intern("z")], 3);
+  EXPECT_EQ(m.string_to_int32().at("z"), 3);
+}
@@ -0,0 +1,230 @@
+#include "sugar_io.h"
+#include "sugar_iovec.h"
+#include "sugar_runtime.h"
+#include "test_messages.pb.h"
+
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/dynamic_message.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/text_format.h>
+#include <google/protobuf/util/delimited_message_util.h>
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+using namespace sugar;
+
+namespace {
+using Top = mypkg::Top;
+
+struct TopIo {
+  using Access = RootAccess<TopIo, Top>;
+  union {
+    Top *_msg;
+    FieldTag<Access, 6, int32_t> i32;
+  };
+
+  explicit TopIo(Top &m) noexcept : _msg(&m) {}
+};
+
+Top make_top() {
+  Top m;
+  m.set_i32(-7);
+  m.set_i64(-1);
+  m.set_u64(1ull << 63);
+  m.set_b(true);
+  m.set_f(1.5f);
+  m.set_d(-2.25);
+  m.set_e(mypkg::COLOR_BLUE);
+  m.set_s("short");
+  m.mutable_child()->set_child_str("child");
+  m.set_o_i32(3);
+  (*m.mutable_m_i32_str())[-1] = "v";
+  (*m.mutable_m_u64_u32())[2] = 0;
+  for (int i : {-1, 0, 300})
+    m.add_r_i32(i);
+  m.add_r_enum(mypkg::ONE);
+  m.add_r_f(0.5f);
+  m.add_r_str("a");
+  m.mutable_inner()->mutable_deep()->set_x(9);
+  return m;
+}
+
+string gather(span<const iovec> pieces) {
+  string out;
+  for (const auto &p : pieces)
+    out.append(static_cast<const char *>(p.iov_base), p.iov_len);
+  return out;
+}
+
+bool references(span<const iovec> pieces, const string &s) {
+  for (const auto &p : pieces)
+    if (p.iov_base == s.data() && p.iov_len == s.size())
+      return true;
+  return false;
+}
+} // namespace
+
+TEST(SerializeInto, WritesWithoutAllocatingAndChecksSpace) {
+  Top msg = make_top();
+  const string expected = msg.SerializeAsString();
+
+  vector<byte> buf(expected.size() + 8, byte{0x55});
+  EXPECT_EQ(serialized_size(msg), expected.size());
+  EXPECT_EQ(serialize_into(TopIo(msg), buf), expected.size());
+  EXPECT_EQ(string(reinterpret_cast<const char *>(buf.data()), expected.size()),
+            expected);
+  EXPECT_EQ(buf.back(), byte{0x55});
+
+  vector<byte> small(expected.size() - 1, byte{0x55});
+  EXPECT_THROW((void)serialize_into(msg, small), length_error);
+  EXPECT_EQ(small.front(), byte{0x55});
+}
+
+TEST(SerializeFramed, MatchesDelimitedFormatAndParsesBack) {
+  Top a = make_top(), b;
+  b.set_i32(1);
+
+  string expected;
+  {
+    google::protobuf::io::StringOutputStream out(&expected);
+    ASSERT_TRUE(google::protobuf::util::SerializeDelimitedToZeroCopyStream(
+        a, &out));
+    ASSERT_TRUE(google::protobuf::util::SerializeDelimitedToZeroCopyStream(
+        b, &out));
+  }
+
+  vector<byte> buf(framed_size(a) + framed_size(b));
+  size_t n = serialize_framed(TopIo(a), buf);
+  n += serialize_framed(b, span(buf).subspan(n));
+  ASSERT_EQ(n, buf.size());
+  EXPECT_EQ(string(reinterpret_cast<const char *>(buf.data()), n), expected);
+
+  Top got;
+  const size_t first = parse_framed(buf, TopIo(got));
+  EXPECT_EQ(first, framed_size(a));
+  EXPECT_EQ(got.SerializeAsString(), a.SerializeAsString());
+  // Partial frames ask for more input.
+  EXPECT_EQ(parse_framed(span(buf).subspan(first, 1), got), 0u);
+  EXPECT_EQ(parse_framed(span(buf).first(first - 1), got), 0u);
+  EXPECT_EQ(parse_framed(span(buf).subspan(first), got), framed_size(b));
+  EXPECT_EQ(got.i32(), 1);
+
+  const byte bad[] = {byte{0xff}, byte{0xff}, byte{0xff}, byte{0xff},
+                      byte{0xff}, byte{0x01}};
+  EXPECT_THROW((void)parse_framed(bad, got), runtime_error);
+}
+
+TEST(IovecWriter, ReferencesLargeStringsAndMatchesSerialize) {
+  Top msg = make_top();
+  msg.set_s(string(5000, 's'));
+  msg.mutable_child()->set_child_str(string(4096, 'c'));
+  msg.add_r_str(string(6000, 'r'));
+  msg.add_repeated_child()->set_child_str(string(100, 'x'));
+  msg.add_repeated_child()->set_child_str(string(4500, 'y'));
+
+  IovecWriter writer;
+  const auto pieces = writer.serialize(TopIo(msg));
+  EXPECT_EQ(writer.size(), msg.ByteSizeLong());
+  EXPECT_TRUE(references(pieces, msg.s()));
+  EXPECT_TRUE(references(pieces, msg.child().child_str()));
+  EXPECT_TRUE(references(pieces, msg.r_str(1)));
+  EXPECT_TRUE(references(pieces, msg.repeated_child(1).child_str()));
+  EXPECT_FALSE(references(pieces, msg.repeated_child(0).child_str()));
+  // Single-entry maps, so protobuf's own output is deterministic too.
+  EXPECT_EQ(gather(pieces), msg.SerializeAsString());
+
+  // Small messages come out as one buffered piece.
+  Top small = make_top();
+  EXPECT_EQ(writer.serialize(small).size(), 1u);
+  EXPECT_EQ(gather(writer.pieces()), small.SerializeAsString());
+}
+
+TEST(IovecWriter, EncodesEveryWireType) {
+  google::protobuf::FileDescriptorProto proto;
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(R"pb(
+    name: "wire.proto"
+    package: "wire"
+    syntax: "proto2"
+    message_type {
+      name: "W"
+      field { name: "si32" number: 1 label: LABEL_OPTIONAL type: TYPE_SINT32 }
+      field { name: "si64" number: 2 label: LABEL_OPTIONAL type: TYPE_SINT64 }
+      field { name: "fx32" number: 3 label: LABEL_OPTIONAL type: TYPE_FIXED32 }
+      field { name: "sf32" number: 4 label: LABEL_OPTIONAL type: TYPE_SFIXED32 }
+      field { name: "fx64" number: 5 label: LABEL_OPTIONAL type: TYPE_FIXED64 }
+      field { name: "sf64" number: 6 label: LABEL_OPTIONAL type: TYPE_SFIXED64 }
+      field {
+        name: "packed"
+        number: 7
+        label: LABEL_REPEATED
+        type: TYPE_SINT32
+        options { packed: true }
+      }
+      field { name: "loose" number: 8 label: LABEL_REPEATED type: TYPE_DOUBLE }
+      field {
+        name: "g"
+        number: 9
+        label: LABEL_OPTIONAL
+        type: TYPE_GROUP
+        type_name: ".wire.W.G"
+      }
+      field { name: "blob" number: 10 label: LABEL_OPTIONAL type: TYPE_BYTES }
+      nested_type {
+        name: "G"
+        field { name: "data" number: 1 label: LABEL_OPTIONAL type: TYPE_BYTES }
+      }
+    }
+  )pb", &proto));
+  google::protobuf::DescriptorPool pool;
+  const auto *file = pool.BuildFile(proto);
+  ASSERT_NE(file, nullptr);
+  google::protobuf::DynamicMessageFactory factory(&pool);
+  unique_ptr<google::protobuf::Message> msg(
+      factory.GetPrototype(file->FindMessageTypeByName("W"))->New());
+
+  DynamicWrapped w(*msg);
+  w["si32"] = -5;
+  w["si64"] = int64_t{-1} << 40;
+  w["fx32"] = 7u;
+  w["sf32"] = -8;
+  w["fx64"] = uint64_t{1} << 60;
+  w["sf64"] = int64_t{-9};
+  for (int v : {-1, 1, -300})
+    w.repeated<int32_t>("packed").push_back(v);
+  w.repeated<double>("loose").push_back(0.25);
+  w.repeated<double>("loose").push_back(-4.0);
+  w["g"]["data"] = string(2000, 'g');
+  w["blob"] = string(10, 'b');
+
+  IovecWriter writer(1024);
+  const auto pieces = writer.serialize(*msg);
+  EXPECT_EQ(pieces.size(), 3u);
+  EXPECT_EQ(gather(pieces), msg->SerializeAsString());
+}
+
+TEST(IovecWriter, WriteToHandlesFiles) {
+  Top msg = make_top();
+  msg.set_s(string(70000, 'z'));
+  IovecWriter writer(1);
+  writer.serialize(msg);
+  EXPECT_GE(writer.pieces().size(), 3u);
+
+  FILE *f = tmpfile();
+  ASSERT_NE(f, nullptr);
+  writer.write_to(fileno(f));
+  EXPECT_TRUE(writer.pieces().empty());
+  rewind(f);
+  string read(msg.ByteSizeLong(), '\0');
+  ASSERT_EQ(fread(read.data(), 1, read.size(), f), read.size());
+  fclose(f);
+  EXPECT_EQ(read, msg.SerializeAsString());
+}
@@ -0,0 +1,359 @@
+#include "sugar_json.h"
+#include "test_messages.pb.h"
+#include "test_messages_sugar.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <limits>
+#include <string>
+
+using namespace std;
+
+using namespace sugar::json;
+
+namespace {
+
+TEST(JsonWriter_Strings, EscapesQuotesBackslashesAndControls) {
+  string out;
+  Writer w(out);
+  w.string("a\"b\\c\n\t\x01/\xc3\xa9");
+  EXPECT_EQ(out, "\"a\\\"b\\\\c\\n\\t\\u0001/\xc3\xa9\"");
+}
+
+TEST(JsonWriter_Strings, LongRunsCrossVectorBoundaries) {
+  string in(40, 'x');
+  in[17] = '"';
+  in[33] = '\\';
+  string out;
+  Writer w(out);
+  w.string(in);
+  string expected = "\"" + string(17, 'x') + "\\\"" + string(15, 'x') +
+                    "\\\\" + string(6, 'x') + "\"";
+  EXPECT_EQ(out, expected);
+}
+
+TEST(JsonWriter_Scalars, ProtoJsonMapping) {
+  string out;
+  Writer w(out);
+  w.begin_array();
+  w.element();
+  w.int32(-5);
+  w.element();
+  w.int64(-9000000000LL);
+  w.element();
+  w.uint64(18446744073709551615ULL);
+  w.element();
+  w.boolean(true);
+  w.element();
+  w.float64(std::numeric_limits<double>::quiet_NaN());
+  w.element();
+  w.float32(-std::numeric_limits<float>::infinity());
+  w.element();
+  w.float32(0.1f);
+  w.element();
+  w.enumeration(2, "COLOR_RED");
+  w.element();
+  w.enumeration(9, "");
+  w.end_array();
+  EXPECT_EQ(out, "[-5,\"-9000000000\",\"18446744073709551615\",true,\"NaN\","
+                 "\"-Infinity\",0.1,\"COLOR_RED\",9]");
+}
+
+TEST(JsonWriter_Objects, KeysMapKeysAndNesting) {
+  string out;
+  Writer w(out);
+  w.begin_object();
+  w.key("\"a\":");
+  w.begin_object();
+  w.map_key(int64_t{-3});
+  w.int32(1);
+  w.map_key(true);
+  w.int32(2);
+  w.map_key(string("k"));
+  w.int32(3);
+  w.end_object();
+  w.key("\"b\":");
+  w.begin_array();
+  w.end_array();
+  w.end_object();
+  EXPECT_EQ(out, "{\"a\":{\"-3\":1,\"true\":2,\"k\":3},\"b\":[]}");
+}
+
+TEST(JsonWriter_Bytes, Base64WithPadding) {
+  string out;
+  Writer w(out);
+  w.bytes("");
+  w.bytes("f");
+  w.bytes("fo");
+  w.bytes("foo");
+  w.bytes("foob");
+  EXPECT_EQ(out, "\"\"\"Zg==\"\"Zm8=\"\"Zm9v\"\"Zm9vYg==\"");
+}
+
+TEST(JsonReader_Objects, IteratesKeysAndSkipsWhitespace) {
+  Reader r(" { \"a\" : 1 , \"b\":[true, false] ,\"c\":{}} ");
+  r.begin_object();
+  string_view key;
+  ASSERT_TRUE(r.next_key(key));
+  EXPECT_EQ(key, "a");
+  EXPECT_EQ(r.int32(), 1);
+  ASSERT_TRUE(r.next_key(key));
+  EXPECT_EQ(key, "b");
+  r.begin_array();
+  ASSERT_TRUE(r.next_element());
+  EXPECT_TRUE(r.boolean());
+  ASSERT_TRUE(r.next_element());
+  EXPECT_FALSE(r.boolean());
+  EXPECT_FALSE(r.next_element());
+  ASSERT_TRUE(r.next_key(key));
+  EXPECT_EQ(key, "c");
+  r.begin_object();
+  EXPECT_FALSE(r.next_key(key));
+  EXPECT_FALSE(r.next_key(key));
+  r.finish();
+}
+
+TEST(JsonReader_Numbers, QuotedExponentAndRanges) {
+  Reader r("[\"-7\", 1e2, 3.0, \"18446744073709551615\", 2147483648, "
+           "\"NaN\", \"-Infinity\", 2.5]");
+  r.begin_array();
+  ASSERT_TRUE(r.next_element());
+  EXPECT_EQ(r.int64(), -7);
+  ASSERT_TRUE(r.next_element());
+  EXPECT_EQ(r.int32(), 100);
+  ASSERT_TRUE(r.next_element());
+  EXPECT_EQ(r.uint32(), 3u);
+  ASSERT_TRUE(r.next_element());
+  EXPECT_EQ(r.uint64(), 18446744073709551615ULL);
+  ASSERT_TRUE(r.next_element());
+  EXPECT_THROW(r.int32(), ParseError);
+  Reader r2("[\"NaN\", \"-Infinity\", 2.5, 1.5]");
+  r2.begin_array();
+  ASSERT_TRUE(r2.next_element());
+  EXPECT_TRUE(std::isnan(r2.float64()));
+  ASSERT_TRUE(r2.next_element());
+  EXPECT_EQ(r2.float32(), -std::numeric_limits<float>::infinity());
+  ASSERT_TRUE(r2.next_element());
+  EXPECT_DOUBLE_EQ(r2.float64(), 2.5);
+  ASSERT_TRUE(r2.next_element());
+  EXPECT_THROW(r2.int32(), ParseError);
+}
+
+TEST(JsonReader_Strings, UnescapesAndValidatesUtf8) {
+  Reader r("[\"plain\", \"q\\\"\\\\\\/\\n\\u00e9\\ud83d\\ude00\", "
+           "\"\xc3\xa9\xf0\x9f\x98\x80\"]");
+  string s;
+  r.begin_array();
+  ASSERT_TRUE(r.next_element());
+  r.string(s);
+  EXPECT_EQ(s, "plain");
+  ASSERT_TRUE(r.next_element());
+  r.string(s);
+  EXPECT_EQ(s, "q\"\\/\n\xc3\xa9\xf0\x9f\x98\x80");
+  ASSERT_TRUE(r.next_element());
+  r.string(s);
+  EXPECT_EQ(s, "\xc3\xa9\xf0\x9f\x98\x80");
+
+  Reader bad("\"\xc3\x28\"");
+  EXPECT_THROW(bad.string(s), ParseError);
+  Reader ctrl("\"a\x01\"");
+  EXPECT_THROW(ctrl.string(s), ParseError);
+  Reader lone("\"\\udc00\"");
+  EXPECT_THROW(lone.string(s), ParseError);
+}
+
+TEST(JsonReader_Bytes, StandardAndUrlSafeBase64) {
+  string s;
+  Reader r("[\"Zm9vYg==\", \"-_8\"]");
+  r.begin_array();
+  ASSERT_TRUE(r.next_element());
+  r.bytes(s);
+  EXPECT_EQ(s, "foob");
+  ASSERT_TRUE(r.next_element());
+  r.bytes(s);
+  EXPECT_EQ(s, "\xfb\xff");
+}
+
+enum class Color { RED = 1, BLUE = 2 };
+
+bool ParseColor(const string &name, Color *out) {
+  if (name == "RED")
+    *out = Color::RED;
+  else if (name == "BLUE")
+    *out = Color::BLUE;
+  else
+    return false;
+  return true;
+}
+
+TEST(JsonReader_Enums, NameOrNumber) {
+  Reader r("[\"BLUE\", 1, \"GREEN\"]");
+  r.begin_array();
+  ASSERT_TRUE(r.next_element());
+  EXPECT_EQ(r.enumeration(&ParseColor), Color::BLUE);
+  ASSERT_TRUE(r.next_element());
+  EXPECT_EQ(r.enumeration(&ParseColor), Color::RED);
+  ASSERT_TRUE(r.next_element());
+  EXPECT_THROW(r.enumeration(&ParseColor), ParseError);
+}
+
+TEST(JsonReader_MapKeys, ConvertToKeyType) {
+  EXPECT_EQ(Reader::map_key<int32_t>("-3"), -3);
+  EXPECT_EQ(Reader::map_key<uint64_t>("18446744073709551615"),
+            18446744073709551615ULL);
+  EXPECT_TRUE(Reader::map_key<bool>("true"));
+  EXPECT_EQ(Reader::map_key<string>("k"), "k");
+  EXPECT_THROW(Reader::map_key<int32_t>("x"), ParseError);
+}
+
+TEST(JsonReader_MapKeys, ErrorsReportTheKeysOffset) {
+  const string json = "{\"m\": {\"1\": 2, \"x\": 3}}";
+  const size_t at = json.find("\"x\"");
+  Reader r(json);
+  string_view key;
+  r.begin_object();
+  ASSERT_TRUE(r.next_key(key));
+  r.begin_object();
+  ASSERT_TRUE(r.next_key(key));
+  EXPECT_EQ(r.map_key_at_last<int32_t>(key), 1);
+  r.int32();
+  ASSERT_TRUE(r.next_key(key));
+  try {
+    r.map_key_at_last<int32_t>(key);
+    FAIL() << "no error";
+  } catch (const ParseError &e) {
+    EXPECT_EQ(e.offset(), at);
+  }
+
+  // The generated readers report it too.
+  mypkg::Top m;
+  const string bad = "{\"mI32Str\": {\"7\": \"a\", \"true\": \"b\"}}";
+  try {
+    mypkg::TopWrapped(m).from_json(bad);
+    FAIL() << "no error";
+  } catch (const ParseError &e) {
+    EXPECT_EQ(e.offset(), bad.find("\"true\""));
+  }
+}
+
+TEST(JsonReader_Unknown, ThrowsOrSkips) {
+  string_view key;
+  Reader strict("{\"x\": 1}");
+  strict.begin_object();
+  ASSERT_TRUE(strict.next_key(key));
+  EXPECT_THROW(strict.unknown_field(key), ParseError);
+
+  Reader lenient("{\"x\": {\"y\": [1, \"z\", null, {}]}, \"n\": null}", true);
+  lenient.begin_object();
+  ASSERT_TRUE(lenient.next_key(key));
+  lenient.unknown_field(key);
+  ASSERT_TRUE(lenient.next_key(key));
+  EXPECT_EQ(key, "n");
+  EXPECT_TRUE(lenient.null());
+  EXPECT_FALSE(lenient.next_key(key));
+  lenient.finish();
+}
+
+TEST(JsonReader_Errors, MalformedInput) {
+  string_view key;
+  Reader missing_comma("{\"a\":1 \"b\":2}");
+  missing_comma.begin_object();
+  ASSERT_TRUE(missing_comma.next_key(key));
+  missing_comma.int32();
+  EXPECT_THROW(missing_comma.next_key(key), ParseError);
+
+  Reader trailing("{} x");
+  trailing.begin_object();
+  EXPECT_FALSE(trailing.next_key(key));
+  EXPECT_THROW(trailing.finish(), ParseError);
+
+  Reader fraction("1.5");
+  EXPECT_THROW(fraction.int64(), ParseError);
+}
+
+TEST(JsonReader_Numbers, NonFiniteValuesOnlyAsQuotedNames) {
+  for (const char *bare : {"nan", "inf", "-inf", "infinity", "NaN", ".5",
+                           "-", "\"nan\"", "\"inf\""}) {
+    Reader r(bare);
+    EXPECT_THROW(r.float64(), ParseError) << bare;
+    if (*bare == '"')
+      continue; // any string skips
+    Reader skipped(string("[") + bare + "]");
+    skipped.begin_array();
+    ASSERT_TRUE(skipped.next_element());
+    EXPECT_THROW(skipped.skip_value(), ParseError) << bare;
+  }
+  Reader quoted("[\"NaN\", \"-Infinity\", -0.5, \"1e3\"]");
+  quoted.begin_array();
+  ASSERT_TRUE(quoted.next_element());
+  EXPECT_TRUE(isnan(quoted.float64()));
+  ASSERT_TRUE(quoted.next_element());
+  EXPECT_EQ(quoted.float64(), -numeric_limits<double>::infinity());
+  ASSERT_TRUE(quoted.next_element());
+  EXPECT_EQ(quoted.float64(), -0.5);
+  ASSERT_TRUE(quoted.next_element());
+  EXPECT_EQ(quoted.float64(), 1e3);
+}
+
+TEST(JsonGenerated_Writer, NegativeZeroIsNotDropped) {
+  mypkg::Top m;
+  m.set_f(-0.0f);
+  m.set_d(-0.0);
+  m.set_i32(0);
+  mypkg::TopWrapped w(m);
+  const string json = w.to_json();
+  EXPECT_NE(json.find("\"f\":-0"), string::npos) << json;
+  EXPECT_NE(json.find("\"d\":-0"), string::npos) << json;
+  EXPECT_EQ(json.find("i32"), string::npos) << json;
+
+  mypkg::Top back;
+  mypkg::TopWrapped(back).from_json(json);
+  EXPECT_TRUE(signbit(back.f()));
+  EXPECT_TRUE(signbit(back.d()));
+  EXPECT_EQ(mypkg::TopWrapped(back).to_json(), json);
+  EXPECT_EQ(mypkg::TopWrapped(m).to_json(), json);
+
+  m.set_d(0.0);
+  m.set_f(0.0f);
+  EXPECT_EQ(w.to_json(), "{}");
+}
+
+} // namespace
+
+TEST(JsonGenerated_Reader, NamesNullsAndUnknownFields) {
+  // JSON and proto field names, quoted 64-bit integers, enum names and
+  // numbers, map keys of every key type and base64 all read back.
+  const string json = R"({"i64": "-9000000000", "u64": 18446744073709551615,
+      "string_to_int32": {"": 1}, "mBoolU64": {"true": "7"},
+      "m_i32_str": {"-2": "neg"}, "e": "COLOR_BLUE", "sEnum": 9,
+      "rEnum": ["ONE", 0], "valsDouble": [1e-3, "-Infinity"],
+      "inner": {"deep": {"x": 4.0}}})";
+  mypkg::Top m;
+  mypkg::TopWrapped w(m);
+  w.from_json(json);
+  EXPECT_EQ(m.i64(), -9000000000LL);
+  EXPECT_EQ(m.u64(), 18446744073709551615ULL);
+  EXPECT_EQ(m.string_to_int32().at(""), 1);
+  EXPECT_EQ(m.m_bool_u64().at(true), 7u);
+  EXPECT_EQ(m.m_i32_str().at(-2), "neg");
+  EXPECT_EQ(m.e(), mypkg::COLOR_BLUE);
+  EXPECT_EQ(static_cast<int>(m.s_enum()), 9);
+  ASSERT_EQ(m.r_enum_size(), 2);
+  EXPECT_EQ(m.r_enum(0), mypkg::ONE);
+  EXPECT_EQ(m.vals_double(1), -numeric_limits<double>::infinity());
+  EXPECT_EQ(m.inner().deep().x(), 4);
+
+  mypkg::Top again;
+  mypkg::TopWrapped(again).from_json(w.to_json());
+  EXPECT_EQ(mypkg::TopWrapped(again).to_json(), w.to_json());
+
+  // null resets a field; unknown fields throw unless ignored.
+  w.from_json(R"({"i64": null, "inner": null, "rEnum": null})");
+  EXPECT_EQ(m.i64(), 0);
+  EXPECT_FALSE(m.has_inner());
+  EXPECT_EQ(m.r_enum_size(), 0);
+  EXPECT_THROW(w.from_json(R"({"nope": {"a": [1]}})"), ParseError);
+  w.from_json(R"({"nope": {"a": [1]}, "i32": 3})", true);
+  EXPECT_EQ(m.i32(), 3);
+}
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include "lite_messages.pb.h"
+#include "lite_messages.sugar.h"
+
+#ifdef GOOGLE_PROTOBUF_DESCRIPTOR_H__
+#error "the lite wrappers must not depend on descriptor.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+using namespace std;
+
+using namespace sugar;
+using namespace sugar::lite;
+
+namespace {
+using litepkg::Device;
+using litepkg::DeviceWrapped;
+using litepkg::PointWrapped;
+
+static_assert(sizeof(DeviceWrapped) == sizeof(void *));
+static_assert(is_trivially_copyable_v<DeviceWrapped>);
+static_assert(!is_copy_constructible_v<decltype(DeviceWrapped::serial)>);
+static_assert(find_field(DeviceWrapped::kFields, "ipv4")->number == 11);
+static_assert(find_field(DeviceWrapped::kFields, 4)->kind == FieldKind::kEnum);
+static_assert(find_field(DeviceWrapped::kFields, "missing") == nullptr);
+
+TEST(LiteTags, ScalarsStringsAndEnums) {
+  Device msg;
+  DeviceWrapped w(msg);
+  w.serial = 42u;
+  w.name = "edge";
+  w.level = litepkg::LEVEL_HIGH;
+  EXPECT_EQ(msg.serial(), 42u);
+  EXPECT_EQ(msg.name(), "edge");
+  EXPECT_EQ(static_cast<string_view>(w.name), "edge");
+  EXPECT_EQ(w.level.get(), litepkg::LEVEL_HIGH);
+
+  w.level = 1; // enums also take their integer value
+  EXPECT_EQ(msg.level(), litepkg::LEVEL_LOW);
+
+  Device other;
+  DeviceWrapped wo(other);
+  wo.name = w.name;
+  wo.serial = w.serial;
+  EXPECT_EQ(other.name(), "edge");
+  EXPECT_EQ(other.serial(), 42u);
+
+  // The generated equality and hash need no reflection either.
+  EXPECT_FALSE(w == wo);
+  wo.level = w.level;
+  EXPECT_TRUE(w == wo);
+  EXPECT_EQ(hash<DeviceWrapped>()(w), hash<DeviceWrapped>()(wo));
+}
+
+TEST(LiteTags, SubmessagesAndRepeated) {
+  Device msg;
+  DeviceWrapped w(msg);
+  EXPECT_FALSE(msg.has_origin());
+  w.origin.y = 4;
+  EXPECT_EQ(msg.origin().y(), 4);
+
+  w.path.push_back([](PointWrapped p) { p.x = 7; });
+  ASSERT_EQ(w.path.size(), 1);
+  EXPECT_EQ(w.path[0].x.get(), 7);
+
+  w.readings.push_back(1);
+  w.readings.push_back(2);
+  w.readings.set(0, 5);
+  int sum = 0;
+  for (int r : w.readings)
+    sum += r;
+  EXPECT_EQ(sum, 7);
+  EXPECT_THROW(w.readings.at(2), out_of_range);
+
+  w.labels.push_back("a");
+  w.labels.push_back(string_view("b"));
+  EXPECT_EQ(w.labels.back(), "b");
+  EXPECT_EQ(msg.labels_size(), 2);
+}
+
+TEST(LiteTags, MapsAndOneofs) {
+  Device msg;
+  DeviceWrapped w(msg);
+  w.counters.set("rx", 3);
+  EXPECT_EQ(msg.counters().at("rx"), 3);
+  EXPECT_EQ(w.counters.size(), 1u);
+
+  EXPECT_EQ(w.address.active_field(), nullptr);
+  msg.set_ipv4(0x7f000001u);
+  EXPECT_EQ(w.address.active_number(), 11);
+  EXPECT_EQ(w.address.active_field()->name, "ipv4");
+  w.address.clear();
+  EXPECT_EQ(msg.address_case(), Device::ADDRESS_NOT_SET);
+}
+
+} // namespace
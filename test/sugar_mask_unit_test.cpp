@@ -0,0 +1,195 @@
+#include "sugar_mask.h"
+#include "test_messages.pb.h"
+#include "test_messages_sugar.h"
+
+#include <google/protobuf/util/field_mask_util.h>
+#include <google/protobuf/util/message_differencer.h>
+
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+using namespace sugar;
+
+namespace {
+using Top = mypkg::Top;
+using google::protobuf::FieldMask;
+using google::protobuf::util::FieldMaskUtil;
+using google::protobuf::util::MessageDifferencer;
+
+using mypkg::TopWrapped;
+
+Top make_source() {
+  Top m;
+  (*m.mutable_string_to_int32())["a"] = 1;
+  (*m.mutable_string_to_int32())["b"] = 2;
+  m.add_repeated_child()->set_child_str("r");
+  m.mutable_child()->set_child_str("c");
+  m.set_s("src");
+  m.set_o_i32(4);
+  m.add_r_i32(5);
+  (*m.mutable_u64_to_child())[7].set_child_str("seven");
+  (*m.mutable_m_i32_str())[1] = "one";
+  m.mutable_inner()->mutable_deep()->set_x(3);
+  m.set_d(0.5);
+  m.set_e(mypkg::COLOR_RED);
+  m.add_r_str("x");
+  return m;
+}
+
+Top make_destination() {
+  Top m;
+  (*m.mutable_string_to_int32())["a"] = 9;
+  (*m.mutable_string_to_int32())["z"] = 9;
+  m.add_repeated_child()->set_child_str("old");
+  m.set_i32(9);
+  m.set_s("dst");
+  m.set_o_i32(8);
+  m.add_r_i32(9);
+  (*m.mutable_u64_to_child())[7].set_child_str("old");
+  (*m.mutable_u64_to_child())[8].set_child_str("eight");
+  (*m.mutable_m_i32_str())[2] = "two";
+  m.mutable_inner()->mutable_deep()->set_x(6);
+  m.set_e(mypkg::ONE);
+  return m;
+}
+
+// Reflection leaves map entries appended by MergeMessageTo in its
+// repeated view, duplicate keys included; a round trip through the wire
+// keeps the last entry per key, so maps compare by content.
+Top normalized(const Top &m) {
+  Top out;
+  out.ParseFromString(m.SerializeAsString());
+  return out;
+}
+
+FieldMask mask_of(const vector<string> &paths) {
+  FieldMask mask;
+  for (const auto &p : paths)
+    mask.add_paths(p);
+  return mask;
+}
+} // namespace
+
+TEST(CompiledMask_Compile, PathsBecomeNestedBitsets) {
+  const CompiledMask mask(Top::descriptor(),
+                          {"s", "child.child_str", "inner.deep.x", "r_i32"});
+  vector<int> selected;
+  mask.for_each([&](int i, const CompiledMask *) { selected.push_back(i); });
+  const auto *d = Top::descriptor();
+  EXPECT_EQ(selected, (vector<int>{d->FindFieldByName("child")->index(),
+                                   d->FindFieldByName("s")->index(),
+                                   d->FindFieldByName("r_i32")->index(),
+                                   d->FindFieldByName("inner")->index()}));
+  EXPECT_EQ(mask.child(d->FindFieldByName("s")->index()), nullptr);
+  const CompiledMask *inner = mask.child(d->FindFieldByName("inner")->index());
+  ASSERT_NE(inner, nullptr);
+  EXPECT_EQ(inner->descriptor(), Top::Inner::descriptor());
+  ASSERT_NE(inner->child(0), nullptr);
+  EXPECT_TRUE(inner->child(0)->selected(0));
+
+  // A whole field absorbs narrower paths in either order.
+  const int child = d->FindFieldByName("child")->index();
+  EXPECT_EQ(CompiledMask(d, {"child.child_str", "child"}).child(child), nullptr);
+  EXPECT_EQ(CompiledMask(d, {"child", "child.child_str"}).child(child), nullptr);
+  EXPECT_FALSE(CompiledMask(d).selected(child));
+
+  EXPECT_THROW(CompiledMask(d, {"nope"}), invalid_argument);
+  EXPECT_THROW(CompiledMask(d, {"r_i32.x"}), invalid_argument);
+  EXPECT_THROW(CompiledMask(d, {"repeated_child.child_str"}), invalid_argument);
+  EXPECT_THROW(CompiledMask(d, {"child."}), invalid_argument);
+  EXPECT_THROW(mask.check(mypkg::Child::descriptor()), invalid_argument);
+}
+
+TEST(CompiledMask_Merge, MatchesFieldMaskUtil) {
+  const Top src = make_source();
+  for (const auto &paths : vector<vector<string>>{
+           {"s", "i32", "o_i32"},
+           {"string_to_int32", "repeated_child", "r_i32"},
+           {"child"},
+           {"child.child_str"},
+           {"child", "s", "string_to_int32", "o_i32", "r_i32"},
+           {"u64_to_child", "m_i32_str", "d", "e", "r_str"},
+           {"inner.deep.x", "o_s"},
+           {"inner", "u64_to_child"},
+       }) {
+    const FieldMask fm = mask_of(paths);
+    Top expected = make_destination();
+    FieldMaskUtil::MergeMessageTo(src, fm, {}, &expected);
+
+    Top merged = make_destination();
+    TopWrapped::merge_masked(src, merged, CompiledMask(Top::descriptor(), fm));
+    EXPECT_TRUE(
+        MessageDifferencer::Equals(normalized(merged), normalized(expected)))
+        << fm.DebugString() << merged.DebugString() << expected.DebugString();
+  }
+
+  // A sub-path creates the submessage even when src has none, as
+  // MergeMessageTo does; a whole-field path does not.
+  Top empty, dst;
+  TopWrapped::merge_masked(empty, dst,
+                           CompiledMask(Top::descriptor(), {"child.child_str"}));
+  EXPECT_TRUE(dst.has_child());
+  dst.Clear();
+  TopWrapped::merge_masked(empty, dst, CompiledMask(Top::descriptor(), {"child"}));
+  EXPECT_FALSE(dst.has_child());
+}
+
+TEST(CompiledMask_Copy, KeepsOnlySelectedFields) {
+  const Top src = make_source();
+  Top dst = make_destination();
+  TopWrapped::copy_masked(src, dst,
+                          CompiledMask(Top::descriptor(), {"s", "child"}));
+  Top expected;
+  expected.set_s("src");
+  expected.mutable_child()->set_child_str("c");
+  EXPECT_TRUE(MessageDifferencer::Equals(dst, expected)) << dst.DebugString();
+}
+
+TEST(CompiledMask_Compile, DuplicateAndEmptyPaths) {
+  const auto *d = Top::descriptor();
+  const CompiledMask twice(d, {"s", "inner.deep.x", "s", "inner.deep.x"});
+  const CompiledMask once(d, {"s", "inner.deep.x"});
+  vector<int> a, b;
+  twice.for_each([&](int i, const CompiledMask *) { a.push_back(i); });
+  once.for_each([&](int i, const CompiledMask *) { b.push_back(i); });
+  EXPECT_EQ(a, b);
+
+  // An empty mask merges nothing and copies nothing.
+  const Top src = make_source();
+  Top merged = make_destination();
+  TopWrapped::merge_masked(src, merged, CompiledMask(d));
+  EXPECT_TRUE(MessageDifferencer::Equals(merged, make_destination()));
+  Top copied = make_destination();
+  TopWrapped::copy_masked(src, copied, CompiledMask(d));
+  EXPECT_EQ(copied.ByteSizeLong(), 0u);
+}
+
+TEST(CompiledMask_Copy, EqualsClearThenMerge) {
+  const Top src = make_source();
+  Top only_o_s;
+  only_o_s.set_o_s("only");
+  const Top &partial = only_o_s;
+  for (const Top *from : {&src, &partial}) {
+    for (const auto &paths : vector<vector<string>>{
+             {"o_s"},
+             {"o_i32", "o_s"},
+             {"inner.deep.x"},
+             {"child.child_str", "u64_to_child"},
+             {"string_to_int32", "r_str", "e"},
+         }) {
+      const FieldMask fm = mask_of(paths);
+      Top expected;
+      FieldMaskUtil::MergeMessageTo(*from, fm, {}, &expected);
+      Top copied = make_destination();
+      TopWrapped::copy_masked(*from, copied, CompiledMask(Top::descriptor(), fm));
+      EXPECT_TRUE(
+          MessageDifferencer::Equals(normalized(copied), normalized(expected)))
+          << fm.DebugString() << copied.DebugString() << expected.DebugString();
+    }
+  }
+}
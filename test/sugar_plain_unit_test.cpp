@@ -0,0 +1,170 @@
+#include "test_messages.pb.h"
+#include "test_messages_sugar.h"
+
+#include <google/protobuf/util/message_differencer.h>
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstddef>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <variant>
+#include <vector>
+
+using namespace std;
+
+using namespace sugar;
+
+namespace {
+using Top = mypkg::Top;
+using mypkg::TopPlain;
+using google::protobuf::util::MessageDifferencer;
+
+// Every field kind but maps, whose serialization order protobuf leaves
+// unspecified.
+Top populated() {
+  Top m;
+  m.set_i64(-1);
+  m.set_u32(4000000000u);
+  m.set_u64(1ull << 40);
+  m.set_b(true);
+  m.set_f(-0.5f);
+  m.set_d(3.25);
+  m.add_r_i32(-3);
+  m.add_r_i64(1ll << 50);
+  m.add_r_u32(7);
+  m.add_r_u64(0);
+  m.add_r_f(1.5f);
+  m.set_s_i32(-9);
+  m.set_s_u64(9);
+  m.set_s_d(0.125);
+  m.set_s_enum(mypkg::COLOR_BLUE);
+  for (int i = 0; i < 3; ++i)
+    m.add_repeated_child()->set_child_str("rc" + to_string(i));
+  m.add_vals_double(1.5);
+  m.add_vals_double(-2.25);
+  m.mutable_child()->set_child_str("child");
+  m.set_s("hello");
+  m.set_i32(-7);
+  m.set_e(mypkg::COLOR_RED);
+  m.set_o_i32(300);
+  m.add_r_str("x");
+  m.add_r_str("");
+  m.add_r_bool(true);
+  m.add_r_bool(false);
+  m.add_r_bool(true);
+  m.add_r_enum(mypkg::COLOR_RED);
+  m.add_r_enum(mypkg::ONE);
+  m.mutable_inner()->mutable_deep()->set_x(-1);
+  return m;
+}
+} // namespace
+
+TEST(SugarPlain_Wire, SerializeMatchesProtobufBytes) {
+  const Top m = populated();
+  const TopPlain p = TopPlain::from_proto(m);
+  EXPECT_EQ(p.byte_size(), m.ByteSizeLong());
+  EXPECT_EQ(p.serialize(), m.SerializeAsString());
+
+  // Defaults are skipped, an empty present submessage is not.
+  TopPlain q;
+  q.inner.emplace();
+  EXPECT_EQ(q.serialize(), string("\x92\x03\x00", 3));
+  EXPECT_EQ(TopPlain{}.serialize(), "");
+}
+
+TEST(SugarPlain_Conversions, ParseAndProtoRoundTrip) {
+  Top m = populated();
+  (*m.mutable_string_to_int32())["b"] = 2;
+  (*m.mutable_string_to_int32())["a"] = 1;
+  (*m.mutable_u64_to_child())[9].set_child_str("nine");
+  (*m.mutable_u64_to_child())[0];
+
+  const TopPlain p = TopPlain::from_proto(m);
+  EXPECT_EQ(TopPlain::parse(m.SerializeAsString()), p);
+  EXPECT_EQ(TopPlain::parse(p.serialize()), p);
+  EXPECT_EQ(p.choice.index(), TopPlain::kOI32);
+  EXPECT_EQ(get<TopPlain::kOI32>(p.choice), 300);
+  ASSERT_TRUE(p.inner && p.inner->deep);
+  EXPECT_EQ(p.inner->deep->x, -1);
+  EXPECT_EQ(p.u64_to_child.at(9).child_str, "nine");
+
+  Top back;
+  back.set_o_s("stale"); // cleared by to_proto
+  p.to_proto(back);
+  EXPECT_TRUE(MessageDifferencer::Equals(back, m));
+
+  Top parsed;
+  ASSERT_TRUE(parsed.ParseFromString(p.serialize()));
+  EXPECT_TRUE(MessageDifferencer::Equals(parsed, m));
+}
+
+TEST(SugarPlain_Merge, FollowsParserSemantics) {
+  Top a;
+  a.set_s("first");
+  a.set_o_s("text");
+  a.mutable_inner()->mutable_deep()->set_x(1);
+  a.add_r_enum(mypkg::COLOR_RED);
+  (*a.mutable_string_to_int32())["k"] = 1;
+  Top b;
+  b.set_s("second");
+  b.set_o_i32(4);
+  b.mutable_inner();
+  b.add_r_enum(mypkg::ONE);
+  (*b.mutable_string_to_int32())["k"] = 2;
+
+  // Concatenated messages merge as protobuf would merge them.
+  Top expected = a;
+  expected.MergeFrom(b);
+  EXPECT_EQ(TopPlain::parse(a.SerializeAsString() + b.SerializeAsString()),
+            TopPlain::from_proto(expected));
+
+  // Unpacked repeated scalars are accepted, unknown fields dropped.
+  array<byte, 32> buf{};
+  WireWriter w(buf);
+  w.scalar<35, WireKind::kBool>(true);
+  w.scalar<35, WireKind::kBool>(false);
+  w.scalar<998, WireKind::kInt64>(99);
+  w.scalar<999, WireKind::kFixed64>(1);
+  const TopPlain p = TopPlain::parse(
+      string_view(reinterpret_cast<const char *>(buf.data()), w.size()));
+  EXPECT_EQ(p.r_bool, (vector<bool>{true, false}));
+  EXPECT_EQ(p.serialize(), string("\x9a\x02\x02\x01\x00", 5));
+
+  EXPECT_THROW(TopPlain::parse(string_view("\x32\x05he", 4)), runtime_error);
+}
+
+TEST(SugarPlain_Wire, EdgeValuesMatchProtobuf) {
+  // -0.0 and NaN are not defaults, a zero oneof member is present, open
+  // enums keep unknown numbers, and a map entry may hold only defaults.
+  Top m;
+  m.set_d(-0.0);
+  m.set_f(numeric_limits<float>::quiet_NaN());
+  m.set_e(static_cast<mypkg::MyEnum>(-1));
+  m.set_i64(numeric_limits<int64_t>::min());
+  m.set_o_i32(0);
+  (*m.mutable_string_to_int32())[""] = 0;
+  const TopPlain p = TopPlain::from_proto(m);
+  EXPECT_EQ(p.serialize(), m.SerializeAsString());
+  EXPECT_EQ(p.byte_size(), m.ByteSizeLong());
+  const TopPlain back = TopPlain::parse(p.serialize());
+  EXPECT_TRUE(signbit(back.d));
+  EXPECT_TRUE(isnan(back.f));
+  EXPECT_EQ(back.e, -1);
+  EXPECT_EQ(back.choice.index(), TopPlain::kOI32);
+
+  // Map entries missing their key or value read them as defaults, like
+  // the parser does.
+  const string only_value("\x0a\x02\x10\x05", 4);
+  const string only_key("\x0a\x03\x0a\x01k", 5);
+  Top parsed;
+  ASSERT_TRUE(parsed.ParseFromString(only_value + only_key));
+  const TopPlain entries = TopPlain::parse(only_value + only_key);
+  EXPECT_EQ(entries.string_to_int32, (map<string, int32_t>{{"", 5}, {"k", 0}}));
+  EXPECT_EQ(entries, TopPlain::from_proto(parsed));
+}
\ No newline at end of file
@@ -1,10 +1,25 @@
 #include "sugar_runtime.h"
 #include "test_messages.pb.h"
+#include "test_messages_sugar.h"
+
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/dynamic_message.h>
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 using namespace std;
 
@@ -61,6 +76,45 @@ TEST(FieldProxy_AssignAndRead, ScalarsAndEnum) {
   EXPECT_EQ(static_cast<int32_t>(FP<int32_t>(msg, F(d, "e"))), 1);
 }
 
+TEST(FieldProxy_AssignAndRead, ArgumentsNormalisedPerCategory) {
+  static_assert(is_same_v<detail::canonical_t<const short &>, int64_t>);
+  static_assert(is_same_v<detail::canonical_t<unsigned char>, uint64_t>);
+  static_assert(is_same_v<detail::canonical_t<bool &>, bool>);
+  static_assert(is_same_v<detail::canonical_t<const float &>, float>);
+  static_assert(is_same_v<detail::canonical_t<const char (&)[4]>, string>);
+  static_assert(is_same_v<detail::canonical_t<string_view>, string>);
+  static_assert(is_same_v<detail::canonical_t<mypkg::MyEnum>, mypkg::MyEnum>);
+  static_assert(
+      is_same_v<detail::canonical_t<vector<int>>, detail::unsupported_value>);
+
+  Top msg;
+  auto *d = msg.GetDescriptor();
+  const short small = -3;
+  FP<int32_t>(msg, F(d, "i32")) = small;
+  EXPECT_EQ(msg.i32(), -3);
+  const long long big = 1LL << 40;
+  FP<int64_t>(msg, F(d, "i64")) = big;
+  EXPECT_EQ(msg.i64(), 1LL << 40);
+  FP<uint32_t>(msg, F(d, "u32")) = true;
+  EXPECT_EQ(msg.u32(), 1u);
+  const char *cstr = "ptr";
+  FP<string>(msg, F(d, "s")) = cstr;
+  EXPECT_EQ(msg.s(), "ptr");
+  string moved(64, 'x');
+  FP<string>(msg, F(d, "s")) = std::move(moved);
+  EXPECT_EQ(msg.s(), string(64, 'x'));
+  FP<int32_t>(msg, F(d, "e")) = mypkg::ONE;
+  EXPECT_EQ(msg.e(), mypkg::ONE);
+  EXPECT_THROW(FP<int32_t>(msg, F(d, "i32")) = vector<int>{}, runtime_error);
+
+  auto rr = RP<int32_t>(msg, F(d, "r_i32"));
+  const unsigned short us = 9;
+  EXPECT_THROW(rr.push_back(us), runtime_error);
+  rr.push_back(small);
+  rr.set(0, 4L);
+  EXPECT_EQ(msg.r_i32(0), 4);
+}
+
 TEST(FieldProxy_AssignInvalid, WrongTypes) {
   Top msg;
   auto *d = msg.GetDescriptor();
@@ -303,6 +357,173 @@ TEST(RepeatedProxy_IndexOutOfRange, Throws) {
   EXPECT_THROW(rr[0], out_of_range);
 }
 
+static vector<int32_t> ints(const Top &m) {
+  return {m.r_i32().begin(), m.r_i32().end()};
+}
+
+TEST(RepeatedProxy_Algorithms, StdAlgorithmsRunInPlace) {
+  using It = RepeatedProxy<int32_t>::iterator;
+  static_assert(is_same_v<iterator_traits<It>::iterator_category,
+                          random_access_iterator_tag>);
+
+  Top msg;
+  auto *d = msg.GetDescriptor();
+  auto rr = RP<int32_t>(msg, F(d, "r_i32"));
+  for (int v : {5, 3, 9, 1, 7})
+    rr.push_back(v);
+
+  sort(rr.begin(), rr.end());
+  EXPECT_EQ(ints(msg), (vector<int32_t>{1, 3, 5, 7, 9}));
+  EXPECT_EQ(lower_bound(rr.begin(), rr.end(), 7) - rr.begin(), 3);
+  EXPECT_EQ(rr.end()[-1], 9);
+
+  nth_element(rr.begin(), rr.begin() + 1, rr.end(), greater<int32_t>());
+  EXPECT_EQ(rr[1], 7);
+  reverse(rr.begin(), rr.end());
+  swap(*rr.begin(), *(rr.begin() + 1));
+  EXPECT_EQ(rr.size(), 5);
+
+  auto rs = RP<string>(msg, F(d, "r_str"));
+  for (const char *v : {"pear", "apple", "fig"})
+    rs.push_back(v);
+  sort(rs.begin(), rs.end());
+  EXPECT_EQ(msg.r_str(0), "apple");
+  EXPECT_EQ(msg.r_str(2), "pear");
+  EXPECT_TRUE(binary_search(rs.begin(), rs.end(), string("fig")));
+  EXPECT_TRUE(*rs.begin() == "apple");
+}
+
+TEST(RepeatedProxy_Algorithms, SortByKeySwapsSubmessages) {
+  using ChildW = MessageWrapped<mypkg::Child>;
+  Top msg;
+  auto *d = msg.GetDescriptor();
+  for (const char *v : {"c", "a", "d", "b"})
+    msg.add_repeated_child()->set_child_str(v);
+  const mypkg::Child *a = &msg.repeated_child(1);
+
+  auto rr = RP<ChildW>(msg, F(d, "repeated_child"));
+  auto name = [](ChildW w) {
+    return static_cast<mypkg::Child &>(w._msg).child_str();
+  };
+  rr.sort(name);
+  EXPECT_EQ(msg.repeated_child(0).child_str(), "a");
+  EXPECT_EQ(msg.repeated_child(3).child_str(), "d");
+  EXPECT_EQ(&msg.repeated_child(0), a);
+
+  rr.sort(name, greater<>());
+  EXPECT_EQ(msg.repeated_child(0).child_str(), "d");
+  EXPECT_EQ(msg.repeated_child(3).child_str(), "a");
+
+  iter_swap(rr.begin(), rr.begin() + 3);
+  EXPECT_EQ(msg.repeated_child(0).child_str(), "a");
+}
+
+TEST(RepeatedProxy_Algorithms, EraseRemoveIfTruncate) {
+  Top msg;
+  auto *d = msg.GetDescriptor();
+  auto rr = RP<int32_t>(msg, F(d, "r_i32"));
+  for (int v = 0; v < 10; ++v)
+    rr.push_back(v);
+
+  rr.erase(0);
+  rr.erase(2, 4);
+  EXPECT_EQ(ints(msg), (vector<int32_t>{1, 2, 5, 6, 7, 8, 9}));
+  rr.erase(rr.begin() + 5, rr.end());
+  EXPECT_EQ(ints(msg), (vector<int32_t>{1, 2, 5, 6, 7}));
+
+  EXPECT_EQ(rr.remove_if([](int32_t v) { return v % 2; }), 3);
+  EXPECT_EQ(ints(msg), (vector<int32_t>{2, 6}));
+  rr.truncate(1);
+  EXPECT_EQ(ints(msg), (vector<int32_t>{2}));
+  rr.truncate(4);
+  EXPECT_EQ(rr.size(), 1);
+
+  EXPECT_THROW(rr.erase(1), out_of_range);
+  EXPECT_THROW(rr.erase(1, 0), out_of_range);
+  EXPECT_THROW(rr.truncate(-1), out_of_range);
+}
+
+static vector<string> child_strs(const Top &m) {
+  vector<string> out;
+  for (const auto &c : m.repeated_child())
+    out.push_back(c.child_str());
+  return out;
+}
+
+TEST(RepeatedProxy_Transfer, ReleaseAndAddAllocatedKeepPointers) {
+  using ChildW = MessageWrapped<mypkg::Child>;
+  Top src, dst;
+  auto *d = src.GetDescriptor();
+  for (const char *v : {"a", "b", "c"})
+    src.add_repeated_child()->set_child_str(v);
+  const mypkg::Child *b = &src.repeated_child(1);
+
+  auto from = RP<ChildW>(src, F(d, "repeated_child"));
+  auto to = RP<ChildW>(dst, F(d, "repeated_child"));
+  unique_ptr<Msg> owned = from.release(1);
+  EXPECT_EQ(owned.get(), b);
+  EXPECT_EQ(child_strs(src), (vector<string>{"a", "c"}));
+
+  to.add_allocated(std::move(owned));
+  EXPECT_EQ(&dst.repeated_child(0), b);
+  EXPECT_THROW(to.add_allocated(make_unique<Top>()), runtime_error);
+  EXPECT_THROW((void)from.release(2), out_of_range);
+}
+
+TEST(RepeatedProxy_Transfer, TakeFromMovesRangesInOrder) {
+  using ChildW = MessageWrapped<mypkg::Child>;
+  Top src, dst;
+  auto *d = src.GetDescriptor();
+  for (const char *v : {"a", "b", "c", "d", "e"})
+    src.add_repeated_child()->set_child_str(v);
+  dst.add_repeated_child()->set_child_str("x");
+  const mypkg::Child *c = &src.repeated_child(2);
+
+  auto from = RP<ChildW>(src, F(d, "repeated_child"));
+  auto to = RP<ChildW>(dst, F(d, "repeated_child"));
+  to.take_from(from, 1, 4);
+  EXPECT_EQ(child_strs(src), (vector<string>{"a", "e"}));
+  EXPECT_EQ(child_strs(dst), (vector<string>{"x", "b", "c", "d"}));
+  EXPECT_EQ(&dst.repeated_child(2), c);
+
+  to.take_from(from);
+  EXPECT_EQ(src.repeated_child_size(), 0);
+  EXPECT_EQ(child_strs(dst), (vector<string>{"x", "b", "c", "d", "a", "e"}));
+  EXPECT_THROW(to.take_from(to), runtime_error);
+  EXPECT_THROW(to.take_from(from, 0, 1), out_of_range);
+}
+
+TEST(RepeatedProxy_Transfer, RespectsArenaOwnership) {
+  using ChildW = MessageWrapped<mypkg::Child>;
+  google::protobuf::Arena arena, other_arena;
+  auto *a = google::protobuf::Arena::CreateMessage<Top>(&arena);
+  auto *b = google::protobuf::Arena::CreateMessage<Top>(&arena);
+  auto *c = google::protobuf::Arena::CreateMessage<Top>(&other_arena);
+  auto *d = a->GetDescriptor();
+  for (const char *v : {"a", "b"})
+    a->add_repeated_child()->set_child_str(v);
+  const mypkg::Child *first = &a->repeated_child(0);
+
+  // Same arena: pointers move.
+  auto ra = RP<ChildW>(*a, F(d, "repeated_child"));
+  auto rb = RP<ChildW>(*b, F(d, "repeated_child"));
+  rb.take_from(ra);
+  EXPECT_EQ(&b->repeated_child(0), first);
+
+  // Out of an arena: copied once, onto the destination's arena.
+  auto rc = RP<ChildW>(*c, F(d, "repeated_child"));
+  rc.take_from(rb, 0, 1);
+  EXPECT_EQ(c->repeated_child(0).child_str(), "a");
+  EXPECT_EQ(c->repeated_child(0).GetArena(), &other_arena);
+  EXPECT_EQ(child_strs(*b), (vector<string>{"b"}));
+
+  // Released from an arena: a heap copy the caller owns.
+  unique_ptr<Msg> owned = rb.release(0);
+  EXPECT_EQ(owned->GetArena(), nullptr);
+  rc.add_allocated(std::move(owned));
+  EXPECT_EQ(child_strs(*c), (vector<string>{"a", "b"}));
+}
+
 TEST(MapProxy_SubmessageNotSupported, Throws) {
   Top msg;
   auto *d = msg.GetDescriptor();
@@ -312,4 +533,444 @@ TEST(MapProxy_SubmessageNotSupported, Throws) {
                runtime_error);
 }
 
+TEST(Hash_Helpers, MapHashIsOrderIndependent) {
+  Top a, b;
+  (*a.mutable_string_to_int32())["x"] = 1;
+  (*a.mutable_string_to_int32())["y"] = 2;
+  (*b.mutable_string_to_int32())["y"] = 2;
+  (*b.mutable_string_to_int32())["x"] = 1;
+  EXPECT_EQ(hash_map(a.string_to_int32()), hash_map(b.string_to_int32()));
+  EXPECT_TRUE(map_equal(a.string_to_int32(), b.string_to_int32()));
+  (*b.mutable_string_to_int32())["x"] = 3;
+  EXPECT_NE(hash_map(a.string_to_int32()), hash_map(b.string_to_int32()));
+  EXPECT_FALSE(map_equal(a.string_to_int32(), b.string_to_int32()));
+}
+
+TEST(Hash_Helpers, RangeHashIsOrderSensitive) {
+  Top a, b;
+  a.add_r_i32(1);
+  a.add_r_i32(2);
+  b.add_r_i32(2);
+  b.add_r_i32(1);
+  EXPECT_NE(hash_range(a.r_i32()), hash_range(b.r_i32()));
+  EXPECT_FALSE(range_equal(a.r_i32(), b.r_i32()));
+  b.Clear();
+  b.add_r_i32(1);
+  b.add_r_i32(2);
+  EXPECT_EQ(hash_range(a.r_i32()), hash_range(b.r_i32()));
+  EXPECT_TRUE(range_equal(a.r_i32(), b.r_i32()));
+}
+
+TEST(Hash_Helpers, ScalarHashMatchesEquality) {
+  EXPECT_EQ(hash_scalar(0.0), hash_scalar(-0.0));
+  EXPECT_TRUE(scalar_equal(0.0f, -0.0f));
+  // NaNs with different payloads and signs are one value.
+  EXPECT_TRUE(scalar_equal(nan("1"), -nan("2")));
+  EXPECT_EQ(hash_scalar(nan("1")), hash_scalar(-nan("2")));
+  EXPECT_FALSE(scalar_equal(nan(""), 0.0));
+  EXPECT_TRUE(range_equal(vector<float>{nanf("")}, vector<float>{nanf("3")}));
+  EXPECT_EQ(hash_scalar(string("abc")), hash_scalar(string("abc")));
+  EXPECT_EQ(hash_scalar(mypkg::ONE), hash_scalar(1));
+  size_t h1 = 0, h2 = 0;
+  hash_combine(h1, 1);
+  hash_combine(h1, 2);
+  hash_combine(h2, 2);
+  hash_combine(h2, 1);
+  EXPECT_NE(h1, h2);
+}
+
+TEST(Hash_Helpers, GeneratedEqualityAgreesWithHash) {
+  Top a, b;
+  a.set_d(nan("1"));
+  b.set_d(-nan("2"));
+  a.set_f(0.0f);
+  b.set_f(-0.0f);
+  a.set_s_d(nan(""));
+  b.set_s_d(nan(""));
+  a.add_vals_double(nan("4"));
+  b.add_vals_double(nan("5"));
+  (*a.mutable_m_i64_dbl())[1] = nan("");
+  (*b.mutable_m_i64_dbl())[1] = -nan("");
+  (*a.mutable_m_u32_float())[2] = -0.0f;
+  (*b.mutable_m_u32_float())[2] = 0.0f;
+  EXPECT_TRUE(mypkg::TopWrapped::equal(a, b));
+  EXPECT_TRUE(mypkg::TopWrapped::equal(a, a));
+  EXPECT_EQ(mypkg::TopWrapped::hash_of(a), mypkg::TopWrapped::hash_of(b));
+
+  b.set_s_d(1.0);
+  EXPECT_FALSE(mypkg::TopWrapped::equal(a, b));
+  b.set_s_d(nan(""));
+  b.set_vals_double(0, 1.0);
+  EXPECT_FALSE(mypkg::TopWrapped::equal(a, b));
+}
+
+TEST(Hash_Helpers, MessageFunctorsDelegateToWrapper) {
+  struct FakeWrapped {
+    static size_t hash_of(const mypkg::Child &c) {
+      return c.child_str().size();
+    }
+    static bool equal(const mypkg::Child &a, const mypkg::Child &b) {
+      return a.child_str() == b.child_str();
+    }
+  };
+  Top a, b;
+  a.add_repeated_child()->set_child_str("abc");
+  b.add_repeated_child()->set_child_str("xyz");
+  EXPECT_EQ(hash_range(a.repeated_child(), MessageHash<FakeWrapped>{}),
+            hash_range(b.repeated_child(), MessageHash<FakeWrapped>{}));
+  EXPECT_FALSE(range_equal(a.repeated_child(), b.repeated_child(),
+                           MessageEqual<FakeWrapped>{}));
+}
+
+
+// Hand-written counterpart of a generated compact wrapper over Top.
+template <typename Access> union ChildFields {
+  FieldTag<Access, 0, string> child_str;
+
+private:
+  ChildFields(const ChildFields &) = default;
+  friend typename Access::parent::owner;
+};
+
+struct TopCompact {
+  using Access = RootAccess<TopCompact, Top>;
+  union {
+    Top *_msg;
+    MapTag<Access, 0, string, int32_t> string_to_int32;
+    RepeatedTag<Access, 3, double> vals_double;
+    ChildFields<SubmessageAccess<Access, &Top::mutable_child, ChildFields>>
+        child;
+    FieldTag<Access, 5, string> s;
+    FieldTag<Access, 6, int32_t> i32;
+    OneofTag<Access, 0> choice;
+  };
+
+  explicit TopCompact(Top &m) noexcept : _msg(&m) {}
+};
+
+static_assert(sizeof(TopCompact) == sizeof(void *));
+static_assert(is_trivially_copyable_v<TopCompact>);
+static_assert(!is_copy_constructible_v<decltype(TopCompact::i32)>);
+static_assert(!is_copy_constructible_v<decltype(TopCompact::child)>);
+
+int32_t bump(TopCompact w) { return w.i32 = w.i32 + 1; }
+
+TEST(CompactWrapper_Tags, ProxiesBuiltOnAccess) {
+  Top msg;
+  TopCompact w(msg);
+  w.i32 = 41;
+  EXPECT_EQ(bump(w), 42);
+  EXPECT_EQ(msg.i32(), 42);
+  w.s = "hi";
+  EXPECT_EQ(w.s.get(), "hi");
+  EXPECT_EQ(static_cast<string_view>(w.s), "hi");
+
+  EXPECT_FALSE(msg.has_child());
+  w.child.child_str = "c";
+  EXPECT_EQ(msg.child().child_str(), "c");
+
+  w.string_to_int32.set("k", 3);
+  EXPECT_EQ(msg.string_to_int32().at("k"), 3);
+
+  w.choice.set("o_i32", [](Msg &m, const FD &f) {
+    m.GetReflection()->SetInt32(&m, &f, 9);
+  });
+  EXPECT_EQ(w.choice.active_field()->name(), "o_i32");
+}
+
+TEST(CompactWrapper_Tags, TagAssignmentCopiesValues) {
+  Top a, b;
+  TopCompact wa(a), wb(b);
+  wb.i32 = 7;
+  wb.s = "x";
+  wa.i32 = wb.i32;
+  wa.s = wb.s;
+  EXPECT_EQ(a.i32(), 7);
+  EXPECT_EQ(a.s(), "x");
+}
+
+TEST(CompactWrapper_Tags, IteratorsOutliveTemporaryProxy) {
+  Top msg;
+  TopCompact w(msg);
+  w.vals_double.push_back(1.5);
+  w.vals_double.push_back(2.5);
+  double sum = 0;
+  for (double v : w.vals_double)
+    sum += v;
+  EXPECT_DOUBLE_EQ(sum, 4.0);
+  EXPECT_EQ(w.vals_double.size(), 2);
+  EXPECT_DOUBLE_EQ(w.vals_double.back(), 2.5);
+}
+
+// ---- Field visitation ------------------------------------------------------
+
+using mypkg::InnerWrapped;
+using mypkg::TopWrapped;
+
+static_assert(get<4>(TopWrapped::kFieldList).name == "child");
+static_assert(tuple_element_t<6, decltype(TopWrapped::kFieldList)>::number ==
+              7);
+
+// A generic writer of the kind for_each_field exists for: one visitor for
+// every wrapper, recursing into submessages.
+struct Describe {
+  ostream &out;
+
+  template <typename F, typename V>
+  void operator()(const F &field, const V &value) const {
+    out << field.name << '#' << F::number;
+    if constexpr (F::cardinality == Cardinality::kMap)
+      out << '{' << value.size() << '}';
+    else if constexpr (F::cardinality == Cardinality::kRepeated)
+      out << '[' << value.size() << ']';
+    else if constexpr (F::kind == FieldKind::kMessage) {
+      out << '(';
+      for_each_field<typename F::wrapped>(value, *this);
+      out << ')';
+    } else
+      out << '=' << value;
+    out << ' ';
+  }
+};
+
+TEST(FieldVisitation, VisitsEveryFieldInOrder) {
+  Top msg;
+  TopWrapped w(msg);
+  vector<pair<string_view, int>> seen;
+  for_each_field(w, [&](auto field, const auto &) {
+    seen.emplace_back(field.name, decltype(field)::number);
+  });
+  const auto *d = Top::descriptor();
+  ASSERT_EQ(seen.size(), static_cast<size_t>(d->field_count()));
+  for (int i = 0; i < d->field_count(); ++i) {
+    EXPECT_EQ(seen[i].first, d->field(i)->name());
+    EXPECT_EQ(seen[i].second, d->field(i)->number());
+  }
+
+  w.s = "hi";
+  w.i32 = 7;
+  w.child.child_str = "c";
+  w.vals_double.push_back(1.0);
+  w.vals_double.push_back(2.0);
+  w.inner.deep.x = 3;
+  ostringstream out;
+  for_each_field(w, Describe{out});
+  const string described = out.str();
+  EXPECT_EQ(described.rfind("string_to_int32#1{0} ", 0), 0u) << described;
+  EXPECT_NE(described.find(" vals_double#4[2] child#5(child_str#1=c ) s#6=hi "
+                           "i32#7=7 "),
+            string::npos)
+      << described;
+  EXPECT_TRUE(described.ends_with(" inner#50(deep#1(x#1=3 ) ) ")) << described;
+
+  out.str("");
+  for_each_field(InnerWrapped(*msg.mutable_inner()), Describe{out});
+  EXPECT_EQ(out.str(), "deep#1(x#1=3 ) ");
+
+  // Visitors that write go through the wrapper's tags.
+  for_each_field(w, [&](auto field, const auto &) {
+    using F = decltype(field);
+    if constexpr (F::kind == FieldKind::kInt32 &&
+                  F::cardinality == Cardinality::kSingular)
+      w.*F::member = F::number * 10;
+  });
+  EXPECT_EQ(msg.i32(), 70);
+  EXPECT_EQ(msg.o_i32(), 160);
+  EXPECT_EQ(msg.s_i32(), 400);
+}
+
+// ---- Access by name --------------------------------------------------------
+
+struct ChildNames {
+  static constexpr NameTable<mypkg::Child, 1, 1, 1> kByName = {
+      {{
+          {"child_str", 0,
+           [](mypkg::Child &m, const FieldValue &v) {
+             const auto s = v.as<string_view>();
+             m.mutable_child_str()->assign(s.data(), s.size());
+           },
+           [](const mypkg::Child &m) { return FieldValue(m.child_str()); },
+           nullptr, nullptr},
+      }},
+      {{0}},
+      {{0}},
+  };
+};
+
+// The generator picks seeds offline; here one bucket is enough.
+constexpr auto kTopNames = [] {
+  NameTable<Top, 4, 1, 8> t = {
+      {{
+          {"i32", 6,
+           [](Top &m, const FieldValue &v) { m.set_i32(v.as<int32_t>()); },
+           [](const Top &m) { return FieldValue(m.i32()); }, nullptr,
+           nullptr},
+          {"d", 12, [](Top &m, const FieldValue &v) { m.set_d(v.as<double>()); },
+           [](const Top &m) { return FieldValue(m.d()); }, nullptr, nullptr},
+          {"e", 13,
+           [](Top &m, const FieldValue &v) {
+             static constexpr EnumName kNames[] = {{"ZERO", 0}, {"ONE", 1}};
+             m.set_e(static_cast<mypkg::MyEnum>(v.enum_number(kNames)));
+           },
+           [](const Top &m) { return FieldValue(m.e()); }, nullptr, nullptr},
+          {"child", 4, nullptr, nullptr,
+           &set_nested<Top, ChildNames, &Top::mutable_child>,
+           &get_nested<Top, ChildNames, &Top::child>},
+      }},
+      {{0}},
+      {},
+  };
+  for (uint16_t seed = 0;; ++seed) {
+    t.slots.fill(-1);
+    bool ok = true;
+    for (int i = 0; ok && i < 4; ++i) {
+      auto &slot = t.slots[name_slot(name_hash(t.fields[i].name), seed, 8)];
+      ok = slot == -1;
+      slot = static_cast<int16_t>(i);
+    }
+    if (ok) {
+      t.seeds[0] = seed;
+      return t;
+    }
+  }
+}();
+
+static_assert(kTopNames.find("e")->index == 13);
+static_assert(kTopNames.find("f") == nullptr);
+
+TEST(FieldValue_Conversions, ParsesStringsAndChecksRanges) {
+  EXPECT_EQ(FieldValue("42").as<int32_t>(), 42);
+  EXPECT_EQ(FieldValue(7u).as<int64_t>(), 7);
+  EXPECT_DOUBLE_EQ(FieldValue("2.5").as<double>(), 2.5);
+  EXPECT_TRUE(FieldValue("true").as<bool>());
+  EXPECT_FALSE(FieldValue(0).as<bool>());
+  EXPECT_EQ(FieldValue(string("x")).as<string_view>(), "x");
+  EXPECT_THROW((void)FieldValue("4x").as<int32_t>(), invalid_argument);
+  EXPECT_THROW((void)FieldValue(-1).as<uint32_t>(), out_of_range);
+  EXPECT_THROW((void)FieldValue(int64_t{1} << 40).as<int32_t>(),
+               out_of_range);
+  EXPECT_THROW((void)FieldValue(1).as<string_view>(), invalid_argument);
+  EXPECT_THROW((void)FieldValue(2).as<bool>(), invalid_argument);
+  EXPECT_FALSE(FieldValue().has_value());
+}
+
+TEST(NameTable_ByName, SetsAndGetsScalars) {
+  Top msg;
+  EXPECT_TRUE(kTopNames.set(msg, "i32", "12"));
+  EXPECT_TRUE(kTopNames.set(msg, "d", 0.5f));
+  EXPECT_TRUE(kTopNames.set(msg, "e", "ONE"));
+  EXPECT_EQ(msg.i32(), 12);
+  EXPECT_DOUBLE_EQ(msg.d(), 0.5);
+  EXPECT_EQ(msg.e(), mypkg::ONE);
+  EXPECT_EQ(kTopNames.get(msg, "i32").as<int>(), 12);
+  EXPECT_EQ(kTopNames.get(msg, "e").as<int>(), 1);
+  EXPECT_THROW(kTopNames.set(msg, "e", "PURPLE"), invalid_argument);
+
+  EXPECT_FALSE(kTopNames.set(msg, "missing", 1));
+  EXPECT_FALSE(kTopNames.set(msg, "child", 1));
+  EXPECT_FALSE(kTopNames.get(msg, "missing").has_value());
+}
+
+TEST(NameTable_ByName, DottedPathsReachSubmessages) {
+  Top msg;
+  EXPECT_TRUE(kTopNames.set(msg, "child.child_str", "c"));
+  EXPECT_EQ(msg.child().child_str(), "c");
+  EXPECT_EQ(kTopNames.get(msg, "child.child_str").as<string_view>(), "c");
+  EXPECT_FALSE(kTopNames.set(msg, "child.nope", "c"));
+  EXPECT_FALSE(kTopNames.set(msg, "i32.x", 1));
+}
+
+// ---- Dynamic messages ------------------------------------------------------
+
+// test_messages.proto loaded into its own pool, as a schema read at runtime
+// would be; no generated class backs these messages.
+class DynamicWrapped_Top : public ::testing::Test {
+protected:
+  void SetUp() override {
+    google::protobuf::FileDescriptorProto proto;
+    Top::descriptor()->file()->CopyTo(&proto);
+    const auto *file = pool_.BuildFile(proto);
+    ASSERT_NE(file, nullptr);
+    type_ = file->FindMessageTypeByName("Top");
+    msg_.reset(factory_.GetPrototype(type_)->New());
+  }
+
+  google::protobuf::DescriptorPool pool_;
+  google::protobuf::DynamicMessageFactory factory_{&pool_};
+  const google::protobuf::Descriptor *type_{};
+  unique_ptr<Msg> msg_;
+};
+
+TEST_F(DynamicWrapped_Top, ProxySyntaxMatchesGeneratedWrappers) {
+  DynamicWrapped w(*msg_);
+  w["i32"] = 5;
+  w["s"] = "hello";
+  w["e"] = 2;
+  w["child"]["child_str"] = "c";
+  w["inner"]["deep"]["x"] = 7;
+  w.repeated<int32_t>("r_i32").push_back(3);
+  w.map<string, int64_t>("m_str_i64").set("k", 9);
+  w["s_i32"] = w["i32"];
+
+  const int i32 = w["i32"];
+  EXPECT_EQ(i32, 5);
+  EXPECT_EQ(static_cast<string_view>(w["s"]), "hello");
+  EXPECT_EQ(w["s_i32"].get<int32_t>(), 5);
+  EXPECT_EQ(w["inner"].message()["deep"]["x"].get<int32_t>(), 7);
+  EXPECT_EQ(w.repeated<int32_t>("r_i32")[0], 3);
+
+  Top typed;
+  ASSERT_TRUE(typed.ParseFromString(msg_->SerializeAsString()));
+  EXPECT_EQ(typed.child().child_str(), "c");
+  EXPECT_EQ(typed.e(), mypkg::COLOR_RED);
+  EXPECT_EQ(typed.m_str_i64().at("k"), 9);
+
+  ostringstream os;
+  os << w["inner"] << " " << w["e"];
+  EXPECT_EQ(os.str(), "deep { x: 7 } 2");
+}
+
+TEST_F(DynamicWrapped_Top, SlotsSkipNameLookups) {
+  const auto &plan = MessagePlan::of(type_);
+  ASSERT_EQ(plan.slots().size(),
+            static_cast<size_t>(type_->field_count()));
+  const auto &child = plan.slot("child");
+  const auto &child_str = child.nested().slot("child_str");
+  DynamicWrapped w(*msg_, plan);
+  w[child][child_str] = "x";
+  EXPECT_EQ(w["child"]["child_str"].get<string>(), "x");
+  EXPECT_EQ(plan.find("nope"), nullptr);
+  EXPECT_TRUE(plan.slot("r_i32").repeated);
+  EXPECT_TRUE(plan.slot("m_i32_str").map);
+}
+
+TEST_F(DynamicWrapped_Top, PlansAreSharedAcrossThreads) {
+  const MessagePlan *first = &MessagePlan::of(type_);
+  vector<const MessagePlan *> seen(8);
+  vector<thread> threads;
+  for (size_t t = 0; t < seen.size(); ++t)
+    threads.emplace_back([&, t] {
+      for (int k = 0; k < 1000; ++k) {
+        unique_ptr<Msg> m(factory_.GetPrototype(type_)->New());
+        DynamicWrapped w(*m);
+        w["i32"] = k;
+        w["child"]["child_str"] = "t";
+        seen[t] = &w.plan();
+      }
+    });
+  for (auto &t : threads)
+    t.join();
+  for (const auto *p : seen)
+    EXPECT_EQ(p, first);
+}
+
+TEST_F(DynamicWrapped_Top, UnknownNamesAndMisuseThrow) {
+  DynamicWrapped w(*msg_);
+  EXPECT_THROW((void)w["nope"], runtime_error);
+  EXPECT_THROW((void)w["i32"]["x"], runtime_error);
+  EXPECT_THROW((void)w.oneof("nope"), runtime_error);
+  EXPECT_THROW(w["child"] = 1, runtime_error);
+  w.oneof("choice").clear();
+}
+
 } // namespace
@@ -0,0 +1,142 @@
+#include "sugar_runtime.h"
+#include "sugar_snapshot.h"
+#include "test_messages.pb.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+using namespace sugar;
+
+namespace {
+using Top = mypkg::Top;
+
+struct TopSnap {
+  using Access = RootAccess<TopSnap, Top>;
+  union {
+    Top *_msg;
+    FieldTag<Access, 5, string> s;
+    FieldTag<Access, 6, int32_t> i32;
+    FieldTag<Access, 7, int64_t> i64;
+  };
+
+  static constexpr NameTable<Top, 1, 1, 1> kByName = {
+      {{
+          {"i32", 6,
+           [](Top &m, const FieldValue &v) { m.set_i32(v.as<int32_t>()); },
+           [](const Top &m) { return FieldValue(m.i32()); }, nullptr,
+           nullptr},
+      }},
+      {{0}},
+      {{0}},
+  };
+
+  [[nodiscard]] static size_t hash_of(const Top &m) noexcept {
+    return hash<int32_t>{}(m.i32());
+  }
+
+  explicit TopSnap(Top &m) noexcept : _msg(&m) {}
+};
+
+using TopSnapshot = Snapshot<TopSnap>;
+
+Top make_top(int32_t v) {
+  Top m;
+  m.set_i32(v);
+  m.set_i64(v);
+  return m;
+}
+} // namespace
+
+TEST(Snapshot_Publish, UpdateEditsACopyThenPublishes) {
+  TopSnapshot snap(make_top(1));
+  auto before = snap.load();
+  snap.update([](TopSnap w) {
+    w.i32 = 2;
+    w.s = "two";
+  });
+
+  EXPECT_EQ(before->i32(), 1);
+  EXPECT_TRUE(before->s().empty());
+  const auto r = snap.read();
+  EXPECT_EQ(r->i32(), 2);
+  EXPECT_EQ((*r).s(), "two");
+  EXPECT_EQ(r.get_by_name("i32").as<int>(), 2);
+  EXPECT_EQ(r.hash_value(), hash<int32_t>{}(2));
+
+  snap.store(make_top(3));
+  EXPECT_EQ(snap.read()->i32(), 3);
+  EXPECT_EQ(snap.load()->i64(), 3);
+}
+
+TEST(Snapshot_Read, ReadersStayOnTheirVersion) {
+  TopSnapshot snap(make_top(1));
+  const auto outer = snap.read();
+  snap.store(make_top(2));
+  {
+    const auto inner = snap.read();
+    EXPECT_EQ(inner->i32(), 2);
+    // Pin every cache entry so the next reads have to own a reference.
+    snap.store(make_top(3));
+    const auto r3 = snap.read();
+    snap.store(make_top(4));
+    const auto r4 = snap.read();
+    snap.store(make_top(5));
+    const auto r5 = snap.read();
+    EXPECT_EQ(r5->i32(), 5);
+    EXPECT_EQ(r3->i32(), 3);
+    EXPECT_EQ(r4->i32(), 4);
+  }
+  EXPECT_EQ(outer->i32(), 1);
+
+  // Two holders never share cache entries.
+  TopSnapshot other(make_top(7));
+  EXPECT_EQ(other.read()->i32(), 7);
+  EXPECT_EQ(snap.read()->i32(), 5);
+
+  shared_ptr<const Top> kept;
+  {
+    const auto r = snap.read();
+    kept = r.share();
+  }
+  snap.store(make_top(6));
+  EXPECT_EQ(snap.read()->i32(), 6);
+  EXPECT_EQ(kept->i32(), 5);
+}
+
+TEST(Snapshot_Concurrency, ReadersNeverSeeTornUpdates) {
+  TopSnapshot snap(make_top(0));
+  atomic<bool> done{false};
+  atomic<int> torn{0};
+  vector<thread> readers;
+  for (int t = 0; t < 4; ++t)
+    readers.emplace_back([&] {
+      int32_t last = 0;
+      while (!done.load(memory_order_relaxed)) {
+        const auto r = snap.read();
+        if (r->i32() != r->i64() || r->i32() < last)
+          torn.fetch_add(1);
+        last = r->i32();
+      }
+    });
+
+  for (int32_t v = 1; v <= 2000; ++v)
+    snap.update([v](TopSnap w) {
+      w.i32 = v;
+      w.i64 = int64_t{v};
+    });
+  done = true;
+  for (auto &t : readers)
+    t.join();
+
+  EXPECT_EQ(torn.load(), 0);
+  EXPECT_EQ(snap.read()->i64(), 2000);
+}
@@ -0,0 +1,165 @@
+#include "sugar_runtime.h"
+#include "sugar_varint.h"
+#include "test_messages.pb.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+using namespace sugar;
+
+namespace {
+using Top = mypkg::Top;
+
+struct TopNumbers {
+  using Access = RootAccess<TopNumbers, Top>;
+  union {
+    Top *_msg;
+    RepeatedTag<Access, 25, int32_t> r_i32;
+    RepeatedTag<Access, 31, int> r_enum;
+  };
+
+  explicit TopNumbers(Top &m) noexcept : _msg(&m) {}
+};
+
+// Varints of every length, including runs that fit the vector paths.
+template <typename T> vector<T> mixed_values(size_t n) {
+  mt19937_64 rng(42);
+  vector<T> v(n);
+  for (size_t i = 0; i < n; ++i) {
+    const uint64_t r = rng();
+    switch (i / 40 % 4) {
+    case 0: // one byte
+      v[i] = static_cast<T>(r & 0x7f);
+      break;
+    case 1: // one or two bytes
+      v[i] = static_cast<T>(r & 0x3fff);
+      break;
+    case 2: // up to four bytes
+      v[i] = static_cast<T>(r >> (36 + r % 28));
+      break;
+    default: // anything, negative included
+      v[i] = static_cast<T>(r >> (r % 64));
+    }
+  }
+  return v;
+}
+
+// The packed payload of the only field in bytes.
+span<const byte> payload(const string &bytes) {
+  if (bytes.empty())
+    return {};
+  const byte *p = reinterpret_cast<const byte *>(bytes.data());
+  const byte *end = p + bytes.size();
+  uint64_t tag, len;
+  EXPECT_TRUE(detail::read_varint(p, end, tag));
+  EXPECT_TRUE(detail::read_varint(p, end, len));
+  EXPECT_EQ(static_cast<size_t>(end - p), len);
+  return {p, end};
+}
+
+template <typename T, typename Field>
+void round_trip(const vector<T> &values, Field *(Top::*mutable_field)()) {
+  Top m;
+  auto *field = (m.*mutable_field)();
+  field->Add(values.begin(), values.end());
+  const string bytes = m.SerializeAsString();
+  const auto packed = payload(bytes);
+
+  EXPECT_EQ(count_varints(packed), values.size());
+  vector<T> decoded(values.size() + 3);
+  EXPECT_EQ(decode_varints(packed, span(decoded)), values.size());
+  decoded.resize(values.size());
+  EXPECT_EQ(decoded, values);
+
+  vector<T> scalar(values.size());
+  detail::decode_varints_scalar(packed.data(), packed.data() + packed.size(),
+                                scalar.data(), scalar.size());
+  EXPECT_EQ(scalar, values);
+
+  // The encoder writes protobuf's bytes and nothing past them.
+  EXPECT_EQ(varints_size(span<const T>(values)), packed.size());
+  vector<byte> out(packed.size() + 16, byte{0x55});
+  EXPECT_EQ(encode_varints(span<const T>(values), span(out)), packed.size());
+  EXPECT_TRUE(equal(packed.begin(), packed.end(), out.begin()));
+  EXPECT_EQ(out[packed.size()], byte{0x55});
+}
+} // namespace
+
+TEST(Varints, RoundTripAgainstProtobufForEveryWidth) {
+  for (size_t n : {0u, 1u, 15u, 17u, 1000u, 5003u}) {
+    round_trip(mixed_values<int32_t>(n), &Top::mutable_r_i32);
+    round_trip(mixed_values<int64_t>(n), &Top::mutable_r_i64);
+    round_trip(mixed_values<uint32_t>(n), &Top::mutable_r_u32);
+    round_trip(mixed_values<uint64_t>(n), &Top::mutable_r_u64);
+  }
+  round_trip(vector<int32_t>(100, -1), &Top::mutable_r_i32);
+  round_trip(vector<uint64_t>(100, ~uint64_t{0}), &Top::mutable_r_u64);
+}
+
+TEST(Varints, AppendsToRepeatedFieldsAndWrapperFields) {
+  const auto values = mixed_values<int32_t>(777);
+  Top src;
+  src.mutable_r_i32()->Add(values.begin(), values.end());
+  const string bytes = src.SerializeAsString();
+  const auto packed = payload(bytes);
+
+  Top m;
+  m.add_r_i32(5);
+  EXPECT_EQ(decode_varints(packed, *m.mutable_r_i32()), values.size());
+  ASSERT_EQ(m.r_i32_size(), 778);
+  EXPECT_EQ(m.r_i32(0), 5);
+  EXPECT_EQ(m.r_i32(777), values.back());
+
+  Top w_msg;
+  TopNumbers w(w_msg);
+  EXPECT_EQ(decode_varints(packed, w.r_i32), values.size());
+  EXPECT_TRUE(equal(values.begin(), values.end(), w_msg.r_i32().begin()));
+
+  // Enums go through int32 storage.
+  const vector<byte> enums{byte{1}, byte{3}, byte{0}};
+  EXPECT_EQ(decode_varints(enums, w.r_enum.proxy()), 3u);
+  ASSERT_EQ(w_msg.r_enum_size(), 3);
+  EXPECT_EQ(w_msg.r_enum(1), 3);
+}
+
+TEST(Varints, RejectsMalformedInputAndSmallBuffers) {
+  vector<int64_t> out(16);
+  const vector<byte> cut{byte{1}, byte{0x80}};
+  EXPECT_THROW((void)count_varints(cut), runtime_error);
+  EXPECT_THROW((void)decode_varints(cut, span(out)), runtime_error);
+
+  // Eleven bytes is too long for a varint, with and without the vector path.
+  for (size_t pad : {0u, 40u}) {
+    vector<byte> overlong(pad, byte{1});
+    overlong.insert(overlong.end(), 10, byte{0x80});
+    overlong.push_back(byte{1});
+    vector<int64_t> big(overlong.size());
+    EXPECT_THROW((void)decode_varints(overlong, span(big)), runtime_error);
+  }
+
+  const vector<byte> three{byte{1}, byte{2}, byte{3}};
+  vector<int64_t> two(2);
+  EXPECT_THROW((void)decode_varints(three, span(two)), length_error);
+
+  // A failed append leaves the field as it was.
+  Top m;
+  m.add_r_i64(9);
+  vector<byte> bad(64, byte{1});
+  bad.insert(bad.end(), 11, byte{0x80});
+  bad.push_back(byte{1});
+  EXPECT_THROW((void)decode_varints(bad, *m.mutable_r_i64()), runtime_error);
+  ASSERT_EQ(m.r_i64_size(), 1);
+
+  const vector<uint32_t> values{1, 300, 70000};
+  vector<byte> small(4);
+  EXPECT_THROW((void)encode_varints(span<const uint32_t>(values), span(small)),
+               length_error);
+}
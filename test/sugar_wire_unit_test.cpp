@@ -0,0 +1,365 @@
+#include "sugar_wire.h"
+#include "test_messages.pb.h"
+#include "test_messages_sugar.h"
+
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/dynamic_message.h>
+#include <google/protobuf/text_format.h>
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+using namespace sugar;
+
+namespace {
+using Top = mypkg::Top;
+using mypkg::TopWrapped;
+
+// Hand-written tables for shapes test_messages.proto does not have: a
+// submessage with a repeated field, for views that merge it, ...
+struct ListWire {
+  static constexpr array<WireField, 1> kWireFields = {{
+      {"values", 2, WireKind::kInt32, WireField::kRepeated},
+  }};
+};
+
+struct OuterWire {
+  static constexpr array<WireField, 1> kWireFields = {{
+      {"inner", 50, WireKind::kMessage},
+  }};
+  static ListWire wire_message(WireNumber<50>);
+};
+
+// ... a oneof holding a submessage and a scalar, ...
+struct ChoiceWire {
+  static constexpr array<WireField, 2> kWireFields = {{
+      {"list", 1, WireKind::kMessage, WireField::kSingular, WireKind::kInt32,
+       WireKind::kInt32, 1},
+      {"n", 2, WireKind::kInt32, WireField::kSingular, WireKind::kInt32,
+       WireKind::kInt32, 1},
+  }};
+  static ListWire wire_message(WireNumber<1>);
+};
+
+// ... and the proto2 message built in WireView_Encodings; the group is
+// left out so it can only be skipped.
+struct WWire {
+  static constexpr array<WireField, 9> kWireFields = {{
+      {"si32", 1, WireKind::kSInt32},
+      {"si64", 2, WireKind::kSInt64},
+      {"fx32", 3, WireKind::kFixed32},
+      {"sf32", 4, WireKind::kSFixed32},
+      {"fx64", 5, WireKind::kFixed64},
+      {"sf64", 6, WireKind::kSFixed64},
+      {"packed", 7, WireKind::kSInt32, WireField::kRepeated},
+      {"loose", 8, WireKind::kDouble, WireField::kRepeated},
+      {"blob", 10, WireKind::kBytes},
+  }};
+};
+
+template <typename Range> auto collect(const Range &r) {
+  vector<typename Range::value_type> out;
+  for (const auto &v : r)
+    out.push_back(v);
+  return out;
+}
+} // namespace
+
+TEST(WireView_Singular, ReadWithoutParsing) {
+  Top m;
+  m.set_i32(-7);
+  m.set_i64(int64_t{-1} << 40);
+  m.set_u64(1ull << 63);
+  m.set_b(true);
+  m.set_f(1.5f);
+  m.set_d(-2.25);
+  m.set_e(mypkg::COLOR_BLUE);
+  m.set_s("hello");
+  m.mutable_inner()->mutable_deep()->set_x(9);
+  const string bytes = m.SerializeAsString();
+
+  const WireView<TopWrapped> v(bytes);
+  EXPECT_EQ(v.get<"i32">(), -7);
+  EXPECT_EQ(v.get<"i64">(), int64_t{-1} << 40);
+  EXPECT_EQ(v.get<"u64">(), 1ull << 63);
+  EXPECT_TRUE(v.get<"b">());
+  EXPECT_EQ(v.get<"f">(), 1.5f);
+  EXPECT_EQ(v.get<"d">(), -2.25);
+  EXPECT_EQ(v.get<"e">(), mypkg::COLOR_BLUE);
+  EXPECT_EQ(v.get<"inner">().get<"deep">().get<"x">(), 9);
+
+  // Strings point into the input.
+  const string_view s = v.get<"s">();
+  EXPECT_EQ(s, "hello");
+  EXPECT_GE(s.data(), bytes.data());
+  EXPECT_LE(s.data() + s.size(), bytes.data() + bytes.size());
+
+  const auto [i32, str, d] = v.get<"i32", "s", "d">();
+  EXPECT_EQ(i32, -7);
+  EXPECT_EQ(str, "hello");
+  EXPECT_EQ(d, -2.25);
+
+  // Absent fields read as defaults, absent messages as empty views.
+  EXPECT_FALSE(v.has<"child">());
+  EXPECT_TRUE(v.has<"inner">());
+  EXPECT_EQ(v.get<"child">().get<"child_str">(), "");
+  EXPECT_FALSE(v.get<"child">().has<"child_str">());
+  EXPECT_EQ(WireView<TopWrapped>().get<"i32">(), 0);
+
+  // Concatenated messages merge: the last singular value wins.
+  Top later;
+  later.set_i32(5);
+  const string both = bytes + later.SerializeAsString();
+  const WireView<TopWrapped> merged(both);
+  EXPECT_EQ(merged.get<"i32">(), 5);
+  EXPECT_EQ(merged.get<"s">(), "hello");
+}
+
+TEST(WireView_Ranges, RepeatedMapsAndNestedViews) {
+  Top m;
+  for (int i : {-1, 0, 300})
+    m.add_r_i32(i);
+  m.add_r_str("a");
+  m.add_r_str("bc");
+  m.add_vals_double(0.5);
+  m.add_repeated_child()->set_child_str("x");
+  m.add_repeated_child()->set_child_str("y");
+  (*m.mutable_string_to_int32())["k"] = 4;
+  (*m.mutable_u64_to_child())[7].set_child_str("seven");
+  string bytes = m.SerializeAsString();
+  // An unpacked element after the packed run, as older writers produce.
+  bytes += "\xf8\x01\x2a"; // field 31, varint 42
+
+  const WireView<TopWrapped> v(bytes);
+  EXPECT_EQ(collect(v.get<"r_i32">()), (vector<int32_t>{-1, 0, 300, 42}));
+  EXPECT_EQ(collect(v.get<"r_str">()), (vector<string_view>{"a", "bc"}));
+  EXPECT_EQ(collect(v.get<"vals_double">()), vector<double>{0.5});
+  EXPECT_EQ(v.get<"r_i32">().size(), 4u);
+  EXPECT_TRUE(v.has<"r_str">());
+
+  vector<string_view> children;
+  for (auto c : v.get<"repeated_child">())
+    children.push_back(c.get<"child_str">());
+  EXPECT_EQ(children, (vector<string_view>{"x", "y"}));
+
+  const auto map = v.get<"string_to_int32">();
+  ASSERT_EQ(map.size(), 1u);
+  EXPECT_EQ((*map.begin()).first, "k");
+  EXPECT_EQ((*map.begin()).second, 4);
+  EXPECT_EQ(map.find("k"), 4);
+  EXPECT_FALSE(map.find("missing").has_value());
+  const auto child = v.get<"u64_to_child">().find(7);
+  ASSERT_TRUE(child.has_value());
+  EXPECT_EQ(child->get<"child_str">(), "seven");
+
+  const WireView<TopWrapped> empty;
+  EXPECT_TRUE(empty.get<"r_i32">().empty());
+  EXPECT_FALSE(empty.has<"string_to_int32">());
+}
+
+TEST(WireView_Merge, SubmessagesMergeEveryOccurrence) {
+  // inner.deep.x is only in the first occurrence of inner; the second one
+  // carries an empty deep. Parsing a + b merges them and keeps x.
+  Top a, b;
+  a.mutable_inner()->mutable_deep()->set_x(42);
+  b.mutable_inner()->mutable_deep();
+  a.mutable_child()->set_child_str("first");
+  b.mutable_child();
+  const string bytes = a.SerializeAsString() + b.SerializeAsString();
+  Top parsed;
+  ASSERT_TRUE(parsed.ParseFromString(bytes));
+  ASSERT_EQ(parsed.inner().deep().x(), 42);
+
+  const WireView<TopWrapped> v(bytes);
+  EXPECT_EQ(v.get<"inner">().get<"deep">().get<"x">(), 42);
+  EXPECT_EQ(v.get<"child">().get<"child_str">(), "first");
+  const auto [inner, i32] = v.get<"inner", "i32">();
+  EXPECT_EQ(inner.get<"deep">().get<"x">(), 42);
+  EXPECT_EQ(i32, 0);
+  EXPECT_TRUE(v.get<"inner">().has<"deep">());
+
+  // Later occurrences win field by field.
+  Top c;
+  c.mutable_inner()->mutable_deep()->set_x(7);
+  c.mutable_child()->set_child_str("last");
+  const string three = bytes + c.SerializeAsString();
+  const WireView<TopWrapped> w(three);
+  EXPECT_EQ(w.get<"inner">().get<"deep">().get<"x">(), 7);
+  EXPECT_EQ(w.get<"child">().get<"child_str">(), "last");
+
+  // Map entry values merge their own occurrences: field 2 twice in one
+  // u64_to_child entry, the string in the first.
+  const string entry = string{char(1 << 3), 9} +
+                       string{char(2 << 3 | 2), 3, char(1 << 3 | 2), 1, 'q'} +
+                       string{char(2 << 3 | 2), 0};
+  const string map_bytes = string{char(2 << 3 | 2), char(entry.size())} + entry;
+  ASSERT_TRUE(parsed.ParseFromString(map_bytes));
+  ASSERT_EQ(parsed.u64_to_child().at(9).child_str(), "q");
+  const auto value = WireView<TopWrapped>(map_bytes).get<"u64_to_child">().find(9);
+  ASSERT_TRUE(value.has_value());
+  EXPECT_EQ(value->get<"child_str">(), "q");
+}
+
+TEST(WireView_Merge, RepeatedFieldsConcatenateAcrossOccurrences) {
+  // inner { values: [1, 2] (packed) }, an unrelated field, inner { values: 3 }
+  const string first = string{char(2 << 3 | 2), 2, 1, 2};
+  const string second = string{char(2 << 3), 3};
+  const string bytes = string{char(0x92), 3, char(first.size())} + first +
+                       string{char(7 << 3), 5} +
+                       string{char(0x92), 3, char(second.size())} + second;
+  const WireView<OuterWire> v(bytes);
+  const auto values = v.get<"inner">().get<"values">();
+  EXPECT_EQ(collect(values), (vector<int32_t>{1, 2, 3}));
+  EXPECT_EQ(values.size(), 3u);
+  auto it = values.begin();
+  auto copy = it++;
+  EXPECT_EQ(*copy, 1);
+  EXPECT_EQ(*it, 2);
+  EXPECT_FALSE(copy == it);
+  EXPECT_TRUE(++copy == it);
+}
+
+TEST(WireView_Merge, LaterOneofMembersClearEarlierOnes) {
+  Top s, i;
+  s.set_o_s("text");
+  i.set_o_i32(4);
+  const string s_then_i = s.SerializeAsString() + i.SerializeAsString();
+  Top parsed;
+  ASSERT_TRUE(parsed.ParseFromString(s_then_i));
+  ASSERT_FALSE(parsed.has_o_s());
+
+  const WireView<TopWrapped> v(s_then_i);
+  EXPECT_FALSE(v.has<"o_s">());
+  EXPECT_EQ(v.get<"o_s">(), "");
+  EXPECT_TRUE(v.has<"o_i32">());
+  EXPECT_EQ(v.get<"o_i32">(), 4);
+  const auto [str, n] = v.get<"o_s", "o_i32">();
+  EXPECT_EQ(str, "");
+  EXPECT_EQ(n, 4);
+
+  const string i_then_s = i.SerializeAsString() + s.SerializeAsString();
+  const WireView<TopWrapped> w(i_then_s);
+  EXPECT_EQ(w.get<"o_s">(), "text");
+  EXPECT_EQ(w.get<"o_i32">(), 0);
+  EXPECT_FALSE(w.has<"o_i32">());
+
+  // A sibling clears a submessage member: list { values: 1 }, n: 2,
+  // list { values: 3 } leaves only the last list.
+  const string list1 = string{char(2 << 3), 1};
+  const string list3 = string{char(2 << 3), 3};
+  const string bytes = string{char(1 << 3 | 2), char(list1.size())} + list1 +
+                       string{char(2 << 3), 2} +
+                       string{char(1 << 3 | 2), char(list3.size())} + list3;
+  const WireView<ChoiceWire> c(bytes);
+  EXPECT_EQ(collect(c.get<"list">().get<"values">()), (vector<int32_t>{3}));
+  EXPECT_TRUE(c.has<"list">());
+  EXPECT_FALSE(c.has<"n">());
+  EXPECT_EQ(c.get<"n">(), 0);
+
+  // Without the last list the first one is cleared too.
+  const WireView<ChoiceWire> cleared(
+      string_view(bytes).substr(0, bytes.size() - list3.size() - 2));
+  EXPECT_TRUE(cleared.get<"list">().get<"values">().empty());
+  EXPECT_FALSE(cleared.has<"list">());
+  EXPECT_EQ(cleared.get<"n">(), 2);
+}
+
+TEST(WireView_Encodings, EveryScalarEncodingAndSkippedGroups) {
+  google::protobuf::FileDescriptorProto proto;
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(R"pb(
+    name: "wire.proto"
+    package: "wire"
+    syntax: "proto2"
+    message_type {
+      name: "W"
+      field { name: "si32" number: 1 label: LABEL_OPTIONAL type: TYPE_SINT32 }
+      field { name: "si64" number: 2 label: LABEL_OPTIONAL type: TYPE_SINT64 }
+      field { name: "fx32" number: 3 label: LABEL_OPTIONAL type: TYPE_FIXED32 }
+      field { name: "sf32" number: 4 label: LABEL_OPTIONAL type: TYPE_SFIXED32 }
+      field { name: "fx64" number: 5 label: LABEL_OPTIONAL type: TYPE_FIXED64 }
+      field { name: "sf64" number: 6 label: LABEL_OPTIONAL type: TYPE_SFIXED64 }
+      field {
+        name: "packed"
+        number: 7
+        label: LABEL_REPEATED
+        type: TYPE_SINT32
+        options { packed: true }
+      }
+      field { name: "loose" number: 8 label: LABEL_REPEATED type: TYPE_DOUBLE }
+      field {
+        name: "g"
+        number: 9
+        label: LABEL_OPTIONAL
+        type: TYPE_GROUP
+        type_name: ".wire.W.G"
+      }
+      field { name: "blob" number: 10 label: LABEL_OPTIONAL type: TYPE_BYTES }
+      nested_type {
+        name: "G"
+        field { name: "data" number: 1 label: LABEL_OPTIONAL type: TYPE_BYTES }
+      }
+    }
+  )pb", &proto));
+  google::protobuf::DescriptorPool pool;
+  const auto *file = pool.BuildFile(proto);
+  ASSERT_NE(file, nullptr);
+  google::protobuf::DynamicMessageFactory factory(&pool);
+  unique_ptr<google::protobuf::Message> msg(
+      factory.GetPrototype(file->FindMessageTypeByName("W"))->New());
+
+  DynamicWrapped w(*msg);
+  w["si32"] = -5;
+  w["si64"] = int64_t{-1} << 40;
+  w["fx32"] = 7u;
+  w["sf32"] = -8;
+  w["fx64"] = uint64_t{1} << 60;
+  w["sf64"] = int64_t{-9};
+  for (int v : {-1, 1, -300})
+    w.repeated<int32_t>("packed").push_back(v);
+  w.repeated<double>("loose").push_back(0.25);
+  w.repeated<double>("loose").push_back(-4.0);
+  w["g"]["data"] = string(20, 'g');
+  w["blob"] = string(3, 'b');
+
+  const string bytes = msg->SerializeAsString();
+  const WireView<WWire> v(bytes);
+  EXPECT_EQ(v.get<"si32">(), -5);
+  EXPECT_EQ(v.get<"si64">(), int64_t{-1} << 40);
+  EXPECT_EQ(v.get<"fx32">(), 7u);
+  EXPECT_EQ(v.get<"sf32">(), -8);
+  EXPECT_EQ(v.get<"fx64">(), uint64_t{1} << 60);
+  EXPECT_EQ(v.get<"sf64">(), -9);
+  EXPECT_EQ(collect(v.get<"packed">()), (vector<int32_t>{-1, 1, -300}));
+  EXPECT_EQ(collect(v.get<"loose">()), (vector<double>{0.25, -4.0}));
+  EXPECT_EQ(v.get<"blob">(), "bbb");
+}
+
+TEST(WireView_Malformed, MismatchedWireTypesAndTruncation) {
+  // Field 7 (i32) sent as fixed32 is unknown to the schema and skipped;
+  // the varint occurrence before it still counts.
+  const string odd = string{char(7 << 3), char(3)} +
+                     string{char(7 << 3 | 5), 1, 2, 3, 4};
+  EXPECT_EQ(WireView<TopWrapped>(odd).get<"i32">(), 3);
+
+  Top m;
+  m.set_s("truncated");
+  m.set_i32(1);
+  const string bytes = m.SerializeAsString();
+  const WireView<TopWrapped> cut(string_view(bytes).substr(0, 4));
+  EXPECT_THROW((void)cut.get<"i32">(), runtime_error);
+  EXPECT_THROW((void)WireView<TopWrapped>(string_view("\x38", 1)).get<"i32">(),
+               runtime_error);
+  // A submessage is only checked when it is viewed.
+  const string bad_child = string{char(5 << 3 | 2), 2, char(1 << 3 | 2), 9};
+  const WireView<TopWrapped> v(bad_child);
+  EXPECT_TRUE(v.has<"child">());
+  EXPECT_THROW((void)v.get<"child">().get<"child_str">(), runtime_error);
+}
@@ -0,0 +1,170 @@
+#include "alloc_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+#ifdef SUGAR_ALLOC_COUNT_MALLOC
+extern "C" {
+void *__libc_malloc(std::size_t);
+void *__libc_calloc(std::size_t, std::size_t);
+void *__libc_realloc(void *, std::size_t);
+void __libc_free(void *);
+}
+#endif
+
+namespace sugar::testing {
+namespace {
+
+// Constant-initialized, so touching it from operator new needs no guard.
+constinit thread_local AllocationStats tls_stats;
+
+void count_allocation(std::size_t n) noexcept {
+  ++tls_stats.allocations;
+  tls_stats.bytes += n;
+}
+
+void count_deallocation(void *p) noexcept {
+  if (p)
+    ++tls_stats.deallocations;
+}
+
+#ifdef SUGAR_ALLOC_COUNT_MALLOC
+void *raw_malloc(std::size_t n) noexcept { return __libc_malloc(n); }
+void raw_free(void *p) noexcept { __libc_free(p); }
+#else
+void *raw_malloc(std::size_t n) noexcept { return std::malloc(n); }
+void raw_free(void *p) noexcept { std::free(p); }
+#endif
+
+void *counted_new(std::size_t n) noexcept {
+  count_allocation(n);
+  return raw_malloc(n == 0 ? 1 : n);
+}
+
+void *counted_new(std::size_t n, std::align_val_t al) noexcept {
+  count_allocation(n);
+  const auto a = static_cast<std::size_t>(al);
+  // aligned_alloc wants a size that is a multiple of the alignment.
+  return std::aligned_alloc(a, (n + a - 1) / a * a);
+}
+
+void *new_or_throw(std::size_t n) {
+  for (;;) {
+    if (void *p = counted_new(n))
+      return p;
+    std::new_handler h = std::get_new_handler();
+    if (!h)
+      throw std::bad_alloc();
+    h();
+  }
+}
+
+void *new_or_throw(std::size_t n, std::align_val_t al) {
+  for (;;) {
+    if (void *p = counted_new(n, al))
+      return p;
+    std::new_handler h = std::get_new_handler();
+    if (!h)
+      throw std::bad_alloc();
+    h();
+  }
+}
+
+void counted_delete(void *p) noexcept {
+  count_deallocation(p);
+  raw_free(p);
+}
+
+} // namespace
+
+AllocationStats thread_allocation_stats() noexcept { return tls_stats; }
+
+bool counts_malloc() noexcept {
+#ifdef SUGAR_ALLOC_COUNT_MALLOC
+  return true;
+#else
+  return false;
+#endif
+}
+
+} // namespace sugar::testing
+
+using sugar::testing::counted_delete;
+using sugar::testing::counted_new;
+using sugar::testing::new_or_throw;
+
+void *operator new(std::size_t n) { return new_or_throw(n); }
+void *operator new[](std::size_t n) { return new_or_throw(n); }
+void *operator new(std::size_t n, std::align_val_t al) {
+  return new_or_throw(n, al);
+}
+void *operator new[](std::size_t n, std::align_val_t al) {
+  return new_or_throw(n, al);
+}
+void *operator new(std::size_t n, const std::nothrow_t &) noexcept {
+  return counted_new(n);
+}
+void *operator new[](std::size_t n, const std::nothrow_t &) noexcept {
+  return counted_new(n);
+}
+void *operator new(std::size_t n, std::align_val_t al,
+                   const std::nothrow_t &) noexcept {
+  return counted_new(n, al);
+}
+void *operator new[](std::size_t n, std::align_val_t al,
+                     const std::nothrow_t &) noexcept {
+  return counted_new(n, al);
+}
+
+void operator delete(void *p) noexcept { counted_delete(p); }
+void operator delete[](void *p) noexcept { counted_delete(p); }
+void operator delete(void *p, std::size_t) noexcept { counted_delete(p); }
+void operator delete[](void *p, std::size_t) noexcept { counted_delete(p); }
+void operator delete(void *p, std::align_val_t) noexcept { counted_delete(p); }
+void operator delete[](void *p, std::align_val_t) noexcept {
+  counted_delete(p);
+}
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+  counted_delete(p);
+}
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept {
+  counted_delete(p);
+}
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+  counted_delete(p);
+}
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+  counted_delete(p);
+}
+void operator delete(void *p, std::align_val_t,
+                     const std::nothrow_t &) noexcept {
+  counted_delete(p);
+}
+void operator delete[](void *p, std::align_val_t,
+                       const std::nothrow_t &) noexcept {
+  counted_delete(p);
+}
+
+#ifdef SUGAR_ALLOC_COUNT_MALLOC
+// Direct C allocations; operator new above goes to __libc_malloc and is not
+// counted twice.
+extern "C" {
+void *malloc(std::size_t n) {
+  sugar::testing::count_allocation(n);
+  return __libc_malloc(n);
+}
+void *calloc(std::size_t k, std::size_t n) {
+  sugar::testing::count_allocation(k * n);
+  return __libc_calloc(k, n);
+}
+void *realloc(void *p, std::size_t n) {
+  sugar::testing::count_deallocation(p);
+  sugar::testing::count_allocation(n);
+  return __libc_realloc(p, n);
+}
+void free(void *p) {
+  sugar::testing::count_deallocation(p);
+  __libc_free(p);
+}
+}
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+
+// Allocation counting for tests and benchmarks. Linking alloc_counter.cpp
+// replaces the global operator new/delete family with versions that count
+// per thread; building it with SUGAR_ALLOC_COUNT_MALLOC also counts direct
+// malloc/calloc/realloc/free calls (glibc only). Counting is per thread, so
+// work done on other threads inside a scope is not attributed to it.
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace sugar::testing {
+
+struct AllocationStats {
+  uint64_t allocations = 0;   // operator new (and malloc, if counted)
+  uint64_t deallocations = 0; // operator delete (and free, if counted)
+  uint64_t bytes = 0;         // requested bytes over all allocations
+
+  friend AllocationStats operator-(const AllocationStats &a,
+                                   const AllocationStats &b) noexcept {
+    return {a.allocations - b.allocations, a.deallocations - b.deallocations,
+            a.bytes - b.bytes};
+  }
+};
+
+// Running totals of the calling thread since it started.
+[[nodiscard]] AllocationStats thread_allocation_stats() noexcept;
+
+// True when malloc and friends are counted too.
+[[nodiscard]] bool counts_malloc() noexcept;
+
+// Counts the calling thread's allocations from construction on.
+class AllocationScope {
+public:
+  AllocationScope() noexcept : start_(thread_allocation_stats()) {}
+
+  [[nodiscard]] AllocationStats stats() const noexcept {
+    return thread_allocation_stats() - start_;
+  }
+  [[nodiscard]] uint64_t allocations() const noexcept {
+    return stats().allocations;
+  }
+
+private:
+  AllocationStats start_;
+};
+
+// Allocations made by one call of fn.
+template <typename Fn> [[nodiscard]] uint64_t allocations_in(Fn &&fn) {
+  const AllocationScope scope;
+  std::forward<Fn>(fn)();
+  return scope.allocations();
+}
+
+} // namespace sugar::testing
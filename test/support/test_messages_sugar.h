@@ -0,0 +1,12 @@
+#pragma once
+
+// The generator's output for test_messages.proto, as built by the
+// generate_test_sugar step in test/CMakeLists.txt: the single header, or
+// with SUGAR_TEST_SPLIT_HEADERS the split_headers layout (whose
+// test_messages.sugar.cc the test links).
+
+#ifdef SUGAR_TEST_SPLIT_HEADERS
+#include "test_messages.Top.sugar.h"
+#else
+#include "test_messages.sugar.h"
+#endif
@@ -0,0 +1,55 @@
+#include "zero_copy_streambuf.h"
+
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
+#include <gtest/gtest.h>
+
+#include <ostream>
+#include <string>
+
+using namespace std;
+
+using google::protobuf::io::ArrayOutputStream;
+using google::protobuf::io::StringOutputStream;
+
+namespace {
+
+TEST(ZeroCopyStreambuf, WritesIntoStringAndBacksUpSlack) {
+  string out;
+  {
+    StringOutputStream stream(&out);
+    ZeroCopyStreambuf buf(&stream);
+    ostream os(&buf);
+    os << "struct " << 42 << ' ' << string(1000, 'x');
+    os.flush();
+    EXPECT_TRUE(buf.ok());
+  }
+  EXPECT_EQ(out, "struct 42 " + string(1000, 'x'));
+}
+
+TEST(ZeroCopyStreambuf, SpansManySmallBlocks) {
+  char storage[64] = {};
+  ArrayOutputStream stream(storage, sizeof(storage), 5);
+  {
+    ZeroCopyStreambuf buf(&stream);
+    ostream os(&buf);
+    os << "0123456789" << 'a' << "bcdefghijklmnopqrstuvwxyz";
+    os.flush();
+    EXPECT_TRUE(buf.ok());
+  }
+  EXPECT_EQ(stream.ByteCount(), 36);
+  EXPECT_EQ(string(storage, 36), "0123456789abcdefghijklmnopqrstuvwxyz");
+}
+
+TEST(ZeroCopyStreambuf, ReportsExhaustedStream) {
+  char storage[8] = {};
+  ArrayOutputStream stream(storage, sizeof(storage), 3);
+  ZeroCopyStreambuf buf(&stream);
+  ostream os(&buf);
+  os << "0123456789";
+  EXPECT_TRUE(os.fail());
+  EXPECT_FALSE(buf.ok());
+  EXPECT_EQ(string(storage, sizeof(storage)), "01234567");
+}
+
+} // namespace